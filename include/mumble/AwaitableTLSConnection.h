@@ -0,0 +1,372 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_AWAITABLETLSCONNECTION_H_
+#define MUMBLE_AWAITABLETLSCONNECTION_H_
+
+// AwaitableTLSConnection requires C++20 coroutines. The rest of
+// libmumble builds as C++11, so this header is empty unless it is
+// included from code that is built as C++20.
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+
+#include <mumble/CoTask.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/ByteArray.h>
+#include <mumble/ByteView.h>
+#include <mumble/Error.h>
+
+#include <coroutine>
+#include <string>
+#include <utility>
+
+namespace mumble {
+
+/// AwaitableTLSConnection adapts a TLSConnection for use from C++20
+/// coroutines.
+///
+///     CoTask<void> Session(AwaitableTLSConnection &conn) {
+///         Error err = co_await conn.Connect("127.0.0.1", 64738, nullptr);
+///         ...
+///         err = co_await conn.Write(version);
+///         ByteArray buf;
+///         err = co_await conn.ReadSome(&buf);
+///         ...
+///     }
+///
+/// The AwaitableTLSConnection takes over all of the TLSConnection's
+/// handlers except the chain verify handler. Coroutines are resumed from
+/// those handlers, and thus on the TLSConnection's thread (or on its
+/// Executor). The AwaitableTLSConnection itself is not thread-safe: once
+/// a coroutine has awaited Connect or Established, it must only be used
+/// from that thread.
+///
+/// Awaiting an operation does not allocate in steady state. Received data
+/// is collected in a buffer that is swapped with the caller's, such that
+/// the two buffers are reused across reads.
+///
+/// The AwaitableTLSConnection must outlive all activity on the underlying
+/// TLSConnection, that is, it must not be destroyed before the connection's
+/// disconnect or error handler would have run.
+class AwaitableTLSConnection {
+public:
+	/// Constructs an AwaitableTLSConnection for *conn*. For connections
+	/// accepted by a TLSListener, this must be done from the TLSListener's
+	/// accept handler.
+	explicit AwaitableTLSConnection(TLSConnection &conn)
+		: conn_(conn), established_(false), closed_(false), outstanding_writes_(0) {
+		conn_.SetEstablishedHandler([this] {
+			OnEstablished();
+		});
+		conn_.SetReadBatchHandler([this](const ByteViewChain &chain) {
+			OnRead(chain);
+		});
+		conn_.SetErrorHandler([this](const Error &err) {
+			OnClosed(err);
+		});
+		conn_.SetDisconnectHandler([this](bool local) {
+			OnClosed(Error::ErrorFromStaticDescription(
+				"TLSConnection",
+				0L,
+				local ? "connection closed" : "connection closed by remote"
+			));
+		});
+	}
+
+	/// Connection returns the underlying TLSConnection.
+	TLSConnection &Connection() {
+		return conn_;
+	}
+
+	class ConnectAwaiter;
+	class EstablishedAwaiter;
+	class ReadAwaiter;
+	class WriteAwaiter;
+	class DrainAwaiter;
+
+	/// Connect connects the underlying TLSConnection. Awaiting the
+	/// result yields an Error once the TLS handshake has completed
+	/// or failed.
+	ConnectAwaiter Connect(const std::string &ipaddr, int port, TLSConnectionOptions *opts);
+
+	/// Established yields an Error once the TLS handshake of an
+	/// accepted connection has completed or failed.
+	EstablishedAwaiter Established();
+
+	/// ReadSome yields an Error once data is available, and stores all
+	/// data received so far in *buf*, replacing its previous content.
+	/// Data that arrives before the connection closes is always delivered
+	/// before the error.
+	ReadAwaiter ReadSome(ByteArray *buf);
+
+	/// Write writes *buf* to the connection, and yields an Error once
+	/// the data has been handed to the kernel.
+	WriteAwaiter Write(const ByteArray &buf, TLSConnectionWritePriority prio = TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE);
+
+	/// Drained yields an Error once all writes made through the
+	/// AwaitableTLSConnection have been handed to the kernel.
+	DrainAwaiter Drained();
+
+	class ConnectAwaiter {
+	public:
+		ConnectAwaiter(AwaitableTLSConnection &ac, const std::string &ipaddr, int port, TLSConnectionOptions *opts)
+			: ac_(ac), ipaddr_(ipaddr), port_(port), opts_(opts) {}
+
+		bool await_ready() const noexcept {
+			return false;
+		}
+
+		bool await_suspend(std::coroutine_handle<> h) {
+			ac_.Reset();
+			ac_.connect_waiter_ = h;
+			// Once Connect succeeds, the coroutine may be resumed
+			// on the connection's thread at any time, so nothing
+			// may be touched past this point.
+			Error err = ac_.conn_.Connect(ipaddr_, port_, opts_);
+			if (err.HasError()) {
+				ac_.connect_waiter_ = nullptr;
+				err_ = err;
+				return false;
+			}
+			return true;
+		}
+
+		Error await_resume() {
+			if (err_.HasError()) {
+				return err_;
+			}
+			return ac_.closed_ ? ac_.close_err_ : Error::NoError();
+		}
+
+	private:
+		AwaitableTLSConnection  &ac_;
+		std::string             ipaddr_;
+		int                     port_;
+		TLSConnectionOptions    *opts_;
+		Error                   err_;
+	};
+
+	class EstablishedAwaiter {
+	public:
+		explicit EstablishedAwaiter(AwaitableTLSConnection &ac) : ac_(ac) {}
+
+		bool await_ready() const noexcept {
+			return ac_.established_ || ac_.closed_;
+		}
+
+		void await_suspend(std::coroutine_handle<> h) {
+			ac_.connect_waiter_ = h;
+		}
+
+		Error await_resume() {
+			return ac_.closed_ ? ac_.close_err_ : Error::NoError();
+		}
+
+	private:
+		AwaitableTLSConnection &ac_;
+	};
+
+	class ReadAwaiter {
+	public:
+		ReadAwaiter(AwaitableTLSConnection &ac, ByteArray *buf) : ac_(ac), buf_(buf) {}
+
+		bool await_ready() const noexcept {
+			return ac_.pending_.Length() > 0 || ac_.closed_;
+		}
+
+		void await_suspend(std::coroutine_handle<> h) {
+			ac_.read_waiter_ = h;
+		}
+
+		Error await_resume() {
+			if (ac_.pending_.Length() > 0) {
+				// Hand over the received data, and keep the
+				// caller's old buffer for the next read.
+				buf_->Swap(ac_.pending_);
+				if (!ac_.pending_.IsNull()) {
+					ac_.pending_.Truncate(0);
+				}
+				return Error::NoError();
+			}
+			buf_->Truncate(0);
+			return ac_.close_err_;
+		}
+
+	private:
+		AwaitableTLSConnection  &ac_;
+		ByteArray               *buf_;
+	};
+
+	class WriteAwaiter {
+	public:
+		WriteAwaiter(AwaitableTLSConnection &ac, const ByteArray &buf, TLSConnectionWritePriority prio)
+			: ac_(ac), buf_(buf), prio_(prio), suspending_(false), done_(false) {}
+
+		bool await_ready() const noexcept {
+			return ac_.closed_;
+		}
+
+		bool await_suspend(std::coroutine_handle<> h) {
+			handle_ = h;
+			suspending_ = true;
+			ac_.outstanding_writes_++;
+			WriteAwaiter *self = this;
+			AwaitableTLSConnection *ac = &ac_;
+			ac_.conn_.Write(buf_, prio_, [ac, self](const Error &err, const TLSConnectionWriteInfo &) {
+				ac->OnWriteDone(self, err);
+			});
+			suspending_ = false;
+			// The write completed right away. Carry on
+			// without suspending.
+			return !done_;
+		}
+
+		Error await_resume() {
+			if (!done_) {
+				return ac_.close_err_;
+			}
+			return err_;
+		}
+
+	private:
+		friend class AwaitableTLSConnection;
+
+		AwaitableTLSConnection      &ac_;
+		const ByteArray             &buf_;
+		TLSConnectionWritePriority  prio_;
+		std::coroutine_handle<>     handle_;
+		bool                        suspending_;
+		bool                        done_;
+		Error                       err_;
+	};
+
+	class DrainAwaiter {
+	public:
+		explicit DrainAwaiter(AwaitableTLSConnection &ac) : ac_(ac) {}
+
+		bool await_ready() const noexcept {
+			return ac_.outstanding_writes_ == 0 || ac_.closed_;
+		}
+
+		void await_suspend(std::coroutine_handle<> h) {
+			ac_.drain_waiter_ = h;
+		}
+
+		Error await_resume() {
+			return ac_.closed_ ? ac_.close_err_ : Error::NoError();
+		}
+
+	private:
+		AwaitableTLSConnection &ac_;
+	};
+
+private:
+	AwaitableTLSConnection(const AwaitableTLSConnection &);
+	AwaitableTLSConnection &operator=(const AwaitableTLSConnection &);
+
+	// Reset prepares the AwaitableTLSConnection for a new connection.
+	void Reset() {
+		established_ = false;
+		closed_ = false;
+		close_err_ = Error::NoError();
+		if (!pending_.IsNull()) {
+			pending_.Truncate(0);
+		}
+	}
+
+	void OnEstablished() {
+		established_ = true;
+		std::coroutine_handle<> h = std::exchange(connect_waiter_, nullptr);
+		if (h) {
+			h.resume();
+		}
+	}
+
+	// OnRead appends the received data to pending_,
+	// and wakes up the reader, if any.
+	void OnRead(const ByteViewChain &chain) {
+		AppendChain(&pending_, chain);
+
+		std::coroutine_handle<> h = std::exchange(read_waiter_, nullptr);
+		if (h) {
+			h.resume();
+		}
+	}
+
+	void OnWriteDone(WriteAwaiter *w, const Error &err) {
+		outstanding_writes_--;
+		std::coroutine_handle<> drain;
+		if (outstanding_writes_ == 0) {
+			drain = std::exchange(drain_waiter_, nullptr);
+		}
+
+		w->err_ = err;
+		w->done_ = true;
+		// Resuming a coroutine may destroy this
+		// AwaitableTLSConnection, so only use locals
+		// from here on.
+		if (!w->suspending_) {
+			w->handle_.resume();
+		}
+		if (drain) {
+			drain.resume();
+		}
+	}
+
+	// OnClosed wakes up everything that is waiting for the connection.
+	// Pending writes have already been failed by the TLSConnection.
+	void OnClosed(const Error &err) {
+		closed_ = true;
+		close_err_ = err;
+
+		std::coroutine_handle<> connect = std::exchange(connect_waiter_, nullptr);
+		std::coroutine_handle<> read = std::exchange(read_waiter_, nullptr);
+		std::coroutine_handle<> drain = std::exchange(drain_waiter_, nullptr);
+		if (connect) {
+			connect.resume();
+		}
+		if (read) {
+			read.resume();
+		}
+		if (drain) {
+			drain.resume();
+		}
+	}
+
+	TLSConnection            &conn_;
+	bool                     established_;
+	bool                     closed_;
+	Error                    close_err_;
+	ByteArray                pending_;
+	int                      outstanding_writes_;
+
+	std::coroutine_handle<>  connect_waiter_;
+	std::coroutine_handle<>  read_waiter_;
+	std::coroutine_handle<>  drain_waiter_;
+};
+
+inline AwaitableTLSConnection::ConnectAwaiter AwaitableTLSConnection::Connect(const std::string &ipaddr, int port, TLSConnectionOptions *opts) {
+	return ConnectAwaiter(*this, ipaddr, port, opts);
+}
+
+inline AwaitableTLSConnection::EstablishedAwaiter AwaitableTLSConnection::Established() {
+	return EstablishedAwaiter(*this);
+}
+
+inline AwaitableTLSConnection::ReadAwaiter AwaitableTLSConnection::ReadSome(ByteArray *buf) {
+	return ReadAwaiter(*this, buf);
+}
+
+inline AwaitableTLSConnection::WriteAwaiter AwaitableTLSConnection::Write(const ByteArray &buf, TLSConnectionWritePriority prio) {
+	return WriteAwaiter(*this, buf, prio);
+}
+
+inline AwaitableTLSConnection::DrainAwaiter AwaitableTLSConnection::Drained() {
+	return DrainAwaiter(*this);
+}
+
+}
+
+#endif
+
+#endif
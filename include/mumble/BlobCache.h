@@ -0,0 +1,186 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_BLOBCACHE_H_
+#define MUMBLE_BLOBCACHE_H_
+
+#include <mumble/ByteView.h>
+#include <mumble/Error.h>
+
+#include <memory>
+#include <string>
+#include <functional>
+#include <stdint.h>
+
+namespace MumbleProto {
+class RequestBlob;
+}
+
+namespace mumble {
+
+class BlobCachePrivate;
+
+/// BlobCacheErrorCode lists the error codes of Errors in the
+/// "BlobCache" domain.
+enum BlobCacheErrorCode {
+	/// The blob passed to Put does not match its hash.
+	BLOB_CACHE_ERROR_HASH_MISMATCH = 1,
+	/// The blob could not be written to the on-disk store.
+	BLOB_CACHE_ERROR_DISK = 2,
+};
+
+/// BlobKind names the kinds of blobs that a Mumble server sends by
+/// hash, and that a client can request with a RequestBlob message.
+enum BlobKind {
+	/// A user's texture, announced by its *texture_hash*.
+	BLOB_KIND_TEXTURE,
+	/// A user's comment, announced by its *comment_hash*.
+	BLOB_KIND_COMMENT,
+	/// A channel's description, announced by its *description_hash*.
+	BLOB_KIND_DESCRIPTION,
+	NUM_BLOB_KINDS
+};
+
+/// BlobCacheOptions specifies options for a BlobCache.
+struct BlobCacheOptions {
+	/// Constructs a BlobCacheOptions with default values.
+	BlobCacheOptions();
+
+	/// memory_limit is the number of bytes of blobs that the BlobCache
+	/// keeps in memory. Once it is exceeded, the least recently used
+	/// blobs are dropped from memory. The default is 32 MiB.
+	size_t       memory_limit;
+
+	/// directory is the directory of the on-disk store. Blobs are
+	/// written to it as they are put into the BlobCache, and read back
+	/// when they are not in memory. The
+	/// directory must exist, and it is not pruned by the BlobCache.
+	/// If empty (the default), there is no on-disk store.
+	std::string  directory;
+
+	/// max_batch is the largest number of blobs requested by a single
+	/// RequestBlob message. Once that many blobs are waiting to be
+	/// requested, they are requested right away. The default is 256.
+	int          max_batch;
+
+	/// request_timeout_ms is the number of milliseconds that fetches of
+	/// a requested blob wait for the server's answer before a later fetch
+	/// of the blob requests it again. The default is 30 seconds.
+	int          request_timeout_ms;
+};
+
+/// BlobCacheStats holds statistics about a BlobCache.
+struct BlobCacheStats {
+	/// Constructs a BlobCacheStats with all fields set to zero.
+	BlobCacheStats();
+
+	/// memory_hits is the number of lookups answered from memory.
+	uint64_t  memory_hits;
+
+	/// disk_hits is the number of lookups answered from the on-disk store.
+	uint64_t  disk_hits;
+
+	/// misses is the number of lookups that were not answered.
+	uint64_t  misses;
+
+	/// coalesced is the number of fetches that waited for a blob
+	/// that had already been requested.
+	uint64_t  coalesced;
+
+	/// requests is the number of RequestBlob messages built, and
+	/// requested_blobs the number of blobs they asked for.
+	uint64_t  requests;
+	uint64_t  requested_blobs;
+
+	/// memory_used is the number of bytes of blobs kept in memory.
+	size_t    memory_used;
+};
+
+/// BlobHandler is called with a blob once it is available. It is
+/// called with null if the fetch is cancelled.
+typedef std::function<void (const std::shared_ptr<const std::string> &blob)>  BlobHandler;
+
+/// BlobCacheRequestHandler is called with each RequestBlob message
+/// that the BlobCache wants sent to the server.
+typedef std::function<void (const MumbleProto::RequestBlob &req)>             BlobCacheRequestHandler;
+
+/// BlobCache caches the textures, comments and channel descriptions that
+/// a Mumble server announces by hash, such that a client only downloads
+/// each of them once, rather than on each connect.
+///
+/// Blobs are keyed by their SHA-1 hash, as sent by the server, and kept
+/// in an in-memory LRU, optionally backed by an on-disk store that is
+/// shared across connections and runs.
+///
+/// Fetch looks up a blob, and if it is missing, queues a request for it.
+/// Fetches of a blob that has already been requested only add a handler,
+/// and queued requests are sent together, in a single RequestBlob, by
+/// FlushRequests. To request the misses of each burst of messages at
+/// once, call FlushRequests from the ControlChannel's batch end handler,
+/// and send the RequestBlob from the request handler:
+///
+///     cache.SetRequestHandler([&](const MumbleProto::RequestBlob &req) {
+///         channel.Send(MESSAGE_TYPE_REQUEST_BLOB, req);
+///     });
+///     channel.SetBatchEndHandler([&] { cache.FlushRequests(); });
+///
+/// The server answers with UserState and ChannelState messages carrying
+/// the blobs, which are to be passed to Put along with their hashes.
+///
+/// BlobCache is not thread-safe. It is meant to be used from the
+/// ControlChannel's handlers.
+class BlobCache {
+public:
+	/// Constructs a BlobCache.
+	///
+	/// @param   opts   Options for the BlobCache. If null, the
+	///                 defaults are used.
+	explicit BlobCache(const BlobCacheOptions *opts = nullptr);
+	~BlobCache();
+
+	/// Get returns the blob with *hash*, or null if it is not cached.
+	std::shared_ptr<const std::string> Get(const ByteView &hash);
+
+	/// Put adds *blob* with *hash* to the BlobCache, and passes it to the
+	/// handlers of all fetches waiting for it.
+	///
+	/// @return  Returns an Error if *hash* is not the SHA-1 hash of *blob*,
+	///          in which case the blob is dropped, or if the blob could
+	///          not be written to the on-disk store, in which case it is
+	///          still cached in memory.
+	Error Put(const ByteView &hash, const std::shared_ptr<const std::string> &blob);
+
+	/// Fetch calls *fn* with the blob with *hash*. If the blob is cached,
+	/// *fn* is called right away. Otherwise, *fn* is called once the blob
+	/// is Put, and unless the blob has already been requested, a request
+	/// for the blob of *kind* belonging to the user session or channel
+	/// *id* is queued. A request that has gone unanswered for longer
+	/// than the request timeout is queued again.
+	void Fetch(BlobKind kind, uint32_t id, const ByteView &hash, BlobHandler fn);
+
+	/// FlushRequests passes all queued requests to the request handler,
+	/// as a single RequestBlob message.
+	void FlushRequests();
+
+	/// CancelRequests drops all queued and outstanding requests, and
+	/// calls the handlers of their fetches with null. It is meant to be
+	/// called when the connection to the server is lost.
+	void CancelRequests();
+
+	/// Stats returns the current statistics of the BlobCache.
+	BlobCacheStats Stats() const;
+
+	/// SetRequestHandler sets the BlobCache's *request handler*.
+	BlobCache& SetRequestHandler(BlobCacheRequestHandler fn);
+
+private:
+	BlobCache(const BlobCache &);
+	BlobCache &operator=(const BlobCache &);
+
+	std::unique_ptr<BlobCachePrivate> priv_;
+};
+
+}
+
+#endif
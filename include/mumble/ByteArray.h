@@ -142,6 +142,12 @@ public:
 	/// @return  Returns a reference to the ByteArray that was truncated.
 	ByteArray &Truncate(int len);
 
+	/// Swap exchanges the content and underlying storage of this ByteArray
+	/// with that of *other*, without copying or allocating.
+	///
+	/// @param   other   The ByteArray to swap with.
+	void Swap(ByteArray &other);
+
 	/// Equal determines whether *other* is equal to this ByteArray.
 	/// A ByteArray is equal to another ByteArray if their contents match.
 	/// The content of a ByteArray is specified by its length, and *length*
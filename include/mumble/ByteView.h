@@ -0,0 +1,83 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_BYTEVIEW_H_
+#define MUMBLE_BYTEVIEW_H_
+
+#include <mumble/ByteArray.h>
+
+#include <vector>
+
+namespace mumble {
+
+/// ByteView is a non-owning reference to a contiguous run of bytes.
+///
+/// Unlike ByteArray, a ByteView never allocates or copies. It is only
+/// valid for as long as the storage it points into is kept alive by
+/// its owner. Views handed out by libmumble components (for example,
+/// by a TLSConnectionReadBatchHandler) are only valid for the duration
+/// of the call they were passed to. Use ToByteArray to keep a copy of
+/// the bytes around for longer.
+class ByteView {
+public:
+	/// Constructs a null ByteView.
+	ByteView();
+
+	/// Constructs a ByteView referencing *len* bytes starting at *data*.
+	///
+	/// @param   data   Pointer to the first byte of the view.
+	/// @param   len    Number of bytes in the view.
+	ByteView(const char *data, int len);
+
+	/// Constructs a ByteView referencing the content of *ba*.
+	/// The view is invalidated if *ba* is modified or destroyed.
+	ByteView(const ByteArray &ba);
+
+	/// IsNull returns true if the ByteView does not reference any storage.
+	bool IsNull() const;
+
+	/// Length returns the number of bytes referenced by the ByteView.
+	int Length() const;
+
+	/// ConstData returns a pointer to the first byte referenced by the ByteView.
+	const char *ConstData() const;
+
+	/// Slice returns a ByteView referencing *len* bytes starting at *off*
+	/// of this ByteView. No bytes are copied.
+	///
+	/// @param   off   Offset into this ByteView.
+	/// @param   len   Number of bytes to include in the slice. If -1, the
+	///                slice extends to the end of this ByteView.
+	ByteView Slice(int off, int len = -1) const;
+
+	/// ToByteArray copies the bytes referenced by the ByteView into a
+	/// newly allocated ByteArray.
+	ByteArray ToByteArray() const;
+
+	/// Equal determines whether *other* references the same content as
+	/// this ByteView. The comparison is done on the referenced bytes, not
+	/// on the pointers themselves.
+	bool Equal(const ByteView &other) const;
+
+private:
+	const char *data_;
+	int         len_;
+};
+
+/// ByteViewChain is an ordered sequence of ByteViews that together make up
+/// a logically contiguous stream of bytes.
+typedef std::vector<ByteView> ByteViewChain;
+
+/// AppendChain appends the bytes of *chain* to *buf*. If they do not fit
+/// into the capacity of *buf*, its storage is replaced by one of at least
+/// twice the capacity, such that appending repeatedly takes amortized
+/// linear time.
+///
+/// @param   buf     The ByteArray to append to.
+/// @param   chain   The bytes to append.
+void AppendChain(ByteArray *buf, const ByteViewChain &chain);
+
+}
+
+#endif
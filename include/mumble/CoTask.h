@@ -0,0 +1,287 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_COTASK_H_
+#define MUMBLE_COTASK_H_
+
+// CoTask requires C++20 coroutines. The rest of libmumble builds as
+// C++11, so this header is empty unless it is included from code that
+// is built as C++20.
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <utility>
+
+namespace mumble {
+
+/// CoroutineFramePool recycles the memory of coroutine frames.
+///
+/// Frames are kept in per-thread free lists, one for each size class of
+/// 64 bytes, up to 4 KiB. A coroutine that is started repeatedly, such as
+/// a per-message handler, allocates its frame from the heap only the first
+/// time around. Frames that are larger than the largest size class, or that
+/// do not fit in a full free list, go straight to the heap.
+class CoroutineFramePool {
+public:
+	/// Allocate returns storage for a coroutine frame of *size* bytes.
+	static void *Allocate(std::size_t size) {
+		std::size_t cls = SizeClass(size);
+		if (cls < kNumSizeClasses) {
+			FreeList &list = Lists()[cls];
+			if (list.head != nullptr) {
+				Block *block = list.head;
+				list.head = block->next;
+				list.count--;
+				return block;
+			}
+			return std::malloc((cls + 1) * kSizeClassBytes);
+		}
+		return std::malloc(size);
+	}
+
+	/// Deallocate returns the storage of a coroutine frame of *size*
+	/// bytes to the pool. It may be called on any thread.
+	static void Deallocate(void *ptr, std::size_t size) {
+		std::size_t cls = SizeClass(size);
+		if (cls < kNumSizeClasses) {
+			FreeList &list = Lists()[cls];
+			if (list.count < kMaxFreeFrames) {
+				Block *block = static_cast<Block *>(ptr);
+				block->next = list.head;
+				list.head = block;
+				list.count++;
+				return;
+			}
+		}
+		std::free(ptr);
+	}
+
+private:
+	static const std::size_t kSizeClassBytes = 64;
+	static const std::size_t kNumSizeClasses = 64;
+	static const int kMaxFreeFrames = 64;
+
+	struct Block {
+		Block *next;
+	};
+
+	struct FreeList {
+		Block  *head;
+		int    count;
+	};
+
+	// FreeLists frees the cached frames of a thread once it exits.
+	struct FreeLists {
+		FreeList lists[kNumSizeClasses];
+
+		FreeLists() : lists() {}
+		~FreeLists() {
+			for (FreeList &list : lists) {
+				while (list.head != nullptr) {
+					Block *next = list.head->next;
+					std::free(list.head);
+					list.head = next;
+				}
+			}
+		}
+	};
+
+	static std::size_t SizeClass(std::size_t size) {
+		return (size + kSizeClassBytes - 1) / kSizeClassBytes - 1;
+	}
+
+	static FreeList *Lists() {
+		static thread_local FreeLists lists;
+		return lists.lists;
+	}
+};
+
+template <typename T>
+class CoTask;
+
+/// CoTaskPromiseBase holds the parts of a CoTask's promise that do not
+/// depend on the CoTask's result type.
+class CoTaskPromiseBase {
+public:
+	CoTaskPromiseBase() : detached_(false) {}
+
+	static void *operator new(std::size_t size) {
+		return CoroutineFramePool::Allocate(size);
+	}
+
+	static void operator delete(void *ptr, std::size_t size) {
+		CoroutineFramePool::Deallocate(ptr, size);
+	}
+
+	std::suspend_always initial_suspend() noexcept {
+		return std::suspend_always();
+	}
+
+	// FinalAwaiter resumes the coroutine that awaited the CoTask, if
+	// any. A detached CoTask has nobody to hand its result to, and
+	// destroys itself instead.
+	struct FinalAwaiter {
+		bool await_ready() noexcept {
+			return false;
+		}
+
+		template <typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+			CoTaskPromiseBase &promise = h.promise();
+			if (promise.detached_) {
+				h.destroy();
+				return std::noop_coroutine();
+			}
+			if (promise.continuation_) {
+				return promise.continuation_;
+			}
+			return std::noop_coroutine();
+		}
+
+		void await_resume() noexcept {}
+	};
+
+	FinalAwaiter final_suspend() noexcept {
+		return FinalAwaiter();
+	}
+
+	void unhandled_exception() {
+		exception_ = std::current_exception();
+	}
+
+	std::coroutine_handle<>  continuation_;
+	std::exception_ptr       exception_;
+	bool                     detached_;
+};
+
+/// CoTaskPromise is the promise type of a CoTask with a result of type T.
+template <typename T>
+class CoTaskPromise : public CoTaskPromiseBase {
+public:
+	CoTask<T> get_return_object();
+
+	void return_value(T value) {
+		value_ = std::move(value);
+	}
+
+	T TakeResult() {
+		if (exception_) {
+			std::rethrow_exception(exception_);
+		}
+		return std::move(value_);
+	}
+
+	T value_;
+};
+
+template <>
+class CoTaskPromise<void> : public CoTaskPromiseBase {
+public:
+	CoTask<void> get_return_object();
+
+	void return_void() {}
+
+	void TakeResult() {
+		if (exception_) {
+			std::rethrow_exception(exception_);
+		}
+	}
+};
+
+/// CoTask is the return type of libmumble coroutines.
+///
+/// A CoTask does not start running until it is either awaited by another
+/// coroutine, in which case the result of the CoTask is the result of the
+/// co_await expression, or detached using Detach, in which case it runs
+/// on its own, and frees itself when done.
+///
+///     CoTask<Error> Handshake(AwaitableTLSConnection &conn);
+///
+///     CoTask<void> Session(AwaitableTLSConnection &conn) {
+///         Error err = co_await Handshake(conn);
+///         ...
+///     }
+///
+///     Session(conn).Detach();
+///
+/// The frames of CoTask coroutines are allocated from a
+/// CoroutineFramePool.
+template <typename T = void>
+class CoTask {
+public:
+	typedef CoTaskPromise<T> promise_type;
+
+	CoTask() {}
+	explicit CoTask(std::coroutine_handle<promise_type> h) : handle_(h) {}
+	CoTask(CoTask &&other) : handle_(std::exchange(other.handle_, nullptr)) {}
+
+	CoTask &operator=(CoTask &&other) {
+		if (this != &other) {
+			Reset();
+			handle_ = std::exchange(other.handle_, nullptr);
+		}
+		return *this;
+	}
+
+	/// Destroys the CoTask. A CoTask that was never started is
+	/// destroyed without running.
+	~CoTask() {
+		Reset();
+	}
+
+	/// Detach starts the CoTask, and hands the ownership of the coroutine
+	/// over to the coroutine itself. It frees itself once it finishes.
+	/// Exceptions that escape a detached coroutine are dropped.
+	void Detach() {
+		std::coroutine_handle<promise_type> h = std::exchange(handle_, nullptr);
+		if (h) {
+			h.promise().detached_ = true;
+			h.resume();
+		}
+	}
+
+	bool await_ready() const noexcept {
+		return !handle_ || handle_.done();
+	}
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+		handle_.promise().continuation_ = awaiting;
+		return handle_;
+	}
+
+	T await_resume() {
+		return handle_.promise().TakeResult();
+	}
+
+private:
+	CoTask(const CoTask &);
+	CoTask &operator=(const CoTask &);
+
+	void Reset() {
+		if (handle_) {
+			handle_.destroy();
+			handle_ = nullptr;
+		}
+	}
+
+	std::coroutine_handle<promise_type> handle_;
+};
+
+template <typename T>
+CoTask<T> CoTaskPromise<T>::get_return_object() {
+	return CoTask<T>(std::coroutine_handle<CoTaskPromise<T> >::from_promise(*this));
+}
+
+inline CoTask<void> CoTaskPromise<void>::get_return_object() {
+	return CoTask<void>(std::coroutine_handle<CoTaskPromise<void> >::from_promise(*this));
+}
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_CONTROLCHANNEL_H_
+#define MUMBLE_CONTROLCHANNEL_H_
+
+#include <memory>
+#include <functional>
+
+#include <mumble/TLSConnection.h>
+#include <mumble/MessageType.h>
+#include <mumble/ByteView.h>
+#include <mumble/Error.h>
+
+namespace google {
+namespace protobuf {
+class MessageLite;
+}
+}
+
+namespace mumble {
+
+class ControlChannelPrivate;
+
+/// ControlChannelErrorCode lists the error codes of Errors in the
+/// "ControlChannel" domain.
+enum ControlChannelErrorCode {
+	/// A message was larger than the ControlChannel allows.
+	CONTROL_CHANNEL_ERROR_MESSAGE_TOO_LARGE = 1,
+	/// A message passed to Send was missing required fields.
+	CONTROL_CHANNEL_ERROR_UNINITIALIZED_MESSAGE = 2,
+};
+
+/// ControlChannelOptions specifies options for a ControlChannel.
+struct ControlChannelOptions {
+	/// Constructs a ControlChannelOptions with default values.
+	ControlChannelOptions();
+
+	/// max_message_size is the largest payload, in bytes, that the
+	/// ControlChannel accepts from the remote end. A frame announcing
+	/// a larger payload is treated as a protocol error, and the
+	/// connection is closed. The default is 8 MiB.
+	int  max_message_size;
+};
+
+/// ControlChannelMessageHandler is called for each message received on a
+/// ControlChannel, with the message's type and its serialized payload.
+/// The payload is only valid for the duration of the call.
+typedef std::function<void (MessageType type, const ByteView &payload)>  ControlChannelMessageHandler;
+
+/// ControlChannelErrorHandler is called when the remote end violates the
+/// framing of the control channel.
+typedef std::function<void (const Error &err)>                           ControlChannelErrorHandler;
+
+/// ControlChannelBatchEndHandler is called after the messages that arrived
+/// in a single read have been passed to the message handler. It can be used
+/// to coalesce the replies to a burst of messages.
+typedef std::function<void ()>                                           ControlChannelBatchEndHandler;
+
+/// ControlChannel frames Mumble control messages on top of a TLSConnection.
+///
+/// Incoming data is split into messages as it arrives. Messages that are
+/// contained in a single read are passed to the message handler without
+/// being copied. Only a message that spans several reads is reassembled,
+/// in a buffer that is reused across messages.
+///
+/// Outgoing messages are serialized directly into a pooled buffer, behind
+/// their frame header. When Send is called on the TLSConnection's thread,
+/// and nothing else is queued for writing, the message is encrypted
+/// straight out of that buffer, and sending it does not allocate.
+/// Otherwise, the framed message is copied once into the write queue.
+///
+/// The ControlChannel takes over the TLSConnection's read batch handler.
+/// All other handlers remain available to the user. The ControlChannel
+/// must outlive all activity on the TLSConnection.
+class ControlChannel {
+public:
+	/// Constructs a ControlChannel for *conn*. For connections accepted
+	/// by a TLSListener, this must be done from the TLSListener's accept
+	/// handler.
+	///
+	/// @param   conn   The TLSConnection to frame messages on.
+	/// @param   opts   Options for the ControlChannel. If null, the
+	///                 defaults are used.
+	explicit ControlChannel(TLSConnection &conn, const ControlChannelOptions *opts = nullptr);
+	~ControlChannel();
+
+	/// Send serializes *msg* and writes it to the TLSConnection as a
+	/// message of type *type*. Send is thread-safe.
+	///
+	/// @param   type   The type of the message.
+	/// @param   msg    The message to send. Must be fully initialized.
+	/// @param   prio   The lane of the TLSConnection's write queue that
+	///                 the message is written on.
+	/// @param   done   Called once the message has been handed to the
+	///                 kernel, as for TLSConnection's Write.
+	///
+	/// @return  Returns an Error if *msg* is not fully initialized, or if
+	///          it is too large to be framed.
+	Error Send(MessageType type,
+	           const google::protobuf::MessageLite &msg,
+	           TLSConnectionWritePriority prio = TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE,
+	           TLSConnectionWriteCompletionHandler done = TLSConnectionWriteCompletionHandler());
+
+	/// SendRaw writes an already serialized payload to the TLSConnection
+	/// as a message of type *type*. SendRaw is thread-safe.
+	Error SendRaw(MessageType type,
+	              const ByteView &payload,
+	              TLSConnectionWritePriority prio = TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE,
+	              TLSConnectionWriteCompletionHandler done = TLSConnectionWriteCompletionHandler());
+
+	/// Reset discards any partially received message. It must be called
+	/// before the TLSConnection is connected again, and must not be called
+	/// from within the message handler.
+	void Reset();
+
+	/// SetMessageHandler sets the ControlChannel's *message handler*. It is
+	/// called on the TLSConnection's thread (or on its Executor).
+	ControlChannel& SetMessageHandler(ControlChannelMessageHandler fn);
+
+	/// SetErrorHandler sets the ControlChannel's *error handler*. It is
+	/// called on the TLSConnection's thread (or on its Executor), right
+	/// before the ControlChannel disconnects the TLSConnection.
+	ControlChannel& SetErrorHandler(ControlChannelErrorHandler fn);
+
+	/// SetBatchEndHandler sets the ControlChannel's *batch end handler*. It is
+	/// called on the TLSConnection's thread (or on its Executor), after each
+	/// read that contained at least one complete message.
+	ControlChannel& SetBatchEndHandler(ControlChannelBatchEndHandler fn);
+
+private:
+	ControlChannel(const ControlChannel &);
+	ControlChannel &operator=(const ControlChannel &);
+
+	friend class ControlChannelPrivate;
+	std::unique_ptr<ControlChannelPrivate> priv_;
+};
+
+}
+
+#endif
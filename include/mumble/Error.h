@@ -13,7 +13,17 @@ namespace mumble {
 
 struct ErrorPrivate;
 
+/// ErrorDescriber returns the description of the error *code* in some
+/// error domain. The returned string must remain valid for the lifetime
+/// of the program, such as a string literal, or a string from a static
+/// table of error messages.
+typedef const char *(*ErrorDescriber)(long code);
+
 /// Error represents an error returned by a libmumble component.
+///
+/// An Error that signals success, and an Error created by
+/// ErrorFromStaticDescription or ErrorFromCode, do not allocate any
+/// memory. Copying an Error never copies its description.
 class Error {
 public:
 	/// Constructs a new Error with the given domain, code and description.
@@ -27,6 +37,31 @@ public:
 	/// @return   Returns an Error described by domain, code and description.
 	static Error ErrorFromDescription(std::string domain, long code, std::string description);
 
+	/// Constructs a new Error with the given domain, code and description,
+	/// without allocating any memory.
+	///
+	/// @param    domain        The error domain. Must remain valid for the lifetime
+	///                         of the program, such as a string literal.
+	/// @param    code          An error code in the context of the given domain.
+	/// @param    description   A description of the error. Must remain valid for the
+	///                         lifetime of the program, such as a string literal.
+	///
+	/// @return   Returns an Error described by domain, code and description.
+	static Error ErrorFromStaticDescription(const char *domain, long code, const char *description);
+
+	/// Constructs a new Error with the given domain and code, without allocating
+	/// any memory. The description of the error is only looked up once it is
+	/// asked for.
+	///
+	/// @param    domain        The error domain. Must remain valid for the lifetime
+	///                         of the program, such as a string literal.
+	/// @param    code          An error code in the context of the given domain.
+	/// @param    describe      The ErrorDescriber that returns the description of
+	///                         *code*.
+	///
+	/// @return   Returns an Error described by domain and code.
+	static Error ErrorFromCode(const char *domain, long code, ErrorDescriber describe);
+
 	/// Constructs an empty error signalling
 	/// that the Error objects contains no error
 	/// code. This is useful for signalling *success*
@@ -46,6 +81,9 @@ public:
 	/// Copies the Error *err* into this Error.
 	Error(const Error &err);
 
+	/// Moves the Error *err* into this Error. *err* is left empty.
+	Error(Error &&err);
+
 	/// Assigns the Error *err* to this Error.
 	Error& operator=(Error err);
 
@@ -68,10 +106,19 @@ public:
 	std::string String() const;
 
 private:
-	friend class ErrorPrivate;
-	std::unique_ptr<ErrorPrivate> priv_;
+	friend struct ErrorPrivate;
+
+	// domain_ is either a static string, or a string
+	// interned by ErrorFromDescription. The description
+	// is given by the first of priv_, description_ and
+	// describe_ that is set.
+	const char                           *domain_;
+	long                                 code_;
+	const char                           *description_;
+	ErrorDescriber                       describe_;
+	std::shared_ptr<const ErrorPrivate>  priv_;
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
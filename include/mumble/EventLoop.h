@@ -0,0 +1,106 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_EVENTLOOP_H_
+#define MUMBLE_EVENTLOOP_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <mumble/Error.h>
+
+namespace mumble {
+
+class EventLoopPrivate;
+
+/// EventLoopOptions controls the placement and scheduling of the
+/// thread that an EventLoop runs on.
+///
+/// The same options are used for the I/O threads that TLSConnections
+/// and TLSListeners create for themselves. See the *thread_options*
+/// fields of TLSConnectionOptions and TLSListenerOptions.
+struct EventLoopOptions {
+	/// Constructs an EventLoopOptions with default values.
+	EventLoopOptions();
+
+	/// thread_name is the name given to the thread, as shown by
+	/// debuggers and profilers. Linux limits names to 15 characters,
+	/// and longer names are cut short. If empty (the default), the
+	/// thread is not named. Ignored on platforms that cannot name
+	/// threads.
+	std::string       thread_name;
+
+	/// cpu_affinity is the list of CPUs that the thread may run on.
+	/// If empty (the default), the thread may run on any CPU. Not
+	/// supported on OS X and iOS.
+	std::vector<int>  cpu_affinity;
+
+	/// realtime_priority runs the thread under the SCHED_FIFO real-time
+	/// scheduling policy with the given priority, from 1 to 99. This
+	/// usually requires elevated privileges. If zero (the default), the
+	/// thread keeps the default scheduling policy. Not supported on
+	/// Windows.
+	int               realtime_priority;
+
+	/// nice_value sets the nice value of the thread, from -20 (highest
+	/// priority) to 19 (lowest priority). If zero (the default), the
+	/// thread keeps the nice value of the process. Only supported on
+	/// Linux and Android.
+	int               nice_value;
+};
+
+/// EventLoop is an I/O thread that TLSConnections and TLSListeners
+/// can share.
+///
+/// By default, each TLSConnection runs its own I/O thread. For
+/// applications that handle many connections, that quickly becomes
+/// expensive. Instead, a small number of EventLoops can be created,
+/// and connections can be spread across them using the *event_loop*
+/// field of TLSConnectionOptions (or, for accepted connections, the
+/// *event_loops* field of TLSListenerOptions).
+///
+/// All handlers of connections that run on an EventLoop are called on
+/// that EventLoop's thread.
+class EventLoop {
+public:
+	/// Constructs a new EventLoop. The EventLoop's thread is not started
+	/// until Start is called.
+	EventLoop();
+
+	/// Destroys the EventLoop. This stops the EventLoop, and waits for
+	/// its thread to exit. All connections that run on the EventLoop must
+	/// have been disconnected before the EventLoop is destroyed.
+	~EventLoop();
+
+	/// Start starts the EventLoop's thread.
+	///
+	/// @param   opts  The options for the EventLoop's thread. If null,
+	///                the defaults are used.
+	///
+	/// @return  Returns an Error object representing whether
+	///          or not the EventLoop could be started. If any of
+	///          the options could not be applied, the thread is
+	///          stopped again, and an error is returned.
+	Error Start(const EventLoopOptions *opts = nullptr);
+
+	/// Stop requests that the EventLoop shut down. The EventLoop's
+	/// thread exits once all connections running on it have been
+	/// closed.
+	void Stop();
+
+private:
+	EventLoop(const EventLoop &loop);
+	EventLoop& operator=(EventLoop loop);
+
+	friend class EventLoopPrivate;
+	friend class TLSConnectionPrivate;
+	friend class TLSListenerPrivate;
+	friend class TLSSyncConnectionPrivate;
+	std::unique_ptr<EventLoopPrivate> priv_;
+};
+
+}
+
+#endif
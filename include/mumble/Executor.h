@@ -0,0 +1,133 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_EXECUTOR_H_
+#define MUMBLE_EXECUTOR_H_
+
+#include <memory>
+#include <functional>
+#include <stdint.h>
+
+#include <mumble/EventLoop.h>
+#include <mumble/Error.h>
+
+namespace mumble {
+
+/// Executor runs functions on behalf of libmumble, such as the handlers
+/// of TLSConnections.
+///
+/// By default, TLSConnections call their handlers directly on their I/O
+/// thread, which means that a slow handler holds up all I/O for the
+/// connection. Setting the *executor* field of TLSConnectionOptions moves
+/// the handlers off the I/O thread, and onto the given Executor.
+///
+/// Applications can implement Executor to run handlers on threads of
+/// their own, for example on a UI thread, or use WorkQueueExecutor.
+class Executor {
+public:
+	virtual ~Executor();
+
+	/// Execute arranges for *fn* to be run. It must be safe to call
+	/// Execute from any thread.
+	///
+	/// Executors do not need to preserve the order of the functions
+	/// they are given. TLSConnections never hand more than one function
+	/// at a time to an Executor, and thereby keep their handlers in order
+	/// on their own.
+	///
+	/// @return  Returns true if *fn* will be run, or false if the
+	///          Executor dropped it, for example because it has been
+	///          stopped. A TLSConnection whose function is dropped
+	///          drops its pending handlers along with it, and tries
+	///          again with the next handler.
+	virtual bool Execute(std::function<void ()> fn) = 0;
+};
+
+/// WorkQueueExecutorOptions specifies options for a WorkQueueExecutor.
+struct WorkQueueExecutorOptions {
+	/// Constructs a WorkQueueExecutorOptions with default values.
+	WorkQueueExecutorOptions();
+
+	/// num_threads is the number of worker threads. The default is 1.
+	int               num_threads;
+
+	/// max_queue_length is the largest number of functions that may be
+	/// waiting to run. Once the queue is full, Execute blocks until a
+	/// worker has taken a function off the queue, which in turn holds up
+	/// the I/O threads that are calling it. The default is 4096.
+	int               max_queue_length;
+
+	/// thread_options are the options for each worker thread. Thread
+	/// names are suffixed with the index of the worker.
+	EventLoopOptions  thread_options;
+};
+
+/// WorkQueueExecutorStats holds statistics about a WorkQueueExecutor.
+/// All times are in nanoseconds.
+struct WorkQueueExecutorStats {
+	/// Constructs a WorkQueueExecutorStats with all fields set to zero.
+	WorkQueueExecutorStats();
+
+	/// queue_length is the number of functions currently waiting to run.
+	int       queue_length;
+
+	/// executed is the number of functions that have been run.
+	uint64_t  executed;
+
+	/// total_lag is the sum of the time that each executed function
+	/// spent waiting in the queue.
+	uint64_t  total_lag;
+
+	/// max_lag is the longest time that any executed function
+	/// spent waiting in the queue.
+	uint64_t  max_lag;
+};
+
+class WorkQueueExecutorPrivate;
+
+/// WorkQueueExecutor is an Executor that runs functions on a pool of
+/// worker threads, in the order that they were queued.
+class WorkQueueExecutor : public Executor {
+public:
+	/// Constructs a new WorkQueueExecutor. Its worker threads are not
+	/// started until Start is called.
+	WorkQueueExecutor();
+
+	/// Destroys the WorkQueueExecutor. This stops the WorkQueueExecutor,
+	/// and waits for its workers to exit.
+	~WorkQueueExecutor();
+
+	/// Start starts the WorkQueueExecutor's worker threads.
+	///
+	/// @param   opts  The options for the WorkQueueExecutor. If null,
+	///                the defaults are used.
+	///
+	/// @return  Returns an Error object representing whether or not
+	///          the WorkQueueExecutor could be started.
+	Error Start(const WorkQueueExecutorOptions *opts = nullptr);
+
+	/// Stop runs all functions that are already queued, and then stops
+	/// the worker threads. Functions passed to Execute after Stop has
+	/// been called are dropped, and Execute returns false for them.
+	void Stop();
+
+	/// Execute queues *fn* to be run by one of the worker threads.
+	///
+	/// @return  Returns false if the WorkQueueExecutor is not running,
+	///          in which case *fn* is dropped.
+	virtual bool Execute(std::function<void ()> fn);
+
+	/// Stats returns the current statistics of the WorkQueueExecutor.
+	WorkQueueExecutorStats Stats() const;
+
+private:
+	WorkQueueExecutor(const WorkQueueExecutor &);
+	WorkQueueExecutor& operator=(WorkQueueExecutor);
+
+	std::unique_ptr<WorkQueueExecutorPrivate> priv_;
+};
+
+}
+
+#endif
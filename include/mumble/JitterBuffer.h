@@ -0,0 +1,170 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_JITTERBUFFER_H_
+#define MUMBLE_JITTERBUFFER_H_
+
+#include <mumble/ByteView.h>
+#include <mumble/VoicePacket.h>
+
+#include <memory>
+#include <stdint.h>
+
+namespace mumble {
+
+class JitterBufferPrivate;
+
+/// JitterBufferOptions specifies options for a JitterBuffer.
+struct JitterBufferOptions {
+	/// Constructs a JitterBufferOptions with default values.
+	JitterBufferOptions();
+
+	/// frame_ms is the duration, in milliseconds, of the audio
+	/// covered by one sequence number. Mumble clients count 10 ms
+	/// frames, which is the default.
+	int  frame_ms;
+
+	/// capacity is the number of packets buffered per speaker. It is
+	/// rounded up to a power of two. The default is 64.
+	int  capacity;
+
+	/// max_packet_size is the largest packet, in bytes, that the
+	/// JitterBuffer accepts. The default is 1024, the largest
+	/// datagram Mumble sends.
+	int  max_packet_size;
+
+	/// min_delay_ms and max_delay_ms bound the delay, in milliseconds,
+	/// between the arrival of the first packet of a transmission and
+	/// its playout. max_delay_ms is capped to half the time covered by
+	/// capacity packets of one frame. The defaults are 20 and 300.
+	int  min_delay_ms;
+	int  max_delay_ms;
+};
+
+/// JitterBufferStats holds the packet counts of a JitterBuffer, or of
+/// one of its speakers. The counts can be reported in the good, late
+/// and lost fields of Ping messages.
+struct JitterBufferStats {
+	/// Constructs a JitterBufferStats with all fields set to zero.
+	JitterBufferStats();
+
+	/// good is the number of packets that arrived in time to be played.
+	uint32_t  good;
+
+	/// late is the number of packets that arrived after they had
+	/// been given up for lost. They are not played, and no longer
+	/// counted as lost.
+	uint32_t  late;
+
+	/// lost is the number of packets that had not arrived when it
+	/// was their turn to be played.
+	uint32_t  lost;
+
+	/// buffered is the number of packets waiting to be played.
+	int       buffered;
+
+	/// jitter_ms is the speaker's measured inter-arrival jitter, and
+	/// delay_ms is the playout delay applied to its transmissions,
+	/// both in milliseconds. They are zero in the totals of a
+	/// JitterBuffer.
+	float     jitter_ms;
+	int       delay_ms;
+};
+
+/// JitterBufferStatus tells what JitterBuffer::Pop returned.
+enum JitterBufferStatus {
+	/// There is nothing to play: the speaker is not talking, its
+	/// transmission is still held back by the delay, or no packet
+	/// is buffered.
+	JITTER_BUFFER_EMPTY,
+	/// The next packet has been returned.
+	JITTER_BUFFER_PACKET,
+	/// The next packet has not arrived, but a later one has. The
+	/// returned number of frames should be concealed by the decoder.
+	JITTER_BUFFER_LOST,
+};
+
+/// JitterBuffer reorders the voice packets received from each speaker,
+/// and holds back the start of each transmission, such that packets
+/// arriving with varying delays can be played at the even pace of the
+/// audio output.
+///
+/// Packets are passed to Put as they arrive, over UDP or in UDPTunnel
+/// messages, and are keyed by the session and sequence number in their
+/// header. Each speaker has a ring of preallocated slots, indexed by
+/// sequence number, so buffering allocates nothing once a speaker has
+/// been seen, and each speaker takes the same amount of memory.
+///
+/// The audio output calls Pop for each speaker whenever it needs more
+/// audio. The first packet of a transmission is held back by the
+/// speaker's delay, which follows the jitter measured between the
+/// arrival times of its packets and their sequence numbers. Once the
+/// delay has passed, the JitterBuffer keeps no time of its own: each
+/// Pop returns the next packet, so the audio output sets the pace,
+/// and the packets buffered during the delay absorb the variation in
+/// their arrival. A next packet that has not arrived, while later ones
+/// have, is given up for lost. A transmission ends when its terminator
+/// has been played, or when no packets arrive for longer than the
+/// maximum delay, and the next one starts over with the current delay.
+///
+/// Times are passed in as milliseconds from an arbitrary epoch, such as
+/// that of uv_now. JitterBuffer is thread-safe, so packets may be put
+/// on the event loop thread and popped on an audio thread.
+class JitterBuffer {
+public:
+	/// Constructs a JitterBuffer.
+	///
+	/// @param   opts   Options for the JitterBuffer. If null, the
+	///                 defaults are used.
+	explicit JitterBuffer(const JitterBufferOptions *opts = nullptr);
+	~JitterBuffer();
+
+	/// Put buffers *packet*, a voice packet as sent by the server,
+	/// carrying the session of its speaker, that arrived at *now_ms*.
+	///
+	/// @return  Returns false if the packet is dropped, because it is
+	///          malformed, a ping, too large, late or a duplicate.
+	bool Put(const ByteView &packet, uint64_t now_ms);
+
+	/// Pop returns the next packet of the speaker with *session*, if the
+	/// delay of its transmission has passed at *now_ms*. It is meant to
+	/// be called once for each packet's worth of audio that is needed.
+	///
+	/// @param   packet   Set to the packet, if one is returned. Its frames
+	///                   are valid until the next call to Pop for the
+	///                   same session, or to Remove.
+	/// @param   frames   Set to the number of frames, of frame_ms each,
+	///                   that the returned packet covers, or that are to
+	///                   be concealed.
+	JitterBufferStatus Pop(uint32_t session, uint64_t now_ms, VoicePacket *packet, int *frames);
+
+	/// Remove drops the speaker with *session*, and frees its buffer.
+	/// It is meant to be called when the user leaves the server.
+	void Remove(uint32_t session);
+
+	/// Clear drops all speakers. The totals returned by Stats are kept.
+	void Clear();
+
+	/// Stats returns the packet counts of all speakers, including those
+	/// that have been removed.
+	JitterBufferStats Stats() const;
+
+	/// SpeakerStats sets *stats* to the packet counts, jitter and delay of
+	/// the speaker with *session*.
+	///
+	/// @return  Returns false if no packet of the speaker has been put
+	///          since the JitterBuffer was created, or the speaker was
+	///          removed.
+	bool SpeakerStats(uint32_t session, JitterBufferStats *stats) const;
+
+private:
+	JitterBuffer(const JitterBuffer &);
+	JitterBuffer &operator=(const JitterBuffer &);
+
+	std::unique_ptr<JitterBufferPrivate> priv_;
+};
+
+}
+
+#endif
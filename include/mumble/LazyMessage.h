@@ -0,0 +1,291 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_LAZYMESSAGE_H_
+#define MUMBLE_LAZYMESSAGE_H_
+
+#include <mumble/MessageType.h>
+#include <mumble/ByteView.h>
+
+#include <vector>
+#include <stdint.h>
+
+namespace mumble {
+
+/// LazyMessage is the base class of the lazily decoded control messages.
+///
+/// Parsing a LazyMessage scans the fields of the serialized message once.
+/// Scalar fields are decoded right away. String and bytes fields, such as
+/// a user's texture or a channel's description, are not copied: they are
+/// returned as ByteViews into the serialized message, and the caller
+/// decides whether to copy them. Entries of large repeated fields, such
+/// as the bans of a BanList, are likewise only decoded when accessed.
+///
+/// Since the views point into the serialized message, a LazyMessage is
+/// only valid for as long as the buffer it was parsed from. For messages
+/// passed to a ControlChannelMessageHandler, or dispatched through a
+/// MessageDispatcher, that is the duration of the handler call.
+///
+/// Like MumbleProto's messages, a LazyMessage can be parsed into many
+/// times, and reuses the memory it has allocated for repeated fields.
+class LazyMessage {
+public:
+	virtual ~LazyMessage();
+
+	/// ParseFromArray parses the serialized message of *size* bytes
+	/// at *data*, replacing the previous content of the LazyMessage.
+	/// It mirrors MessageLite's method of the same name, such that
+	/// LazyMessages can be registered with a MessageDispatcher.
+	///
+	/// @return  Returns false if the message is malformed, or if
+	///          required fields are missing.
+	bool ParseFromArray(const void *data, int size);
+
+	/// Parse parses the serialized message referenced by *payload*.
+	/// See ParseFromArray.
+	bool Parse(const ByteView &payload);
+
+	/// Clear resets all fields of the LazyMessage.
+	void Clear();
+
+	/// Payload returns the serialized message that the LazyMessage
+	/// was last parsed from.
+	ByteView Payload() const;
+
+protected:
+	LazyMessage();
+
+	// kMaxFields bounds the field numbers that are stored. Higher
+	// field numbers are skipped, as are fields of unexpected types.
+	static const int kMaxFields = 20;
+
+	// AddRepeated is called for each value of the repeated fields
+	// set in *repeated*, rather than storing the field. *view* is
+	// non-null for length-delimited values.
+	virtual bool AddRepeated(int field, uint64_t value, const ByteView *view);
+	virtual void ClearRepeated();
+
+	// Validate is called after a successful parse, to check
+	// for required fields.
+	virtual bool Validate() const;
+
+	bool HasScalar(int field) const {
+		return (scalar_mask_ & (1U << field)) != 0;
+	}
+
+	bool HasView(int field) const {
+		return (view_mask_ & (1U << field)) != 0;
+	}
+
+	uint64_t Scalar(int field) const {
+		return HasScalar(field) ? scalars_[field] : 0;
+	}
+
+	ByteView View(int field) const {
+		return HasView(field) ? views_[field] : ByteView();
+	}
+
+	// AddVarints appends the varints of a packed repeated field,
+	// or the single *value* of an unpacked one, to *out*.
+	static bool AddVarints(uint64_t value, const ByteView *view, std::vector<uint32_t> *out);
+
+	// repeated_ has a bit set for each field number
+	// that is passed to AddRepeated.
+	uint32_t  repeated_;
+
+private:
+	LazyMessage(const LazyMessage &);
+	LazyMessage &operator=(const LazyMessage &);
+
+	ByteView  payload_;
+	uint32_t  scalar_mask_;
+	uint32_t  view_mask_;
+	uint64_t  scalars_[kMaxFields];
+	ByteView  views_[kMaxFields];
+};
+
+/// LazyUserState is a lazily decoded MumbleProto::UserState.
+class LazyUserState : public LazyMessage {
+public:
+	LazyUserState();
+
+	bool HasSession() const         { return HasScalar(1); }
+	uint32_t Session() const        { return static_cast<uint32_t>(Scalar(1)); }
+	bool HasActor() const           { return HasScalar(2); }
+	uint32_t Actor() const          { return static_cast<uint32_t>(Scalar(2)); }
+	bool HasName() const            { return HasView(3); }
+	ByteView Name() const           { return View(3); }
+	bool HasUserId() const          { return HasScalar(4); }
+	uint32_t UserId() const         { return static_cast<uint32_t>(Scalar(4)); }
+	bool HasChannelId() const       { return HasScalar(5); }
+	uint32_t ChannelId() const      { return static_cast<uint32_t>(Scalar(5)); }
+	bool HasMute() const            { return HasScalar(6); }
+	bool Mute() const               { return Scalar(6) != 0; }
+	bool HasDeaf() const            { return HasScalar(7); }
+	bool Deaf() const               { return Scalar(7) != 0; }
+	bool HasSuppress() const        { return HasScalar(8); }
+	bool Suppress() const           { return Scalar(8) != 0; }
+	bool HasSelfMute() const        { return HasScalar(9); }
+	bool SelfMute() const           { return Scalar(9) != 0; }
+	bool HasSelfDeaf() const        { return HasScalar(10); }
+	bool SelfDeaf() const           { return Scalar(10) != 0; }
+	bool HasTexture() const         { return HasView(11); }
+	ByteView Texture() const        { return View(11); }
+	bool HasPluginContext() const   { return HasView(12); }
+	ByteView PluginContext() const  { return View(12); }
+	bool HasPluginIdentity() const  { return HasView(13); }
+	ByteView PluginIdentity() const { return View(13); }
+	bool HasComment() const         { return HasView(14); }
+	ByteView Comment() const        { return View(14); }
+	bool HasHash() const            { return HasView(15); }
+	ByteView Hash() const           { return View(15); }
+	bool HasCommentHash() const     { return HasView(16); }
+	ByteView CommentHash() const    { return View(16); }
+	bool HasTextureHash() const     { return HasView(17); }
+	ByteView TextureHash() const    { return View(17); }
+	bool HasPrioritySpeaker() const { return HasScalar(18); }
+	bool PrioritySpeaker() const    { return Scalar(18) != 0; }
+	bool HasRecording() const       { return HasScalar(19); }
+	bool Recording() const          { return Scalar(19) != 0; }
+};
+
+/// LazyChannelState is a lazily decoded MumbleProto::ChannelState.
+class LazyChannelState : public LazyMessage {
+public:
+	LazyChannelState();
+
+	bool HasChannelId() const                        { return HasScalar(1); }
+	uint32_t ChannelId() const                       { return static_cast<uint32_t>(Scalar(1)); }
+	bool HasParent() const                           { return HasScalar(2); }
+	uint32_t Parent() const                          { return static_cast<uint32_t>(Scalar(2)); }
+	bool HasName() const                             { return HasView(3); }
+	ByteView Name() const                            { return View(3); }
+	const std::vector<uint32_t> &Links() const       { return links_; }
+	bool HasDescription() const                      { return HasView(5); }
+	ByteView Description() const                     { return View(5); }
+	const std::vector<uint32_t> &LinksAdd() const    { return links_add_; }
+	const std::vector<uint32_t> &LinksRemove() const { return links_remove_; }
+	bool HasTemporary() const                        { return HasScalar(8); }
+	bool Temporary() const                           { return Scalar(8) != 0; }
+	bool HasPosition() const                         { return HasScalar(9); }
+	int32_t Position() const                         { return static_cast<int32_t>(Scalar(9)); }
+	bool HasDescriptionHash() const                  { return HasView(10); }
+	ByteView DescriptionHash() const                 { return View(10); }
+
+protected:
+	virtual bool AddRepeated(int field, uint64_t value, const ByteView *view);
+	virtual void ClearRepeated();
+
+private:
+	std::vector<uint32_t>  links_;
+	std::vector<uint32_t>  links_add_;
+	std::vector<uint32_t>  links_remove_;
+};
+
+/// LazyBanEntry is a lazily decoded MumbleProto::BanList_BanEntry.
+class LazyBanEntry : public LazyMessage {
+public:
+	LazyBanEntry();
+
+	ByteView Address() const     { return View(1); }
+	uint32_t Mask() const        { return static_cast<uint32_t>(Scalar(2)); }
+	bool HasName() const         { return HasView(3); }
+	ByteView Name() const        { return View(3); }
+	bool HasHash() const         { return HasView(4); }
+	ByteView Hash() const        { return View(4); }
+	bool HasReason() const       { return HasView(5); }
+	ByteView Reason() const      { return View(5); }
+	bool HasStart() const        { return HasView(6); }
+	ByteView Start() const       { return View(6); }
+	bool HasDuration() const     { return HasScalar(7); }
+	uint32_t Duration() const    { return static_cast<uint32_t>(Scalar(7)); }
+
+protected:
+	virtual bool Validate() const;
+};
+
+/// LazyBanList is a lazily decoded MumbleProto::BanList. Its entries
+/// are only located when the list is parsed, and are decoded one at a
+/// time by Ban.
+class LazyBanList : public LazyMessage {
+public:
+	LazyBanList();
+
+	int BanSize() const      { return static_cast<int>(bans_.size()); }
+	bool HasQuery() const    { return HasScalar(2); }
+	bool Query() const       { return Scalar(2) != 0; }
+
+	/// Ban decodes the *i*th entry of the list into *entry*. Returns
+	/// false if the entry is malformed.
+	bool Ban(int i, LazyBanEntry *entry) const;
+
+protected:
+	virtual bool AddRepeated(int field, uint64_t value, const ByteView *view);
+	virtual void ClearRepeated();
+
+private:
+	std::vector<ByteView>  bans_;
+};
+
+/// LazyUserListEntry is a lazily decoded MumbleProto::UserList_User.
+class LazyUserListEntry : public LazyMessage {
+public:
+	LazyUserListEntry();
+
+	uint32_t UserId() const       { return static_cast<uint32_t>(Scalar(1)); }
+	bool HasName() const          { return HasView(2); }
+	ByteView Name() const         { return View(2); }
+	bool HasLastSeen() const      { return HasView(3); }
+	ByteView LastSeen() const     { return View(3); }
+	bool HasLastChannel() const   { return HasScalar(4); }
+	uint32_t LastChannel() const  { return static_cast<uint32_t>(Scalar(4)); }
+
+protected:
+	virtual bool Validate() const;
+};
+
+/// LazyUserList is a lazily decoded MumbleProto::UserList. Its entries
+/// are only located when the list is parsed, and are decoded one at a
+/// time by User.
+class LazyUserList : public LazyMessage {
+public:
+	LazyUserList();
+
+	int UserSize() const { return static_cast<int>(users_.size()); }
+
+	/// User decodes the *i*th entry of the list into *entry*. Returns
+	/// false if the entry is malformed.
+	bool User(int i, LazyUserListEntry *entry) const;
+
+protected:
+	virtual bool AddRepeated(int field, uint64_t value, const ByteView *view);
+	virtual void ClearRepeated();
+
+private:
+	std::vector<ByteView>  users_;
+};
+
+template <>
+struct MessageTraits<LazyUserState> {
+	static MessageType Type() { return MESSAGE_TYPE_USER_STATE; }
+};
+
+template <>
+struct MessageTraits<LazyChannelState> {
+	static MessageType Type() { return MESSAGE_TYPE_CHANNEL_STATE; }
+};
+
+template <>
+struct MessageTraits<LazyBanList> {
+	static MessageType Type() { return MESSAGE_TYPE_BAN_LIST; }
+};
+
+template <>
+struct MessageTraits<LazyUserList> {
+	static MessageType Type() { return MESSAGE_TYPE_USER_LIST; }
+};
+
+}
+
+#endif
@@ -0,0 +1,181 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_MESSAGEDISPATCHER_H_
+#define MUMBLE_MESSAGEDISPATCHER_H_
+
+#include <mumble/MessageType.h>
+#include <mumble/ControlChannel.h>
+#include <mumble/ByteView.h>
+
+#include <functional>
+#include <memory>
+
+/// LIBMUMBLE_MESSAGE_TYPES lists the messages of Mumble.proto, along
+/// with their MessageType. It is invoked with a macro that takes the
+/// name of the message and its MessageType.
+#define LIBMUMBLE_MESSAGE_TYPES(X) \
+	X(Version,             MESSAGE_TYPE_VERSION) \
+	X(UDPTunnel,           MESSAGE_TYPE_UDP_TUNNEL) \
+	X(Authenticate,        MESSAGE_TYPE_AUTHENTICATE) \
+	X(Ping,                MESSAGE_TYPE_PING) \
+	X(Reject,              MESSAGE_TYPE_REJECT) \
+	X(ServerSync,          MESSAGE_TYPE_SERVER_SYNC) \
+	X(ChannelRemove,       MESSAGE_TYPE_CHANNEL_REMOVE) \
+	X(ChannelState,        MESSAGE_TYPE_CHANNEL_STATE) \
+	X(UserRemove,          MESSAGE_TYPE_USER_REMOVE) \
+	X(UserState,           MESSAGE_TYPE_USER_STATE) \
+	X(BanList,             MESSAGE_TYPE_BAN_LIST) \
+	X(TextMessage,         MESSAGE_TYPE_TEXT_MESSAGE) \
+	X(PermissionDenied,    MESSAGE_TYPE_PERMISSION_DENIED) \
+	X(ACL,                 MESSAGE_TYPE_ACL) \
+	X(QueryUsers,          MESSAGE_TYPE_QUERY_USERS) \
+	X(CryptSetup,          MESSAGE_TYPE_CRYPT_SETUP) \
+	X(ContextActionModify, MESSAGE_TYPE_CONTEXT_ACTION_MODIFY) \
+	X(ContextAction,       MESSAGE_TYPE_CONTEXT_ACTION) \
+	X(UserList,            MESSAGE_TYPE_USER_LIST) \
+	X(VoiceTarget,         MESSAGE_TYPE_VOICE_TARGET) \
+	X(PermissionQuery,     MESSAGE_TYPE_PERMISSION_QUERY) \
+	X(CodecVersion,        MESSAGE_TYPE_CODEC_VERSION) \
+	X(UserStats,           MESSAGE_TYPE_USER_STATS) \
+	X(RequestBlob,         MESSAGE_TYPE_REQUEST_BLOB) \
+	X(ServerConfig,        MESSAGE_TYPE_SERVER_CONFIG) \
+	X(SuggestConfig,       MESSAGE_TYPE_SUGGEST_CONFIG)
+
+namespace MumbleProto {
+#define LIBMUMBLE_DECLARE_MESSAGE(name, type) class name;
+LIBMUMBLE_MESSAGE_TYPES(LIBMUMBLE_DECLARE_MESSAGE)
+#undef LIBMUMBLE_DECLARE_MESSAGE
+}
+
+namespace mumble {
+
+#define LIBMUMBLE_DEFINE_MESSAGE_TRAITS(name, type) \
+	template <> \
+	struct MessageTraits<MumbleProto::name> { \
+		static MessageType Type() { return type; } \
+	};
+LIBMUMBLE_MESSAGE_TYPES(LIBMUMBLE_DEFINE_MESSAGE_TRAITS)
+#undef LIBMUMBLE_DEFINE_MESSAGE_TRAITS
+
+#define LIBMUMBLE_COUNT_MESSAGE(name, type) + 1
+static_assert(0 LIBMUMBLE_MESSAGE_TYPES(LIBMUMBLE_COUNT_MESSAGE) == NUM_MESSAGE_TYPES,
+              "LIBMUMBLE_MESSAGE_TYPES must list every MessageType");
+#undef LIBMUMBLE_COUNT_MESSAGE
+
+/// MessageDispatcher parses messages received on a ControlChannel into
+/// their Mumble.proto classes, and passes them to typed handlers.
+///
+///     MessageDispatcher dispatcher;
+///     dispatcher.On<MumbleProto::UserState>([](const MumbleProto::UserState &us) {
+///         ...
+///     });
+///     channel.SetMessageHandler(dispatcher.Handler());
+///
+/// Dispatch looks up the handler for a message in a table indexed by its
+/// MessageType. Messages without a handler are passed to the default
+/// handler, if any, without being parsed.
+///
+/// Each handler owns a single instance of its message class, which is
+/// parsed into for every message of that type. This reuses the memory
+/// the message has allocated for its fields, so a message passed to a
+/// handler is only valid for the duration of the call. Use one
+/// MessageDispatcher per connection.
+///
+/// MessageDispatcher is not thread-safe. Handlers must be registered
+/// before messages are dispatched.
+class MessageDispatcher {
+public:
+	/// Constructs a MessageDispatcher without any handlers.
+	MessageDispatcher() {}
+
+	/// On sets the handler for messages of type *T*, such as
+	/// MumbleProto::UserState, replacing the previous one. Callers
+	/// must include the definition of *T* from Mumble.pb.h.
+	///
+	/// @param   fn   A callable taking a `const T &`.
+	///
+	/// @return  Returns a reference to the MessageDispatcher that
+	///          this method was called on.
+	template <typename T, typename Fn>
+	MessageDispatcher& On(Fn fn) {
+		handlers_[MessageTraits<T>::Type()].reset(new TypedHandler<T>(std::function<void (const T &)>(fn)));
+		return *this;
+	}
+
+	/// SetDefaultHandler sets the handler for messages that no
+	/// typed handler has been registered for, including messages
+	/// of types that libmumble does not know about.
+	MessageDispatcher& SetDefaultHandler(ControlChannelMessageHandler fn) {
+		default_handler_ = fn;
+		return *this;
+	}
+
+	/// Dispatch passes the message of *type* with *payload* to its
+	/// handler.
+	///
+	/// @return  Returns false if the message had a handler, but
+	///          could not be parsed. Otherwise, returns true.
+	bool Dispatch(MessageType type, const ByteView &payload) {
+		HandlerBase *h = nullptr;
+		if (type >= 0 && type < NUM_MESSAGE_TYPES) {
+			h = handlers_[type].get();
+		}
+		if (h == nullptr) {
+			if (default_handler_) {
+				default_handler_(type, payload);
+			}
+			return true;
+		}
+		return h->Dispatch(payload);
+	}
+
+	/// Handler returns a ControlChannelMessageHandler that dispatches
+	/// messages through this MessageDispatcher, and drops messages that
+	/// cannot be parsed. The MessageDispatcher must outlive the
+	/// ControlChannel that the handler is set on.
+	ControlChannelMessageHandler Handler() {
+		MessageDispatcher *self = this;
+		return [self](MessageType type, const ByteView &payload) {
+			self->Dispatch(type, payload);
+		};
+	}
+
+private:
+	MessageDispatcher(const MessageDispatcher &);
+	MessageDispatcher &operator=(const MessageDispatcher &);
+
+	class HandlerBase {
+	public:
+		virtual ~HandlerBase() {}
+		virtual bool Dispatch(const ByteView &payload) = 0;
+	};
+
+	template <typename T>
+	class TypedHandler : public HandlerBase {
+	public:
+		explicit TypedHandler(std::function<void (const T &)> fn) : fn_(fn) {}
+
+		// Dispatch parses *payload* into msg_. Parsing clears
+		// msg_ first, but keeps the storage of its fields.
+		virtual bool Dispatch(const ByteView &payload) {
+			if (!msg_.ParseFromArray(payload.ConstData(), payload.Length())) {
+				return false;
+			}
+			fn_(msg_);
+			return true;
+		}
+
+	private:
+		std::function<void (const T &)>  fn_;
+		T                                msg_;
+	};
+
+	std::unique_ptr<HandlerBase>   handlers_[NUM_MESSAGE_TYPES];
+	ControlChannelMessageHandler   default_handler_;
+};
+
+}
+
+#endif
@@ -0,0 +1,55 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_MESSAGETYPE_H_
+#define MUMBLE_MESSAGETYPE_H_
+
+namespace mumble {
+
+/// MessageType identifies the type of a message on the Mumble control
+/// channel. Each frame on the wire starts with the type, followed by
+/// the length of the payload, and the payload itself: the corresponding
+/// message from Mumble.proto, serialized as a protocol buffer.
+enum MessageType {
+	MESSAGE_TYPE_VERSION               = 0,
+	MESSAGE_TYPE_UDP_TUNNEL            = 1,
+	MESSAGE_TYPE_AUTHENTICATE          = 2,
+	MESSAGE_TYPE_PING                  = 3,
+	MESSAGE_TYPE_REJECT                = 4,
+	MESSAGE_TYPE_SERVER_SYNC           = 5,
+	MESSAGE_TYPE_CHANNEL_REMOVE        = 6,
+	MESSAGE_TYPE_CHANNEL_STATE         = 7,
+	MESSAGE_TYPE_USER_REMOVE           = 8,
+	MESSAGE_TYPE_USER_STATE            = 9,
+	MESSAGE_TYPE_BAN_LIST              = 10,
+	MESSAGE_TYPE_TEXT_MESSAGE          = 11,
+	MESSAGE_TYPE_PERMISSION_DENIED     = 12,
+	MESSAGE_TYPE_ACL                   = 13,
+	MESSAGE_TYPE_QUERY_USERS           = 14,
+	MESSAGE_TYPE_CRYPT_SETUP           = 15,
+	MESSAGE_TYPE_CONTEXT_ACTION_MODIFY = 16,
+	MESSAGE_TYPE_CONTEXT_ACTION        = 17,
+	MESSAGE_TYPE_USER_LIST             = 18,
+	MESSAGE_TYPE_VOICE_TARGET          = 19,
+	MESSAGE_TYPE_PERMISSION_QUERY      = 20,
+	MESSAGE_TYPE_CODEC_VERSION         = 21,
+	MESSAGE_TYPE_USER_STATS            = 22,
+	MESSAGE_TYPE_REQUEST_BLOB          = 23,
+	MESSAGE_TYPE_SERVER_CONFIG         = 24,
+	MESSAGE_TYPE_SUGGEST_CONFIG        = 25,
+
+	/// NUM_MESSAGE_TYPES is the number of message types known to libmumble.
+	NUM_MESSAGE_TYPES
+};
+
+/// MessageTraits maps a message class to its MessageType. It is defined
+/// for the messages listed in LIBMUMBLE_MESSAGE_TYPES (see
+/// MessageDispatcher.h), and for the lazily decoded messages of
+/// LazyMessage.h.
+template <typename T>
+struct MessageTraits;
+
+}
+
+#endif
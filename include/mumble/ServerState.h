@@ -0,0 +1,225 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_SERVERSTATE_H_
+#define MUMBLE_SERVERSTATE_H_
+
+#include <mumble/MessageType.h>
+#include <mumble/ByteView.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+namespace mumble {
+
+class ServerStatePrivate;
+class ServerStateTree;
+class LazyChannelState;
+class LazyUserState;
+
+/// ServerChannel is a channel of a Mumble server, as known to a ServerState.
+struct ServerChannel {
+	/// Constructs a ServerChannel with all fields cleared.
+	ServerChannel();
+
+	uint32_t                            channel_id;
+
+	/// has_parent is false for the root channel, and for channels
+	/// whose parent has not been announced.
+	bool                                has_parent;
+	uint32_t                            parent;
+
+	std::string                         name;
+	int32_t                             position;
+	bool                                temporary;
+
+	/// description is shared with snapshots of the ServerState, as it
+	/// can be large. It is null if the server has not sent one.
+	std::shared_ptr<const std::string>  description;
+	std::string                         description_hash;
+
+	/// children lists the channel ids of the channel's sub-channels.
+	std::vector<uint32_t>               children;
+
+	/// links lists the channel ids of the channels this one is linked to.
+	/// Links are symmetric.
+	std::vector<uint32_t>               links;
+
+	/// users lists the sessions of the users in the channel.
+	std::vector<uint32_t>               users;
+};
+
+/// ServerUser is a user connected to a Mumble server, as known to a
+/// ServerState.
+struct ServerUser {
+	/// Constructs a ServerUser with all fields cleared.
+	ServerUser();
+
+	uint32_t                            session;
+	uint32_t                            channel_id;
+
+	/// has_user_id is false for users that are not registered.
+	bool                                has_user_id;
+	uint32_t                            user_id;
+
+	std::string                         name;
+	std::string                         hash;
+	bool                                mute;
+	bool                                deaf;
+	bool                                suppress;
+	bool                                self_mute;
+	bool                                self_deaf;
+	bool                                priority_speaker;
+	bool                                recording;
+
+	/// texture and comment are shared with snapshots of the ServerState,
+	/// as they can be large. They are null if the server has not sent
+	/// them, or has only sent their hashes.
+	std::shared_ptr<const std::string>  texture;
+	std::string                         texture_hash;
+	std::shared_ptr<const std::string>  comment;
+	std::string                         comment_hash;
+
+	std::string                         plugin_context;
+	std::string                         plugin_identity;
+};
+
+/// ServerStateChange describes a change reported to a ServerStateChangeHandler.
+enum ServerStateChange {
+	SERVER_STATE_CHANNEL_ADDED,
+	SERVER_STATE_CHANNEL_UPDATED,
+	SERVER_STATE_CHANNEL_REMOVED,
+	SERVER_STATE_USER_ADDED,
+	SERVER_STATE_USER_UPDATED,
+	/// A user has moved to another channel. The user's other fields
+	/// may have changed as well.
+	SERVER_STATE_USER_MOVED,
+	SERVER_STATE_USER_REMOVED,
+};
+
+/// ServerStateChangeHandler is called for each change to a ServerState, with
+/// the channel id or session that was changed. It is called once the message
+/// that caused the change has been applied, and its snapshot published.
+typedef std::function<void (ServerStateChange change, uint32_t id)>  ServerStateChangeHandler;
+
+/// ServerStateSnapshot is an immutable, versioned view of a ServerState's
+/// channels and users. It can be read from any thread, and stays valid for
+/// as long as it is referenced, however the ServerState changes.
+///
+/// Snapshots share their channels and users with each other: a change to
+/// a single user only copies that user, and O(log n) nodes of the trees
+/// that index the snapshot's channels and users.
+class ServerStateSnapshot {
+public:
+	~ServerStateSnapshot();
+
+	/// Version returns the version of the ServerState that the snapshot
+	/// was taken of. The version changes with every change to the state.
+	uint64_t Version() const;
+
+	/// Channel returns the channel with *channel_id*, or null. Lookups
+	/// take O(log n).
+	const ServerChannel *Channel(uint32_t channel_id) const;
+
+	/// User returns the user with *session*, or null. Lookups take O(log n).
+	const ServerUser *User(uint32_t session) const;
+
+	int NumChannels() const;
+	int NumUsers() const;
+
+	/// ForEachChannel calls *fn* for each channel, in no particular order.
+	void ForEachChannel(const std::function<void (const ServerChannel &channel)> &fn) const;
+
+	/// ForEachUser calls *fn* for each user, in no particular order.
+	void ForEachUser(const std::function<void (const ServerUser &user)> &fn) const;
+
+private:
+	friend class ServerStatePrivate;
+	ServerStateSnapshot();
+	ServerStateSnapshot(const ServerStateSnapshot &);
+	ServerStateSnapshot &operator=(const ServerStateSnapshot &);
+
+	std::unique_ptr<ServerStateTree>    tree_;
+	uint64_t                            version_;
+};
+
+/// ServerState tracks the channel tree and the users of a Mumble server,
+/// as described by the ChannelState, ChannelRemove, UserState and UserRemove
+/// messages the server sends.
+///
+/// Messages are applied incrementally, and decoded lazily, so large fields
+/// are copied at most once, and only if present. Channels and users are
+/// kept in flat tables, indexed by channel id and session, so lookups take
+/// constant time.
+///
+/// ServerState is not thread-safe, with the exception of Snapshot. It is meant
+/// to be fed from a connection's handlers, and read from the same thread.
+/// After each message, a new ServerStateSnapshot is published, which other
+/// threads can pick up with Snapshot without ever blocking the thread that
+/// feeds the ServerState.
+class ServerState {
+public:
+	ServerState();
+	~ServerState();
+
+	/// Apply applies the message of *type* with *payload* to the ServerState.
+	/// Messages of types other than ChannelState, ChannelRemove, UserState
+	/// and UserRemove are ignored.
+	///
+	/// @return  Returns false if the message could not be parsed.
+	bool Apply(MessageType type, const ByteView &payload);
+
+	/// ApplyChannelState applies an already parsed ChannelState message.
+	void ApplyChannelState(const LazyChannelState &msg);
+
+	/// ApplyChannelRemove removes the channel with *channel_id*. Its
+	/// sub-channels and users, if any, are moved to its parent.
+	void ApplyChannelRemove(uint32_t channel_id);
+
+	/// ApplyUserState applies an already parsed UserState message.
+	void ApplyUserState(const LazyUserState &msg);
+
+	/// ApplyUserRemove removes the user with *session*.
+	void ApplyUserRemove(uint32_t session);
+
+	/// Clear removes all channels and users, without notifying
+	/// the change handler.
+	void Clear();
+
+	/// Version returns the current version of the ServerState. It is
+	/// incremented with each change.
+	uint64_t Version() const;
+
+	/// Channel returns the channel with *channel_id*, or null. The
+	/// returned pointer is invalidated by the next change.
+	const ServerChannel *Channel(uint32_t channel_id) const;
+
+	/// User returns the user with *session*, or null. The returned
+	/// pointer is invalidated by the next change.
+	const ServerUser *User(uint32_t session) const;
+
+	int NumChannels() const;
+	int NumUsers() const;
+
+	/// Snapshot returns the most recently published snapshot of the
+	/// ServerState. If the state has not changed since, the same snapshot
+	/// is returned again. Snapshot can be called from any thread.
+	std::shared_ptr<const ServerStateSnapshot> Snapshot() const;
+
+	/// SetChangeHandler sets the ServerState's *change handler*.
+	ServerState& SetChangeHandler(ServerStateChangeHandler fn);
+
+private:
+	ServerState(const ServerState &);
+	ServerState &operator=(const ServerState &);
+
+	std::unique_ptr<ServerStatePrivate> priv_;
+};
+
+}
+
+#endif
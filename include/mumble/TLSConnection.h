@@ -10,20 +10,146 @@
 #include <vector>
 #include <queue>
 #include <functional>
+#include <stdint.h>
 
 #include <mumble/ByteArray.h>
+#include <mumble/ByteView.h>
 #include <mumble/X509Certificate.h>
+#include <mumble/EventLoop.h>
+#include <mumble/Executor.h>
 #include <mumble/Error.h>
 
 namespace mumble {
 
 class TLSConnectionPrivate;
 
+/// TLSConnectionWritePriority selects the lane that a write to a TLSConnection
+/// is queued on. Queued writes are sent in order of priority, and in the order
+/// they were written within each lane.
+enum TLSConnectionWritePriority {
+	/// For data that must not wait behind anything else, such as tunneled voice.
+	TLS_CONNECTION_WRITE_PRIORITY_REALTIME,
+	/// For regular control messages. This is the default.
+	TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE,
+	/// For large transfers, such as textures or ACL uploads. Bulk writes are
+	/// split into chunks of at most *bulk_chunk_size* bytes, such that writes
+	/// with a higher priority can be sent between them.
+	TLS_CONNECTION_WRITE_PRIORITY_BULK,
+};
+
 /// TLSConnectionOptions specifies options for a TLSConnections.
 struct TLSConnectionOptions {
+	/// Constructs a TLSConnectionOptions with default values.
+	TLSConnectionOptions();
+
 	/// tcp_no_delay determines whether Nagle's algorithm
 	/// should be disabled.
 	bool          tcp_no_delay;
+
+	/// event_loop is the EventLoop that the TLSConnection should
+	/// run on. If null (the default), the TLSConnection runs on
+	/// an I/O thread of its own.
+	EventLoop     *event_loop;
+
+	/// thread_options are the options for the I/O thread that
+	/// the TLSConnection creates when *event_loop* is null.
+	EventLoopOptions  thread_options;
+
+	/// executor is the Executor that the TLSConnection's handlers
+	/// are run on. If null (the default), handlers are called directly
+	/// on the TLSConnection's I/O thread.
+	///
+	/// Handlers are always called one at a time, and in order, even on
+	/// an Executor with multiple threads. Data passed to a read batch
+	/// handler is copied before it is handed over, and remains valid
+	/// for the duration of the call. The chain verify handler must
+	/// return its verdict during the TLS handshake, and is always called
+	/// on the I/O thread.
+	///
+	/// The Executor must outlive the TLSConnection, and must be able to
+	/// run functions until all of the TLSConnection's handlers have run.
+	Executor      *executor;
+
+	/// cipher_list restricts the cipher suites that the
+	/// TLSConnection offers or accepts. It uses the OpenSSL
+	/// cipher list format, for example "AES128-SHA:AES256-SHA".
+	/// If empty (the default), OpenSSL's defaults are used.
+	std::string   cipher_list;
+
+	/// bulk_chunk_size is the largest amount of bulk data that is
+	/// sent as a single TLS record. It also bounds how much data the
+	/// TLSConnection keeps queued in front of the socket, and thereby
+	/// how long a realtime write can be held up by bulk writes. The
+	/// default, 16384, is the size of a full TLS record, such that
+	/// dynamic record sizing alone decides the size of bulk records.
+	int           bulk_chunk_size;
+
+	/// send_buffer_size sets the size of the socket's kernel send
+	/// buffer (SO_SNDBUF), in bytes. If zero (the default), the
+	/// system default is used.
+	int           send_buffer_size;
+
+	/// receive_buffer_size sets the size of the socket's kernel
+	/// receive buffer (SO_RCVBUF), in bytes. If zero (the default),
+	/// the system default is used.
+	int           receive_buffer_size;
+
+	/// not_sent_low_water_mark limits how much unsent data the kernel
+	/// keeps queued for the socket (TCP_NOTSENT_LOWAT), in bytes. A low
+	/// value keeps data in the TLSConnection's own write queue, where
+	/// realtime writes can still overtake it. If zero (the default),
+	/// the system default is used. Only supported on Linux and OS X.
+	int           not_sent_low_water_mark;
+
+	/// dscp is the Differentiated Services code point that outgoing
+	/// packets are marked with (IP_TOS), for example 46 (EF) for voice.
+	/// If negative (the default), packets are left unmarked.
+	int           dscp;
+
+	/// tcp_quick_ack determines whether delayed ACKs should be
+	/// disabled (TCP_QUICKACK). The kernel clears this setting on its
+	/// own, so the TLSConnection sets it again after every read. Only
+	/// supported on Linux.
+	bool          tcp_quick_ack;
+
+	/// busy_poll_usec is the number of microseconds that the kernel
+	/// may busy poll the network device for incoming data when the
+	/// socket is read (SO_BUSY_POLL). If zero (the default), busy
+	/// polling is disabled. Only supported on Linux.
+	int           busy_poll_usec;
+
+	/// dynamic_record_sizing determines whether the TLSConnection adapts
+	/// the size of the TLS records it sends to the traffic on the
+	/// connection. A record can only be decrypted once all of it has
+	/// arrived, so full-size records of 16 KiB delay the receiver, and
+	/// anything queued behind them, by several TCP segments.
+	///
+	/// With dynamic record sizing, the TLSConnection sends records of at
+	/// most *min_record_size* bytes of plaintext after the connection has
+	/// been idle for *record_size_idle_ms*, until *record_size_ramp_bytes*
+	/// bytes have been sent. After that, it switches to full-size records,
+	/// which cost less CPU and framing overhead for sustained transfers.
+	/// Realtime writes always use small records. Bulk writes are further
+	/// limited to *bulk_chunk_size* bytes per record.
+	///
+	/// Enabled by default.
+	bool          dynamic_record_sizing;
+
+	/// min_record_size is the size of the small records sent with
+	/// dynamic record sizing, in bytes of plaintext. The default,
+	/// 1400, makes each record fit into a single TCP segment of a
+	/// typical Ethernet path.
+	int           min_record_size;
+
+	/// record_size_ramp_bytes is the number of bytes that are sent in
+	/// small records before dynamic record sizing switches to full-size
+	/// records. The default is 128 KiB.
+	int           record_size_ramp_bytes;
+
+	/// record_size_idle_ms is the number of milliseconds without any
+	/// writes after which dynamic record sizing goes back to small
+	/// records. The default is 1000.
+	int           record_size_idle_ms;
 };
 
 /// TLSConnectionChainVerifyHandler is a handler in TLSConnection that overrides
@@ -46,6 +172,14 @@ typedef std::function<void ()>                                           TLSConn
 /// new data is received from the remote side of the TLSConnection.
 typedef std::function<void (const ByteArray &buf)>                       TLSConnectionReadHandler;
 
+/// TLSConnectionReadBatchHandler is a handler in TLSConnection that is called whenever
+/// new data is received from the remote side of the TLSConnection, with all data that
+/// could be decrypted at that point delivered as a single chain of views.
+///
+/// The views in *chain* point into buffers owned by the TLSConnection, and are only
+/// valid for the duration of the call.
+typedef std::function<void (const ByteViewChain &chain)>                 TLSConnectionReadBatchHandler;
+
 /// TLSConnectionErrorHandler is a handler in TLSConnection that is called whenever
 /// an error occurs in the TLSconnection. When the handler is called, the TLSConnection
 /// is guaranteed to be fully disconnected.
@@ -58,7 +192,79 @@ typedef std::function<void (const Error &err)>                           TLSConn
 ///                   the connection.
 typedef std::function<void (bool local)>                                  TLSConnectionDisconnectHandler;
 
-/// TLSConnection implements a TLS client connection.
+/// TLSConnectionWriteInfo holds the timestamps of a single write to a TLSConnection.
+/// All timestamps are in nanoseconds, taken from libuv's monotonic clock (uv_hrtime).
+struct TLSConnectionWriteInfo {
+	/// Constructs a TLSConnectionWriteInfo with all timestamps set to zero.
+	TLSConnectionWriteInfo();
+
+	/// enqueue_time is the time at which Write was called.
+	uint64_t  enqueue_time;
+
+	/// encrypt_time is the time at which the last TLS record of the
+	/// write was encrypted and queued on the socket. The difference to
+	/// *enqueue_time* is the time spent waiting in the write queue,
+	/// plus the time spent encrypting.
+	uint64_t  encrypt_time;
+
+	/// write_time is the time at which the last TLS record of the write
+	/// was handed to the kernel. Zero if the write failed.
+	uint64_t  write_time;
+};
+
+/// TLSConnectionWriteCompletionHandler is a handler that can be passed to
+/// TLSConnection's Write method. It is called on the TLSConnection's thread
+/// once the written data has been handed to the kernel, or once it is clear
+/// that this will never happen, in which case *err* holds an error. If the
+/// TLSConnection is not connected, it is called right away, on the calling
+/// thread.
+typedef std::function<void (const Error &err, const TLSConnectionWriteInfo &info)>  TLSConnectionWriteCompletionHandler;
+
+/// TLSConnectionHandlerStats holds statistics about the handlers of a
+/// TLSConnection that uses an Executor. All times are in nanoseconds.
+struct TLSConnectionHandlerStats {
+	/// Constructs a TLSConnectionHandlerStats with all fields set to zero.
+	TLSConnectionHandlerStats();
+
+	/// queue_length is the number of handler calls currently
+	/// waiting to run.
+	int       queue_length;
+
+	/// executed is the number of handler calls that have been run.
+	uint64_t  executed;
+
+	/// total_lag is the sum of the time that each handler call spent
+	/// waiting between being queued by the I/O thread and being run.
+	uint64_t  total_lag;
+
+	/// max_lag is the longest time that any handler call spent waiting
+	/// between being queued by the I/O thread and being run.
+	uint64_t  max_lag;
+};
+
+/// TLSConnectionRecordStats holds statistics about the TLS records sent by
+/// a TLSConnection.
+struct TLSConnectionRecordStats {
+	/// Constructs a TLSConnectionRecordStats with all fields set to zero.
+	TLSConnectionRecordStats();
+
+	/// records is the number of TLS records sent.
+	uint64_t  records;
+
+	/// bytes is the number of bytes of plaintext sent.
+	uint64_t  bytes;
+
+	/// small_records is the number of records that were limited to
+	/// less than a full TLS record, by dynamic record sizing or by
+	/// *bulk_chunk_size*.
+	uint64_t  small_records;
+};
+
+/// TLSConnection implements a TLS connection.
+///
+/// TLSConnections created by the user are client connections, and are
+/// connected using Connect. Server-side TLSConnections are created by a
+/// TLSListener.
 class TLSConnection {
 public:
 	/// Constructs a new TLSConnection.
@@ -85,7 +291,22 @@ public:
 	/// Write writes the contents of the ByteArray to the TLS connection.
 	///
 	/// @param   buf   The ByteArray to write to the TLSConnection.
-	void Write(const ByteArray &buf);
+	/// @param   prio  The priority lane to queue the write on.
+	/// @param   done  An optional handler to call once the write has
+	///                completed. Writes without a completion handler
+	///                do not take any timestamps.
+	void Write(const ByteArray &buf,
+	           TLSConnectionWritePriority prio = TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE,
+	           TLSConnectionWriteCompletionHandler done = TLSConnectionWriteCompletionHandler());
+
+	/// HandlerStats returns statistics about the handler calls of the
+	/// current connection. If the TLSConnection does not use an Executor,
+	/// all fields are zero.
+	TLSConnectionHandlerStats HandlerStats() const;
+
+	/// RecordStats returns statistics about the TLS records sent on the
+	/// current connection. It may be called from any thread.
+	TLSConnectionRecordStats RecordStats() const;
 
 	/// SetChainVerifyHandler sets an override handler for the TLSConnection's
 	/// certificate chain verification mechanism. By default, TLSConnection will
@@ -126,6 +347,25 @@ public:
 	///           the various handler setters.
 	TLSConnection& SetReadHandler(TLSConnectionReadHandler fn);
 
+	/// SetReadBatchHandler sets the TLSConnection's *read batch handler*.
+	/// Registering a read batch handler switches the TLSConnection into
+	/// batched read mode: instead of calling the read handler once for
+	/// each chunk returned by the TLS layer, the TLSConnection decrypts
+	/// everything that is currently available into pooled, record-sized
+	/// buffers and calls the read batch handler once with a chain of
+	/// views into those buffers. No copy of the decrypted data is made
+	/// on the way to the handler.
+	///
+	/// While a read batch handler is registered, the read handler is
+	/// not called.
+	///
+	/// @param    fn   The TLSConnectionReadBatchHandler to register.
+	///
+	/// @return   Returns a reference to the TLSConnection that this method
+	///           was called on. This makes it possible to chain calls to
+	///           the various handler setters.
+	TLSConnection& SetReadBatchHandler(TLSConnectionReadBatchHandler fn);
+
 	/// SetErrorHandler sets the TLSConnection's *error handler* which will be
 	/// called if an error happens in the TLSConnection. Whenever this function
 	/// is invoked, the connection is also guaranteed to be disconnected. That is,
@@ -139,7 +379,14 @@ public:
 	TLSConnection& SetDisconnectHandler(TLSConnectionDisconnectHandler fn);
 
 private:
+	TLSConnection(const TLSConnection &conn);
+	TLSConnection& operator=(TLSConnection conn);
+
 	friend class TLSConnectionPrivate;
+	friend class TLSListenerPrivate;
+	friend class TLSSyncConnectionPrivate;
+	friend class ControlChannelPrivate;
+	friend class VoiceChannelPrivate;
 	std::unique_ptr<TLSConnectionPrivate> priv_;
 };
 
@@ -0,0 +1,137 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_TLSLISTENER_H_
+#define MUMBLE_TLSLISTENER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <mumble/TLSConnection.h>
+#include <mumble/X509Certificate.h>
+#include <mumble/EventLoop.h>
+#include <mumble/Error.h>
+
+namespace mumble {
+
+class TLSListenerPrivate;
+
+/// TLSListenerOptions specifies options for a TLSListener.
+struct TLSListenerOptions {
+	/// Constructs a TLSListenerOptions with default values.
+	TLSListenerOptions();
+
+	/// backlog is the maximum length of the queue of
+	/// pending connections on the listening socket.
+	int                         backlog;
+
+	/// request_client_certificate determines whether clients
+	/// are asked to present a certificate during the TLS
+	/// handshake. Clients that do not present one are still
+	/// accepted. Client certificates are checked by the chain
+	/// verify handler of the accepted TLSConnection, if one is
+	/// registered.
+	bool                        request_client_certificate;
+
+	/// num_event_loops is the number of EventLoops that the
+	/// TLSListener creates for its connections, if *event_loops*
+	/// is empty.
+	int                         num_event_loops;
+
+	/// event_loops is a list of started EventLoops that accepted
+	/// connections are spread across. The first EventLoop in the
+	/// list also runs the listening socket. If empty (the default),
+	/// the TLSListener creates *num_event_loops* EventLoops of its own.
+	std::vector<EventLoop *>    event_loops;
+
+	/// thread_options are the options for the EventLoops that the
+	/// TLSListener creates when *event_loops* is empty. If more than
+	/// one EventLoop is created, each thread's name is suffixed with
+	/// the index of its EventLoop.
+	EventLoopOptions            thread_options;
+
+	/// connection_options are the options used for
+	/// accepted TLSConnections. The *event_loop* field
+	/// is ignored.
+	TLSConnectionOptions        connection_options;
+};
+
+/// TLSListenerAcceptHandler is a handler in TLSListener that is called for each
+/// newly accepted TLSConnection, before its TLS handshake begins. The handler is
+/// called on the thread of the EventLoop that the connection runs on, and is the
+/// place to register the connection's handlers.
+///
+/// The TLSConnection is owned by the TLSListener, and is destroyed once its
+/// disconnect or error handler has returned.
+typedef std::function<void (TLSConnection &conn)>  TLSListenerAcceptHandler;
+
+/// TLSListenerErrorHandler is a handler in TLSListener that is called whenever
+/// accepting an incoming connection fails.
+typedef std::function<void (const Error &err)>     TLSListenerErrorHandler;
+
+/// TLSListener implements the server side of TLS connections.
+///
+/// A TLSListener listens for incoming TCP connections, and hands out a server-side
+/// TLSConnection for each of them. Accepted connections are spread across the
+/// TLSListener's EventLoops in a round-robin fashion.
+class TLSListener {
+public:
+	/// Constructs a new TLSListener.
+	TLSListener();
+
+	/// Destroys a TLSListener. This closes the listening socket, and disconnects
+	/// all connections accepted by the TLSListener. It must not be called from
+	/// within one of the TLSListener's (or its connections') handlers.
+	~TLSListener();
+
+	/// Listen starts listening for incoming connections.
+	///
+	/// @param   ipaddr  The IP address to listen on.
+	/// @param   port    The port number to listen on. If 0, a free port is
+	///                  picked by the operating system. (See Port).
+	/// @param   cert    The certificate to present to clients. The certificate
+	///                  must have a private key.
+	/// @param   opts    Options for the TLSListener. May be null,
+	///                  in which case the default options are used.
+	///
+	/// @return  Returns an Error object representing whether
+	///          or not an Error happened while setting up the
+	///          listening socket.
+	Error Listen(const std::string &ipaddr, int port, const X509Certificate &cert, TLSListenerOptions *opts);
+
+	/// Port returns the port number that the TLSListener is listening on,
+	/// or -1 if it is not listening.
+	int Port() const;
+
+	/// Close stops the TLSListener from accepting new connections.
+	/// Already accepted connections are not affected.
+	void Close();
+
+	/// SetAcceptHandler sets the TLSListener's *accept handler* which will be
+	/// called for each accepted TLSConnection.
+	///
+	/// @param    fn   The TLSListenerAcceptHandler to register.
+	///
+	/// @return   Returns a reference to the TLSListener that this method
+	///           was called on. This makes it possible to chain calls to
+	///           the various handler setters.
+	TLSListener& SetAcceptHandler(TLSListenerAcceptHandler fn);
+
+	/// SetErrorHandler sets the TLSListener's *error handler* which will be
+	/// called if accepting an incoming connection fails.
+	TLSListener& SetErrorHandler(TLSListenerErrorHandler fn);
+
+private:
+	TLSListener(const TLSListener &listener);
+	TLSListener& operator=(TLSListener listener);
+
+	friend class TLSListenerPrivate;
+	std::unique_ptr<TLSListenerPrivate> priv_;
+};
+
+}
+
+#endif
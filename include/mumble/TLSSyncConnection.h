@@ -0,0 +1,109 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_TLSSYNCCONNECTION_H_
+#define MUMBLE_TLSSYNCCONNECTION_H_
+
+#include <memory>
+#include <string>
+
+#include <mumble/ByteArray.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/Error.h>
+
+namespace mumble {
+
+class TLSSyncConnectionPrivate;
+
+/// TLSSyncConnectionErrorCode lists the error codes of Errors in the
+/// "TLSSyncConnection" domain.
+enum TLSSyncConnectionErrorCode {
+	/// The operation did not complete within its timeout. The
+	/// connection is left as it was, and can still be used.
+	TLS_SYNC_CONNECTION_ERROR_TIMEOUT = 1,
+	/// The connection was closed by either side.
+	TLS_SYNC_CONNECTION_ERROR_CLOSED = 2,
+};
+
+/// TLSSyncConnection is a blocking TLS client connection, for tools that
+/// just want to run a short exchange with a server, one step at a time.
+///
+/// A TLSSyncConnection does not create any threads. Each call runs a
+/// private event loop on the calling thread until the call completes or
+/// times out, and the connection does nothing in between calls. Apart
+/// from that, it behaves exactly like a TLSConnection, and shares all of
+/// its TLS code.
+///
+/// Once connected, a TLSSyncConnection must only be used from the thread
+/// that called Connect. A new call to Connect may be made from any thread.
+class TLSSyncConnection {
+public:
+	/// Constructs a new TLSSyncConnection.
+	TLSSyncConnection();
+
+	/// Destroys the TLSSyncConnection, closing it if needed.
+	~TLSSyncConnection();
+
+	/// Connect connects to a remote host, and waits for the TLS
+	/// handshake to complete.
+	///
+	/// @param   ipaddr      The IP address to connect to.
+	/// @param   port        The port number to connect to.
+	/// @param   timeout_ms  The longest time to wait, in milliseconds.
+	///                      If negative, Connect waits indefinitely.
+	/// @param   opts        Options for the connection. May be null. The
+	///                      *event_loop* and *executor* fields are ignored.
+	///
+	/// @return  Returns an Error object representing whether or not
+	///          the connection was established. On timeout, the
+	///          connection attempt is abandoned.
+	Error Connect(const std::string &ipaddr, int port, int timeout_ms, TLSConnectionOptions *opts);
+
+	/// Read waits for data from the remote side.
+	///
+	/// @param   buf         Receives all data that has arrived so far,
+	///                      replacing the previous content of *buf*.
+	/// @param   timeout_ms  The longest time to wait, in milliseconds.
+	///                      If negative, Read waits indefinitely.
+	///
+	/// @return  Returns an Error object representing whether or not
+	///          any data was read. Data that arrived before the
+	///          connection was closed is returned before the error.
+	Error Read(ByteArray *buf, int timeout_ms);
+
+	/// Write writes *buf* to the connection, and waits until it
+	/// has been handed to the kernel.
+	///
+	/// @param   buf         The data to write.
+	/// @param   timeout_ms  The longest time to wait, in milliseconds.
+	///                      If negative, Write waits indefinitely.
+	///
+	/// @return  Returns an Error object representing whether or not
+	///          the data was written. On timeout, the data is still
+	///          sent by later calls.
+	Error Write(const ByteArray &buf, int timeout_ms);
+
+	/// Disconnect closes the connection, and waits for it to shut down.
+	void Disconnect();
+
+	/// SetChainVerifyHandler sets an override handler for the connection's
+	/// certificate chain verification. See TLSConnection's method of the
+	/// same name.
+	///
+	/// @param    fn   The TLSConnectionChainVerifyHandler to register.
+	///
+	/// @return   Returns a reference to the TLSSyncConnection that this
+	///           method was called on.
+	TLSSyncConnection& SetChainVerifyHandler(TLSConnectionChainVerifyHandler fn);
+
+private:
+	TLSSyncConnection(const TLSSyncConnection &conn);
+	TLSSyncConnection& operator=(TLSSyncConnection conn);
+
+	std::unique_ptr<TLSSyncConnectionPrivate> priv_;
+};
+
+}
+
+#endif
@@ -0,0 +1,230 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_VOICECHANNEL_H_
+#define MUMBLE_VOICECHANNEL_H_
+
+#include <memory>
+#include <string>
+#include <functional>
+#include <stdint.h>
+
+#include <mumble/TLSConnection.h>
+#include <mumble/ControlChannel.h>
+#include <mumble/ByteArray.h>
+#include <mumble/ByteView.h>
+#include <mumble/Error.h>
+
+namespace mumble {
+
+class VoiceChannelPrivate;
+
+/// VoiceChannelErrorCode lists the error codes of Errors in the
+/// "VoiceChannel" domain.
+enum VoiceChannelErrorCode {
+	/// The TLSConnection is not established, or has been torn down.
+	VOICE_CHANNEL_ERROR_NOT_CONNECTED = 1,
+	/// The VoiceChannel has not been started, or has been stopped.
+	VOICE_CHANNEL_ERROR_NOT_STARTED = 2,
+	/// No key has been set with SetKey.
+	VOICE_CHANNEL_ERROR_NO_KEY = 3,
+	/// A key or nonce does not have the length required by OCB2-AES128,
+	/// or the cipher could not be set up.
+	VOICE_CHANNEL_ERROR_INVALID_KEY = 4,
+	/// A packet passed to Send is larger than a voice datagram allows.
+	VOICE_CHANNEL_ERROR_PACKET_TOO_LARGE = 5,
+};
+
+/// VoiceChannelPath names the paths that a VoiceChannel sends packets on.
+enum VoiceChannelPath {
+	/// Packets are sent as UDPTunnel messages on the ControlChannel.
+	VOICE_CHANNEL_PATH_TUNNEL,
+	/// Packets are sent as encrypted UDP datagrams.
+	VOICE_CHANNEL_PATH_UDP,
+};
+
+/// VoiceChannelOptions specifies options for a VoiceChannel.
+struct VoiceChannelOptions {
+	/// Constructs a VoiceChannelOptions with default values.
+	VoiceChannelOptions();
+
+	/// ping_interval_ms is the interval, in milliseconds, at which UDP
+	/// pings are sent to the server while the VoiceChannel is started.
+	/// The default is 2000.
+	int  ping_interval_ms;
+
+	/// udp_timeout_ms is how long, in milliseconds, the server may leave
+	/// UDP pings unanswered before a VoiceChannel with a tunnel falls
+	/// back to it. The default is 5000.
+	int  udp_timeout_ms;
+
+	/// batch_io lets the VoiceChannel read and write its datagrams in
+	/// batches, with recvmmsg and sendmmsg, coalescing runs of equally
+	/// sized datagrams with UDP segmentation offload where the kernel
+	/// supports it. It only has an effect on Linux; elsewhere, or if it
+	/// is false, each datagram takes a syscall of its own. The default
+	/// is true.
+	bool batch_io;
+};
+
+/// VoiceChannelStats holds the packet counts of a VoiceChannel's
+/// decryption, and the round trip times of its UDP pings, which a
+/// client reports to the server in its Ping messages.
+struct VoiceChannelStats {
+	/// Constructs a VoiceChannelStats with all fields set to zero.
+	VoiceChannelStats();
+
+	/// good is the number of packets that were decrypted.
+	uint32_t  good;
+
+	/// late is the number of packets that arrived after a
+	/// packet that was sent after them.
+	uint32_t  late;
+
+	/// lost is the number of packets that never arrived.
+	uint32_t  lost;
+
+	/// resync is the number of times the server nonce was
+	/// replaced by SetServerNonce.
+	uint32_t  resync;
+
+	/// udp_packets is the number of UDP pings that were answered,
+	/// and udp_ping_avg and udp_ping_var are the mean and variance
+	/// of their round trip times, in milliseconds.
+	uint32_t  udp_packets;
+	float     udp_ping_avg;
+	float     udp_ping_var;
+};
+
+/// VoiceChannelPacketHandler is called with each packet received on a
+/// VoiceChannel, after it has been decrypted. The packet is only valid
+/// for the duration of the call.
+typedef std::function<void (const ByteView &packet)>  VoiceChannelPacketHandler;
+
+/// VoiceChannelResyncHandler is called when the VoiceChannel has lost
+/// track of the server's nonce. The client should then send an empty
+/// CryptSetup message, which the server answers with its current nonce.
+typedef std::function<void ()>                        VoiceChannelResyncHandler;
+
+/// VoiceChannelPathHandler is called when a VoiceChannel switches the
+/// path that it sends packets on.
+typedef std::function<void (VoiceChannelPath path)>   VoiceChannelPathHandler;
+
+/// VoiceChannel sends and receives Mumble voice packets over UDP, on the
+/// event loop of a TLSConnection, encrypted with OCB2-AES128 as specified
+/// by the server's CryptSetup message.
+///
+/// Each datagram carries the low byte of the sender's nonce and part of
+/// the OCB tag. Packets that arrive late, or after others were lost, are
+/// still decrypted, replayed packets are dropped, and the counts of each
+/// are available from Stats, for reporting in Ping messages. If packets
+/// stop decrypting for more than five seconds, the resync handler is
+/// called, at most once every five seconds.
+///
+/// While started, the VoiceChannel pings the server over UDP. If it is
+/// given a tunnel, a ControlChannel on the same TLSConnection, it starts
+/// out sending packets as UDPTunnel messages on the tunnel, switches to
+/// UDP once a ping has been answered, and falls back to the tunnel when
+/// pings go unanswered for too long. Pings continue while on the tunnel,
+/// so the VoiceChannel switches back once UDP works again. Each packet
+/// is sent on exactly one path, chosen when Send is called, so a switch
+/// neither drops nor duplicates packets; packets sent around a switch
+/// may arrive out of order, as they may on UDP alone.
+///
+/// The VoiceChannel's socket is closed when the TLSConnection is torn
+/// down. It must be started again once a new connection is established.
+/// The VoiceChannel must outlive all activity on the TLSConnection, or be
+/// stopped before it is destroyed.
+class VoiceChannel {
+public:
+	/// MaxPacketSize returns the largest packet, in bytes, that can be
+	/// passed to Send, such that its datagram fits Mumble's limit of
+	/// 1024 bytes.
+	static int MaxPacketSize();
+
+	/// Constructs a VoiceChannel for *conn*.
+	///
+	/// @param   conn   The TLSConnection whose event loop runs the
+	///                 VoiceChannel.
+	/// @param   opts   Options for the VoiceChannel. If null, the
+	///                 defaults are used.
+	explicit VoiceChannel(TLSConnection &conn, const VoiceChannelOptions *opts = nullptr);
+	~VoiceChannel();
+
+	/// SetKey sets the key and nonces sent by the server in its CryptSetup
+	/// message, and resets the packet counts. SetKey is thread-safe.
+	///
+	/// @param   key            The 16 byte AES key.
+	/// @param   client_nonce   The 16 byte nonce used to encrypt packets.
+	/// @param   server_nonce   The 16 byte nonce used to decrypt packets.
+	///
+	/// @return  Returns an Error if the key or nonces are not 16 bytes long.
+	Error SetKey(const ByteView &key, const ByteView &client_nonce, const ByteView &server_nonce);
+
+	/// SetServerNonce replaces the nonce used to decrypt packets, as sent by
+	/// the server in a CryptSetup message that only carries *server_nonce*.
+	/// SetServerNonce is thread-safe.
+	Error SetServerNonce(const ByteView &server_nonce);
+
+	/// ClientNonce returns the current nonce used to encrypt packets. It is
+	/// what a client sends when the server sends an empty CryptSetup message.
+	/// ClientNonce is thread-safe.
+	ByteArray ClientNonce() const;
+
+	/// Start opens the VoiceChannel's UDP socket, and starts exchanging
+	/// packets with the server at *ipaddr*:*port*. Datagrams from any other
+	/// address are ignored. The TLSConnection must be established.
+	Error Start(const std::string &ipaddr, int port);
+
+	/// Stop closes the VoiceChannel's UDP socket.
+	void Stop();
+
+	/// SetTunnel sets the ControlChannel that packets are tunneled through
+	/// when UDP does not work. It must be called before Start.
+	VoiceChannel& SetTunnel(ControlChannel *tunnel);
+
+	/// Send sends *packet* to the server on the current path. Send is
+	/// thread-safe, and does not wait for the packet to be sent.
+	///
+	/// @return  Returns an Error if *packet* is too large, or if it cannot
+	///          be sent over UDP, because the VoiceChannel is not started or
+	///          no key has been set, and there is no tunnel.
+	Error Send(const ByteView &packet);
+
+	/// HandleTunnelPacket passes a packet received in a UDPTunnel message to
+	/// the packet handler. It is meant to be called from the ControlChannel's
+	/// message handler.
+	void HandleTunnelPacket(const ByteView &packet);
+
+	/// Path returns the path that packets are currently sent on. Path is
+	/// thread-safe.
+	VoiceChannelPath Path() const;
+
+	/// Stats returns the current packet counts. Stats is thread-safe.
+	VoiceChannelStats Stats() const;
+
+	/// SetPacketHandler sets the VoiceChannel's *packet handler*. It is
+	/// called on the TLSConnection's event loop thread.
+	VoiceChannel& SetPacketHandler(VoiceChannelPacketHandler fn);
+
+	/// SetResyncHandler sets the VoiceChannel's *resync handler*. It is
+	/// called on the TLSConnection's event loop thread.
+	VoiceChannel& SetResyncHandler(VoiceChannelResyncHandler fn);
+
+	/// SetPathHandler sets the VoiceChannel's *path handler*. It is
+	/// called on the TLSConnection's event loop thread, when the path
+	/// changes while the VoiceChannel is started. Stopping returns the
+	/// VoiceChannel to the tunnel without calling the handler.
+	VoiceChannel& SetPathHandler(VoiceChannelPathHandler fn);
+
+private:
+	VoiceChannel(const VoiceChannel &);
+	VoiceChannel &operator=(const VoiceChannel &);
+
+	std::unique_ptr<VoiceChannelPrivate> priv_;
+};
+
+}
+
+#endif
@@ -0,0 +1,113 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_VOICEPACKET_H_
+#define MUMBLE_VOICEPACKET_H_
+
+#include <mumble/ByteView.h>
+
+#include <stdint.h>
+
+namespace mumble {
+
+/// VoicePacketType lists the codecs of Mumble voice packets, as stored
+/// in the upper three bits of a packet's first byte.
+enum VoicePacketType {
+	VOICE_PACKET_TYPE_CELT_ALPHA = 0,
+	VOICE_PACKET_TYPE_PING       = 1,
+	VOICE_PACKET_TYPE_SPEEX      = 2,
+	VOICE_PACKET_TYPE_CELT_BETA  = 3,
+	VOICE_PACKET_TYPE_OPUS       = 4,
+};
+
+/// VoicePacket is a decoded Mumble voice packet, as sent on a
+/// VoiceChannel or tunneled in UDPTunnel messages.
+///
+/// A voice packet starts with a byte holding its type and target,
+/// followed by the sender's session, in packets from the server, and
+/// the packet's sequence number, both written as Mumble's variable
+/// length integers. Then come the audio frames, each with a length
+/// header, and optionally the speaker's position as three floats.
+/// Ping packets only carry a timestamp after the first byte.
+///
+/// Parsing does not copy the audio frames: they are ByteViews into the
+/// parsed packet, and are only valid for as long as it is.
+struct VoicePacket {
+	/// kMaxFrames is the largest number of audio frames a packet
+	/// may carry. Mumble clients send at most ten.
+	static const int kMaxFrames = 16;
+
+	/// kMaxVarintSize is the largest size, in bytes, of the
+	/// variable length integers written by EncodeVarint.
+	static const int kMaxVarintSize = 9;
+
+	/// Constructs a VoicePacket with all fields cleared.
+	VoicePacket();
+
+	VoicePacketType  type;
+
+	/// target is the voice target of the packet: 0 for normal
+	/// talking, 1 to 30 for whisper targets, and 31 for loopback.
+	int              target;
+
+	/// session is the session of the sender. It is only present
+	/// in packets sent by the server.
+	uint32_t         session;
+
+	/// sequence is the sequence number of the packet's first frame,
+	/// or for pings, the timestamp they carry.
+	uint64_t         sequence;
+
+	/// frames holds the first num_frames audio frames. Opus packets
+	/// carry a single frame.
+	int              num_frames;
+	ByteView         frames[kMaxFrames];
+
+	/// terminator is set on the last packet of a transmission. Opus
+	/// packets flag it in their frame header; other codecs append an
+	/// empty frame, which is not included in frames.
+	bool             terminator;
+
+	bool             has_position;
+	float            position[3];
+
+	/// Parse decodes *packet*, replacing the content of the VoicePacket.
+	///
+	/// @param   packet        The packet, as received.
+	/// @param   with_session  Whether the packet carries the sender's
+	///                        session, as packets sent by the server do.
+	///
+	/// @return  Returns false if the packet is malformed, or carries more
+	///          than kMaxFrames frames.
+	bool Parse(const ByteView &packet, bool with_session);
+
+	/// Serialize encodes the VoicePacket into the *size* bytes at *buf*.
+	///
+	/// @return  Returns the length of the packet, or 0 if it does not fit,
+	///          or if the VoicePacket cannot be encoded.
+	int Serialize(char *buf, int size, bool with_session) const;
+
+	/// ParseBatch parses the *count* packets at *packets* into *out*,
+	/// which must hold as many VoicePackets, and sets ok[i] to whether
+	/// packet i was parsed. It saves a call per packet over Parse,
+	/// which matters when relaying the packets of many speakers.
+	///
+	/// @return  Returns the number of packets that were parsed.
+	static int ParseBatch(const ByteView *packets, int count, bool with_session, VoicePacket *out, bool *ok);
+
+	/// EncodeVarint writes *value* as a Mumble variable length integer
+	/// to *out*, which must have room for kMaxVarintSize bytes, and
+	/// returns the number of bytes written. Values with the top bit set
+	/// are taken to be negative, and are written as such.
+	static int EncodeVarint(uint64_t value, unsigned char *out);
+
+	/// DecodeVarint reads a Mumble variable length integer from the *len*
+	/// bytes at *in*, and returns the number of bytes read, or 0 if they
+	/// do not start with a valid integer.
+	static int DecodeVarint(const unsigned char *in, int len, uint64_t *value);
+};
+
+}
+
+#endif
@@ -203,6 +203,7 @@ private:
 	friend class X509PEMVerifier;
 	friend class X509VerifierPrivate;
 	friend class X509CertificatePrivate;
+	friend class TLSListenerPrivate;
 	std::unique_ptr<X509CertificatePrivate> dptr_;
 };
 
@@ -18,14 +18,42 @@
 			'include_dirs': [
 				'include',
 				'src',
+				'proto',
 				'3rdparty/libuv/include',
 				'3rdparty/opensslbuild/include',
 			],
 			'sources': [
+				'src/BlobCache.cpp',
+				'src/BlobCache_p.cpp',
+				'src/ControlChannel.cpp',
+				'src/ControlChannel_p.cpp',
+				'src/ControlFramer.cpp',
+				'src/CryptState.cpp',
+				'src/JitterBuffer.cpp',
+				'src/JitterBuffer_p.cpp',
+				'src/LazyMessage.cpp',
+				'src/ServerState.cpp',
+				'src/ServerState_p.cpp',
 				'src/TLSConnection.cpp',
 				'src/TLSConnection_p.cpp',
+				'src/TLSListener.cpp',
+				'src/TLSListener_p.cpp',
+				'src/TLSSyncConnection.cpp',
+				'src/TLSSyncConnection_p.cpp',
+				'src/VoiceChannel.cpp',
+				'src/VoiceChannel_p.cpp',
+				'src/VoicePacket.cpp',
+				'src/EventLoop.cpp',
+				'src/ThreadUtils.cpp',
+				'src/Executor.cpp',
+				'src/HandlerStrand.cpp',
 				'src/UVBio.cpp',
+				'src/SocketOptions.cpp',
+				'src/SocketUtils.cpp',
+				'src/UDPBatch.cpp',
 				'src/ByteArray.cpp',
+				'src/ByteView.cpp',
+				'src/BufferPool.cpp',
 				'src/X509Certificate.cpp',
 				'src/X509Certificate_p.cpp',
 				'src/X509PEMVerifier.cpp',
@@ -35,6 +63,7 @@
 				'src/UVUtils.cpp',
 				'src/Error.cpp',
 				'src/Utils.cpp',
+				'src/WireFormat.cpp',
 			],
 			'conditions': [
 				['use_system_protobuf==0', {
@@ -52,12 +81,18 @@
 				}],
 				['OS=="linux"', {
 					'defines': ['LIBMUMBLE_OS_LINUX'],
+					'direct_dependent_settings': {
+						'defines': ['LIBMUMBLE_OS_LINUX'],
+					},
 					'link_settings': {
 						'libraries': [ '-lpthread', '-lrt' ],
 					},
 				}],
 				['OS=="mac"', {
 					'defines': ['LIBMUMBLE_OS_MAC'],
+					'direct_dependent_settings': {
+						'defines': ['LIBMUMBLE_OS_MAC'],
+					},
 					'xcode_settings': {
 						'CLANG_CXX_LANGUAGE_STANDARD': 'c++0x',
 						'CLANG_CXX_LIBRARY': 'libc++',
@@ -78,6 +113,10 @@
 				}],
 				['OS=="ios"', {
 					'defines': ['LIBMUMBLE_OS_IOS'],
+					'direct_dependent_settings': {
+						# mumble_test.cpp tests LIBMUMBLE_OS_IOS == 1.
+						'defines': ['LIBMUMBLE_OS_IOS=1'],
+					},
 					'xcode_settings': {
 						'CLANG_CXX_LANGUAGE_STANDARD': 'c++0x',
 						'CLANG_CXX_LIBRARY': 'libc++',
@@ -98,6 +137,9 @@
 				}],
 				['OS=="win"', {
 					'defines': [ 'LIBMUMBLE_OS_WINDOWS' ],
+					'direct_dependent_settings': {
+						'defines': ['LIBMUMBLE_OS_WINDOWS'],
+					},
 					'link_settings': {
 						'libraries': [
 							'crypt32',
@@ -113,6 +155,9 @@
 				}],
 				['OS=="android"', {
 					'defines': [ 'LIBMUMBLE_OS_ANDROID', '__STDC_LIMIT_MACROS' ],
+					'direct_dependent_settings': {
+						'defines': ['LIBMUMBLE_OS_ANDROID'],
+					},
 					'sources!': [
 						'src/X509Verifier_unix.cpp',
 					],
@@ -130,17 +175,36 @@
 			'cflags_cc':     ['-std=c++11'],
 			'dependencies':  [
 				'libmumble',
+				'3rdparty/protobufbuild/protobuf.gyp:protobuf_lite',
 			],
 			'include_dirs': [
 				'include',
 				'src',
+				'proto',
 				'3rdparty/libuv/include',
 				'3rdparty/opensslbuild/include',
 				'3rdparty/gtest/include',
 				'3rdparty/gtest',
 			],
 			'sources': [
+				'src/BlobCache_test.cpp',
 				'src/ByteArray_test.cpp',
+				'src/ByteView_test.cpp',
+				'src/ControlChannel_test.cpp',
+				'src/Error_test.cpp',
+				'src/EventLoop_test.cpp',
+				'src/Executor_test.cpp',
+				'src/JitterBuffer_test.cpp',
+				'src/LazyMessage_test.cpp',
+				'src/MessageDispatcher_test.cpp',
+				'src/ServerState_test.cpp',
+				'src/SocketOptions_test.cpp',
+				'src/TLSConnection_test.cpp',
+				'src/TLSListener_test.cpp',
+				'src/TLSSyncConnection_test.cpp',
+				'src/UVBio_test.cpp',
+				'src/VoiceChannel_test.cpp',
+				'src/VoicePacket_test.cpp',
 				'src/mumble_test.cpp',
 				'src/X509Certificate_test.cpp',
 				'src/X509HostnameVerifier_test.cpp',
@@ -172,7 +236,6 @@
 						'<!@(find testdata -type f)',
 					],
 					'defines': [
-						'LIBMUMBLE_OS_IOS=1',
 						'GTEST_HAS_TR1_TUPLE=0',
 						'GTEST_USE_OWN_TR1_TUPLE=1',
 					],
@@ -204,6 +267,39 @@
 				}],
 			],
 		},
+		{
+			# libmumble-coro-test tests the C++20 coroutine headers,
+			# which are empty unless they are built as C++20.
+			'target_name':   'libmumble-coro-test',
+			'product_name':  'libmumble-coro-test',
+			'type':          'executable',
+			'cflags_cc':     ['-std=c++20'],
+			'dependencies':  [
+				'libmumble',
+				'3rdparty/protobufbuild/protobuf.gyp:protobuf_lite',
+			],
+			'include_dirs': [
+				'include',
+				'src',
+				'proto',
+				'3rdparty/libuv/include',
+				'3rdparty/opensslbuild/include',
+				'3rdparty/gtest/include',
+				'3rdparty/gtest',
+			],
+			'sources': [
+				'src/AwaitableTLSConnection_test.cpp',
+				'src/mumble_test.cpp',
+			],
+			'conditions': [
+				['OS=="mac"', {
+					'xcode_settings': {
+						'CLANG_CXX_LANGUAGE_STANDARD': 'c++20',
+						'CLANG_CXX_LIBRARY': 'libc++',
+					},
+				}],
+			],
+		},
 		{
 			'target_name':   'libmumble-demo',
 			'product_name':  'libmumble-demo',
@@ -247,5 +343,67 @@
 				}],
 			],
 		},
+		{
+			'target_name':   'libmumble-bench',
+			'product_name':  'libmumble-bench',
+			'type':          'executable',
+			'cflags_cc':     ['-std=c++11'],
+			'dependencies':  [
+				'libmumble',
+				'3rdparty/protobufbuild/protobuf.gyp:protobuf_lite',
+			],
+			'include_dirs': [
+				'include',
+				'src',
+				'proto',
+				'3rdparty/libuv/include',
+				'3rdparty/opensslbuild/include',
+			],
+			'sources': [
+				'src/bench.cpp',
+			],
+			'conditions': [
+				['OS=="mac"', {
+					'xcode_settings': {
+						'CLANG_CXX_LANGUAGE_STANDARD': 'c++0x',
+						'CLANG_CXX_LIBRARY': 'libc++',
+					},
+				}],
+				['OS=="android"', {
+					'defines': ['__STDC_LIMIT_MACROS' ],
+				}],
+			],
+		},
+		{
+			'target_name':   'libmumble-loadgen',
+			'product_name':  'libmumble-loadgen',
+			'type':          'executable',
+			'cflags_cc':     ['-std=c++11'],
+			'dependencies':  [
+				'libmumble',
+				'3rdparty/protobufbuild/protobuf.gyp:protobuf_lite',
+			],
+			'include_dirs': [
+				'include',
+				'src',
+				'proto',
+				'3rdparty/libuv/include',
+				'3rdparty/opensslbuild/include',
+			],
+			'sources': [
+				'src/loadgen.cpp',
+			],
+			'conditions': [
+				['OS=="mac"', {
+					'xcode_settings': {
+						'CLANG_CXX_LANGUAGE_STANDARD': 'c++0x',
+						'CLANG_CXX_LIBRARY': 'libc++',
+					},
+				}],
+				['OS=="android"', {
+					'defines': ['__STDC_LIMIT_MACROS' ],
+				}],
+			],
+		},
 	],
 }
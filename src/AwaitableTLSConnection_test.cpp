@@ -0,0 +1,193 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/AwaitableTLSConnection.h>
+#include <mumble/CoTask.h>
+#include <mumble/TLSListener.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/X509Certificate.h>
+#include <mumble/ByteArray.h>
+
+#include <uv.h>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace mumble;
+
+#if !(__cplusplus >= 202002L && defined(__cpp_impl_coroutine))
+# error "AwaitableTLSConnection_test.cpp must be built as C++20"
+#endif
+
+static CoTask<int> Add(int a, int b) {
+	co_return a + b;
+}
+
+static CoTask<int> Fail() {
+	throw std::runtime_error("fail");
+	co_return 0;
+}
+
+static CoTask<void> Sum(int *result, bool *caught) {
+	int sum = 0;
+	for (int i = 0; i < 100; i++) {
+		sum += co_await Add(i, 1);
+	}
+	*result = sum;
+	try {
+		co_await Fail();
+	} catch (const std::runtime_error &) {
+		*caught = true;
+	}
+}
+
+TEST(CoTaskTest, AwaitsResultsAndExceptions) {
+	int result = 0;
+	bool caught = false;
+	Sum(&result, &caught).Detach();
+	EXPECT_EQ(100 * 99 / 2 + 100, result);
+	EXPECT_TRUE(caught);
+}
+
+TEST(CoTaskTest, NotStartedUntilAwaitedOrDetached) {
+	int result = 0;
+	bool caught = false;
+	{
+		CoTask<void> task = Sum(&result, &caught);
+	}
+	EXPECT_EQ(0, result);
+	EXPECT_FALSE(caught);
+}
+
+TEST(CoroutineFramePoolTest, ReusesFrames) {
+	void *a = CoroutineFramePool::Allocate(200);
+	CoroutineFramePool::Deallocate(a, 200);
+	// Frames of the same size class share a free list.
+	void *b = CoroutineFramePool::Allocate(250);
+	EXPECT_EQ(a, b);
+	CoroutineFramePool::Deallocate(b, 250);
+
+	void *big = CoroutineFramePool::Allocate(1 << 20);
+	ASSERT_NE(nullptr, big);
+	CoroutineFramePool::Deallocate(big, 1 << 20);
+}
+
+// EchoSession echoes everything it reads on an accepted connection.
+static CoTask<void> EchoSession(AwaitableTLSConnection &ac) {
+	Error err = co_await ac.Established();
+	ByteArray buf;
+	while (!err.HasError()) {
+		err = co_await ac.ReadSome(&buf);
+		if (!err.HasError()) {
+			err = co_await ac.Write(buf);
+		}
+	}
+}
+
+struct ClientResult {
+	uv_sem_t     done;
+	Error        connect_err;
+	Error        write_err;
+	Error        drain_err;
+	Error        close_err;
+	std::string  received;
+};
+
+// ClientSession writes messages of growing size, and reads
+// back their echoes, before it disconnects.
+static CoTask<void> ClientSession(AwaitableTLSConnection &ac, int port, const std::string *sent, ClientResult *res) {
+	res->connect_err = co_await ac.Connect("127.0.0.1", port, nullptr);
+	if (!res->connect_err.HasError()) {
+		size_t off = 0;
+		for (size_t len = 1; off < sent->size(); len *= 2) {
+			len = std::min(len, sent->size() - off);
+			ByteArray msg(const_cast<char *>(sent->data() + off), static_cast<int>(len));
+			res->write_err = co_await ac.Write(msg);
+			if (res->write_err.HasError()) {
+				break;
+			}
+			off += len;
+
+			ByteArray buf;
+			while (res->received.size() < off) {
+				Error err = co_await ac.ReadSome(&buf);
+				if (err.HasError()) {
+					break;
+				}
+				res->received.append(buf.ConstData(), buf.Length());
+			}
+		}
+		res->drain_err = co_await ac.Drained();
+
+		ac.Connection().Disconnect();
+		ByteArray buf;
+		res->close_err = co_await ac.ReadSome(&buf);
+	}
+	uv_sem_post(&res->done);
+}
+
+TEST(AwaitableTLSConnectionTest, LoopbackEcho) {
+	std::string sent;
+	for (int i = 0; i < 100000; i++) {
+		sent.push_back(static_cast<char>(i * 13));
+	}
+
+	// The sessions must outlive the listener's connections.
+	uv_mutex_t lock;
+	uv_mutex_init(&lock);
+	std::vector<std::unique_ptr<AwaitableTLSConnection> > sessions;
+	{
+		X509Certificate cert = X509Certificate::GenerateSelfSignedCertificate("AwaitableTLSConnectionTest");
+		TLSListener listener;
+		listener.SetAcceptHandler([&lock, &sessions](TLSConnection &conn) {
+			AwaitableTLSConnection *ac = new AwaitableTLSConnection(conn);
+			uv_mutex_lock(&lock);
+			sessions.push_back(std::unique_ptr<AwaitableTLSConnection>(ac));
+			uv_mutex_unlock(&lock);
+			EchoSession(*ac).Detach();
+		});
+		ASSERT_FALSE(listener.Listen("127.0.0.1", 0, cert, nullptr).HasError());
+
+		ClientResult res;
+		uv_sem_init(&res.done, 0);
+		{
+			TLSConnection conn;
+			conn.SetChainVerifyHandler([](const std::vector<X509Certificate> &chain) {
+				return true;
+			});
+			AwaitableTLSConnection ac(conn);
+			ClientSession(ac, listener.Port(), &sent, &res).Detach();
+			uv_sem_wait(&res.done);
+		}
+		uv_sem_destroy(&res.done);
+
+		EXPECT_FALSE(res.connect_err.HasError());
+		EXPECT_FALSE(res.write_err.HasError());
+		EXPECT_FALSE(res.drain_err.HasError());
+		EXPECT_TRUE(res.close_err.HasError());
+		EXPECT_TRUE(res.received == sent);
+	}
+	EXPECT_EQ(1U, sessions.size());
+	uv_mutex_destroy(&lock);
+}
+
+TEST(AwaitableTLSConnectionTest, ConnectFailure) {
+	ClientResult res;
+	uv_sem_init(&res.done, 0);
+	std::string sent("x");
+	{
+		TLSConnection conn;
+		AwaitableTLSConnection ac(conn);
+		// Port 1 is reserved, and nothing listens on it.
+		ClientSession(ac, 1, &sent, &res).Detach();
+		uv_sem_wait(&res.done);
+	}
+	uv_sem_destroy(&res.done);
+	EXPECT_TRUE(res.connect_err.HasError());
+}
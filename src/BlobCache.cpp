@@ -0,0 +1,55 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/BlobCache.h>
+#include "BlobCache_p.h"
+
+namespace mumble {
+
+BlobCacheOptions::BlobCacheOptions() : memory_limit(32 * 1024 * 1024), max_batch(256), request_timeout_ms(30000) {
+}
+
+BlobCacheStats::BlobCacheStats()
+	: memory_hits(0), disk_hits(0), misses(0), coalesced(0), requests(0), requested_blobs(0), memory_used(0) {
+}
+
+BlobCache::BlobCache(const BlobCacheOptions *opts)
+	: priv_(new BlobCachePrivate(opts != nullptr ? *opts : BlobCacheOptions())) {
+}
+
+BlobCache::~BlobCache() {
+}
+
+std::shared_ptr<const std::string> BlobCache::Get(const ByteView &hash) {
+	return priv_->Get(std::string(hash.ConstData(), hash.Length()));
+}
+
+Error BlobCache::Put(const ByteView &hash, const std::shared_ptr<const std::string> &blob) {
+	return priv_->Put(std::string(hash.ConstData(), hash.Length()), blob);
+}
+
+void BlobCache::Fetch(BlobKind kind, uint32_t id, const ByteView &hash, BlobHandler fn) {
+	priv_->Fetch(kind, id, std::string(hash.ConstData(), hash.Length()), fn);
+}
+
+void BlobCache::FlushRequests() {
+	priv_->FlushRequests();
+}
+
+void BlobCache::CancelRequests() {
+	priv_->CancelRequests();
+}
+
+BlobCacheStats BlobCache::Stats() const {
+	BlobCacheStats stats = priv_->stats_;
+	stats.memory_used = priv_->memory_used_;
+	return stats;
+}
+
+BlobCache& BlobCache::SetRequestHandler(BlobCacheRequestHandler fn) {
+	priv_->request_handler_ = fn;
+	return *this;
+}
+
+}
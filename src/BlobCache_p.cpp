@@ -0,0 +1,301 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "BlobCache_p.h"
+
+#include "Mumble.pb.h"
+
+#include <openssl/sha.h>
+
+#include <uv.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifndef LIBMUMBLE_OS_WINDOWS
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#else
+# include <process.h>
+#endif
+
+namespace mumble {
+
+BlobCachePrivate::BlobCachePrivate(const BlobCacheOptions &opts)
+	: opts_(opts), memory_used_(0), num_pending_(0) {
+}
+
+std::shared_ptr<const std::string> BlobCachePrivate::Get(const std::string &hash) {
+	std::unordered_map<std::string, EntryList::iterator>::iterator it = entries_.find(hash);
+	if (it != entries_.end()) {
+		lru_.splice(lru_.begin(), lru_, it->second);
+		stats_.memory_hits++;
+		return it->second->blob;
+	}
+
+	std::shared_ptr<const std::string> blob = ReadFile(hash);
+	if (blob != nullptr) {
+		Remember(hash, blob);
+		stats_.disk_hits++;
+		return blob;
+	}
+
+	stats_.misses++;
+	return blob;
+}
+
+Error BlobCachePrivate::Put(const std::string &hash, const std::shared_ptr<const std::string> &blob) {
+	if (blob == nullptr || !Matches(hash, *blob)) {
+		return Error::ErrorFromStaticDescription(
+			"BlobCache",
+			BLOB_CACHE_ERROR_HASH_MISMATCH,
+			"blob does not match its hash"
+		);
+	}
+
+	Error err;
+	if (entries_.find(hash) == entries_.end()) {
+		Remember(hash, blob);
+		if (!opts_.directory.empty()) {
+			err = WriteFile(hash, *blob);
+		}
+	}
+
+	std::unordered_map<std::string, Waiter>::iterator it = waiters_.find(hash);
+	if (it != waiters_.end()) {
+		std::vector<BlobHandler> handlers;
+		handlers.swap(it->second.handlers);
+		waiters_.erase(it);
+		for (const BlobHandler &fn : handlers) {
+			fn(blob);
+		}
+	}
+	return err;
+}
+
+// Fetch requests each missing blob once. Later fetches of the
+// same blob wait for the first request to be answered, unless
+// it has gone unanswered for longer than the request timeout,
+// in which case the blob is requested again.
+void BlobCachePrivate::Fetch(BlobKind kind, uint32_t id, const std::string &hash, const BlobHandler &fn) {
+	if (hash.empty()) {
+		fn(std::shared_ptr<const std::string>());
+		return;
+	}
+	std::shared_ptr<const std::string> blob = Get(hash);
+	if (blob != nullptr) {
+		fn(blob);
+		return;
+	}
+
+	Waiter &w = waiters_[hash];
+	w.handlers.push_back(fn);
+	if (w.handlers.size() > 1) {
+		uint64_t timeout = static_cast<uint64_t>(opts_.request_timeout_ms) * 1000000ULL;
+		if (w.requested_at == 0 || uv_hrtime() - w.requested_at < timeout) {
+			stats_.coalesced++;
+			return;
+		}
+		w.requested_at = 0;
+	}
+	pending_[kind].push_back(id);
+	pending_hashes_.push_back(hash);
+	num_pending_++;
+	if (num_pending_ >= opts_.max_batch) {
+		FlushRequests();
+	}
+}
+
+void BlobCachePrivate::FlushRequests() {
+	if (num_pending_ == 0) {
+		return;
+	}
+	MumbleProto::RequestBlob req;
+	for (uint32_t session : pending_[BLOB_KIND_TEXTURE]) {
+		req.add_session_texture(session);
+	}
+	for (uint32_t session : pending_[BLOB_KIND_COMMENT]) {
+		req.add_session_comment(session);
+	}
+	for (uint32_t channel_id : pending_[BLOB_KIND_DESCRIPTION]) {
+		req.add_channel_description(channel_id);
+	}
+	for (int i = 0; i < NUM_BLOB_KINDS; i++) {
+		pending_[i].clear();
+	}
+	uint64_t now = uv_hrtime();
+	for (const std::string &hash : pending_hashes_) {
+		std::unordered_map<std::string, Waiter>::iterator it = waiters_.find(hash);
+		if (it != waiters_.end()) {
+			it->second.requested_at = now;
+		}
+	}
+	pending_hashes_.clear();
+	stats_.requests++;
+	stats_.requested_blobs += num_pending_;
+	num_pending_ = 0;
+
+	if (request_handler_) {
+		request_handler_(req);
+	}
+}
+
+void BlobCachePrivate::CancelRequests() {
+	for (int i = 0; i < NUM_BLOB_KINDS; i++) {
+		pending_[i].clear();
+	}
+	pending_hashes_.clear();
+	num_pending_ = 0;
+
+	std::unordered_map<std::string, Waiter> waiters;
+	waiters.swap(waiters_);
+	for (const std::pair<const std::string, Waiter> &w : waiters) {
+		for (const BlobHandler &fn : w.second.handlers) {
+			fn(std::shared_ptr<const std::string>());
+		}
+	}
+}
+
+// Remember keeps *blob* in memory, dropping the least recently
+// used blobs until the memory limit is met. Blobs larger than
+// the limit are not kept at all.
+void BlobCachePrivate::Remember(const std::string &hash, const std::shared_ptr<const std::string> &blob) {
+	if (blob->size() > opts_.memory_limit) {
+		return;
+	}
+	Entry e;
+	e.hash = hash;
+	e.blob = blob;
+	lru_.push_front(e);
+	entries_[hash] = lru_.begin();
+	memory_used_ += blob->size();
+
+	while (memory_used_ > opts_.memory_limit) {
+		Entry &last = lru_.back();
+		memory_used_ -= last.blob->size();
+		entries_.erase(last.hash);
+		lru_.pop_back();
+	}
+}
+
+// ReadFile reads the blob with *hash* from the on-disk store. The
+// file is read straight into the blob.
+std::shared_ptr<const std::string> BlobCachePrivate::ReadFile(const std::string &hash) {
+	std::shared_ptr<const std::string> blob;
+	if (opts_.directory.empty() || hash.empty()) {
+		return blob;
+	}
+	std::string path = PathFor(hash);
+
+#ifndef LIBMUMBLE_OS_WINDOWS
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return blob;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return blob;
+	}
+	std::string buf(static_cast<size_t>(st.st_size), '\0');
+	size_t off = 0;
+	while (off < buf.size()) {
+		ssize_t n = read(fd, &buf[off], buf.size() - off);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		off += static_cast<size_t>(n);
+	}
+	close(fd);
+	if (off < buf.size()) {
+		return blob;
+	}
+	std::shared_ptr<const std::string> data = std::make_shared<const std::string>(std::move(buf));
+#else
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == nullptr) {
+		return blob;
+	}
+	std::string buf;
+	char chunk[16384];
+	size_t n;
+	while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+		buf.append(chunk, n);
+	}
+	fclose(f);
+	std::shared_ptr<const std::string> data = std::make_shared<const std::string>(std::move(buf));
+#endif
+
+	// A file that does not match its name is treated as missing,
+	// and is replaced once the blob is fetched again.
+	if (Matches(hash, *data)) {
+		blob = data;
+	}
+	return blob;
+}
+
+// WriteFile writes *blob* to a temporary file, and renames it into
+// place, such that readers never see a partially written blob. The
+// temporary file is named after the process and the BlobCache, as
+// the on-disk store may be shared by several of each.
+Error BlobCachePrivate::WriteFile(const std::string &hash, const std::string &blob) {
+#ifndef LIBMUMBLE_OS_WINDOWS
+	long pid = static_cast<long>(getpid());
+#else
+	long pid = static_cast<long>(_getpid());
+#endif
+	std::string path = PathFor(hash);
+	std::string tmp = path + "." + std::to_string(pid) + "." + std::to_string(reinterpret_cast<uintptr_t>(this)) + ".tmp";
+
+	FILE *f = fopen(tmp.c_str(), "wb");
+	bool ok = f != nullptr;
+	if (ok) {
+		ok = fwrite(blob.data(), 1, blob.size(), f) == blob.size();
+		ok = fclose(f) == 0 && ok;
+	}
+	if (ok) {
+#ifdef LIBMUMBLE_OS_WINDOWS
+		// Windows does not rename over existing files.
+		std::remove(path.c_str());
+#endif
+		ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+	}
+	if (!ok) {
+		std::remove(tmp.c_str());
+		return Error::ErrorFromStaticDescription(
+			"BlobCache",
+			BLOB_CACHE_ERROR_DISK,
+			"unable to write blob to disk"
+		);
+	}
+	return Error::NoError();
+}
+
+std::string BlobCachePrivate::PathFor(const std::string &hash) const {
+	static const char kHex[] = "0123456789abcdef";
+	std::string path = opts_.directory;
+	path.push_back('/');
+	for (unsigned char c : hash) {
+		path.push_back(kHex[c >> 4]);
+		path.push_back(kHex[c & 0x0f]);
+	}
+	return path;
+}
+
+bool BlobCachePrivate::Matches(const std::string &hash, const std::string &blob) {
+	if (hash.size() != SHA_DIGEST_LENGTH) {
+		return false;
+	}
+	unsigned char digest[SHA_DIGEST_LENGTH];
+	SHA1(reinterpret_cast<const unsigned char *>(blob.data()), blob.size(), digest);
+	return memcmp(digest, hash.data(), SHA_DIGEST_LENGTH) == 0;
+}
+
+}
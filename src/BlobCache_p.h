@@ -0,0 +1,70 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_BLOBCACHE_P_H_
+#define MUMBLE_BLOBCACHE_P_H_
+
+#include <mumble/BlobCache.h>
+#include <mumble/Error.h>
+
+#include <list>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace mumble {
+
+class BlobCachePrivate {
+public:
+	explicit BlobCachePrivate(const BlobCacheOptions &opts);
+
+	std::shared_ptr<const std::string> Get(const std::string &hash);
+	Error Put(const std::string &hash, const std::shared_ptr<const std::string> &blob);
+	void Fetch(BlobKind kind, uint32_t id, const std::string &hash, const BlobHandler &fn);
+	void FlushRequests();
+	void CancelRequests();
+
+	void Remember(const std::string &hash, const std::shared_ptr<const std::string> &blob);
+	std::shared_ptr<const std::string> ReadFile(const std::string &hash);
+	Error WriteFile(const std::string &hash, const std::string &blob);
+	std::string PathFor(const std::string &hash) const;
+	static bool Matches(const std::string &hash, const std::string &blob);
+
+	struct Entry {
+		std::string                         hash;
+		std::shared_ptr<const std::string>  blob;
+	};
+	typedef std::list<Entry> EntryList;
+
+	BlobCacheOptions                                              opts_;
+	BlobCacheStats                                                stats_;
+	BlobCacheRequestHandler                                       request_handler_;
+
+	// lru_ holds the blobs kept in memory, most recently used first.
+	EntryList                                                     lru_;
+	std::unordered_map<std::string, EntryList::iterator>          entries_;
+	size_t                                                        memory_used_;
+
+	// Waiter holds the handlers of the fetches waiting for a requested
+	// blob, and the time its request was passed to the request handler,
+	// or 0 if the request is still queued.
+	struct Waiter {
+		Waiter() : requested_at(0) {}
+
+		std::vector<BlobHandler>  handlers;
+		uint64_t                  requested_at;
+	};
+
+	// waiters_ holds the Waiter of each requested blob. pending_ holds
+	// the ids, by kind, of the requests that have not been passed to
+	// the request handler, and pending_hashes_ the hashes they ask for.
+	std::unordered_map<std::string, Waiter>                       waiters_;
+	std::vector<uint32_t>                                         pending_[NUM_BLOB_KINDS];
+	std::vector<std::string>                                      pending_hashes_;
+	int                                                           num_pending_;
+};
+
+}
+
+#endif
@@ -0,0 +1,265 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/BlobCache.h>
+
+#include "Mumble.pb.h"
+
+#include <openssl/sha.h>
+
+#include <uv.h>
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#ifndef LIBMUMBLE_OS_WINDOWS
+# include <unistd.h>
+#endif
+
+using namespace mumble;
+
+static std::shared_ptr<const std::string> Blob(const std::string &s) {
+	return std::make_shared<const std::string>(s);
+}
+
+static std::string Hash(const std::string &s) {
+	unsigned char digest[SHA_DIGEST_LENGTH];
+	SHA1(reinterpret_cast<const unsigned char *>(s.data()), s.size(), digest);
+	return std::string(reinterpret_cast<const char *>(digest), sizeof(digest));
+}
+
+static ByteView View(const std::string &s) {
+	return ByteView(s.data(), static_cast<int>(s.size()));
+}
+
+TEST(BlobCacheTest, PutAndGet) {
+	BlobCache cache;
+	std::string data(5000, 't');
+	std::string hash = Hash(data);
+	EXPECT_TRUE(cache.Get(View(hash)) == nullptr);
+	ASSERT_FALSE(cache.Put(View(hash), Blob(data)).HasError());
+	std::shared_ptr<const std::string> blob = cache.Get(View(hash));
+	ASSERT_TRUE(blob != nullptr);
+	EXPECT_EQ(data, *blob);
+
+	BlobCacheStats stats = cache.Stats();
+	EXPECT_EQ(1U, stats.memory_hits);
+	EXPECT_EQ(1U, stats.misses);
+	EXPECT_EQ(5000U, stats.memory_used);
+}
+
+TEST(BlobCacheTest, RejectsMismatchedHashes) {
+	BlobCache cache;
+	std::string hash = Hash("one");
+	Error err = cache.Put(View(hash), Blob("two"));
+	EXPECT_TRUE(err.HasError());
+	EXPECT_EQ("BlobCache", err.Domain());
+	EXPECT_EQ(BLOB_CACHE_ERROR_HASH_MISMATCH, err.Code());
+	EXPECT_TRUE(cache.Get(View(hash)) == nullptr);
+}
+
+TEST(BlobCacheTest, EvictsLeastRecentlyUsed) {
+	BlobCacheOptions opts;
+	opts.memory_limit = 3000;
+	BlobCache cache(&opts);
+
+	std::string a(1000, 'a'), b(1000, 'b'), c(1000, 'c'), d(1000, 'd');
+	ASSERT_FALSE(cache.Put(View(Hash(a)), Blob(a)).HasError());
+	ASSERT_FALSE(cache.Put(View(Hash(b)), Blob(b)).HasError());
+	ASSERT_FALSE(cache.Put(View(Hash(c)), Blob(c)).HasError());
+	// Using a makes b the least recently used blob.
+	ASSERT_TRUE(cache.Get(View(Hash(a))) != nullptr);
+	ASSERT_FALSE(cache.Put(View(Hash(d)), Blob(d)).HasError());
+
+	EXPECT_TRUE(cache.Get(View(Hash(a))) != nullptr);
+	EXPECT_TRUE(cache.Get(View(Hash(b))) == nullptr);
+	EXPECT_TRUE(cache.Get(View(Hash(c))) != nullptr);
+	EXPECT_TRUE(cache.Get(View(Hash(d))) != nullptr);
+	EXPECT_EQ(3000U, cache.Stats().memory_used);
+
+	// Blobs larger than the limit are not kept.
+	std::string e(4000, 'e');
+	ASSERT_FALSE(cache.Put(View(Hash(e)), Blob(e)).HasError());
+	EXPECT_TRUE(cache.Get(View(Hash(e))) == nullptr);
+}
+
+TEST(BlobCacheTest, BatchesAndCoalescesRequests) {
+	BlobCache cache;
+	std::vector<MumbleProto::RequestBlob> requests;
+	cache.SetRequestHandler([&](const MumbleProto::RequestBlob &req) {
+		requests.push_back(req);
+	});
+
+	std::string texture(2000, 't');
+	std::string comment("a comment");
+	std::string description("a description");
+	int textures = 0;
+	int comments = 0;
+	int descriptions = 0;
+
+	// Two users share a texture.
+	cache.Fetch(BLOB_KIND_TEXTURE, 1, View(Hash(texture)), [&](const std::shared_ptr<const std::string> &blob) {
+		EXPECT_EQ(texture, *blob);
+		textures++;
+	});
+	cache.Fetch(BLOB_KIND_TEXTURE, 2, View(Hash(texture)), [&](const std::shared_ptr<const std::string> &blob) {
+		EXPECT_EQ(texture, *blob);
+		textures++;
+	});
+	cache.Fetch(BLOB_KIND_COMMENT, 2, View(Hash(comment)), [&](const std::shared_ptr<const std::string> &blob) {
+		comments++;
+	});
+	cache.Fetch(BLOB_KIND_DESCRIPTION, 9, View(Hash(description)), [&](const std::shared_ptr<const std::string> &blob) {
+		descriptions++;
+	});
+	EXPECT_TRUE(requests.empty());
+
+	cache.FlushRequests();
+	cache.FlushRequests();
+	ASSERT_EQ(1U, requests.size());
+	ASSERT_EQ(1, requests[0].session_texture_size());
+	EXPECT_EQ(1U, requests[0].session_texture(0));
+	ASSERT_EQ(1, requests[0].session_comment_size());
+	EXPECT_EQ(2U, requests[0].session_comment(0));
+	ASSERT_EQ(1, requests[0].channel_description_size());
+	EXPECT_EQ(9U, requests[0].channel_description(0));
+
+	// A fetch of a blob that has been requested is not requested again.
+	cache.Fetch(BLOB_KIND_TEXTURE, 3, View(Hash(texture)), [&](const std::shared_ptr<const std::string> &blob) {
+		textures++;
+	});
+	cache.FlushRequests();
+	EXPECT_EQ(1U, requests.size());
+	EXPECT_EQ(2U, cache.Stats().coalesced);
+
+	ASSERT_FALSE(cache.Put(View(Hash(texture)), Blob(texture)).HasError());
+	ASSERT_FALSE(cache.Put(View(Hash(comment)), Blob(comment)).HasError());
+	EXPECT_EQ(3, textures);
+	EXPECT_EQ(1, comments);
+	EXPECT_EQ(0, descriptions);
+
+	// Cached blobs are passed to the handler right away.
+	cache.Fetch(BLOB_KIND_COMMENT, 4, View(Hash(comment)), [&](const std::shared_ptr<const std::string> &blob) {
+		comments++;
+	});
+	EXPECT_EQ(2, comments);
+
+	// Cancelled fetches get null.
+	cache.CancelRequests();
+	EXPECT_EQ(1, descriptions);
+	EXPECT_EQ(1U, cache.Stats().requests);
+	EXPECT_EQ(3U, cache.Stats().requested_blobs);
+}
+
+TEST(BlobCacheTest, RequestsAgainAfterTimeout) {
+	BlobCacheOptions opts;
+	opts.request_timeout_ms = 1;
+	BlobCache cache(&opts);
+	std::vector<MumbleProto::RequestBlob> requests;
+	cache.SetRequestHandler([&](const MumbleProto::RequestBlob &req) {
+		requests.push_back(req);
+	});
+
+	std::string comment("a comment");
+	int comments = 0;
+	BlobHandler fn = [&](const std::shared_ptr<const std::string> &blob) {
+		EXPECT_EQ(comment, *blob);
+		comments++;
+	};
+
+	// A fetch of a queued request never requests again.
+	cache.Fetch(BLOB_KIND_COMMENT, 1, View(Hash(comment)), fn);
+	uint64_t start = uv_hrtime();
+	while (uv_hrtime() - start < 5000000ULL) {
+	}
+	cache.Fetch(BLOB_KIND_COMMENT, 1, View(Hash(comment)), fn);
+	cache.FlushRequests();
+	ASSERT_EQ(1U, requests.size());
+	EXPECT_EQ(1U, cache.Stats().coalesced);
+
+	// Once the request times out, the next fetch requests again.
+	start = uv_hrtime();
+	while (uv_hrtime() - start < 5000000ULL) {
+	}
+	cache.Fetch(BLOB_KIND_COMMENT, 2, View(Hash(comment)), fn);
+	cache.FlushRequests();
+	ASSERT_EQ(2U, requests.size());
+	ASSERT_EQ(1, requests[1].session_comment_size());
+	EXPECT_EQ(2U, requests[1].session_comment(0));
+	EXPECT_EQ(1U, cache.Stats().coalesced);
+
+	// The answer goes to all fetches.
+	ASSERT_FALSE(cache.Put(View(Hash(comment)), Blob(comment)).HasError());
+	EXPECT_EQ(3, comments);
+}
+
+TEST(BlobCacheTest, FlushesFullBatches) {
+	BlobCacheOptions opts;
+	opts.max_batch = 10;
+	BlobCache cache(&opts);
+	std::vector<MumbleProto::RequestBlob> requests;
+	cache.SetRequestHandler([&](const MumbleProto::RequestBlob &req) {
+		requests.push_back(req);
+	});
+
+	for (uint32_t i = 0; i < 25; i++) {
+		std::string data(1, static_cast<char>(i));
+		cache.Fetch(BLOB_KIND_COMMENT, i, View(Hash(data)), [](const std::shared_ptr<const std::string> &blob) {});
+	}
+	ASSERT_EQ(2U, requests.size());
+	EXPECT_EQ(10, requests[1].session_comment_size());
+	EXPECT_EQ(10U, requests[1].session_comment(0));
+	cache.FlushRequests();
+	ASSERT_EQ(3U, requests.size());
+	EXPECT_EQ(5, requests[2].session_comment_size());
+}
+
+#ifndef LIBMUMBLE_OS_WINDOWS
+TEST(BlobCacheTest, DiskStore) {
+	char dir[] = "/tmp/libmumble-blobcache-XXXXXX";
+	ASSERT_TRUE(mkdtemp(dir) != nullptr);
+
+	BlobCacheOptions opts;
+	opts.directory = dir;
+	std::string data(100000, 'x');
+	std::string hash = Hash(data);
+	{
+		BlobCache cache(&opts);
+		ASSERT_FALSE(cache.Put(View(hash), Blob(data)).HasError());
+	}
+
+	// A new cache finds the blob on disk.
+	BlobCache cache(&opts);
+	std::shared_ptr<const std::string> blob = cache.Get(View(hash));
+	ASSERT_TRUE(blob != nullptr);
+	EXPECT_EQ(data, *blob);
+	EXPECT_EQ(1U, cache.Stats().disk_hits);
+	ASSERT_TRUE(cache.Get(View(hash)) != nullptr);
+	EXPECT_EQ(1U, cache.Stats().memory_hits);
+
+	// Files that do not match their names are ignored.
+	std::string other(10, 'o');
+	std::string path = std::string(dir) + "/" + "dd4a2a8aa2c6c4fbd3e1fb8d1e8ff11f6b3d0e8f";
+	FILE *f = fopen(path.c_str(), "wb");
+	ASSERT_TRUE(f != nullptr);
+	fwrite(other.data(), 1, other.size(), f);
+	fclose(f);
+	std::string bogus("\xdd\x4a\x2a\x8a\xa2\xc6\xc4\xfb\xd3\xe1\xfb\x8d\x1e\x8f\xf1\x1f\x6b\x3d\x0e\x8f", 20);
+	EXPECT_TRUE(cache.Get(View(bogus)) == nullptr);
+
+	std::string stored = std::string(dir) + "/";
+	static const char kHex[] = "0123456789abcdef";
+	for (unsigned char c : hash) {
+		stored.push_back(kHex[c >> 4]);
+		stored.push_back(kHex[c & 0x0f]);
+	}
+	unlink(stored.c_str());
+	unlink(path.c_str());
+	rmdir(dir);
+}
+#endif
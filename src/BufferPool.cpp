@@ -0,0 +1,96 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "BufferPool.h"
+
+#include "uv.h"
+
+#include <cstdlib>
+#include <assert.h>
+
+namespace mumble {
+
+static uv_once_t   record_pool_once_ = UV_ONCE_INIT;
+static BufferPool *record_pool_ptr_;
+static uv_once_t   read_pool_once_ = UV_ONCE_INIT;
+static BufferPool *read_pool_ptr_;
+static uv_once_t   write_pool_once_ = UV_ONCE_INIT;
+static BufferPool *write_pool_ptr_;
+
+void BufferPool::InitializeRecordPool() {
+	record_pool_ptr_ = new BufferPool(kTLSRecordSize, 256);
+}
+
+BufferPool &BufferPool::RecordPool() {
+	uv_once(&record_pool_once_, BufferPool::InitializeRecordPool);
+	return *record_pool_ptr_;
+}
+
+void BufferPool::InitializeReadPool() {
+	read_pool_ptr_ = new BufferPool(kReadSize, 64);
+}
+
+BufferPool &BufferPool::ReadPool() {
+	uv_once(&read_pool_once_, BufferPool::InitializeReadPool);
+	return *read_pool_ptr_;
+}
+
+void BufferPool::InitializeWritePool() {
+	write_pool_ptr_ = new BufferPool(kTLSCiphertextSize, 256);
+}
+
+BufferPool &BufferPool::WritePool() {
+	uv_once(&write_pool_once_, BufferPool::InitializeWritePool);
+	return *write_pool_ptr_;
+}
+
+BufferPool::BufferPool(int block_size, int max_free) : block_size_(block_size), max_free_(max_free) {
+	uv_mutex_init(&mutex_);
+	free_.reserve(max_free_);
+}
+
+BufferPool::~BufferPool() {
+	for (char *block : free_) {
+		free(block);
+	}
+	uv_mutex_destroy(&mutex_);
+}
+
+char *BufferPool::Acquire() {
+	char *block = nullptr;
+
+	uv_mutex_lock(&mutex_);
+	if (!free_.empty()) {
+		block = free_.back();
+		free_.pop_back();
+	}
+	uv_mutex_unlock(&mutex_);
+
+	if (block == nullptr) {
+		block = static_cast<char *>(malloc(block_size_));
+	}
+	return block;
+}
+
+void BufferPool::Release(char *block) {
+	if (block == nullptr) {
+		return;
+	}
+
+	uv_mutex_lock(&mutex_);
+	if (free_.size() < max_free_) {
+		free_.push_back(block);
+		block = nullptr;
+	}
+	uv_mutex_unlock(&mutex_);
+
+	// The pool is full. Let the block go.
+	free(block);
+}
+
+int BufferPool::BlockSize() const {
+	return block_size_;
+}
+
+}
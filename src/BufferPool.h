@@ -0,0 +1,76 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_BUFFERPOOL_H_
+#define MUMBLE_BUFFERPOOL_H_
+
+#include "uv.h"
+
+#include <vector>
+
+namespace mumble {
+
+// BufferPool hands out fixed-size memory blocks and keeps
+// released blocks around for reuse, such that the I/O paths
+// do not have to hit malloc for every read or record.
+//
+// BufferPool is safe to use from multiple threads.
+class BufferPool {
+public:
+	// kTLSRecordSize is the maximum amount of plaintext
+	// that fits in a single TLS record.
+	static const int kTLSRecordSize = 16384;
+
+	// RecordPool returns the shared pool of blocks
+	// sized to hold the plaintext of a full TLS record.
+	static BufferPool &RecordPool();
+
+	// kReadSize is the size of the blocks that incoming
+	// socket data is read into. It matches the read size
+	// suggested by libuv.
+	static const int kReadSize = 65536;
+
+	// ReadPool returns the shared pool of blocks used
+	// for reading raw data off of sockets.
+	static BufferPool &ReadPool();
+
+	// kTLSCiphertextSize is the maximum size of a single
+	// TLS record on the wire: a full record of plaintext,
+	// plus the header and the maximum expansion allowed
+	// for the cipher.
+	static const int kTLSCiphertextSize = kTLSRecordSize + 2048 + 5;
+
+	// WritePool returns the shared pool of blocks used
+	// for holding encrypted records until they have been
+	// written to a socket.
+	static BufferPool &WritePool();
+
+	BufferPool(int block_size, int max_free);
+	~BufferPool();
+
+	// Acquire returns a block of BlockSize() bytes.
+	char *Acquire();
+
+	// Release returns a block obtained via Acquire to the pool.
+	void Release(char *block);
+
+	int BlockSize() const;
+
+private:
+	BufferPool(const BufferPool &);
+	BufferPool &operator=(const BufferPool &);
+
+	static void InitializeRecordPool();
+	static void InitializeReadPool();
+	static void InitializeWritePool();
+
+	uv_mutex_t           mutex_;
+	std::vector<char *>  free_;
+	int                  block_size_;
+	size_t               max_free_;
+};
+
+}
+
+#endif
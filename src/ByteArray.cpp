@@ -128,6 +128,13 @@ ByteArray &ByteArray::Truncate(int len) {
 	return *this;
 }
 
+// Swap exchanges the storage of the two ByteArrays.
+void ByteArray::Swap(ByteArray &other) {
+	std::swap(buf_, other.buf_);
+	std::swap(len_, other.len_);
+	std::swap(cap_, other.cap_);
+}
+
 // Check whether the other ByteArray is equal to this.
 bool ByteArray::Equal(const ByteArray &other) const {
 	if (Length() != other.Length()) {
@@ -119,6 +119,20 @@ TEST(ByteArrayTest, TestNoAllocAppend) {
 	EXPECT_EQ(buf, b.Data());
 }
 
+TEST(ByteArrayTest, TestSwap) {
+	mumble::ByteArray a(10);
+	a.Truncate(4);
+	char *abuf = a.Data();
+	mumble::ByteArray b;
+
+	b.Swap(a);
+
+	EXPECT_TRUE(a.IsNull());
+	EXPECT_EQ(abuf, b.Data());
+	EXPECT_EQ(4, b.Length());
+	EXPECT_EQ(10, b.Capacity());
+}
+
 TEST(ByteArrayTest, TestEqual) {
 	mumble::ByteArray a(10);
 	mumble::ByteArray b(10);
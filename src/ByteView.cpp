@@ -0,0 +1,87 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/ByteView.h>
+#include <mumble/ByteArray.h>
+
+#include <algorithm>
+#include <cstring>
+#include <assert.h>
+
+namespace mumble {
+
+ByteView::ByteView() : data_(nullptr), len_(0) {
+}
+
+ByteView::ByteView(const char *data, int len) : data_(data), len_(len) {
+	if (data_ == nullptr) {
+		len_ = 0;
+	}
+}
+
+ByteView::ByteView(const ByteArray &ba) : data_(ba.ConstData()), len_(ba.Length()) {
+}
+
+bool ByteView::IsNull() const {
+	return data_ == nullptr;
+}
+
+int ByteView::Length() const {
+	return len_;
+}
+
+const char *ByteView::ConstData() const {
+	return data_;
+}
+
+ByteView ByteView::Slice(int off, int len) const {
+	int remain = len_ - off;
+	// If len is -1, the slice spans the rest of the view.
+	if (len == -1) {
+		len = remain;
+	}
+
+	assert(off >= 0 && len >= 0 && len <= remain);
+	return ByteView(data_ + off, len);
+}
+
+ByteArray ByteView::ToByteArray() const {
+	if (data_ == nullptr) {
+		return ByteArray();
+	}
+	return ByteArray(const_cast<char *>(data_), len_);
+}
+
+bool ByteView::Equal(const ByteView &other) const {
+	if (len_ != other.len_) {
+		return false;
+	}
+	if (len_ == 0) {
+		return IsNull() == other.IsNull();
+	}
+	return memcmp(data_, other.data_, len_) == 0;
+}
+
+void AppendChain(ByteArray *buf, const ByteViewChain &chain) {
+	int total = buf->Length();
+	for (const ByteView &view : chain) {
+		total += view.Length();
+	}
+	if (total > buf->Capacity()) {
+		int cap = std::max(total, buf->Capacity() * 2);
+		ByteArray larger(cap);
+		if (buf->Length() > 0) {
+			memcpy(larger.Data(), buf->ConstData(), buf->Length());
+		}
+		larger.Truncate(buf->Length());
+		buf->Swap(larger);
+	}
+	for (const ByteView &view : chain) {
+		int off = buf->Length();
+		buf->Truncate(off + view.Length());
+		memcpy(buf->Data() + off, view.ConstData(), view.Length());
+	}
+}
+
+}
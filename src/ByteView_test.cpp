@@ -0,0 +1,83 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/ByteArray.h>
+#include <mumble/ByteView.h>
+
+#include <cstring>
+
+TEST(ByteViewTest, Null) {
+	mumble::ByteView v;
+	EXPECT_TRUE(v.IsNull());
+	EXPECT_EQ(0, v.Length());
+}
+
+TEST(ByteViewTest, FromByteArray) {
+	mumble::ByteArray ba(10);
+	memset(ba.Data(), 'x', 10);
+
+	mumble::ByteView v(ba);
+	EXPECT_FALSE(v.IsNull());
+	EXPECT_EQ(10, v.Length());
+	EXPECT_EQ(ba.ConstData(), v.ConstData());
+}
+
+TEST(ByteViewTest, SliceDoesNotCopy) {
+	const char *buf = "abcdefghij";
+	mumble::ByteView v(buf, 10);
+
+	mumble::ByteView tail = v.Slice(5);
+	EXPECT_EQ(5, tail.Length());
+	EXPECT_EQ(buf + 5, tail.ConstData());
+
+	mumble::ByteView mid = v.Slice(2, 3);
+	EXPECT_EQ(3, mid.Length());
+	EXPECT_EQ(0, memcmp("cde", mid.ConstData(), 3));
+}
+
+TEST(ByteViewTest, ToByteArray) {
+	const char *buf = "abcdefghij";
+	mumble::ByteView v(buf, 10);
+
+	mumble::ByteArray ba = v.ToByteArray();
+	EXPECT_EQ(10, ba.Length());
+	EXPECT_NE(buf, ba.ConstData());
+	EXPECT_TRUE(mumble::ByteView(ba).Equal(v));
+}
+
+TEST(ByteViewTest, Equal) {
+	mumble::ByteView a("abc", 3);
+	mumble::ByteView b("abcd", 3);
+	mumble::ByteView c("abd", 3);
+
+	EXPECT_TRUE(a.Equal(b));
+	EXPECT_FALSE(a.Equal(c));
+	EXPECT_FALSE(a.Equal(mumble::ByteView()));
+}
+
+TEST(ByteViewTest, AppendChain) {
+	mumble::ByteArray ba;
+	mumble::ByteViewChain chain;
+	chain.push_back(mumble::ByteView("abc", 3));
+	chain.push_back(mumble::ByteView("defg", 4));
+	mumble::AppendChain(&ba, chain);
+	EXPECT_TRUE(mumble::ByteView(ba).Equal(mumble::ByteView("abcdefg", 7)));
+
+	// The capacity at least doubles when it runs out.
+	int cap = ba.Capacity();
+	chain.resize(1);
+	mumble::AppendChain(&ba, chain);
+	EXPECT_EQ(10, ba.Length());
+	EXPECT_GE(ba.Capacity(), 2 * cap);
+	EXPECT_TRUE(mumble::ByteView(ba).Equal(mumble::ByteView("abcdefgabc", 10)));
+
+	// Appends that fit keep the storage.
+	const char *data = ba.ConstData();
+	chain[0] = mumble::ByteView("h", 1);
+	mumble::AppendChain(&ba, chain);
+	EXPECT_EQ(data, ba.ConstData());
+	EXPECT_EQ(11, ba.Length());
+}
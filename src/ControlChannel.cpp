@@ -0,0 +1,47 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/ControlChannel.h>
+#include "ControlChannel_p.h"
+
+namespace mumble {
+
+ControlChannelOptions::ControlChannelOptions() : max_message_size(8 * 1024 * 1024) {
+}
+
+ControlChannel::ControlChannel(TLSConnection &conn, const ControlChannelOptions *opts)
+	: priv_(new ControlChannelPrivate(conn, opts != nullptr ? *opts : ControlChannelOptions())) {
+}
+
+ControlChannel::~ControlChannel() {
+}
+
+Error ControlChannel::Send(MessageType type, const google::protobuf::MessageLite &msg, TLSConnectionWritePriority prio, TLSConnectionWriteCompletionHandler done) {
+	return priv_->Send(type, msg, prio, done);
+}
+
+Error ControlChannel::SendRaw(MessageType type, const ByteView &payload, TLSConnectionWritePriority prio, TLSConnectionWriteCompletionHandler done) {
+	return priv_->SendRaw(type, payload, prio, done);
+}
+
+void ControlChannel::Reset() {
+	priv_->framer_.Reset();
+}
+
+ControlChannel& ControlChannel::SetMessageHandler(ControlChannelMessageHandler fn) {
+	priv_->message_handler_ = fn;
+	return *this;
+}
+
+ControlChannel& ControlChannel::SetErrorHandler(ControlChannelErrorHandler fn) {
+	priv_->error_handler_ = fn;
+	return *this;
+}
+
+ControlChannel& ControlChannel::SetBatchEndHandler(ControlChannelBatchEndHandler fn) {
+	priv_->batch_end_handler_ = fn;
+	return *this;
+}
+
+}
@@ -0,0 +1,122 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "ControlChannel_p.h"
+#include "TLSConnection_p.h"
+#include "BufferPool.h"
+
+#include <google/protobuf/message_lite.h>
+
+#include <cstring>
+
+namespace mumble {
+
+ControlChannelPrivate::ControlChannelPrivate(TLSConnection &conn, const ControlChannelOptions &opts)
+	: conn_(conn), opts_(opts), framer_(opts.max_message_size), batch_has_messages_(false) {
+	// The frame handler is set up once, such that
+	// reads do not have to construct one each time.
+	on_frame_ = [this](int type, const ByteView &payload) {
+		batch_has_messages_ = true;
+		if (message_handler_) {
+			message_handler_(static_cast<MessageType>(type), payload);
+		}
+	};
+	conn_.SetReadBatchHandler([this](const ByteViewChain &chain) {
+		OnRead(chain);
+	});
+}
+
+void ControlChannelPrivate::PutHeader(char *p, MessageType type, int len) {
+	unsigned char *u = reinterpret_cast<unsigned char *>(p);
+	uint32_t n = static_cast<uint32_t>(len);
+	u[0] = static_cast<unsigned char>((type >> 8) & 0xff);
+	u[1] = static_cast<unsigned char>(type & 0xff);
+	u[2] = static_cast<unsigned char>((n >> 24) & 0xff);
+	u[3] = static_cast<unsigned char>((n >> 16) & 0xff);
+	u[4] = static_cast<unsigned char>((n >> 8) & 0xff);
+	u[5] = static_cast<unsigned char>(n & 0xff);
+}
+
+// WriteFrame writes a frame of the given type with a payload of
+// *len* bytes, which *fill* writes behind the frame header. Frames
+// that fit into a single TLS record are built in a block from the
+// record pool, which is only copied if the write has to be queued.
+// Larger frames are built in a ByteArray of their own, which is
+// handed over to the write queue instead of being copied.
+Error ControlChannelPrivate::WriteFrame(MessageType type, int len, const FrameFiller &fill, TLSConnectionWritePriority prio, const TLSConnectionWriteCompletionHandler &done) {
+	if (len > opts_.max_message_size) {
+		return Error::ErrorFromStaticDescription(
+			"ControlChannel",
+			CONTROL_CHANNEL_ERROR_MESSAGE_TOO_LARGE,
+			"message too large"
+		);
+	}
+
+	int total = ControlFramer::kHeaderSize + len;
+	BufferPool &pool = BufferPool::RecordPool();
+	if (total <= pool.BlockSize()) {
+		char *block = pool.Acquire();
+		PutHeader(block, type, len);
+		fill(block + ControlFramer::kHeaderSize);
+		conn_.priv_->WriteData(block, total, nullptr, prio, done);
+		pool.Release(block);
+		return Error::NoError();
+	}
+
+	ByteArray buf(total);
+	PutHeader(buf.Data(), type, len);
+	fill(buf.Data() + ControlFramer::kHeaderSize);
+	conn_.priv_->WriteData(buf.ConstData(), buf.Length(), &buf, prio, done);
+	return Error::NoError();
+}
+
+Error ControlChannelPrivate::Send(MessageType type, const google::protobuf::MessageLite &msg, TLSConnectionWritePriority prio, const TLSConnectionWriteCompletionHandler &done) {
+	if (!msg.IsInitialized()) {
+		return Error::ErrorFromStaticDescription(
+			"ControlChannel",
+			CONTROL_CHANNEL_ERROR_UNINITIALIZED_MESSAGE,
+			"message is missing required fields"
+		);
+	}
+	return WriteFrame(type, msg.ByteSize(), [&msg](char *p) {
+		msg.SerializeWithCachedSizesToArray(reinterpret_cast<google::protobuf::uint8 *>(p));
+	}, prio, done);
+}
+
+Error ControlChannelPrivate::SendRaw(MessageType type, const ByteView &payload, TLSConnectionWritePriority prio, const TLSConnectionWriteCompletionHandler &done) {
+	int len = payload.Length();
+	return WriteFrame(type, len, [&payload, len](char *p) {
+		if (len > 0) {
+			memcpy(p, payload.ConstData(), len);
+		}
+	}, prio, done);
+}
+
+// OnRead passes the received data through the framer. Should
+// the remote end send a frame that is too large, the error
+// handler is told about it, and the connection is closed. Anything
+// that arrives after that is dropped.
+void ControlChannelPrivate::OnRead(const ByteViewChain &chain) {
+	if (framer_.Failed()) {
+		return;
+	}
+	batch_has_messages_ = false;
+	bool ok = framer_.Feed(chain, on_frame_);
+	if (batch_has_messages_ && batch_end_handler_) {
+		batch_end_handler_();
+	}
+	if (ok) {
+		return;
+	}
+	if (error_handler_) {
+		error_handler_(Error::ErrorFromStaticDescription(
+			"ControlChannel",
+			CONTROL_CHANNEL_ERROR_MESSAGE_TOO_LARGE,
+			"message too large"
+		));
+	}
+	conn_.Disconnect();
+}
+
+}
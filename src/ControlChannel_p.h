@@ -0,0 +1,45 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_CONTROLCHANNEL_P_H_
+#define MUMBLE_CONTROLCHANNEL_P_H_
+
+#include <mumble/ControlChannel.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/ByteView.h>
+#include <mumble/Error.h>
+
+#include "ControlFramer.h"
+
+#include <functional>
+
+namespace mumble {
+
+class ControlChannelPrivate {
+public:
+	typedef std::function<void(char *payload)> FrameFiller;
+
+	ControlChannelPrivate(TLSConnection &conn, const ControlChannelOptions &opts);
+
+	Error Send(MessageType type, const google::protobuf::MessageLite &msg, TLSConnectionWritePriority prio, const TLSConnectionWriteCompletionHandler &done);
+	Error SendRaw(MessageType type, const ByteView &payload, TLSConnectionWritePriority prio, const TLSConnectionWriteCompletionHandler &done);
+	void OnRead(const ByteViewChain &chain);
+
+	Error WriteFrame(MessageType type, int len, const FrameFiller &fill, TLSConnectionWritePriority prio, const TLSConnectionWriteCompletionHandler &done);
+
+	static void PutHeader(char *p, MessageType type, int len);
+
+	TLSConnection                  &conn_;
+	ControlChannelOptions          opts_;
+	ControlFramer                  framer_;
+	ControlFramer::FrameHandler    on_frame_;
+	ControlChannelMessageHandler   message_handler_;
+	ControlChannelErrorHandler     error_handler_;
+	ControlChannelBatchEndHandler  batch_end_handler_;
+	bool                           batch_has_messages_;
+};
+
+}
+
+#endif
@@ -0,0 +1,223 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/ControlChannel.h>
+#include <mumble/TLSListener.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/X509Certificate.h>
+
+#include "ControlFramer.h"
+#include "Mumble.pb.h"
+
+#include <uv.h>
+
+#include <string>
+#include <vector>
+
+using namespace mumble;
+
+// Frame returns a single frame of *type* with *payload*.
+static std::string Frame(int type, const std::string &payload) {
+	std::string f;
+	f.push_back(static_cast<char>((type >> 8) & 0xff));
+	f.push_back(static_cast<char>(type & 0xff));
+	uint32_t n = static_cast<uint32_t>(payload.size());
+	f.push_back(static_cast<char>((n >> 24) & 0xff));
+	f.push_back(static_cast<char>((n >> 16) & 0xff));
+	f.push_back(static_cast<char>((n >> 8) & 0xff));
+	f.push_back(static_cast<char>(n & 0xff));
+	return f + payload;
+}
+
+struct Received {
+	int          type;
+	std::string  payload;
+};
+
+class ControlFramerTest : public ::testing::Test {
+protected:
+	ControlFramerTest() : framer_(1024) {
+		fn_ = [this](int type, const ByteView &payload) {
+			Received r;
+			r.type = type;
+			r.payload = std::string(payload.ConstData(), payload.Length());
+			received_.push_back(r);
+		};
+	}
+
+	bool Feed(const std::string &s) {
+		return framer_.Feed(ByteView(s.data(), static_cast<int>(s.size())), fn_);
+	}
+
+	ControlFramer                 framer_;
+	ControlFramer::FrameHandler   fn_;
+	std::vector<Received>         received_;
+};
+
+TEST_F(ControlFramerTest, WholeFramesAreNotCopied) {
+	std::string stream = Frame(3, "ping") + Frame(11, "hello") + Frame(5, "");
+	ASSERT_TRUE(Feed(stream));
+	ASSERT_EQ(3U, received_.size());
+	EXPECT_EQ(3, received_[0].type);
+	EXPECT_EQ("ping", received_[0].payload);
+	EXPECT_EQ(11, received_[1].type);
+	EXPECT_EQ("hello", received_[1].payload);
+	EXPECT_EQ(5, received_[2].type);
+	EXPECT_EQ("", received_[2].payload);
+	EXPECT_EQ(0U, framer_.CopiedFrames());
+	EXPECT_EQ(0, framer_.Buffered());
+}
+
+TEST_F(ControlFramerTest, ReassemblesFramesAcrossViews) {
+	std::string stream = Frame(9, "first") + Frame(7, "second") + Frame(1, "third");
+
+	// Feed the stream one byte at a time, which splits every
+	// frame, including its header, across views.
+	for (size_t i = 0; i < stream.size(); i++) {
+		ASSERT_TRUE(Feed(stream.substr(i, 1)));
+	}
+	ASSERT_EQ(3U, received_.size());
+	EXPECT_EQ("first", received_[0].payload);
+	EXPECT_EQ(7, received_[1].type);
+	EXPECT_EQ("second", received_[1].payload);
+	EXPECT_EQ("third", received_[2].payload);
+	EXPECT_EQ(3U, framer_.CopiedFrames());
+	EXPECT_EQ(0, framer_.Buffered());
+}
+
+TEST_F(ControlFramerTest, ChainSplitsOnlyOneFrame) {
+	// The second frame is cut short at the end of the first view.
+	std::string cut = Frame(3, "two");
+	std::string a = Frame(3, "one") + cut.substr(0, cut.size() - 1);
+	std::string b = cut.substr(cut.size() - 1) + Frame(3, "three");
+	ByteViewChain chain;
+	chain.push_back(ByteView(a.data(), static_cast<int>(a.size())));
+	chain.push_back(ByteView(b.data(), static_cast<int>(b.size())));
+
+	ASSERT_TRUE(framer_.Feed(chain, fn_));
+	ASSERT_EQ(3U, received_.size());
+	EXPECT_EQ("one", received_[0].payload);
+	EXPECT_EQ("two", received_[1].payload);
+	EXPECT_EQ("three", received_[2].payload);
+	EXPECT_EQ(1U, framer_.CopiedFrames());
+}
+
+TEST_F(ControlFramerTest, RejectsOversizedFrames) {
+	std::string big = Frame(7, std::string(1025, 'x'));
+	EXPECT_FALSE(Feed(big.substr(0, 6)));
+	EXPECT_TRUE(framer_.Failed());
+	EXPECT_FALSE(Feed(Frame(3, "ping")));
+	EXPECT_EQ(0U, received_.size());
+
+	framer_.Reset();
+	EXPECT_FALSE(framer_.Failed());
+	ASSERT_TRUE(Feed(Frame(3, "ping")));
+	EXPECT_EQ(1U, received_.size());
+}
+
+// ControlChannelTest sends messages over a ControlChannel on a
+// TLSConnection to a ControlChannel on the TLSListener's end.
+class ControlChannelTest : public ::testing::Test {
+protected:
+	virtual void SetUp() {
+		uv_sem_init(&sem_, 0);
+		expected_ = 0;
+		batches_ = 0;
+		X509Certificate cert = X509Certificate::GenerateSelfSignedCertificate("ControlChannelTest");
+		listener_.SetAcceptHandler([this](TLSConnection &conn) {
+			server_.reset(new ControlChannel(conn));
+			server_->SetMessageHandler([this](MessageType type, const ByteView &payload) {
+				Received r;
+				r.type = type;
+				r.payload = std::string(payload.ConstData(), payload.Length());
+				received_.push_back(r);
+			});
+			// The test is woken once all expected messages have been
+			// received, and the batch that contained the last of them
+			// has ended.
+			server_->SetBatchEndHandler([this] {
+				batches_++;
+				if (received_.size() == expected_) {
+					uv_sem_post(&sem_);
+				}
+			});
+		});
+		ASSERT_FALSE(listener_.Listen("127.0.0.1", 0, cert, nullptr).HasError());
+
+		uv_sem_t *sem = &sem_;
+		conn_.SetChainVerifyHandler([](const std::vector<X509Certificate> &chain) {
+			return true;
+		}).SetEstablishedHandler([sem] {
+			uv_sem_post(sem);
+		}).SetDisconnectHandler([sem](bool local) {
+			uv_sem_post(sem);
+		}).SetErrorHandler([sem](const Error &err) {
+			uv_sem_post(sem);
+		});
+		client_.reset(new ControlChannel(conn_));
+		ASSERT_FALSE(conn_.Connect("127.0.0.1", listener_.Port(), nullptr).HasError());
+		uv_sem_wait(&sem_);
+	}
+
+	virtual void TearDown() {
+		conn_.Disconnect();
+		uv_sem_wait(&sem_);
+		uv_sem_destroy(&sem_);
+	}
+
+	// server_ is used by the listener's connection,
+	// and must be destroyed after the listener.
+	std::unique_ptr<ControlChannel>  server_;
+	uv_sem_t                         sem_;
+	TLSListener                      listener_;
+	TLSConnection                    conn_;
+	std::unique_ptr<ControlChannel>  client_;
+	size_t                           expected_;
+	int                              batches_;
+	std::vector<Received>            received_;
+};
+
+TEST_F(ControlChannelTest, SendsMessages) {
+	MumbleProto::Ping ping;
+	ping.set_timestamp(1234);
+	MumbleProto::TextMessage text;
+	text.set_message(std::string(40000, 't'));
+	MumbleProto::UserState us;
+	us.set_session(7);
+	us.set_channel_id(3);
+
+	expected_ = 3;
+	ASSERT_FALSE(client_->Send(MESSAGE_TYPE_PING, ping).HasError());
+	ASSERT_FALSE(client_->Send(MESSAGE_TYPE_TEXT_MESSAGE, text).HasError());
+	ASSERT_FALSE(client_->Send(MESSAGE_TYPE_USER_STATE, us, TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE).HasError());
+	uv_sem_wait(&sem_);
+
+	ASSERT_EQ(3U, received_.size());
+	MumbleProto::Ping rping;
+	EXPECT_EQ(MESSAGE_TYPE_PING, received_[0].type);
+	ASSERT_TRUE(rping.ParseFromString(received_[0].payload));
+	EXPECT_EQ(1234U, rping.timestamp());
+	MumbleProto::TextMessage rtext;
+	EXPECT_EQ(MESSAGE_TYPE_TEXT_MESSAGE, received_[1].type);
+	ASSERT_TRUE(rtext.ParseFromString(received_[1].payload));
+	EXPECT_EQ(40000U, rtext.message().size());
+	MumbleProto::UserState rus;
+	EXPECT_EQ(MESSAGE_TYPE_USER_STATE, received_[2].type);
+	ASSERT_TRUE(rus.ParseFromString(received_[2].payload));
+	EXPECT_EQ(3U, rus.channel_id());
+
+	EXPECT_LE(1, batches_);
+	EXPECT_GE(3, batches_);
+}
+
+TEST_F(ControlChannelTest, RejectsUninitializedMessages) {
+	// TextMessage requires its message field.
+	MumbleProto::TextMessage text;
+	Error err = client_->Send(MESSAGE_TYPE_TEXT_MESSAGE, text);
+	EXPECT_TRUE(err.HasError());
+	EXPECT_EQ("ControlChannel", err.Domain());
+	EXPECT_EQ(CONTROL_CHANNEL_ERROR_UNINITIALIZED_MESSAGE, err.Code());
+}
@@ -0,0 +1,134 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "ControlFramer.h"
+
+#include <algorithm>
+
+namespace mumble {
+
+// kMaxRetained is the largest partial frame buffer
+// that is kept around between frames.
+static const size_t kMaxRetained = 64 * 1024;
+
+ControlFramer::ControlFramer(int max_payload)
+	: max_payload_(max_payload), failed_(false), partial_type_(0), partial_len_(-1), copied_frames_(0) {
+}
+
+bool ControlFramer::ParseHeader(const char *p, int *type, int *len) const {
+	const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+	uint32_t n = (static_cast<uint32_t>(u[2]) << 24) | (static_cast<uint32_t>(u[3]) << 16) |
+	             (static_cast<uint32_t>(u[4]) << 8) | static_cast<uint32_t>(u[5]);
+	if (n > static_cast<uint32_t>(max_payload_)) {
+		return false;
+	}
+	*type = (static_cast<int>(u[0]) << 8) | static_cast<int>(u[1]);
+	*len = static_cast<int>(n);
+	return true;
+}
+
+bool ControlFramer::Feed(const ByteView &view, const FrameHandler &fn) {
+	if (failed_) {
+		return false;
+	}
+
+	const char *p = view.ConstData();
+	int left = view.Length();
+
+	// Finish the frame left over from previous views, if any.
+	if (!partial_.empty()) {
+		int have = static_cast<int>(partial_.size());
+		if (partial_len_ < 0) {
+			int n = std::min(kHeaderSize - have, left);
+			partial_.insert(partial_.end(), p, p + n);
+			p += n;
+			left -= n;
+			have += n;
+			if (have < kHeaderSize) {
+				return true;
+			}
+			if (!ParseHeader(&partial_[0], &partial_type_, &partial_len_)) {
+				failed_ = true;
+				return false;
+			}
+			partial_.reserve(kHeaderSize + partial_len_);
+		}
+
+		int n = std::min(kHeaderSize + partial_len_ - have, left);
+		partial_.insert(partial_.end(), p, p + n);
+		p += n;
+		left -= n;
+		if (static_cast<int>(partial_.size()) < kHeaderSize + partial_len_) {
+			return true;
+		}
+
+		copied_frames_++;
+		fn(partial_type_, ByteView(&partial_[0] + kHeaderSize, partial_len_));
+		partial_len_ = -1;
+		// Keep the buffer for the next frame, unless
+		// it was grown for an unusually large one.
+		if (partial_.capacity() > kMaxRetained) {
+			std::vector<char>().swap(partial_);
+		} else {
+			partial_.clear();
+		}
+	}
+
+	// Hand out all frames that are complete within
+	// this view without copying them.
+	while (left >= kHeaderSize) {
+		int type, len;
+		if (!ParseHeader(p, &type, &len)) {
+			failed_ = true;
+			return false;
+		}
+		if (left - kHeaderSize < len) {
+			break;
+		}
+		fn(type, ByteView(p + kHeaderSize, len));
+		p += kHeaderSize + len;
+		left -= kHeaderSize + len;
+	}
+
+	// Keep the start of the next frame around until
+	// the rest of it arrives.
+	if (left > 0) {
+		partial_.assign(p, p + left);
+		if (left >= kHeaderSize) {
+			ParseHeader(p, &partial_type_, &partial_len_);
+			partial_.reserve(kHeaderSize + partial_len_);
+		}
+	}
+	return true;
+}
+
+bool ControlFramer::Feed(const ByteViewChain &chain, const FrameHandler &fn) {
+	for (const ByteView &view : chain) {
+		if (!Feed(view, fn)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void ControlFramer::Reset() {
+	failed_ = false;
+	partial_.clear();
+	partial_type_ = 0;
+	partial_len_ = -1;
+}
+
+bool ControlFramer::Failed() const {
+	return failed_;
+}
+
+int ControlFramer::Buffered() const {
+	return static_cast<int>(partial_.size());
+}
+
+uint64_t ControlFramer::CopiedFrames() const {
+	return copied_frames_;
+}
+
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_CONTROLFRAMER_H_
+#define MUMBLE_CONTROLFRAMER_H_
+
+#include <mumble/ByteView.h>
+
+#include <functional>
+#include <vector>
+#include <stdint.h>
+
+namespace mumble {
+
+// ControlFramer splits the byte stream of a Mumble control
+// channel into frames: a 2 byte type and a 4 byte length,
+// both big-endian, followed by the payload.
+//
+// Frames that lie entirely within a single view passed to
+// Feed are handed out as slices of that view. Only frames
+// that span several views are copied, into a buffer that
+// is reused for all such frames.
+//
+// ControlFramer is not thread-safe.
+class ControlFramer {
+public:
+	static const int kHeaderSize = 6;
+
+	// FrameHandler is called for each complete frame. The
+	// payload is only valid for the duration of the call.
+	typedef std::function<void (int type, const ByteView &payload)> FrameHandler;
+
+	// Constructs a ControlFramer that rejects frames with
+	// a payload of more than *max_payload* bytes.
+	explicit ControlFramer(int max_payload);
+
+	// Feed passes the next bytes of the stream to the framer,
+	// and calls *fn* for each frame completed by them. Returns
+	// false if the stream is malformed, in which case the
+	// framer refuses further input until it is Reset.
+	//
+	// *fn* must not call Feed or Reset.
+	bool Feed(const ByteView &view, const FrameHandler &fn);
+	bool Feed(const ByteViewChain &chain, const FrameHandler &fn);
+
+	// Reset discards any partial frame, and clears the
+	// error state of the framer.
+	void Reset();
+
+	// Failed returns true if the framer has rejected
+	// the stream, and has not been Reset since.
+	bool Failed() const;
+
+	// Buffered returns the number of bytes of the current
+	// partial frame that the framer holds on to.
+	int Buffered() const;
+
+	// CopiedFrames returns the number of frames that spanned
+	// several views, and thus had to be copied.
+	uint64_t CopiedFrames() const;
+
+private:
+	bool ParseHeader(const char *p, int *type, int *len) const;
+
+	int                max_payload_;
+	bool               failed_;
+	std::vector<char>  partial_;
+	int                partial_type_;
+	int                partial_len_;
+	uint64_t           copied_frames_;
+};
+
+}
+
+#endif
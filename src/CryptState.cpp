@@ -0,0 +1,299 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "CryptState.h"
+
+#include <cstring>
+
+namespace mumble {
+
+typedef unsigned char Block[CryptState::kBlockSize];
+
+static void Xor(unsigned char *dst, const unsigned char *a, const unsigned char *b) {
+	for (int i = 0; i < CryptState::kBlockSize; i++) {
+		dst[i] = a[i] ^ b[i];
+	}
+}
+
+// S2 multiplies *block*, a big-endian element of GF(2^128),
+// by x, which doubles the OCB offset.
+static void S2(unsigned char *block) {
+	unsigned char carry = block[0] >> 7;
+	for (int i = 0; i < CryptState::kBlockSize - 1; i++) {
+		block[i] = static_cast<unsigned char>((block[i] << 1) | (block[i + 1] >> 7));
+	}
+	block[CryptState::kBlockSize - 1] = static_cast<unsigned char>((block[CryptState::kBlockSize - 1] << 1) ^ (carry * 0x87));
+}
+
+// S3 multiplies *block* by x + 1.
+static void S3(unsigned char *block) {
+	Block doubled;
+	memcpy(doubled, block, CryptState::kBlockSize);
+	S2(doubled);
+	Xor(block, block, doubled);
+}
+
+// LengthBlock sets *block* to the bit length of
+// a final block of *len* bytes, as a big-endian number.
+static void LengthBlock(unsigned char *block, int len) {
+	memset(block, 0, CryptState::kBlockSize);
+	uint32_t bits = static_cast<uint32_t>(len) * 8;
+	block[CryptState::kBlockSize - 4] = static_cast<unsigned char>(bits >> 24);
+	block[CryptState::kBlockSize - 3] = static_cast<unsigned char>(bits >> 16);
+	block[CryptState::kBlockSize - 2] = static_cast<unsigned char>(bits >> 8);
+	block[CryptState::kBlockSize - 1] = static_cast<unsigned char>(bits);
+}
+
+CryptState::CryptState()
+	: good_(0), late_(0), lost_(0), resync_(0), encrypt_ctx_(EVP_CIPHER_CTX_new()), decrypt_ctx_(EVP_CIPHER_CTX_new()), valid_(false) {
+	memset(encrypt_iv_, 0, sizeof(encrypt_iv_));
+	memset(decrypt_iv_, 0, sizeof(decrypt_iv_));
+	memset(decrypt_history_, 0, sizeof(decrypt_history_));
+}
+
+CryptState::~CryptState() {
+	EVP_CIPHER_CTX_free(encrypt_ctx_);
+	EVP_CIPHER_CTX_free(decrypt_ctx_);
+}
+
+bool CryptState::SetKey(const unsigned char *key, const unsigned char *encrypt_iv, const unsigned char *decrypt_iv) {
+	valid_ = false;
+	if (encrypt_ctx_ == nullptr || decrypt_ctx_ == nullptr) {
+		return false;
+	}
+	if (EVP_EncryptInit_ex(encrypt_ctx_, EVP_aes_128_ecb(), nullptr, key, nullptr) != 1 ||
+	    EVP_DecryptInit_ex(decrypt_ctx_, EVP_aes_128_ecb(), nullptr, key, nullptr) != 1) {
+		return false;
+	}
+	EVP_CIPHER_CTX_set_padding(encrypt_ctx_, 0);
+	EVP_CIPHER_CTX_set_padding(decrypt_ctx_, 0);
+
+	memcpy(encrypt_iv_, encrypt_iv, kBlockSize);
+	memcpy(decrypt_iv_, decrypt_iv, kBlockSize);
+	memset(decrypt_history_, 0, sizeof(decrypt_history_));
+	good_ = 0;
+	late_ = 0;
+	lost_ = 0;
+	resync_ = 0;
+	valid_ = true;
+	return true;
+}
+
+void CryptState::SetDecryptIV(const unsigned char *iv) {
+	memcpy(decrypt_iv_, iv, kBlockSize);
+	resync_++;
+}
+
+void CryptState::AESEncrypt(const unsigned char *in, unsigned char *out) {
+	int outlen = 0;
+	EVP_EncryptUpdate(encrypt_ctx_, out, &outlen, in, kBlockSize);
+}
+
+void CryptState::AESDecrypt(const unsigned char *in, unsigned char *out) {
+	int outlen = 0;
+	EVP_DecryptUpdate(decrypt_ctx_, out, &outlen, in, kBlockSize);
+}
+
+void CryptState::Encrypt(const unsigned char *src, unsigned char *dst, int len) {
+	// The nonce is incremented as a little-endian number.
+	for (int i = 0; i < kBlockSize; i++) {
+		if (++encrypt_iv_[i] != 0) {
+			break;
+		}
+	}
+	Block tag;
+	OCBEncrypt(src, dst + kHeaderSize, len, encrypt_iv_, tag);
+	dst[0] = encrypt_iv_[0];
+	dst[1] = tag[0];
+	dst[2] = tag[1];
+	dst[3] = tag[2];
+}
+
+// Decrypt reconstructs the sender's nonce from the first byte of
+// the packet. A byte one past the current nonce is the expected
+// case. A slightly smaller byte is a late packet, which is decrypted
+// with a temporary nonce, and a larger one means packets were lost
+// on the way. Anything else cannot be decrypted.
+bool CryptState::Decrypt(const unsigned char *src, unsigned char *dst, int len) {
+	if (len < kHeaderSize) {
+		return false;
+	}
+	int plain_len = len - kHeaderSize;
+	unsigned char ivbyte = src[0];
+	bool restore = false;
+	int lost = 0;
+	int late = 0;
+	Block saveiv;
+	memcpy(saveiv, decrypt_iv_, kBlockSize);
+
+	if (static_cast<unsigned char>(decrypt_iv_[0] + 1) == ivbyte) {
+		if (ivbyte > decrypt_iv_[0]) {
+			decrypt_iv_[0] = ivbyte;
+		} else if (ivbyte < decrypt_iv_[0]) {
+			decrypt_iv_[0] = ivbyte;
+			for (int i = 1; i < kBlockSize; i++) {
+				if (++decrypt_iv_[i] != 0) {
+					break;
+				}
+			}
+		} else {
+			return false;
+		}
+	} else {
+		int diff = ivbyte - decrypt_iv_[0];
+		if (diff > 128) {
+			diff -= 256;
+		} else if (diff < -128) {
+			diff += 256;
+		}
+
+		if (ivbyte < decrypt_iv_[0] && diff > -30 && diff < 0) {
+			// Late, without wrapping around.
+			late = 1;
+			lost = -1;
+			decrypt_iv_[0] = ivbyte;
+			restore = true;
+		} else if (ivbyte > decrypt_iv_[0] && diff > -30 && diff < 0) {
+			// Late, from before the low byte wrapped around.
+			late = 1;
+			lost = -1;
+			decrypt_iv_[0] = ivbyte;
+			for (int i = 1; i < kBlockSize; i++) {
+				if (decrypt_iv_[i]-- != 0) {
+					break;
+				}
+			}
+			restore = true;
+		} else if (ivbyte > decrypt_iv_[0] && diff > 0) {
+			// Some packets were lost.
+			lost = ivbyte - decrypt_iv_[0] - 1;
+			decrypt_iv_[0] = ivbyte;
+		} else if (ivbyte < decrypt_iv_[0] && diff > 0) {
+			// Some packets were lost, and the low byte wrapped around.
+			lost = 256 - decrypt_iv_[0] + ivbyte - 1;
+			decrypt_iv_[0] = ivbyte;
+			for (int i = 1; i < kBlockSize; i++) {
+				if (++decrypt_iv_[i] != 0) {
+					break;
+				}
+			}
+		} else {
+			return false;
+		}
+
+		if (decrypt_history_[decrypt_iv_[0]] == decrypt_iv_[1]) {
+			memcpy(decrypt_iv_, saveiv, kBlockSize);
+			return false;
+		}
+	}
+
+	Block tag;
+	if (!OCBDecrypt(src + kHeaderSize, dst, plain_len, decrypt_iv_, tag) || memcmp(tag, src + 1, 3) != 0) {
+		memcpy(decrypt_iv_, saveiv, kBlockSize);
+		return false;
+	}
+	decrypt_history_[decrypt_iv_[0]] = decrypt_iv_[1];
+	if (restore) {
+		memcpy(decrypt_iv_, saveiv, kBlockSize);
+	}
+
+	// A late packet takes back one lost packet, but after a resync,
+	// it may not have been counted as lost in the first place.
+	good_++;
+	late_ += late;
+	if (lost > 0) {
+		lost_ += lost;
+	} else if (lost < 0 && lost_ >= static_cast<uint32_t>(-lost)) {
+		lost_ -= static_cast<uint32_t>(-lost);
+	}
+	return true;
+}
+
+bool CryptState::OCBEncrypt(const unsigned char *plain, unsigned char *encrypted, int len, const unsigned char *nonce, unsigned char *tag) {
+	Block delta, checksum, tmp, pad;
+	AESEncrypt(nonce, delta);
+	memset(checksum, 0, kBlockSize);
+
+	while (len > kBlockSize) {
+		// If the second to last block is all zeros, except for its
+		// last byte, its ciphertext could be used for a forgery.
+		// Silence produces such blocks, so rather than refusing to
+		// encrypt them, one bit is flipped, which is inaudible.
+		bool flip = false;
+		if (len - kBlockSize <= kBlockSize) {
+			unsigned char sum = 0;
+			for (int i = 0; i < kBlockSize - 1; i++) {
+				sum |= plain[i];
+			}
+			flip = sum == 0;
+		}
+		S2(delta);
+		Xor(tmp, delta, plain);
+		if (flip) {
+			tmp[0] ^= 1;
+		}
+		AESEncrypt(tmp, tmp);
+		Xor(checksum, checksum, plain);
+		if (flip) {
+			checksum[0] ^= 1;
+		}
+		Xor(encrypted, delta, tmp);
+		len -= kBlockSize;
+		plain += kBlockSize;
+		encrypted += kBlockSize;
+	}
+
+	S2(delta);
+	LengthBlock(tmp, len);
+	Xor(tmp, tmp, delta);
+	AESEncrypt(tmp, pad);
+	memcpy(tmp, plain, len);
+	memcpy(tmp + len, pad + len, kBlockSize - len);
+	Xor(checksum, checksum, tmp);
+	Xor(tmp, pad, tmp);
+	memcpy(encrypted, tmp, len);
+
+	S3(delta);
+	Xor(tmp, delta, checksum);
+	AESEncrypt(tmp, tag);
+	return true;
+}
+
+bool CryptState::OCBDecrypt(const unsigned char *encrypted, unsigned char *plain, int len, const unsigned char *nonce, unsigned char *tag) {
+	Block delta, checksum, tmp, pad;
+	AESEncrypt(nonce, delta);
+	memset(checksum, 0, kBlockSize);
+
+	while (len > kBlockSize) {
+		S2(delta);
+		Xor(tmp, delta, encrypted);
+		AESDecrypt(tmp, tmp);
+		Xor(plain, delta, tmp);
+		Xor(checksum, checksum, plain);
+		len -= kBlockSize;
+		plain += kBlockSize;
+		encrypted += kBlockSize;
+	}
+
+	S2(delta);
+	LengthBlock(tmp, len);
+	Xor(tmp, tmp, delta);
+	AESEncrypt(tmp, pad);
+	memset(tmp, 0, kBlockSize);
+	memcpy(tmp, encrypted, len);
+	Xor(tmp, tmp, pad);
+	Xor(checksum, checksum, tmp);
+	memcpy(plain, tmp, len);
+
+	// A forged final block decrypts to the offset
+	// itself, apart from its last byte.
+	bool forged = memcmp(tmp, delta, kBlockSize - 1) == 0;
+
+	S3(delta);
+	Xor(tmp, delta, checksum);
+	AESEncrypt(tmp, tag);
+	return !forged;
+}
+
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_CRYPTSTATE_H_
+#define MUMBLE_CRYPTSTATE_H_
+
+#include <openssl/evp.h>
+
+#include <stdint.h>
+
+namespace mumble {
+
+// CryptState implements the OCB2-AES128 encryption of Mumble's UDP
+// packets. Each packet is prefixed by a 4 byte header: the low byte
+// of the sender's nonce, and the first three bytes of the OCB tag.
+//
+// The receiver reconstructs the full nonce from the low byte, which
+// allows for packets that arrive late, or not at all, and keeps a
+// history of recently seen nonces to reject replayed packets. The
+// counts of good, late and lost packets, and of resyncs, are what a
+// client reports to the server in its Ping messages.
+//
+// AES is done through OpenSSL's EVP interface, which uses AES-NI,
+// or other hardware support, when the CPU has it.
+//
+// CryptState is not thread-safe.
+class CryptState {
+public:
+	static const int kBlockSize = 16;
+	static const int kHeaderSize = 4;
+
+	CryptState();
+	~CryptState();
+
+	// SetKey sets the key and both nonces, each kBlockSize bytes,
+	// and resets the packet counts. Returns false if the cipher
+	// could not be set up.
+	bool SetKey(const unsigned char *key, const unsigned char *encrypt_iv, const unsigned char *decrypt_iv);
+
+	// SetDecryptIV replaces the decrypt nonce, as sent by the
+	// remote end to resynchronize, and counts a resync.
+	void SetDecryptIV(const unsigned char *iv);
+
+	// EncryptIV returns the current encrypt nonce.
+	const unsigned char *EncryptIV() const { return encrypt_iv_; }
+
+	// IsValid returns true once a key has been set.
+	bool IsValid() const { return valid_; }
+
+	// Encrypt encrypts the *len* bytes at *src* into the
+	// *len* + kHeaderSize bytes at *dst*. *src* may be
+	// *dst* + kHeaderSize, to encrypt in place.
+	void Encrypt(const unsigned char *src, unsigned char *dst, int len);
+
+	// Decrypt decrypts the *len* bytes at *src*, a packet produced
+	// by the remote end's Encrypt, into the *len* - kHeaderSize bytes
+	// at *dst*. Returns false if the packet is too short, does not
+	// authenticate, or is a replay.
+	bool Decrypt(const unsigned char *src, unsigned char *dst, int len);
+
+	// OCBEncrypt and OCBDecrypt implement OCB2 for a single message
+	// and nonce, producing or checking the full kBlockSize byte tag.
+	// They return false for messages that would allow the forgery
+	// described in section 9 of https://eprint.iacr.org/2019/311.
+	// OCBEncrypt avoids those by flipping a bit of the plaintext.
+	bool OCBEncrypt(const unsigned char *plain, unsigned char *encrypted, int len, const unsigned char *nonce, unsigned char *tag);
+	bool OCBDecrypt(const unsigned char *encrypted, unsigned char *plain, int len, const unsigned char *nonce, unsigned char *tag);
+
+	uint32_t  good_;
+	uint32_t  late_;
+	uint32_t  lost_;
+	uint32_t  resync_;
+
+private:
+	CryptState(const CryptState &);
+	CryptState &operator=(const CryptState &);
+
+	void AESEncrypt(const unsigned char *in, unsigned char *out);
+	void AESDecrypt(const unsigned char *in, unsigned char *out);
+
+	EVP_CIPHER_CTX  *encrypt_ctx_;
+	EVP_CIPHER_CTX  *decrypt_ctx_;
+	bool            valid_;
+	unsigned char   encrypt_iv_[kBlockSize];
+	unsigned char   decrypt_iv_[kBlockSize];
+	unsigned char   decrypt_history_[256];
+};
+
+}
+
+#endif
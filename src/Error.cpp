@@ -4,27 +4,117 @@
 
 #include <mumble/Error.h>
 
+#include <uv.h>
+
+#include <atomic>
+#include <cstring>
+#include <set>
 #include <string>
 #include <sstream>
+#include <utility>
 
 namespace mumble {
 
+// ErrorPrivate holds the description of an Error that was
+// created from a std::string. It is shared, and never
+// modified, by all copies of the Error.
 struct ErrorPrivate {
 public:
-	ErrorPrivate();
-	std::string  domain_;
+	explicit ErrorPrivate(std::string description);
 	std::string  description_;
-	long         code_;
 };
 
-ErrorPrivate::ErrorPrivate() : code_(0) {
+ErrorPrivate::ErrorPrivate(std::string description) : description_(std::move(description)) {
+}
+
+// Interned domains are kept in a fixed-size table that is read
+// without locking. Entries are never modified once published by
+// incrementing numdomains. Should the table fill up, further
+// domains go into the overflow set, under domainlock.
+static const int kMaxDomains = 64;
+static const char *domains[kMaxDomains];
+static std::atomic<int> numdomains(0);
+static std::set<std::string> *overflow = nullptr;
+static uv_once_t domaininit = UV_ONCE_INIT;
+static uv_mutex_t domainlock;
+
+static void InitializeDomains() {
+	uv_mutex_init(&domainlock);
+	overflow = new std::set<std::string>;
+}
+
+static const char *FindDomain(const std::string &domain, int n) {
+	for (int i = 0; i < n; i++) {
+		if (domain == domains[i]) {
+			return domains[i];
+		}
+	}
+	return nullptr;
+}
+
+// InternDomain returns a copy of *domain* that remains valid
+// for the lifetime of the program, such that Errors can refer
+// to their domain by pointer. Error domains come from a small
+// set of names, so after the first Error of each domain, this
+// is a short, lock-free scan.
+static const char *InternDomain(const std::string &domain) {
+	if (domain.empty()) {
+		return nullptr;
+	}
+
+	const char *interned = FindDomain(domain, numdomains.load(std::memory_order_acquire));
+	if (interned != nullptr) {
+		return interned;
+	}
+
+	uv_once(&domaininit, InitializeDomains);
+	uv_mutex_lock(&domainlock);
+	int n = numdomains.load(std::memory_order_relaxed);
+	interned = FindDomain(domain, n);
+	if (interned == nullptr) {
+		if (n < kMaxDomains) {
+			char *copy = new char[domain.size() + 1];
+			memcpy(copy, domain.c_str(), domain.size() + 1);
+			domains[n] = copy;
+			numdomains.store(n + 1, std::memory_order_release);
+			interned = copy;
+		} else {
+			interned = overflow->insert(domain).first->c_str();
+		}
+	}
+	uv_mutex_unlock(&domainlock);
+	return interned;
 }
 
 Error Error::ErrorFromDescription(std::string domain, long code, std::string description) {
 	Error err;
-	err.priv_->domain_ = domain;
-	err.priv_->code_ = code;
-	err.priv_->description_ = description;
+	err.domain_ = InternDomain(domain);
+	err.code_ = code;
+	if (!description.empty()) {
+		err.priv_ = std::make_shared<ErrorPrivate>(std::move(description));
+	}
+	return err;
+}
+
+Error Error::ErrorFromStaticDescription(const char *domain, long code, const char *description) {
+	Error err;
+	if (domain != nullptr && *domain != '\0') {
+		err.domain_ = domain;
+	}
+	err.code_ = code;
+	if (description != nullptr && *description != '\0') {
+		err.description_ = description;
+	}
+	return err;
+}
+
+Error Error::ErrorFromCode(const char *domain, long code, ErrorDescriber describe) {
+	Error err;
+	if (domain != nullptr && *domain != '\0') {
+		err.domain_ = domain;
+	}
+	err.code_ = code;
+	err.describe_ = describe;
 	return err;
 }
 
@@ -32,43 +122,70 @@ Error Error::NoError() {
 	return Error();
 }
 
-Error::Error() : priv_(new ErrorPrivate) {
+Error::Error() : domain_(nullptr), code_(0), description_(nullptr), describe_(nullptr) {
 }
 
 Error::~Error() {
 }
 
-Error::Error(const Error &err) : priv_(new ErrorPrivate) {
-	this->priv_->domain_ = err.priv_->domain_;
-	this->priv_->code_ = err.priv_->code_;
-	this->priv_->description_ = err.priv_->description_;
+Error::Error(const Error &err)
+	: domain_(err.domain_), code_(err.code_), description_(err.description_), describe_(err.describe_), priv_(err.priv_) {
+}
+
+Error::Error(Error &&err)
+	: domain_(err.domain_), code_(err.code_), description_(err.description_), describe_(err.describe_), priv_(std::move(err.priv_)) {
+	err.domain_ = nullptr;
+	err.code_ = 0;
+	err.description_ = nullptr;
+	err.describe_ = nullptr;
 }
 
 Error& Error::operator=(Error err) {
-	std::swap((*this).priv_, err.priv_);
+	std::swap(domain_, err.domain_);
+	std::swap(code_, err.code_);
+	std::swap(description_, err.description_);
+	std::swap(describe_, err.describe_);
+	std::swap(priv_, err.priv_);
 	return *this;
 }
 
 bool Error::HasError() const {
-	return !(priv_->domain_.empty() && priv_->description_.empty() && priv_->code_ == 0L);
+	return domain_ != nullptr || code_ != 0L || description_ != nullptr || priv_ != nullptr;
 }
 
 std::string Error::Domain() const {
-	return priv_->domain_;
+	if (domain_ == nullptr) {
+		return std::string();
+	}
+	return std::string(domain_);
 }
 
 long Error::Code() const {
-	return priv_->code_;
+	return code_;
 }
 
+// Description returns the Error's description, looking
+// it up first if the Error was created by ErrorFromCode.
 std::string Error::Description() const {
-	return priv_->description_;
+	if (priv_ != nullptr) {
+		return priv_->description_;
+	}
+	if (description_ != nullptr) {
+		return std::string(description_);
+	}
+	if (describe_ != nullptr) {
+		const char *desc = describe_(code_);
+		if (desc != nullptr) {
+			return std::string(desc);
+		}
+	}
+	return std::string();
 }
 
 std::string Error::String() const {
 	std::stringstream ss;
-	ss << priv_->domain_ << ": " << priv_->description_ << " (error code: " << priv_->code_ << ")";
+	ss << Domain() << ": " << Description() << " (error code: " << code_ << ")";
 	return ss.str();
 }
 
-}
\ No newline at end of file
+}
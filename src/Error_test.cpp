@@ -0,0 +1,77 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/Error.h>
+
+#include <string>
+#include <utility>
+
+using namespace mumble;
+
+static const char *DescribeTestError(long code) {
+	return code == 42 ? "the answer" : "unknown";
+}
+
+TEST(ErrorTest, NoError) {
+	Error err = Error::NoError();
+	EXPECT_FALSE(err.HasError());
+	EXPECT_EQ(std::string(), err.Domain());
+	EXPECT_EQ(0L, err.Code());
+	EXPECT_EQ(std::string(), err.Description());
+
+	Error empty = Error::ErrorFromDescription(std::string(), 0L, std::string());
+	EXPECT_FALSE(empty.HasError());
+}
+
+TEST(ErrorTest, FromDescription) {
+	Error err = Error::ErrorFromDescription(std::string("test"), 5L, std::string("five"));
+	EXPECT_TRUE(err.HasError());
+	EXPECT_EQ(std::string("test"), err.Domain());
+	EXPECT_EQ(5L, err.Code());
+	EXPECT_EQ(std::string("five"), err.Description());
+	EXPECT_EQ(std::string("test: five (error code: 5)"), err.String());
+
+	Error desc = Error::ErrorFromDescription(std::string(), 0L, std::string("description only"));
+	EXPECT_TRUE(desc.HasError());
+}
+
+TEST(ErrorTest, FromStaticDescription) {
+	Error err = Error::ErrorFromStaticDescription("test", 0L, "static");
+	EXPECT_TRUE(err.HasError());
+	EXPECT_EQ(std::string("test"), err.Domain());
+	EXPECT_EQ(std::string("static"), err.Description());
+}
+
+TEST(ErrorTest, FromCode) {
+	Error err = Error::ErrorFromCode("test", 42L, DescribeTestError);
+	EXPECT_TRUE(err.HasError());
+	EXPECT_EQ(42L, err.Code());
+	EXPECT_EQ(std::string("the answer"), err.Description());
+	EXPECT_EQ(std::string("test: the answer (error code: 42)"), err.String());
+}
+
+TEST(ErrorTest, CopyAndMove) {
+	Error err = Error::ErrorFromDescription(std::string("test"), 7L, std::string("seven"));
+
+	Error copy(err);
+	EXPECT_EQ(err.String(), copy.String());
+
+	Error assigned;
+	assigned = err;
+	EXPECT_EQ(err.String(), assigned.String());
+
+	Error moved(std::move(copy));
+	EXPECT_EQ(err.String(), moved.String());
+	EXPECT_FALSE(copy.HasError());
+
+	assigned = std::move(moved);
+	EXPECT_EQ(err.String(), assigned.String());
+	EXPECT_FALSE(moved.HasError());
+
+	assigned = Error::NoError();
+	EXPECT_FALSE(assigned.HasError());
+	EXPECT_TRUE(err.HasError());
+}
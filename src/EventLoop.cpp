@@ -0,0 +1,287 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/EventLoop.h>
+#include "EventLoop_p.h"
+#include <mumble/Error.h>
+#include "UVUtils.h"
+#include "ThreadUtils.h"
+
+#include "uv.h"
+
+#include <string>
+#include <assert.h>
+
+namespace mumble {
+
+EventLoopOptions::EventLoopOptions() : realtime_priority(0), nice_value(0) {
+}
+
+EventLoop::EventLoop() : priv_(new EventLoopPrivate) {
+}
+
+EventLoop::~EventLoop() {
+	priv_->Stop();
+	if (priv_->caller_driven_) {
+		priv_->Join();
+	} else if (priv_->IsLoopThread()) {
+		// We're being destroyed from within one of our own
+		// callbacks. Let the thread clean up once it exits.
+		priv_->delete_on_exit_ = true;
+		priv_.release();
+	} else {
+		priv_->Join();
+	}
+}
+
+Error EventLoop::Start(const EventLoopOptions *opts) {
+	if (opts != nullptr) {
+		return priv_->Start(*opts);
+	}
+	return priv_->Start(EventLoopOptions());
+}
+
+void EventLoop::Stop() {
+	priv_->Stop();
+}
+
+EventLoopPrivate::EventLoopPrivate() : loop_(nullptr), thread_id_(0), started_(false), stopped_(false), caller_driven_(false), delete_on_exit_(false) {
+	uv_mutex_init(&tasklock_);
+}
+
+EventLoopPrivate::~EventLoopPrivate() {
+	uv_mutex_destroy(&tasklock_);
+}
+
+Error EventLoopPrivate::Start(const EventLoopOptions &opts) {
+	if (started_) {
+		return Error::ErrorFromStaticDescription(
+			"EventLoop",
+			0L,
+			"event loop already started"
+		);
+	}
+
+	stopped_ = false;
+	opts_ = opts;
+	loop_ = uv_loop_new();
+	if (loop_ == nullptr) {
+		return Error::ErrorFromStaticDescription(
+			"EventLoop",
+			0L,
+			"unable to create event loop"
+		);
+	}
+
+	int err = uv_async_init(loop_, &taskasync_, EventLoopPrivate::OnTasks);
+	if (err != UV_OK) {
+		Error uverr = UVUtils::ErrorFromLastUVError(loop_);
+		uv_loop_delete(loop_);
+		loop_ = nullptr;
+		return uverr;
+	}
+	taskasync_.data = this;
+
+	uv_sem_init(&startsem_, 0);
+	err = uv_thread_create(&thread_, EventLoopPrivate::EventLoopThread, this);
+	if (err == -1) {
+		uv_sem_destroy(&startsem_);
+		return Error::ErrorFromStaticDescription(
+			"EventLoop",
+			0L,
+			"unable to create event loop thread"
+		);
+	}
+
+	// Wait for the thread to come up, such that IsLoopThread
+	// gives correct answers once Start returns.
+	uv_sem_wait(&startsem_);
+	uv_sem_destroy(&startsem_);
+
+	if (start_err_.HasError()) {
+		uv_thread_join(&thread_);
+		return start_err_;
+	}
+
+	started_ = true;
+	return Error::NoError();
+}
+
+Error EventLoopPrivate::StartOnCurrentThread() {
+	if (started_) {
+		return Error::ErrorFromStaticDescription(
+			"EventLoop",
+			0L,
+			"event loop already started"
+		);
+	}
+
+	stopped_ = false;
+	loop_ = uv_loop_new();
+	if (loop_ == nullptr) {
+		return Error::ErrorFromStaticDescription(
+			"EventLoop",
+			0L,
+			"unable to create event loop"
+		);
+	}
+
+	int err = uv_async_init(loop_, &taskasync_, EventLoopPrivate::OnTasks);
+	if (err != UV_OK) {
+		Error uverr = UVUtils::ErrorFromLastUVError(loop_);
+		uv_loop_delete(loop_);
+		loop_ = nullptr;
+		return uverr;
+	}
+	taskasync_.data = this;
+
+	// Unlike the loop's own thread, the caller may run the loop
+	// just until something of interest happens. The task handle
+	// must not keep such runs alive by itself.
+	uv_unref(reinterpret_cast<uv_handle_t *>(&taskasync_));
+
+	caller_driven_ = true;
+	thread_id_.store(uv_thread_self());
+	started_ = true;
+	return Error::NoError();
+}
+
+void EventLoopPrivate::Stop() {
+	if (!started_) {
+		return;
+	}
+
+	if (IsLoopThread()) {
+		uv_mutex_lock(&tasklock_);
+		bool already = stopped_;
+		stopped_ = true;
+		uv_mutex_unlock(&tasklock_);
+		// Closing the task handle allows uv_run to return
+		// once all other handles on the loop are closed. Tasks
+		// that were posted before stopped_ was set are run once
+		// the handle is closed.
+		if (!already) {
+			uv_close(reinterpret_cast<uv_handle_t *>(&taskasync_), EventLoopPrivate::OnTasksClosed);
+		}
+	} else {
+		Post([this] {
+			Stop();
+		});
+	}
+}
+
+void EventLoopPrivate::Join() {
+	if (!started_) {
+		return;
+	}
+	if (caller_driven_) {
+		uv_run(loop_, UV_RUN_DEFAULT);
+		thread_id_.store(0);
+		uv_loop_delete(loop_);
+		loop_ = nullptr;
+		caller_driven_ = false;
+	} else {
+		uv_thread_join(&thread_);
+	}
+	started_ = false;
+}
+
+bool EventLoopPrivate::Post(std::function<void ()> fn) {
+	uv_mutex_lock(&tasklock_);
+	if (!started_ || stopped_) {
+		uv_mutex_unlock(&tasklock_);
+		return false;
+	}
+	tasks_.push_back(fn);
+	uv_mutex_unlock(&tasklock_);
+
+	uv_async_send(&taskasync_);
+	return true;
+}
+
+bool EventLoopPrivate::RunSync(std::function<void ()> fn) {
+	if (IsLoopThread()) {
+		fn();
+		return true;
+	}
+
+	uv_sem_t done;
+	uv_sem_init(&done, 0);
+	bool ok = Post([&fn, &done] {
+		fn();
+		uv_sem_post(&done);
+	});
+	if (ok) {
+		uv_sem_wait(&done);
+	}
+	uv_sem_destroy(&done);
+	return ok;
+}
+
+bool EventLoopPrivate::IsLoopThread() const {
+	unsigned long it = thread_id_.load();
+	return it != 0 && it == uv_thread_self();
+}
+
+void EventLoopPrivate::EventLoopThread(void *udata) {
+	EventLoopPrivate *lp = static_cast<EventLoopPrivate *>(udata);
+
+	// If the thread cannot be set up as requested, close the
+	// task handle and let the loop wind down without ever
+	// having run anything.
+	lp->start_err_ = ThreadUtils::ApplyOptions(lp->opts_);
+	if (lp->start_err_.HasError()) {
+		uv_close(reinterpret_cast<uv_handle_t *>(&lp->taskasync_), nullptr);
+	} else {
+		lp->thread_id_.store(uv_thread_self());
+	}
+	uv_sem_post(&lp->startsem_);
+
+	uv_run(lp->loop_, UV_RUN_DEFAULT);
+
+	lp->thread_id_.store(0);
+	uv_loop_delete(lp->loop_);
+	lp->loop_ = nullptr;
+
+	if (lp->delete_on_exit_) {
+		delete lp;
+	}
+}
+
+// OnTasks runs all tasks posted to the loop since the last time
+// it was woken up. Tasks posted while running are picked up by
+// the next wakeup.
+void EventLoopPrivate::OnTasks(uv_async_t *handle, int status) {
+	assert(handle != nullptr);
+	assert(handle->data != nullptr);
+
+	EventLoopPrivate *lp = static_cast<EventLoopPrivate *>(handle->data);
+
+	uv_mutex_lock(&lp->tasklock_);
+	lp->running_tasks_.swap(lp->tasks_);
+	uv_mutex_unlock(&lp->tasklock_);
+
+	for (size_t i = 0; i < lp->running_tasks_.size(); i++) {
+		lp->running_tasks_[i]();
+	}
+	lp->running_tasks_.clear();
+}
+
+// OnTasksClosed runs the tasks that were posted after the last
+// wakeup, but before the loop was stopped. No tasks can be posted
+// anymore, and callers of RunSync may be waiting for them.
+void EventLoopPrivate::OnTasksClosed(uv_handle_t *handle) {
+	EventLoopPrivate *lp = static_cast<EventLoopPrivate *>(handle->data);
+
+	std::vector<std::function<void ()>> tasks;
+	uv_mutex_lock(&lp->tasklock_);
+	tasks.swap(lp->tasks_);
+	uv_mutex_unlock(&lp->tasklock_);
+
+	for (size_t i = 0; i < tasks.size(); i++) {
+		tasks[i]();
+	}
+}
+
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_EVENTLOOP_P_H_
+#define MUMBLE_EVENTLOOP_P_H_
+
+#include <mumble/EventLoop.h>
+#include <mumble/Error.h>
+
+#include "uv.h"
+
+#include <atomic>
+#include <vector>
+#include <functional>
+
+namespace mumble {
+
+class EventLoopPrivate {
+public:
+	EventLoopPrivate();
+	~EventLoopPrivate();
+
+	Error Start(const EventLoopOptions &opts);
+	void Stop();
+	void Join();
+
+	// StartOnCurrentThread sets up the loop without a thread of
+	// its own. The calling thread becomes the loop's thread, and
+	// is responsible for running the loop with uv_run. Join runs
+	// the loop until it has stopped, and then frees it.
+	Error StartOnCurrentThread();
+
+	// Post schedules fn to be run on the loop's thread.
+	// It is safe to call Post from any thread. Returns
+	// false if the loop is not running.
+	bool Post(std::function<void ()> fn);
+
+	// RunSync runs fn on the loop's thread, and waits
+	// for it to complete. If called from the loop's thread,
+	// fn is run immediately. Returns false if the loop is
+	// not running, in which case fn is not run.
+	bool RunSync(std::function<void ()> fn);
+
+	// IsLoopThread returns true if called from the loop's thread.
+	bool IsLoopThread() const;
+
+	uv_loop_t                           *loop_;
+	uv_thread_t                         thread_;
+	std::atomic<unsigned long>          thread_id_;
+	bool                                started_;
+	bool                                stopped_;
+	bool                                caller_driven_;
+
+	// If the EventLoop is destroyed from its own thread, the
+	// thread cannot be joined. Instead, the thread takes over
+	// ownership of the EventLoopPrivate and deletes it on exit.
+	bool                                delete_on_exit_;
+
+	uv_mutex_t                          tasklock_;
+	uv_async_t                          taskasync_;
+	std::vector<std::function<void ()>> tasks_;
+	std::vector<std::function<void ()>> running_tasks_;
+
+	// The options for the loop's thread, and the result of
+	// applying them, which the thread hands back to Start.
+	EventLoopOptions                    opts_;
+	Error                               start_err_;
+	uv_sem_t                            startsem_;
+
+	static void EventLoopThread(void *udata);
+	static void OnTasks(uv_async_t *handle, int status);
+	static void OnTasksClosed(uv_handle_t *handle);
+};
+
+}
+
+#endif
@@ -0,0 +1,124 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/EventLoop.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/Error.h>
+#include "EventLoop_p.h"
+
+#include <uv.h>
+
+#include <atomic>
+#include <string>
+
+#if defined(LIBMUMBLE_OS_LINUX)
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+using namespace mumble;
+
+TEST(EventLoopTest, StartTwice) {
+	EventLoop loop;
+	ASSERT_FALSE(loop.Start().HasError());
+	EXPECT_TRUE(loop.Start().HasError());
+}
+
+TEST(EventLoopTest, BadThreadOptionsFailStart) {
+	EventLoopOptions opts;
+	opts.cpu_affinity.push_back(-1);
+
+	EventLoop loop;
+	EXPECT_TRUE(loop.Start(&opts).HasError());
+
+	// The EventLoop can still be started once
+	// the options have been fixed.
+	opts.cpu_affinity.clear();
+	EXPECT_FALSE(loop.Start(&opts).HasError());
+}
+
+// RunSyncCaller calls RunSync on a loop until the loop refuses,
+// counting the calls that were accepted and the tasks that ran.
+struct RunSyncCaller {
+	EventLoopPrivate  *loop;
+	int               accepted;
+	std::atomic<int>  ran;
+	uv_thread_t       thread;
+
+	static void Run(void *udata) {
+		RunSyncCaller *c = static_cast<RunSyncCaller *>(udata);
+		while (c->loop->RunSync([c] { c->ran++; })) {
+			c->accepted++;
+		}
+	}
+};
+
+// RunSyncDuringStop stops loops while other threads keep calling
+// RunSync on them. Every accepted call must run, and return.
+TEST(EventLoopTest, RunSyncDuringStop) {
+	const int kRounds = 50;
+	const int kCallers = 4;
+	for (int round = 0; round < kRounds; round++) {
+		EventLoopPrivate loop;
+		ASSERT_FALSE(loop.Start(EventLoopOptions()).HasError());
+
+		RunSyncCaller callers[kCallers];
+		for (int i = 0; i < kCallers; i++) {
+			callers[i].loop = &loop;
+			callers[i].accepted = 0;
+			callers[i].ran = 0;
+			ASSERT_EQ(0, uv_thread_create(&callers[i].thread, RunSyncCaller::Run, &callers[i]));
+		}
+		uint64_t start = uv_hrtime();
+		while (uv_hrtime() - start < 200000ULL) {
+		}
+		loop.Stop();
+		for (int i = 0; i < kCallers; i++) {
+			uv_thread_join(&callers[i].thread);
+			EXPECT_EQ(callers[i].accepted, callers[i].ran.load());
+		}
+		loop.Join();
+	}
+}
+
+#if defined(LIBMUMBLE_OS_LINUX)
+TEST(EventLoopTest, ThreadNameAndAffinity) {
+	EventLoopOptions opts;
+	opts.thread_name = "mumble-test-loop-with-a-long-name";
+	opts.cpu_affinity.push_back(0);
+
+	// The thread's settings are inspected through a
+	// TLSConnection, which runs on a thread of its own.
+	// Connecting to port 1 fails, but only once the
+	// thread is up and running the connection.
+	TLSConnection conn;
+	std::string name;
+	int ncpus = 0;
+	uv_sem_t done;
+	uv_sem_init(&done, 0);
+	conn.SetErrorHandler([&](const Error &err) {
+		char buf[32];
+		pthread_getname_np(pthread_self(), buf, sizeof(buf));
+		name = buf;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+		ncpus = CPU_COUNT(&set);
+		EXPECT_TRUE(CPU_ISSET(0, &set));
+		uv_sem_post(&done);
+	});
+
+	TLSConnectionOptions copts;
+	copts.thread_options = opts;
+	Error err = conn.Connect("127.0.0.1", 1, &copts);
+	ASSERT_FALSE(err.HasError());
+	uv_sem_wait(&done);
+	uv_sem_destroy(&done);
+
+	EXPECT_EQ(std::string("mumble-test-loo"), name);
+	EXPECT_EQ(1, ncpus);
+}
+#endif
@@ -0,0 +1,246 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/Executor.h>
+#include "Executor_p.h"
+#include <mumble/Error.h>
+#include "ThreadUtils.h"
+
+#include "uv.h"
+
+#include <string>
+#include <cstdio>
+#include <algorithm>
+
+namespace mumble {
+
+Executor::~Executor() {
+}
+
+WorkQueueExecutorOptions::WorkQueueExecutorOptions() : num_threads(1), max_queue_length(4096) {
+}
+
+WorkQueueExecutorStats::WorkQueueExecutorStats() : queue_length(0), executed(0), total_lag(0), max_lag(0) {
+}
+
+WorkQueueExecutor::WorkQueueExecutor() : priv_(new WorkQueueExecutorPrivate) {
+}
+
+WorkQueueExecutor::~WorkQueueExecutor() {
+	priv_->Stop();
+}
+
+Error WorkQueueExecutor::Start(const WorkQueueExecutorOptions *opts) {
+	if (opts != nullptr) {
+		return priv_->Start(*opts);
+	}
+	return priv_->Start(WorkQueueExecutorOptions());
+}
+
+void WorkQueueExecutor::Stop() {
+	priv_->Stop();
+}
+
+bool WorkQueueExecutor::Execute(std::function<void ()> fn) {
+	return priv_->Execute(fn);
+}
+
+WorkQueueExecutorStats WorkQueueExecutor::Stats() const {
+	return priv_->Stats();
+}
+
+WorkQueueExecutorPrivate::WorkQueueExecutorPrivate() : started_(false), stopping_(false), executed_(0), total_lag_(0), max_lag_(0) {
+	uv_mutex_init(&lock_);
+	uv_cond_init(&notempty_);
+	uv_cond_init(&notfull_);
+}
+
+WorkQueueExecutorPrivate::~WorkQueueExecutorPrivate() {
+	uv_cond_destroy(&notfull_);
+	uv_cond_destroy(&notempty_);
+	uv_mutex_destroy(&lock_);
+}
+
+Error WorkQueueExecutorPrivate::Start(const WorkQueueExecutorOptions &opts) {
+	if (started_) {
+		return Error::ErrorFromStaticDescription(
+			"WorkQueueExecutor",
+			0L,
+			"executor already started"
+		);
+	}
+	if (opts.num_threads < 1 || opts.max_queue_length < 1) {
+		return Error::ErrorFromStaticDescription(
+			"WorkQueueExecutor",
+			0L,
+			"num_threads and max_queue_length must be positive"
+		);
+	}
+
+	opts_ = opts;
+	stopping_ = false;
+	start_err_ = Error::NoError();
+	threads_.resize(opts_.num_threads);
+	worker_args_.resize(opts_.num_threads);
+	started_ = true;
+
+	// Start the workers one at a time, such that each can
+	// report whether it was able to apply its thread options.
+	uv_sem_init(&startsem_, 0);
+	int nstarted = 0;
+	Error err;
+	for (int i = 0; i < opts_.num_threads; i++) {
+		worker_args_[i].priv = this;
+		worker_args_[i].index = i;
+		if (uv_thread_create(&threads_[i], WorkQueueExecutorPrivate::WorkerThread, &worker_args_[i]) == -1) {
+			err = Error::ErrorFromStaticDescription(
+				"WorkQueueExecutor",
+				0L,
+				"unable to create worker thread"
+			);
+			break;
+		}
+		nstarted++;
+		uv_sem_wait(&startsem_);
+		if (start_err_.HasError()) {
+			err = start_err_;
+			break;
+		}
+	}
+	uv_sem_destroy(&startsem_);
+
+	if (err.HasError()) {
+		threads_.resize(nstarted);
+		Stop();
+		return err;
+	}
+
+	return Error::NoError();
+}
+
+void WorkQueueExecutorPrivate::Stop() {
+	uv_mutex_lock(&lock_);
+	if (!started_ || stopping_) {
+		uv_mutex_unlock(&lock_);
+		return;
+	}
+	stopping_ = true;
+	uv_cond_broadcast(&notempty_);
+	uv_cond_broadcast(&notfull_);
+	bool worker = IsWorkerThread();
+	uv_mutex_unlock(&lock_);
+
+	// A worker cannot wait for itself. The workers
+	// still exit once the queue has been drained.
+	if (worker) {
+		return;
+	}
+
+	for (size_t i = 0; i < threads_.size(); i++) {
+		uv_thread_join(&threads_[i]);
+	}
+	threads_.clear();
+	thread_ids_.clear();
+	started_ = false;
+}
+
+bool WorkQueueExecutorPrivate::Execute(std::function<void ()> fn) {
+	uv_mutex_lock(&lock_);
+	if (!started_ || stopping_) {
+		uv_mutex_unlock(&lock_);
+		return false;
+	}
+
+	// Workers are exempt from the queue limit. If all workers were
+	// to wait for room in the queue, no room would ever be made.
+	while (queue_.size() >= static_cast<size_t>(opts_.max_queue_length) && !stopping_ && !IsWorkerThread()) {
+		uv_cond_wait(&notfull_, &lock_);
+	}
+
+	// Stop was called while waiting for room. The workers
+	// may already have drained the queue and exited.
+	if (stopping_) {
+		uv_mutex_unlock(&lock_);
+		return false;
+	}
+
+	Task task;
+	task.fn = fn;
+	task.queue_time = uv_hrtime();
+	queue_.push_back(task);
+	uv_cond_signal(&notempty_);
+	uv_mutex_unlock(&lock_);
+	return true;
+}
+
+WorkQueueExecutorStats WorkQueueExecutorPrivate::Stats() {
+	WorkQueueExecutorStats stats;
+	uv_mutex_lock(&lock_);
+	stats.queue_length = static_cast<int>(queue_.size());
+	stats.executed = executed_;
+	stats.total_lag = total_lag_;
+	stats.max_lag = max_lag_;
+	uv_mutex_unlock(&lock_);
+	return stats;
+}
+
+bool WorkQueueExecutorPrivate::IsWorkerThread() const {
+	unsigned long self = uv_thread_self();
+	return std::find(thread_ids_.begin(), thread_ids_.end(), self) != thread_ids_.end();
+}
+
+void WorkQueueExecutorPrivate::WorkerThread(void *udata) {
+	WorkerArgs *args = static_cast<WorkerArgs *>(udata);
+	WorkQueueExecutorPrivate *wp = args->priv;
+
+	EventLoopOptions thread_opts = wp->opts_.thread_options;
+	if (wp->opts_.num_threads > 1 && !thread_opts.thread_name.empty()) {
+		char suffix[16];
+		snprintf(suffix, sizeof(suffix), "-%d", args->index);
+		thread_opts.thread_name += suffix;
+	}
+	Error err = ThreadUtils::ApplyOptions(thread_opts);
+
+	uv_mutex_lock(&wp->lock_);
+	wp->thread_ids_.push_back(uv_thread_self());
+	uv_mutex_unlock(&wp->lock_);
+
+	if (err.HasError()) {
+		wp->start_err_ = err;
+		uv_sem_post(&wp->startsem_);
+		return;
+	}
+	uv_sem_post(&wp->startsem_);
+
+	uv_mutex_lock(&wp->lock_);
+	while (true) {
+		while (wp->queue_.empty() && !wp->stopping_) {
+			uv_cond_wait(&wp->notempty_, &wp->lock_);
+		}
+		if (wp->queue_.empty()) {
+			break;
+		}
+
+		Task task;
+		task.fn.swap(wp->queue_.front().fn);
+		task.queue_time = wp->queue_.front().queue_time;
+		if (wp->queue_.size() == static_cast<size_t>(wp->opts_.max_queue_length)) {
+			uv_cond_signal(&wp->notfull_);
+		}
+		wp->queue_.pop_front();
+
+		uint64_t lag = uv_hrtime() - task.queue_time;
+		wp->executed_++;
+		wp->total_lag_ += lag;
+		wp->max_lag_ = std::max(wp->max_lag_, lag);
+		uv_mutex_unlock(&wp->lock_);
+
+		task.fn();
+
+		uv_mutex_lock(&wp->lock_);
+	}
+	uv_mutex_unlock(&wp->lock_);
+}
+
+}
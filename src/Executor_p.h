@@ -0,0 +1,72 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_EXECUTOR_P_H_
+#define MUMBLE_EXECUTOR_P_H_
+
+#include <mumble/Executor.h>
+#include <mumble/Error.h>
+
+#include "uv.h"
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+namespace mumble {
+
+class WorkQueueExecutorPrivate {
+public:
+	WorkQueueExecutorPrivate();
+	~WorkQueueExecutorPrivate();
+
+	Error Start(const WorkQueueExecutorOptions &opts);
+	void Stop();
+	bool Execute(std::function<void ()> fn);
+	WorkQueueExecutorStats Stats();
+
+	// IsWorkerThread returns true if called from one of the
+	// worker threads. Must be called with lock_ held.
+	bool IsWorkerThread() const;
+
+	struct Task {
+		std::function<void ()>  fn;
+		uint64_t                queue_time;
+	};
+
+	// WorkerArgs is handed to each worker thread on startup.
+	struct WorkerArgs {
+		WorkQueueExecutorPrivate  *priv;
+		int                       index;
+	};
+
+	WorkQueueExecutorOptions            opts_;
+
+	// lock_ protects everything below. notempty_ is signalled when
+	// a task is queued or the executor is stopping, and notfull_ when
+	// a task is taken off a full queue.
+	uv_mutex_t                          lock_;
+	uv_cond_t                           notempty_;
+	uv_cond_t                           notfull_;
+	std::deque<Task>                    queue_;
+	bool                                started_;
+	bool                                stopping_;
+
+	std::vector<uv_thread_t>            threads_;
+	std::vector<unsigned long>          thread_ids_;
+	std::vector<WorkerArgs>             worker_args_;
+	uv_sem_t                            startsem_;
+	Error                               start_err_;
+
+	uint64_t                            executed_;
+	uint64_t                            total_lag_;
+	uint64_t                            max_lag_;
+
+	static void WorkerThread(void *udata);
+};
+
+}
+
+#endif
@@ -0,0 +1,210 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/Executor.h>
+#include <mumble/TLSListener.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/X509Certificate.h>
+#include <mumble/ByteArray.h>
+
+#include "HandlerStrand.h"
+
+#include <uv.h>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace mumble;
+
+TEST(WorkQueueExecutorTest, StopRunsQueuedTasks) {
+	WorkQueueExecutorOptions opts;
+	opts.num_threads = 4;
+
+	WorkQueueExecutor executor;
+	ASSERT_FALSE(executor.Start(&opts).HasError());
+
+	std::atomic<int> ran(0);
+	for (int i = 0; i < 1000; i++) {
+		executor.Execute([&ran] {
+			ran++;
+		});
+	}
+	executor.Stop();
+
+	EXPECT_EQ(1000, ran.load());
+	WorkQueueExecutorStats stats = executor.Stats();
+	EXPECT_EQ(1000U, stats.executed);
+	EXPECT_EQ(0, stats.queue_length);
+	EXPECT_GE(stats.max_lag * 1000, stats.total_lag);
+}
+
+TEST(WorkQueueExecutorTest, BoundedQueueBlocks) {
+	WorkQueueExecutorOptions opts;
+	opts.max_queue_length = 2;
+
+	WorkQueueExecutor executor;
+	ASSERT_FALSE(executor.Start(&opts).HasError());
+
+	// Park the only worker, then fill the queue.
+	uv_sem_t parked, release;
+	uv_sem_init(&parked, 0);
+	uv_sem_init(&release, 0);
+	executor.Execute([&] {
+		uv_sem_post(&parked);
+		uv_sem_wait(&release);
+	});
+	uv_sem_wait(&parked);
+	executor.Execute([] {});
+	executor.Execute([] {});
+	EXPECT_EQ(2, executor.Stats().queue_length);
+
+	// A third task must wait for room in the queue.
+	std::atomic<bool> queued(false);
+	uv_thread_t thread;
+	struct Args {
+		WorkQueueExecutor *executor;
+		std::atomic<bool> *queued;
+	} args = { &executor, &queued };
+	uv_thread_create(&thread, [](void *udata) {
+		Args *a = static_cast<Args *>(udata);
+		a->executor->Execute([] {});
+		a->queued->store(true);
+	}, &args);
+
+	uv_sleep(50);
+	EXPECT_FALSE(queued.load());
+	uv_sem_post(&release);
+	uv_thread_join(&thread);
+	EXPECT_TRUE(queued.load());
+
+	executor.Stop();
+	EXPECT_EQ(4U, executor.Stats().executed);
+	uv_sem_destroy(&parked);
+	uv_sem_destroy(&release);
+}
+
+TEST(WorkQueueExecutorTest, BadOptions) {
+	WorkQueueExecutorOptions opts;
+	opts.num_threads = 0;
+
+	WorkQueueExecutor executor;
+	EXPECT_TRUE(executor.Start(&opts).HasError());
+}
+
+TEST(WorkQueueExecutorTest, ExecuteAfterStopFails) {
+	WorkQueueExecutor executor;
+	EXPECT_FALSE(executor.Execute([] {}));
+
+	ASSERT_FALSE(executor.Start().HasError());
+	EXPECT_TRUE(executor.Execute([] {}));
+	executor.Stop();
+	EXPECT_FALSE(executor.Execute([] {}));
+	EXPECT_EQ(1U, executor.Stats().executed);
+}
+
+// RecoversFromDroppedRun posts to a strand while its Executor is
+// stopped, and checks that the strand runs again once it is restarted.
+TEST(HandlerStrandTest, RecoversFromDroppedRun) {
+	WorkQueueExecutor executor;
+	std::shared_ptr<HandlerStrand> strand = std::make_shared<HandlerStrand>(&executor);
+
+	bool dropped_ran = false;
+	strand->Post([&dropped_ran] {
+		dropped_ran = true;
+	});
+	EXPECT_EQ(0, strand->Stats().queue_length);
+
+	ASSERT_FALSE(executor.Start().HasError());
+	bool ran = false;
+	strand->Post([&ran] {
+		ran = true;
+	});
+	executor.Stop();
+
+	EXPECT_TRUE(ran);
+	EXPECT_FALSE(dropped_ran);
+	EXPECT_EQ(1U, strand->Stats().executed);
+}
+
+// HandlersStayInOrder checks that the handlers of a TLSConnection run
+// in order, and off the I/O thread, on an Executor with many threads.
+TEST(WorkQueueExecutorTest, HandlersStayInOrder) {
+	const int kMessages = 200;
+
+	X509Certificate cert = X509Certificate::GenerateSelfSignedCertificate("WorkQueueExecutorTest");
+	TLSListener listener;
+	listener.SetAcceptHandler([](TLSConnection &conn) {
+		TLSConnection *cp = &conn;
+		conn.SetReadHandler([cp](const ByteArray &buf) {
+			cp->Write(buf);
+		});
+	});
+	ASSERT_FALSE(listener.Listen("127.0.0.1", 0, cert, nullptr).HasError());
+
+	WorkQueueExecutorOptions eopts;
+	eopts.num_threads = 4;
+	WorkQueueExecutor executor;
+	ASSERT_FALSE(executor.Start(&eopts).HasError());
+
+	TLSConnection conn;
+	std::string received;
+	std::vector<std::string> events;
+	std::atomic<int> completed(0);
+	uv_sem_t done;
+	uv_sem_init(&done, 0);
+
+	conn.SetChainVerifyHandler([](const std::vector<X509Certificate> &chain) {
+		return true;
+	});
+	conn.SetEstablishedHandler([&] {
+		events.push_back("established");
+		for (int i = 0; i < kMessages; i++) {
+			char c = static_cast<char>('a' + i % 26);
+			conn.Write(ByteArray(&c, 1), TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE,
+			           [&completed](const Error &err, const TLSConnectionWriteInfo &info) {
+				completed++;
+			});
+		}
+	});
+	conn.SetReadHandler([&](const ByteArray &buf) {
+		// A slow handler must not reorder or drop anything.
+		uv_sleep(1);
+		received.append(buf.ConstData(), buf.Length());
+		if (received.size() == static_cast<size_t>(kMessages)) {
+			conn.Disconnect();
+		}
+	});
+	conn.SetDisconnectHandler([&](bool local) {
+		events.push_back("disconnected");
+		uv_sem_post(&done);
+	});
+	conn.SetErrorHandler([&](const Error &err) {
+		events.push_back("error");
+		uv_sem_post(&done);
+	});
+
+	TLSConnectionOptions copts;
+	copts.executor = &executor;
+	ASSERT_FALSE(conn.Connect("127.0.0.1", listener.Port(), &copts).HasError());
+	uv_sem_wait(&done);
+	uv_sem_destroy(&done);
+
+	ASSERT_EQ(static_cast<size_t>(kMessages), received.size());
+	for (int i = 0; i < kMessages; i++) {
+		EXPECT_EQ(static_cast<char>('a' + i % 26), received[i]);
+	}
+	ASSERT_EQ(2U, events.size());
+	EXPECT_EQ(std::string("established"), events[0]);
+	EXPECT_EQ(std::string("disconnected"), events[1]);
+	EXPECT_EQ(kMessages, completed.load());
+
+	TLSConnectionHandlerStats stats = conn.HandlerStats();
+	EXPECT_GT(stats.executed, static_cast<uint64_t>(kMessages / 2));
+	EXPECT_GT(stats.max_lag, 0U);
+}
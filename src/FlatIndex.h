@@ -0,0 +1,137 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_FLATINDEX_H_
+#define MUMBLE_FLATINDEX_H_
+
+#include <vector>
+#include <stdint.h>
+
+namespace mumble {
+
+// FlatIndex maps uint32_t keys, such as channel ids or user
+// sessions, to positions in a table kept elsewhere. It is an
+// open addressing hash table with linear probing, stored in a
+// single array, so lookups touch one or two cache lines.
+class FlatIndex {
+public:
+	FlatIndex() : size_(0) {}
+
+	// Find returns the value stored for *key*, or -1.
+	int Find(uint32_t key) const {
+		if (slots_.empty()) {
+			return -1;
+		}
+		size_t mask = slots_.size() - 1;
+		for (size_t i = Hash(key) & mask; ; i = (i + 1) & mask) {
+			const Slot &s = slots_[i];
+			if (s.value < 0) {
+				return -1;
+			}
+			if (s.key == key) {
+				return s.value;
+			}
+		}
+	}
+
+	// Set stores *value*, which must not be negative, for *key*.
+	void Set(uint32_t key, int value) {
+		if ((size_ + 1) * 4 > slots_.size() * 3) {
+			Grow();
+		}
+		size_t mask = slots_.size() - 1;
+		for (size_t i = Hash(key) & mask; ; i = (i + 1) & mask) {
+			Slot &s = slots_[i];
+			if (s.value < 0) {
+				s.key = key;
+				s.value = value;
+				size_++;
+				return;
+			}
+			if (s.key == key) {
+				s.value = value;
+				return;
+			}
+		}
+	}
+
+	// Erase removes *key*. Entries that follow it in the same
+	// probe sequence are shifted back, so no tombstones are left.
+	void Erase(uint32_t key) {
+		if (slots_.empty()) {
+			return;
+		}
+		size_t mask = slots_.size() - 1;
+		size_t i = Hash(key) & mask;
+		for (;; i = (i + 1) & mask) {
+			if (slots_[i].value < 0) {
+				return;
+			}
+			if (slots_[i].key == key) {
+				break;
+			}
+		}
+		size_--;
+		size_t j = i;
+		for (;;) {
+			slots_[i].value = -1;
+			for (;;) {
+				j = (j + 1) & mask;
+				if (slots_[j].value < 0) {
+					return;
+				}
+				// Move the entry at j into the hole at i, unless
+				// its home slot lies cyclically within (i, j].
+				size_t home = Hash(slots_[j].key) & mask;
+				if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) {
+					continue;
+				}
+				break;
+			}
+			slots_[i] = slots_[j];
+			i = j;
+		}
+	}
+
+	void Clear() {
+		slots_.clear();
+		size_ = 0;
+	}
+
+	size_t Size() const {
+		return size_;
+	}
+
+private:
+	struct Slot {
+		Slot() : key(0), value(-1) {}
+		uint32_t  key;
+		int       value;
+	};
+
+	static size_t Hash(uint32_t key) {
+		// Channel ids and sessions are mostly small and sequential,
+		// so spread them out before masking.
+		return static_cast<size_t>((key * 2654435761U) ^ (key >> 16));
+	}
+
+	void Grow() {
+		std::vector<Slot> old;
+		old.swap(slots_);
+		slots_.resize(old.empty() ? 16 : old.size() * 2);
+		size_ = 0;
+		for (size_t i = 0; i < old.size(); i++) {
+			if (old[i].value >= 0) {
+				Set(old[i].key, old[i].value);
+			}
+		}
+	}
+
+	std::vector<Slot>  slots_;
+	size_t             size_;
+};
+
+}
+
+#endif
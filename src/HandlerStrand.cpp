@@ -0,0 +1,86 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "HandlerStrand.h"
+#include <mumble/Executor.h>
+#include <mumble/TLSConnection.h>
+
+#include "uv.h"
+
+#include <algorithm>
+
+namespace mumble {
+
+HandlerStrand::HandlerStrand(Executor *executor)
+	: executor_(executor), scheduled_(false), executed_(0), total_lag_(0), max_lag_(0) {
+	uv_mutex_init(&lock_);
+}
+
+HandlerStrand::~HandlerStrand() {
+	uv_mutex_destroy(&lock_);
+}
+
+void HandlerStrand::Post(std::function<void ()> fn) {
+	Task task;
+	task.fn.swap(fn);
+	task.queue_time = uv_hrtime();
+
+	uv_mutex_lock(&lock_);
+	tasks_.push_back(task);
+	bool schedule = !scheduled_;
+	scheduled_ = true;
+	uv_mutex_unlock(&lock_);
+
+	if (schedule) {
+		std::shared_ptr<HandlerStrand> self = shared_from_this();
+		bool ok = executor_->Execute([self] {
+			self->Run();
+		});
+		if (!ok) {
+			// The Executor will never run what is queued. Drop it,
+			// and let the next Post try the Executor again.
+			std::deque<Task> dropped;
+			uv_mutex_lock(&lock_);
+			dropped.swap(tasks_);
+			scheduled_ = false;
+			uv_mutex_unlock(&lock_);
+		}
+	}
+}
+
+TLSConnectionHandlerStats HandlerStrand::Stats() {
+	TLSConnectionHandlerStats stats;
+	uv_mutex_lock(&lock_);
+	stats.queue_length = static_cast<int>(tasks_.size());
+	stats.executed = executed_;
+	stats.total_lag = total_lag_;
+	stats.max_lag = max_lag_;
+	uv_mutex_unlock(&lock_);
+	return stats;
+}
+
+// Run runs queued functions until the strand is empty.
+void HandlerStrand::Run() {
+	uv_mutex_lock(&lock_);
+	while (!tasks_.empty()) {
+		Task task;
+		task.fn.swap(tasks_.front().fn);
+		task.queue_time = tasks_.front().queue_time;
+		tasks_.pop_front();
+
+		uint64_t lag = uv_hrtime() - task.queue_time;
+		executed_++;
+		total_lag_ += lag;
+		max_lag_ = std::max(max_lag_, lag);
+		uv_mutex_unlock(&lock_);
+
+		task.fn();
+
+		uv_mutex_lock(&lock_);
+	}
+	scheduled_ = false;
+	uv_mutex_unlock(&lock_);
+}
+
+}
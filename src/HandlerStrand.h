@@ -0,0 +1,66 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_HANDLER_STRAND_H_
+#define MUMBLE_HANDLER_STRAND_H_
+
+#include <mumble/Executor.h>
+#include <mumble/TLSConnection.h>
+
+#include "uv.h"
+
+#include <memory>
+#include <deque>
+#include <functional>
+#include <stdint.h>
+
+namespace mumble {
+
+// HandlerStrand runs functions on an Executor, one at a time,
+// and in the order they were posted, regardless of how many
+// threads the Executor runs them on.
+//
+// Only a single function is handed to the Executor at a time.
+// It runs everything that has been posted to the strand, and
+// keeps the strand alive while doing so.
+class HandlerStrand : public std::enable_shared_from_this<HandlerStrand> {
+public:
+	explicit HandlerStrand(Executor *executor);
+	~HandlerStrand();
+
+	// Post queues fn to be run on the strand's Executor.
+	// It is safe to call Post from any thread. If the Executor
+	// drops the strand's run, everything queued is dropped.
+	void Post(std::function<void ()> fn);
+
+	// Stats returns the strand's queue statistics.
+	TLSConnectionHandlerStats Stats();
+
+private:
+	HandlerStrand(const HandlerStrand &);
+	HandlerStrand& operator=(HandlerStrand);
+
+	void Run();
+
+	struct Task {
+		std::function<void ()>  fn;
+		uint64_t                queue_time;
+	};
+
+	Executor           *executor_;
+
+	// lock_ protects everything below. scheduled_ is true
+	// while a call to Run is queued on, or running on, the
+	// Executor.
+	uv_mutex_t         lock_;
+	std::deque<Task>   tasks_;
+	bool               scheduled_;
+	uint64_t           executed_;
+	uint64_t           total_lag_;
+	uint64_t           max_lag_;
+};
+
+}
+
+#endif
@@ -0,0 +1,49 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/JitterBuffer.h>
+#include "JitterBuffer_p.h"
+
+namespace mumble {
+
+JitterBufferOptions::JitterBufferOptions()
+	: frame_ms(10), capacity(64), max_packet_size(1024), min_delay_ms(20), max_delay_ms(300) {
+}
+
+JitterBufferStats::JitterBufferStats()
+	: good(0), late(0), lost(0), buffered(0), jitter_ms(0.0f), delay_ms(0) {
+}
+
+JitterBuffer::JitterBuffer(const JitterBufferOptions *opts)
+	: priv_(new JitterBufferPrivate(opts != nullptr ? *opts : JitterBufferOptions())) {
+}
+
+JitterBuffer::~JitterBuffer() {
+}
+
+bool JitterBuffer::Put(const ByteView &packet, uint64_t now_ms) {
+	return priv_->Put(packet, now_ms);
+}
+
+JitterBufferStatus JitterBuffer::Pop(uint32_t session, uint64_t now_ms, VoicePacket *packet, int *frames) {
+	return priv_->Pop(session, now_ms, packet, frames);
+}
+
+void JitterBuffer::Remove(uint32_t session) {
+	priv_->Remove(session);
+}
+
+void JitterBuffer::Clear() {
+	priv_->Clear();
+}
+
+JitterBufferStats JitterBuffer::Stats() const {
+	return priv_->Stats();
+}
+
+bool JitterBuffer::SpeakerStats(uint32_t session, JitterBufferStats *stats) const {
+	return priv_->SpeakerStats(session, stats);
+}
+
+}
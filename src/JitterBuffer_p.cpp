@@ -0,0 +1,297 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "JitterBuffer_p.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace mumble {
+
+// kDelayPerJitter is the delay, as a multiple of the measured
+// jitter, that the first packet of a transmission is held back.
+static const float kDelayPerJitter = 4.0f;
+
+// kOpusFrameSamples holds the number of samples, at 48 kHz, of
+// each frame of an Opus packet, by the configuration in the upper
+// five bits of its TOC byte: SILK, hybrid and CELT modes, in turn.
+static const int kOpusFrameSamples[32] = {
+	480, 960, 1920, 2880, 480, 960, 1920, 2880, 480, 960, 1920, 2880,
+	480, 960, 480, 960,
+	120, 240, 480, 960, 120, 240, 480, 960, 120, 240, 480, 960, 120, 240, 480, 960,
+};
+
+JitterBufferPrivate::JitterBufferPrivate(const JitterBufferOptions &opts) : opts_(opts) {
+	opts_.frame_ms = std::max(opts_.frame_ms, 1);
+	opts_.max_packet_size = std::max(opts_.max_packet_size, 1);
+	int capacity = 2;
+	while (capacity < opts_.capacity) {
+		capacity *= 2;
+	}
+	opts_.capacity = capacity;
+	mask_ = static_cast<uint64_t>(capacity - 1);
+	opts_.max_delay_ms = std::min(opts_.max_delay_ms, capacity * opts_.frame_ms / 2);
+	opts_.min_delay_ms = std::min(std::max(opts_.min_delay_ms, 0), opts_.max_delay_ms);
+	uv_mutex_init(&lock_);
+}
+
+JitterBufferPrivate::~JitterBufferPrivate() {
+	uv_mutex_destroy(&lock_);
+}
+
+bool JitterBufferPrivate::Put(const ByteView &packet, uint64_t now_ms) {
+	VoicePacket vp;
+	if (packet.Length() > opts_.max_packet_size || !vp.Parse(packet, true) || vp.type == VOICE_PACKET_TYPE_PING) {
+		return false;
+	}
+	uv_mutex_lock(&lock_);
+	bool ok = Store(FindOrAdd(vp.session), vp, packet, now_ms);
+	uv_mutex_unlock(&lock_);
+	return ok;
+}
+
+JitterBufferStatus JitterBufferPrivate::Pop(uint32_t session, uint64_t now_ms, VoicePacket *packet, int *frames) {
+	JitterBufferStatus status = JITTER_BUFFER_EMPTY;
+	uv_mutex_lock(&lock_);
+	int i = index_.Find(session);
+	if (i >= 0) {
+		status = Play(&speakers_[i], now_ms, packet, frames);
+	}
+	uv_mutex_unlock(&lock_);
+	return status;
+}
+
+void JitterBufferPrivate::Remove(uint32_t session) {
+	uv_mutex_lock(&lock_);
+	int i = index_.Find(session);
+	if (i >= 0) {
+		int last = static_cast<int>(speakers_.size()) - 1;
+		if (i != last) {
+			std::swap(speakers_[i], speakers_[last]);
+			index_.Set(speakers_[i].session, i);
+		}
+		speakers_.pop_back();
+		index_.Erase(session);
+	}
+	uv_mutex_unlock(&lock_);
+}
+
+void JitterBufferPrivate::Clear() {
+	uv_mutex_lock(&lock_);
+	speakers_.clear();
+	index_.Clear();
+	uv_mutex_unlock(&lock_);
+}
+
+JitterBufferStats JitterBufferPrivate::Stats() const {
+	uv_mutex_lock(&lock_);
+	JitterBufferStats stats = totals_;
+	stats.buffered = 0;
+	for (size_t i = 0; i < speakers_.size(); i++) {
+		stats.buffered += speakers_[i].buffered;
+	}
+	uv_mutex_unlock(&lock_);
+	return stats;
+}
+
+bool JitterBufferPrivate::SpeakerStats(uint32_t session, JitterBufferStats *stats) const {
+	uv_mutex_lock(&lock_);
+	int i = index_.Find(session);
+	if (i >= 0) {
+		const JitterSpeaker &sp = speakers_[i];
+		*stats = sp.stats;
+		stats->buffered = sp.buffered;
+		stats->jitter_ms = sp.jitter;
+		stats->delay_ms = Delay(sp);
+	}
+	uv_mutex_unlock(&lock_);
+	return i >= 0;
+}
+
+JitterSpeaker *JitterBufferPrivate::FindOrAdd(uint32_t session) {
+	int i = index_.Find(session);
+	if (i >= 0) {
+		return &speakers_[i];
+	}
+	index_.Set(session, static_cast<int>(speakers_.size()));
+	speakers_.push_back(JitterSpeaker());
+	JitterSpeaker &sp = speakers_.back();
+	sp.session = session;
+	sp.slots.resize(opts_.capacity);
+	sp.data.resize(static_cast<size_t>(opts_.capacity) * opts_.max_packet_size);
+	sp.out.resize(opts_.max_packet_size);
+	return &sp;
+}
+
+bool JitterBufferPrivate::Store(JitterSpeaker *sp, const VoicePacket &vp, const ByteView &packet, uint64_t now_ms) {
+	uint64_t seq = vp.sequence;
+	uint64_t capacity = mask_ + 1;
+	bool behind = seq < sp->next;
+	bool near = behind ? sp->next - seq < capacity : seq - sp->next < capacity;
+	JitterSlot &slot = sp->slots[seq & mask_];
+
+	int64_t transit = static_cast<int64_t>(now_ms) - static_cast<int64_t>(seq * opts_.frame_ms);
+	if (sp->playing && near) {
+		int64_t d = transit - sp->last_transit;
+		sp->jitter += (static_cast<float>(d < 0 ? -d : d) - sp->jitter) / 16.0f;
+		sp->last_transit = transit;
+	}
+
+	if (behind && near) {
+		// The packet's turn has passed. If it was given up for
+		// lost, it is counted as late instead, as CryptState does.
+		if (slot.state == JitterSlot::LOST && slot.sequence == seq) {
+			slot.state = JitterSlot::EMPTY;
+			sp->stats.late++;
+			totals_.late++;
+			if (sp->stats.lost > 0) {
+				sp->stats.lost--;
+				totals_.lost--;
+			}
+			return false;
+		}
+		// Until playout begins, the delay is there to absorb packets
+		// that overtook this one, so playout starts from it instead.
+		// The packets buffered must all stay within the ring.
+		if (!sp->playing || now_ms >= sp->due) {
+			return false;
+		}
+		for (uint64_t s = seq; s < sp->next; s++) {
+			if (sp->slots[s & mask_].state == JitterSlot::PACKET) {
+				return false;
+			}
+		}
+		sp->next = seq;
+	} else if (!sp->playing || !near) {
+		// A new transmission, or one whose sequence numbers
+		// jumped further than the ring reaches.
+		Stop(sp);
+		Start(sp, seq, now_ms);
+	}
+	sp->last_arrival = now_ms;
+
+	if (slot.state == JitterSlot::PACKET) {
+		return false;
+	}
+	memcpy(&sp->data[(seq & mask_) * opts_.max_packet_size], packet.ConstData(), packet.Length());
+	slot.sequence = seq;
+	slot.state = JitterSlot::PACKET;
+	slot.len = packet.Length();
+	slot.frames = FramesOf(vp);
+	slot.terminator = vp.terminator;
+	sp->buffered++;
+	sp->stats.good++;
+	totals_.good++;
+	return true;
+}
+
+JitterBufferStatus JitterBufferPrivate::Play(JitterSpeaker *sp, uint64_t now_ms, VoicePacket *packet, int *frames) {
+	if (!sp->playing || now_ms < sp->due) {
+		return JITTER_BUFFER_EMPTY;
+	}
+	if (sp->buffered == 0) {
+		// Nothing is left to play. If nothing arrives for longer
+		// than the maximum delay, the terminator was lost.
+		if (now_ms - sp->last_arrival > static_cast<uint64_t>(opts_.max_delay_ms)) {
+			Stop(sp);
+		}
+		return JITTER_BUFFER_EMPTY;
+	}
+
+	JitterSlot &slot = sp->slots[sp->next & mask_];
+	if (slot.state != JitterSlot::PACKET) {
+		// A later packet has arrived, so give up on this one, and on
+		// as much of the gap up to the later packet as a packet spans.
+		int gap = 1;
+		while (gap < opts_.capacity && sp->slots[(sp->next + gap) & mask_].state != JitterSlot::PACKET) {
+			gap++;
+		}
+		slot.sequence = sp->next;
+		slot.state = JitterSlot::LOST;
+		*frames = std::min(gap, sp->step);
+		sp->next += *frames;
+		sp->stats.lost++;
+		totals_.lost++;
+		return JITTER_BUFFER_LOST;
+	}
+
+	memcpy(&sp->out[0], &sp->data[(sp->next & mask_) * opts_.max_packet_size], slot.len);
+	packet->Parse(ByteView(&sp->out[0], slot.len), true);
+	*frames = slot.frames;
+	slot.state = JitterSlot::EMPTY;
+	sp->buffered--;
+	sp->step = slot.frames;
+	// Packets that overlap the one played are dropped, so that
+	// no buffered packet falls behind next.
+	for (int i = 1; i < slot.frames && sp->buffered > 0; i++) {
+		JitterSlot &skipped = sp->slots[(sp->next + i) & mask_];
+		if (skipped.state == JitterSlot::PACKET) {
+			skipped.state = JitterSlot::EMPTY;
+			sp->buffered--;
+		}
+	}
+	sp->next += slot.frames;
+	if (slot.terminator) {
+		// The transmission ends here, unless packets of the
+		// next one have arrived already; those are played on.
+		if (sp->buffered == 0) {
+			Stop(sp);
+		} else {
+			while (sp->slots[sp->next & mask_].state != JitterSlot::PACKET) {
+				sp->next++;
+			}
+		}
+	}
+	return JITTER_BUFFER_PACKET;
+}
+
+void JitterBufferPrivate::Start(JitterSpeaker *sp, uint64_t sequence, uint64_t now_ms) {
+	sp->playing = true;
+	sp->next = sequence;
+	sp->due = now_ms + Delay(*sp);
+	sp->last_transit = static_cast<int64_t>(now_ms) - static_cast<int64_t>(sequence * opts_.frame_ms);
+}
+
+void JitterBufferPrivate::Stop(JitterSpeaker *sp) {
+	// Markers of lost packets are kept, so that they are
+	// still counted as late if they turn up.
+	for (size_t i = 0; i < sp->slots.size() && sp->buffered > 0; i++) {
+		if (sp->slots[i].state == JitterSlot::PACKET) {
+			sp->slots[i].state = JitterSlot::EMPTY;
+			sp->buffered--;
+		}
+	}
+	sp->playing = false;
+}
+
+int JitterBufferPrivate::Delay(const JitterSpeaker &sp) const {
+	int delay = static_cast<int>(kDelayPerJitter * sp.jitter + 0.5f);
+	return std::min(std::max(delay, opts_.min_delay_ms), opts_.max_delay_ms);
+}
+
+int JitterBufferPrivate::FramesOf(const VoicePacket &vp) const {
+	if (vp.type != VOICE_PACKET_TYPE_OPUS) {
+		return std::max(vp.num_frames, 1);
+	}
+	if (vp.num_frames == 0 || vp.frames[0].Length() == 0) {
+		return 1;
+	}
+	// The TOC byte of an Opus packet gives the duration of its
+	// frames, and in its lower two bits, how many it holds.
+	const unsigned char *toc = reinterpret_cast<const unsigned char *>(vp.frames[0].ConstData());
+	int count = 1;
+	switch (toc[0] & 3) {
+		case 1:
+		case 2:
+			count = 2;
+			break;
+		case 3:
+			count = vp.frames[0].Length() > 1 ? (toc[1] & 0x3f) : 1;
+			break;
+	}
+	int frames = count * kOpusFrameSamples[toc[0] >> 3] / (48 * opts_.frame_ms);
+	return std::min(std::max(frames, 1), opts_.capacity);
+}
+
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_JITTERBUFFER_P_H_
+#define MUMBLE_JITTERBUFFER_P_H_
+
+#include <mumble/JitterBuffer.h>
+#include <mumble/VoicePacket.h>
+
+#include "FlatIndex.h"
+
+#include "uv.h"
+
+#include <vector>
+#include <stdint.h>
+
+namespace mumble {
+
+// JitterSlot is a slot of a speaker's ring. It holds a buffered
+// packet, or marks a sequence number that was given up for lost,
+// so that the packet can be counted as late if it turns up.
+struct JitterSlot {
+	enum State {
+		EMPTY,
+		PACKET,
+		LOST,
+	};
+
+	JitterSlot() : sequence(0), state(EMPTY), len(0), frames(0), terminator(false) {}
+
+	uint64_t  sequence;
+	State     state;
+	int       len;
+	int       frames;
+	bool      terminator;
+};
+
+// JitterSpeaker holds the ring and playout state of one speaker.
+// A packet with sequence number s is kept in slot s & mask, and its
+// bytes at the same index of data. Only packets within capacity of
+// next are buffered, so buffered packets never share a slot. Popped
+// packets are copied to out, so they stay valid while others are put.
+struct JitterSpeaker {
+	JitterSpeaker()
+		: session(0), playing(false), next(0), due(0), last_arrival(0), step(1), buffered(0),
+		  last_transit(0), jitter(0.0f) {}
+
+	uint32_t                 session;
+
+	// playing is set while a transmission is being played, starting
+	// at due. next is the sequence number to be played next, and
+	// step the number of frames of the last packet played, which is
+	// how much is concealed for each packet given up for lost.
+	bool                     playing;
+	uint64_t                 next;
+	uint64_t                 due;
+	uint64_t                 last_arrival;
+	int                      step;
+	int                      buffered;
+
+	// The arrival time of a packet, less the time given by its
+	// sequence number, is its transit. jitter follows the mean
+	// change in transit between consecutive packets, as in RFC 3550.
+	int64_t                  last_transit;
+	float                    jitter;
+
+	JitterBufferStats        stats;
+	std::vector<JitterSlot>  slots;
+	std::vector<char>        data;
+	std::vector<char>        out;
+};
+
+class JitterBufferPrivate {
+public:
+	explicit JitterBufferPrivate(const JitterBufferOptions &opts);
+	~JitterBufferPrivate();
+
+	bool Put(const ByteView &packet, uint64_t now_ms);
+	JitterBufferStatus Pop(uint32_t session, uint64_t now_ms, VoicePacket *packet, int *frames);
+	void Remove(uint32_t session);
+	void Clear();
+	JitterBufferStats Stats() const;
+	bool SpeakerStats(uint32_t session, JitterBufferStats *stats) const;
+
+	JitterSpeaker *FindOrAdd(uint32_t session);
+	bool Store(JitterSpeaker *sp, const VoicePacket &vp, const ByteView &packet, uint64_t now_ms);
+	JitterBufferStatus Play(JitterSpeaker *sp, uint64_t now_ms, VoicePacket *packet, int *frames);
+	void Start(JitterSpeaker *sp, uint64_t sequence, uint64_t now_ms);
+	void Stop(JitterSpeaker *sp);
+	int Delay(const JitterSpeaker &sp) const;
+	int FramesOf(const VoicePacket &vp) const;
+
+	JitterBufferOptions         opts_;
+	uint64_t                    mask_;
+	mutable uv_mutex_t          lock_;
+
+	// speakers_ is a flat table, indexed by session. Removing a
+	// speaker moves the last speaker into its place.
+	std::vector<JitterSpeaker>  speakers_;
+	FlatIndex                   index_;
+	JitterBufferStats           totals_;
+};
+
+}
+
+#endif
@@ -0,0 +1,344 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/JitterBuffer.h>
+#include <mumble/VoicePacket.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace mumble;
+
+// The TOC bytes of Opus packets holding a single
+// 10 ms and 20 ms CELT frame.
+static const unsigned char kOpus10ms = 18 << 3;
+static const unsigned char kOpus20ms = 19 << 3;
+
+static std::string Packet(uint32_t session, uint64_t sequence, bool terminator = false, unsigned char toc = kOpus10ms) {
+	char frame[8] = { static_cast<char>(toc), 1, 2, 3, 4, 5, 6, 7 };
+	VoicePacket vp;
+	vp.type = VOICE_PACKET_TYPE_OPUS;
+	vp.session = session;
+	vp.sequence = sequence;
+	vp.num_frames = 1;
+	vp.frames[0] = ByteView(frame, sizeof(frame));
+	vp.terminator = terminator;
+	char buf[64];
+	int len = vp.Serialize(buf, sizeof(buf), true);
+	return std::string(buf, len);
+}
+
+static bool Put(JitterBuffer &jb, uint32_t session, uint64_t sequence, uint64_t now_ms, bool terminator = false) {
+	std::string pkt = Packet(session, sequence, terminator);
+	return jb.Put(ByteView(pkt.data(), static_cast<int>(pkt.size())), now_ms);
+}
+
+// Pops returns the sequence number of the packet popped for *session*
+// at *now_ms*, -1 if a loss was concealed, or -2 if nothing was due.
+static int64_t Pops(JitterBuffer &jb, uint32_t session, uint64_t now_ms, int *frames = nullptr) {
+	VoicePacket vp;
+	int n = 0;
+	JitterBufferStatus status = jb.Pop(session, now_ms, &vp, &n);
+	if (frames != nullptr) {
+		*frames = n;
+	}
+	switch (status) {
+		case JITTER_BUFFER_PACKET:
+			EXPECT_EQ(session, vp.session);
+			return static_cast<int64_t>(vp.sequence);
+		case JITTER_BUFFER_LOST:
+			return -1;
+		default:
+			return -2;
+	}
+}
+
+TEST(JitterBufferTest, HoldsFirstPacketForDelay) {
+	JitterBuffer jb;
+	ASSERT_TRUE(Put(jb, 7, 100, 1000));
+	ASSERT_EQ(-2, Pops(jb, 8, 2000));
+	ASSERT_EQ(-2, Pops(jb, 7, 1000));
+	ASSERT_EQ(-2, Pops(jb, 7, 1019));
+	int frames = 0;
+	ASSERT_EQ(100, Pops(jb, 7, 1020, &frames));
+	ASSERT_EQ(1, frames);
+	ASSERT_EQ(-2, Pops(jb, 7, 1030));
+
+	JitterBufferStats stats;
+	ASSERT_TRUE(jb.SpeakerStats(7, &stats));
+	ASSERT_EQ(1u, stats.good);
+	ASSERT_EQ(20, stats.delay_ms);
+	ASSERT_FALSE(jb.SpeakerStats(8, &stats));
+}
+
+TEST(JitterBufferTest, ReordersPackets) {
+	JitterBuffer jb;
+	ASSERT_TRUE(Put(jb, 1, 0, 0));
+	ASSERT_TRUE(Put(jb, 1, 2, 5));
+	ASSERT_TRUE(Put(jb, 1, 3, 6));
+	ASSERT_TRUE(Put(jb, 1, 1, 12));
+	ASSERT_FALSE(Put(jb, 1, 2, 13));
+	ASSERT_EQ(4, jb.Stats().buffered);
+	for (int i = 0; i < 4; i++) {
+		ASSERT_EQ(i, Pops(jb, 1, 20 + 10 * i));
+	}
+	ASSERT_EQ(-2, Pops(jb, 1, 60));
+	ASSERT_EQ(0, jb.Stats().buffered);
+}
+
+TEST(JitterBufferTest, ReordersFirstPackets) {
+	JitterBuffer jb;
+	ASSERT_TRUE(Put(jb, 1, 101, 0));
+	ASSERT_TRUE(Put(jb, 1, 100, 2));
+	ASSERT_EQ(2, jb.Stats().buffered);
+	ASSERT_EQ(-2, Pops(jb, 1, 19));
+	ASSERT_EQ(100, Pops(jb, 1, 20));
+	ASSERT_EQ(101, Pops(jb, 1, 30));
+
+	// Once playout has begun, earlier packets are too late.
+	ASSERT_FALSE(Put(jb, 1, 99, 31));
+	JitterBufferStats stats = jb.Stats();
+	ASSERT_EQ(2u, stats.good);
+	ASSERT_EQ(0u, stats.late);
+	ASSERT_EQ(0u, stats.lost);
+}
+
+// Once the delay has passed, the audio output sets the pace: each
+// Pop returns the next packet, however soon it is called.
+TEST(JitterBufferTest, PopsAtTheOutputsPace) {
+	JitterBuffer jb;
+	for (int i = 0; i < 4; i++) {
+		ASSERT_TRUE(Put(jb, 1, i, 5 * i));
+	}
+	for (int i = 0; i < 4; i++) {
+		ASSERT_EQ(i, Pops(jb, 1, 20));
+	}
+	ASSERT_EQ(-2, Pops(jb, 1, 20));
+}
+
+TEST(JitterBufferTest, CountsLostAndLatePackets) {
+	JitterBuffer jb;
+	ASSERT_TRUE(Put(jb, 1, 0, 0));
+	ASSERT_TRUE(Put(jb, 1, 1, 10));
+	ASSERT_TRUE(Put(jb, 1, 3, 30));
+	ASSERT_EQ(0, Pops(jb, 1, 20));
+	ASSERT_EQ(1, Pops(jb, 1, 30));
+	int frames = 0;
+	ASSERT_EQ(-1, Pops(jb, 1, 40, &frames));
+	ASSERT_EQ(1, frames);
+	ASSERT_EQ(3, Pops(jb, 1, 50));
+
+	JitterBufferStats stats = jb.Stats();
+	ASSERT_EQ(3u, stats.good);
+	ASSERT_EQ(0u, stats.late);
+	ASSERT_EQ(1u, stats.lost);
+
+	// The lost packet turns up after all.
+	ASSERT_FALSE(Put(jb, 1, 2, 55));
+	stats = jb.Stats();
+	ASSERT_EQ(3u, stats.good);
+	ASSERT_EQ(1u, stats.late);
+	ASSERT_EQ(0u, stats.lost);
+
+	// A packet that was played is neither late nor lost.
+	ASSERT_FALSE(Put(jb, 1, 1, 56));
+	stats = jb.Stats();
+	ASSERT_EQ(1u, stats.late);
+	ASSERT_EQ(0u, stats.lost);
+}
+
+TEST(JitterBufferTest, OpusPacketsSpanSequenceNumbers) {
+	JitterBuffer jb;
+	uint64_t seqs[] = { 0, 2, 6, 8 };
+	for (int i = 0; i < 4; i++) {
+		std::string pkt = Packet(3, seqs[i], false, kOpus20ms);
+		ASSERT_TRUE(jb.Put(ByteView(pkt.data(), static_cast<int>(pkt.size())), 20 * seqs[i] / 2));
+	}
+	int frames = 0;
+	ASSERT_EQ(0, Pops(jb, 3, 20, &frames));
+	ASSERT_EQ(2, frames);
+	ASSERT_EQ(2, Pops(jb, 3, 40, &frames));
+	ASSERT_EQ(2, frames);
+	ASSERT_EQ(-1, Pops(jb, 3, 60, &frames));
+	ASSERT_EQ(2, frames);
+	ASSERT_EQ(6, Pops(jb, 3, 80, &frames));
+	ASSERT_EQ(8, Pops(jb, 3, 100, &frames));
+	ASSERT_EQ(1u, jb.Stats().lost);
+}
+
+TEST(JitterBufferTest, EndsTransmissionOnTerminator) {
+	JitterBuffer jb;
+	ASSERT_TRUE(Put(jb, 1, 0, 0));
+	ASSERT_TRUE(Put(jb, 1, 1, 10, true));
+	ASSERT_EQ(0, Pops(jb, 1, 20));
+	ASSERT_EQ(1, Pops(jb, 1, 30));
+	ASSERT_EQ(-2, Pops(jb, 1, 40));
+
+	// The next transmission is held back again.
+	ASSERT_TRUE(Put(jb, 1, 500, 5000));
+	ASSERT_EQ(-2, Pops(jb, 1, 5010));
+	ASSERT_EQ(500, Pops(jb, 1, 5020));
+}
+
+TEST(JitterBufferTest, GivesUpOnSilentSpeakers) {
+	JitterBufferOptions opts;
+	opts.max_delay_ms = 100;
+	JitterBuffer jb(&opts);
+	ASSERT_TRUE(Put(jb, 1, 0, 0));
+	ASSERT_EQ(0, Pops(jb, 1, 20));
+	ASSERT_EQ(-2, Pops(jb, 1, 100));
+	ASSERT_EQ(-2, Pops(jb, 1, 101));
+
+	// Without a terminator, the late packet starts a new transmission.
+	ASSERT_TRUE(Put(jb, 1, 1, 150));
+	ASSERT_EQ(-2, Pops(jb, 1, 160));
+	ASSERT_EQ(1, Pops(jb, 1, 170));
+	ASSERT_EQ(0u, jb.Stats().lost);
+}
+
+TEST(JitterBufferTest, RestartsOnSequenceJumps) {
+	JitterBuffer jb;
+	ASSERT_TRUE(Put(jb, 1, 1000, 0));
+	ASSERT_TRUE(Put(jb, 1, 1001, 10));
+	ASSERT_EQ(1000, Pops(jb, 1, 20));
+
+	// The sender started counting from zero again.
+	ASSERT_TRUE(Put(jb, 1, 0, 25));
+	ASSERT_EQ(1, jb.Stats().buffered);
+	ASSERT_EQ(-2, Pops(jb, 1, 30));
+	ASSERT_EQ(0, Pops(jb, 1, 45));
+}
+
+TEST(JitterBufferTest, RejectsInvalidPackets) {
+	JitterBufferOptions opts;
+	opts.max_packet_size = 16;
+	JitterBuffer jb(&opts);
+
+	char ping[] = { static_cast<char>(VOICE_PACKET_TYPE_PING << 5), 0x01 };
+	ASSERT_FALSE(jb.Put(ByteView(ping, sizeof(ping)), 0));
+	char garbage[] = { static_cast<char>(VOICE_PACKET_TYPE_OPUS << 5) };
+	ASSERT_FALSE(jb.Put(ByteView(garbage, sizeof(garbage)), 0));
+	std::string large = Packet(1, 0);
+	large.resize(17);
+	ASSERT_FALSE(jb.Put(ByteView(large.data(), static_cast<int>(large.size())), 0));
+	ASSERT_EQ(0u, jb.Stats().good);
+	JitterBufferStats stats;
+	ASSERT_FALSE(jb.SpeakerStats(1, &stats));
+}
+
+TEST(JitterBufferTest, AdaptsDelayToJitter) {
+	JitterBuffer jb;
+	JitterBufferStats stats;
+	for (uint64_t i = 0; i < 200; i++) {
+		ASSERT_TRUE(Put(jb, 1, i, 10 * i));
+		Put(jb, 2, i, 10 * i + (i % 2) * 40);
+		Pops(jb, 1, 10 * i);
+		Pops(jb, 2, 10 * i);
+	}
+	ASSERT_TRUE(jb.SpeakerStats(1, &stats));
+	ASSERT_EQ(0.0f, stats.jitter_ms);
+	ASSERT_EQ(20, stats.delay_ms);
+	ASSERT_TRUE(jb.SpeakerStats(2, &stats));
+	ASSERT_NEAR(40.0f, stats.jitter_ms, 1.0f);
+	ASSERT_EQ(160, stats.delay_ms);
+
+	// The delay applies from the next transmission on.
+	ASSERT_TRUE(Put(jb, 2, 1000, 10000));
+	ASSERT_EQ(-2, Pops(jb, 2, 10159));
+	ASSERT_EQ(1000, Pops(jb, 2, 10160));
+}
+
+TEST(JitterBufferTest, RemovesSpeakers) {
+	JitterBuffer jb;
+	for (uint32_t session = 1; session <= 100; session++) {
+		ASSERT_TRUE(Put(jb, session, 0, 0));
+		ASSERT_TRUE(Put(jb, session, 1, 10));
+	}
+	for (uint32_t session = 1; session <= 100; session += 2) {
+		jb.Remove(session);
+	}
+	JitterBufferStats stats;
+	for (uint32_t session = 1; session <= 100; session++) {
+		ASSERT_EQ(session % 2 == 0, jb.SpeakerStats(session, &stats));
+		ASSERT_EQ(session % 2 == 0 ? 0 : -2, Pops(jb, session, 20));
+	}
+	stats = jb.Stats();
+	ASSERT_EQ(200u, stats.good);
+	ASSERT_EQ(50, stats.buffered);
+
+	jb.Clear();
+	ASSERT_FALSE(jb.SpeakerStats(2, &stats));
+	ASSERT_EQ(200u, jb.Stats().good);
+	ASSERT_EQ(0, jb.Stats().buffered);
+}
+
+// Packets of many speakers arrive out of order, duplicated or not at
+// all, while each speaker is played at an even pace. Each speaker's
+// packets must come out in order, and every packet put must either
+// be played, or be dropped at the end of a transmission.
+TEST(JitterBufferTest, FuzzArrivals) {
+	srand(3);
+	const int kSpeakers = 20;
+	const int kPackets = 500;
+	JitterBuffer jb;
+
+	struct Arrival {
+		uint64_t  at;
+		uint32_t  session;
+		uint64_t  sequence;
+		bool      terminator;
+		bool operator<(const Arrival &other) const { return at < other.at; }
+	};
+	std::vector<Arrival> arrivals;
+	for (uint32_t s = 1; s <= kSpeakers; s++) {
+		for (int i = 0; i < kPackets; i++) {
+			if (rand() % 20 == 0) {
+				continue;
+			}
+			Arrival a;
+			a.at = 10 * i + rand() % (5 * s);
+			a.session = s;
+			a.sequence = i;
+			a.terminator = i % 100 == 99;
+			arrivals.push_back(a);
+			if (rand() % 50 == 0) {
+				a.at += rand() % 100;
+				arrivals.push_back(a);
+			}
+		}
+	}
+	std::stable_sort(arrivals.begin(), arrivals.end());
+
+	uint32_t accepted = 0;
+	uint32_t played = 0;
+	std::vector<int64_t> last(kSpeakers + 1, -1);
+	size_t next = 0;
+	for (uint64_t now = 0; now < 10 * kPackets + 1000; now += 10) {
+		for (; next < arrivals.size() && arrivals[next].at <= now; next++) {
+			const Arrival &a = arrivals[next];
+			std::string pkt = Packet(a.session, a.sequence, a.terminator);
+			if (jb.Put(ByteView(pkt.data(), static_cast<int>(pkt.size())), a.at)) {
+				accepted++;
+			}
+		}
+		for (uint32_t s = 1; s <= kSpeakers; s++) {
+			int64_t seq = Pops(jb, s, now);
+			if (seq >= 0) {
+				ASSERT_GT(seq, last[s]);
+				last[s] = seq;
+				played++;
+			}
+		}
+	}
+
+	JitterBufferStats stats = jb.Stats();
+	ASSERT_EQ(0, stats.buffered);
+	ASSERT_EQ(accepted, stats.good);
+	ASSERT_EQ(accepted, played);
+	ASSERT_GT(stats.lost, 0u);
+}
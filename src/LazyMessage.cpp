@@ -0,0 +1,202 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/LazyMessage.h>
+
+#include "WireFormat.h"
+
+namespace mumble {
+
+LazyMessage::LazyMessage() : repeated_(0), scalar_mask_(0), view_mask_(0) {
+}
+
+LazyMessage::~LazyMessage() {
+}
+
+bool LazyMessage::ParseFromArray(const void *data, int size) {
+	return Parse(ByteView(static_cast<const char *>(data), size));
+}
+
+// Parse scans the message once. Scalar fields are stored as they
+// are found, and length-delimited fields as views into *payload*.
+// As with protocol buffers, the last occurrence of a field wins.
+bool LazyMessage::Parse(const ByteView &payload) {
+	Clear();
+	payload_ = payload;
+
+	WireReader r(payload);
+	int field, type;
+	while (r.Next(&field, &type)) {
+		bool known = field < kMaxFields;
+		uint64_t value = 0;
+		ByteView view;
+		switch (type) {
+			case WIRE_TYPE_VARINT:
+				if (!r.ReadVarint(&value)) {
+					return false;
+				}
+				break;
+			case WIRE_TYPE_LENGTH_DELIMITED:
+				if (!r.ReadLengthDelimited(&view)) {
+					return false;
+				}
+				break;
+			default:
+				if (!r.Skip(type)) {
+					return false;
+				}
+				known = false;
+				break;
+		}
+		if (!known) {
+			continue;
+		}
+
+		uint32_t bit = 1U << field;
+		bool delimited = type == WIRE_TYPE_LENGTH_DELIMITED;
+		if (repeated_ & bit) {
+			if (!AddRepeated(field, value, delimited ? &view : nullptr)) {
+				return false;
+			}
+		} else if (delimited) {
+			views_[field] = view;
+			view_mask_ |= bit;
+		} else {
+			scalars_[field] = value;
+			scalar_mask_ |= bit;
+		}
+	}
+	if (!r.Done()) {
+		return false;
+	}
+	return Validate();
+}
+
+void LazyMessage::Clear() {
+	payload_ = ByteView();
+	scalar_mask_ = 0;
+	view_mask_ = 0;
+	ClearRepeated();
+}
+
+ByteView LazyMessage::Payload() const {
+	return payload_;
+}
+
+bool LazyMessage::AddRepeated(int field, uint64_t value, const ByteView *view) {
+	return true;
+}
+
+void LazyMessage::ClearRepeated() {
+}
+
+bool LazyMessage::Validate() const {
+	return true;
+}
+
+bool LazyMessage::AddVarints(uint64_t value, const ByteView *view, std::vector<uint32_t> *out) {
+	if (view == nullptr) {
+		out->push_back(static_cast<uint32_t>(value));
+		return true;
+	}
+	WireReader r(*view);
+	while (!r.Done()) {
+		if (!r.ReadVarint(&value)) {
+			return false;
+		}
+		out->push_back(static_cast<uint32_t>(value));
+	}
+	return true;
+}
+
+LazyUserState::LazyUserState() {
+}
+
+LazyChannelState::LazyChannelState() {
+	repeated_ = (1U << 4) | (1U << 6) | (1U << 7);
+}
+
+bool LazyChannelState::AddRepeated(int field, uint64_t value, const ByteView *view) {
+	switch (field) {
+		case 4:
+			return AddVarints(value, view, &links_);
+		case 6:
+			return AddVarints(value, view, &links_add_);
+		case 7:
+			return AddVarints(value, view, &links_remove_);
+	}
+	return true;
+}
+
+void LazyChannelState::ClearRepeated() {
+	links_.clear();
+	links_add_.clear();
+	links_remove_.clear();
+}
+
+LazyBanEntry::LazyBanEntry() {
+}
+
+bool LazyBanEntry::Validate() const {
+	return HasView(1) && HasScalar(2);
+}
+
+LazyBanList::LazyBanList() {
+	repeated_ = 1U << 1;
+}
+
+bool LazyBanList::AddRepeated(int field, uint64_t value, const ByteView *view) {
+	// Skip values of the wrong type, as the full
+	// parser would.
+	if (view == nullptr) {
+		return true;
+	}
+	bans_.push_back(*view);
+	return true;
+}
+
+void LazyBanList::ClearRepeated() {
+	bans_.clear();
+}
+
+bool LazyBanList::Ban(int i, LazyBanEntry *entry) const {
+	if (i < 0 || i >= BanSize()) {
+		return false;
+	}
+	return entry->Parse(bans_[i]);
+}
+
+LazyUserListEntry::LazyUserListEntry() {
+}
+
+bool LazyUserListEntry::Validate() const {
+	return HasScalar(1);
+}
+
+LazyUserList::LazyUserList() {
+	repeated_ = 1U << 1;
+}
+
+bool LazyUserList::AddRepeated(int field, uint64_t value, const ByteView *view) {
+	// Skip values of the wrong type, as the full
+	// parser would.
+	if (view == nullptr) {
+		return true;
+	}
+	users_.push_back(*view);
+	return true;
+}
+
+void LazyUserList::ClearRepeated() {
+	users_.clear();
+}
+
+bool LazyUserList::User(int i, LazyUserListEntry *entry) const {
+	if (i < 0 || i >= UserSize()) {
+		return false;
+	}
+	return entry->Parse(users_[i]);
+}
+
+}
@@ -0,0 +1,184 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/LazyMessage.h>
+#include <mumble/MessageDispatcher.h>
+
+#include "Mumble.pb.h"
+
+#include <string>
+
+using namespace mumble;
+
+static std::string Str(const ByteView &view) {
+	return std::string(view.ConstData(), view.Length());
+}
+
+static ByteView View(const std::string &s) {
+	return ByteView(s.data(), static_cast<int>(s.size()));
+}
+
+TEST(LazyMessageTest, UserState) {
+	MumbleProto::UserState us;
+	us.set_session(12);
+	us.set_channel_id(300);
+	us.set_name("alice");
+	us.set_self_mute(true);
+	us.set_texture(std::string(100000, '\x01'));
+	us.set_comment("a comment");
+	us.set_recording(false);
+	std::string wire = us.SerializeAsString();
+
+	LazyUserState lazy;
+	ASSERT_TRUE(lazy.Parse(View(wire)));
+	EXPECT_TRUE(lazy.HasSession());
+	EXPECT_EQ(12U, lazy.Session());
+	EXPECT_EQ(300U, lazy.ChannelId());
+	EXPECT_FALSE(lazy.HasActor());
+	EXPECT_EQ(0U, lazy.Actor());
+	EXPECT_EQ("alice", Str(lazy.Name()));
+	EXPECT_TRUE(lazy.SelfMute());
+	EXPECT_FALSE(lazy.HasSelfDeaf());
+	EXPECT_TRUE(lazy.HasRecording());
+	EXPECT_FALSE(lazy.Recording());
+	EXPECT_EQ("a comment", Str(lazy.Comment()));
+	EXPECT_FALSE(lazy.HasHash());
+
+	// The texture is not copied.
+	ASSERT_EQ(100000, lazy.Texture().Length());
+	EXPECT_GE(lazy.Texture().ConstData(), wire.data());
+	EXPECT_LE(lazy.Texture().ConstData() + lazy.Texture().Length(), wire.data() + wire.size());
+
+	// Parsing again replaces all fields.
+	MumbleProto::UserState other;
+	other.set_actor(5);
+	std::string wire2 = other.SerializeAsString();
+	ASSERT_TRUE(lazy.Parse(View(wire2)));
+	EXPECT_FALSE(lazy.HasSession());
+	EXPECT_FALSE(lazy.HasTexture());
+	EXPECT_EQ(5U, lazy.Actor());
+}
+
+TEST(LazyMessageTest, ChannelState) {
+	MumbleProto::ChannelState cs;
+	cs.set_channel_id(4);
+	cs.set_parent(0);
+	cs.set_description(std::string(5000, 'd'));
+	cs.set_position(-3);
+	for (uint32_t i = 0; i < 200; i++) {
+		cs.add_links(i * 1000);
+	}
+	cs.add_links_remove(7);
+	std::string wire = cs.SerializeAsString();
+
+	LazyChannelState lazy;
+	ASSERT_TRUE(lazy.Parse(View(wire)));
+	EXPECT_EQ(4U, lazy.ChannelId());
+	EXPECT_TRUE(lazy.HasParent());
+	EXPECT_EQ(0U, lazy.Parent());
+	EXPECT_EQ(-3, lazy.Position());
+	EXPECT_EQ(5000, lazy.Description().Length());
+	ASSERT_EQ(200U, lazy.Links().size());
+	EXPECT_EQ(199000U, lazy.Links()[199]);
+	EXPECT_TRUE(lazy.LinksAdd().empty());
+	ASSERT_EQ(1U, lazy.LinksRemove().size());
+	EXPECT_EQ(7U, lazy.LinksRemove()[0]);
+}
+
+TEST(LazyMessageTest, PackedLinks) {
+	// links = [1, 300] as a packed field.
+	std::string wire("\x22\x03\x01\xac\x02", 5);
+	LazyChannelState lazy;
+	ASSERT_TRUE(lazy.Parse(View(wire)));
+	ASSERT_EQ(2U, lazy.Links().size());
+	EXPECT_EQ(1U, lazy.Links()[0]);
+	EXPECT_EQ(300U, lazy.Links()[1]);
+}
+
+TEST(LazyMessageTest, BanListEntriesAreDecodedOnAccess) {
+	MumbleProto::BanList bl;
+	for (int i = 0; i < 1000; i++) {
+		MumbleProto::BanList_BanEntry *e = bl.add_bans();
+		e->set_address(std::string(16, static_cast<char>(i)));
+		e->set_mask(128);
+		e->set_reason("spam");
+		e->set_duration(i);
+	}
+	bl.set_query(true);
+	std::string wire = bl.SerializeAsString();
+
+	LazyBanList lazy;
+	ASSERT_TRUE(lazy.Parse(View(wire)));
+	EXPECT_TRUE(lazy.Query());
+	ASSERT_EQ(1000, lazy.BanSize());
+
+	LazyBanEntry entry;
+	ASSERT_TRUE(lazy.Ban(999, &entry));
+	EXPECT_EQ(16, entry.Address().Length());
+	EXPECT_EQ(128U, entry.Mask());
+	EXPECT_EQ("spam", Str(entry.Reason()));
+	EXPECT_EQ(999U, entry.Duration());
+	EXPECT_FALSE(entry.HasName());
+	EXPECT_FALSE(lazy.Ban(1000, &entry));
+}
+
+TEST(LazyMessageTest, UserList) {
+	MumbleProto::UserList ul;
+	for (uint32_t i = 0; i < 3; i++) {
+		MumbleProto::UserList_User *u = ul.add_users();
+		u->set_user_id(i + 1);
+		u->set_name("user");
+	}
+	std::string wire = ul.SerializeAsString();
+
+	LazyUserList lazy;
+	ASSERT_TRUE(lazy.Parse(View(wire)));
+	ASSERT_EQ(3, lazy.UserSize());
+	LazyUserListEntry entry;
+	ASSERT_TRUE(lazy.User(2, &entry));
+	EXPECT_EQ(3U, entry.UserId());
+	EXPECT_EQ("user", Str(entry.Name()));
+	EXPECT_FALSE(entry.HasLastChannel());
+
+	// An entry without its required user_id is malformed.
+	std::string missing("\x0a\x02\x12\x00", 4);
+	ASSERT_TRUE(lazy.Parse(View(missing)));
+	ASSERT_EQ(1, lazy.UserSize());
+	EXPECT_FALSE(lazy.User(0, &entry));
+}
+
+TEST(LazyMessageTest, RejectsMalformedMessages) {
+	LazyUserState lazy;
+	// Truncated varint.
+	EXPECT_FALSE(lazy.Parse(View(std::string("\x08\x80", 2))));
+	// Length-delimited field running past the end.
+	EXPECT_FALSE(lazy.Parse(View(std::string("\x1a\x05" "ab", 4))));
+	// Field number 0.
+	EXPECT_FALSE(lazy.Parse(View(std::string("\x00\x01", 2))));
+	// Group.
+	EXPECT_FALSE(lazy.Parse(View(std::string("\x0b\x0c", 2))));
+	// Unknown fields are skipped.
+	EXPECT_TRUE(lazy.Parse(View(std::string("\xa8\x1f\x01\x08\x02", 5))));
+	EXPECT_EQ(2U, lazy.Session());
+}
+
+TEST(LazyMessageTest, WorksWithMessageDispatcher) {
+	MessageDispatcher d;
+	uint32_t session = 0;
+	int texture = 0;
+	d.On<LazyUserState>([&session, &texture](const LazyUserState &us) {
+		session = us.Session();
+		texture = us.Texture().Length();
+	});
+
+	MumbleProto::UserState us;
+	us.set_session(9);
+	us.set_texture(std::string(1000, 't'));
+	std::string wire = us.SerializeAsString();
+	EXPECT_TRUE(d.Dispatch(MESSAGE_TYPE_USER_STATE, View(wire)));
+	EXPECT_EQ(9U, session);
+	EXPECT_EQ(1000, texture);
+}
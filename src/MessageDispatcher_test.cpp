@@ -0,0 +1,123 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/MessageDispatcher.h>
+
+#include "Mumble.pb.h"
+
+#include <string>
+#include <vector>
+
+using namespace mumble;
+
+static std::string Serialize(const google::protobuf::MessageLite &msg) {
+	std::string s;
+	msg.SerializeToString(&s);
+	return s;
+}
+
+static ByteView View(const std::string &s) {
+	return ByteView(s.data(), static_cast<int>(s.size()));
+}
+
+TEST(MessageDispatcherTest, DispatchesToTypedHandlers) {
+	MessageDispatcher d;
+	uint32_t session = 0;
+	uint64_t timestamp = 0;
+	d.On<MumbleProto::UserState>([&session](const MumbleProto::UserState &us) {
+		session = us.session();
+	}).On<MumbleProto::Ping>([&timestamp](const MumbleProto::Ping &ping) {
+		timestamp = ping.timestamp();
+	});
+
+	MumbleProto::UserState us;
+	us.set_session(42);
+	std::string uss = Serialize(us);
+	EXPECT_TRUE(d.Dispatch(MESSAGE_TYPE_USER_STATE, View(uss)));
+	EXPECT_EQ(42U, session);
+
+	MumbleProto::Ping ping;
+	ping.set_timestamp(1000);
+	std::string ps = Serialize(ping);
+	EXPECT_TRUE(d.Dispatch(MESSAGE_TYPE_PING, View(ps)));
+	EXPECT_EQ(1000U, timestamp);
+}
+
+TEST(MessageDispatcherTest, SkipsUnregisteredTypes) {
+	MessageDispatcher d;
+	int pings = 0;
+	d.On<MumbleProto::Ping>([&pings](const MumbleProto::Ping &ping) {
+		pings++;
+	});
+
+	// Without a default handler, unregistered messages are dropped,
+	// even if they are not valid protocol buffers.
+	std::string garbage("\xff\xff\xff", 3);
+	EXPECT_TRUE(d.Dispatch(MESSAGE_TYPE_USER_STATE, View(garbage)));
+	EXPECT_TRUE(d.Dispatch(static_cast<MessageType>(1000), View(garbage)));
+
+	std::vector<MessageType> skipped;
+	d.SetDefaultHandler([&skipped](MessageType type, const ByteView &payload) {
+		skipped.push_back(type);
+	});
+	EXPECT_TRUE(d.Dispatch(MESSAGE_TYPE_USER_STATE, View(garbage)));
+	EXPECT_TRUE(d.Dispatch(static_cast<MessageType>(1000), View(garbage)));
+	ASSERT_EQ(2U, skipped.size());
+	EXPECT_EQ(MESSAGE_TYPE_USER_STATE, skipped[0]);
+	EXPECT_EQ(1000, skipped[1]);
+	EXPECT_EQ(0, pings);
+}
+
+TEST(MessageDispatcherTest, RejectsMalformedMessages) {
+	MessageDispatcher d;
+	int texts = 0;
+	d.On<MumbleProto::TextMessage>([&texts](const MumbleProto::TextMessage &tm) {
+		texts++;
+	});
+
+	// TextMessage requires its message field.
+	MumbleProto::TextMessage tm;
+	tm.set_actor(1);
+	std::string partial = tm.SerializePartialAsString();
+	EXPECT_FALSE(d.Dispatch(MESSAGE_TYPE_TEXT_MESSAGE, View(partial)));
+	std::string garbage("\xff\xff\xff", 3);
+	EXPECT_FALSE(d.Dispatch(MESSAGE_TYPE_TEXT_MESSAGE, View(garbage)));
+	EXPECT_EQ(0, texts);
+}
+
+TEST(MessageDispatcherTest, ReusesMessages) {
+	MessageDispatcher d;
+	std::vector<const MumbleProto::UserState *> seen;
+	std::vector<bool> has_comment;
+	d.On<MumbleProto::UserState>([&seen, &has_comment](const MumbleProto::UserState &us) {
+		seen.push_back(&us);
+		has_comment.push_back(us.has_comment());
+	});
+
+	MumbleProto::UserState first;
+	first.set_session(1);
+	first.set_comment("hello");
+	MumbleProto::UserState second;
+	second.set_session(2);
+	std::string a = Serialize(first);
+	std::string b = Serialize(second);
+	EXPECT_TRUE(d.Dispatch(MESSAGE_TYPE_USER_STATE, View(a)));
+	EXPECT_TRUE(d.Dispatch(MESSAGE_TYPE_USER_STATE, View(b)));
+
+	// The same message object is parsed into each time, and
+	// fields of earlier messages do not leak into later ones.
+	ASSERT_EQ(2U, seen.size());
+	EXPECT_EQ(seen[0], seen[1]);
+	EXPECT_TRUE(has_comment[0]);
+	EXPECT_FALSE(has_comment[1]);
+}
+
+TEST(MessageDispatcherTest, TraitsMatchMessageTypes) {
+	EXPECT_EQ(MESSAGE_TYPE_VERSION, MessageTraits<MumbleProto::Version>::Type());
+	EXPECT_EQ(MESSAGE_TYPE_USER_STATE, MessageTraits<MumbleProto::UserState>::Type());
+	EXPECT_EQ(MESSAGE_TYPE_REQUEST_BLOB, MessageTraits<MumbleProto::RequestBlob>::Type());
+	EXPECT_EQ(MESSAGE_TYPE_SUGGEST_CONFIG, MessageTraits<MumbleProto::SuggestConfig>::Type());
+}
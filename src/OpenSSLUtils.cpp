@@ -11,12 +11,37 @@
 #include <openssl/err.h>
 #include <openssl/bio.h>
 #include <openssl/x509.h>
+#include <openssl/crypto.h>
 
 #include <sstream>
 
 static uv_once_t sslinit = UV_ONCE_INIT;
+static uv_mutex_t *ssllocks = nullptr;
+
+// OpenSSLLockingCallback implements the locking that OpenSSL
+// requires for objects (such as a TLSListener's SSL_CTX) that
+// are shared between several threads.
+static void OpenSSLLockingCallback(int mode, int n, const char *file, int line) {
+	if (mode & CRYPTO_LOCK) {
+		uv_mutex_lock(&ssllocks[n]);
+	} else {
+		uv_mutex_unlock(&ssllocks[n]);
+	}
+}
+
+static void OpenSSLThreadIdCallback(CRYPTO_THREADID *id) {
+	CRYPTO_THREADID_set_numeric(id, uv_thread_self());
+}
 
 static void InitializeOpenSSL() {
+	int nlocks = CRYPTO_num_locks();
+	ssllocks = new uv_mutex_t[nlocks];
+	for (int i = 0; i < nlocks; i++) {
+		uv_mutex_init(&ssllocks[i]);
+	}
+	CRYPTO_THREADID_set_callback(OpenSSLThreadIdCallback);
+	CRYPTO_set_locking_callback(OpenSSLLockingCallback);
+
 	SSL_library_init();
 	OpenSSL_add_all_algorithms();
 	ERR_load_crypto_strings();
@@ -29,35 +54,35 @@ void OpenSSLUtils::EnsureInitialized() {
 	uv_once(&sslinit, InitializeOpenSSL);
 }
 
-static std::string SSLErrorToString(int SSLerr) {
+static const char *SSLErrorToString(long SSLerr) {
 	switch (SSLerr) {
 		case SSL_ERROR_NONE:
-			return std::string("SSL_ERROR_NONE - operation completed successfully");
+			return "SSL_ERROR_NONE - operation completed successfully";
 		case SSL_ERROR_ZERO_RETURN:
-			return std::string("SSL_ERROR_ZERO_RETURN - connection closed by peer");
+			return "SSL_ERROR_ZERO_RETURN - connection closed by peer";
 		case SSL_ERROR_WANT_READ:
-			return std::string("SSL_ERROR_WANT_READ - requires a read operation to continue");
+			return "SSL_ERROR_WANT_READ - requires a read operation to continue";
 		case SSL_ERROR_WANT_WRITE:
-			return std::string("SSL_ERROR_WANT_WRITE - requires a write operation to continue");
+			return "SSL_ERROR_WANT_WRITE - requires a write operation to continue";
 		case SSL_ERROR_WANT_CONNECT:
-			return std::string("SSL_ERROR_WANT_CONNECT - operation did not complete, call SSL_connect again later");
+			return "SSL_ERROR_WANT_CONNECT - operation did not complete, call SSL_connect again later";
 		case SSL_ERROR_WANT_ACCEPT:
-			return std::string("SSL_ERROR_WANT_ACCEPT - operation did not complete, call SSL_accept again laster");
+			return "SSL_ERROR_WANT_ACCEPT - operation did not complete, call SSL_accept again laster";
 		case SSL_ERROR_WANT_X509_LOOKUP:
-			return std::string("SSL_ERROR_WANT_X509_LOOKUP - operation did not complete, call the TLS I/O function again later");
+			return "SSL_ERROR_WANT_X509_LOOKUP - operation did not complete, call the TLS I/O function again later";
 		case SSL_ERROR_SYSCALL:
-			return std::string("SSL_ERROR_SYSCALL - system I/O error");
+			return "SSL_ERROR_SYSCALL - system I/O error";
 		case SSL_ERROR_SSL:
-			return std::string("SSL_ERROR_SSL - SSL library error, probably a protocol error");
+			return "SSL_ERROR_SSL - SSL library error, probably a protocol error";
 	}
-	return std::string("(none)");
+	return "(none)";
 }
 
 Error OpenSSLUtils::ErrorFromOpenSSLErrorCode(int SSLerr) {
-	return Error::ErrorFromDescription(
-		std::string("libssl"),
+	return Error::ErrorFromCode(
+		"libssl",
 		static_cast<long>(SSLerr),
-		SSLErrorToString(SSLerr)
+		SSLErrorToString
 	);
 }
 
@@ -0,0 +1,208 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_PERSISTENTMAP_H_
+#define MUMBLE_PERSISTENTMAP_H_
+
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+namespace mumble {
+
+// PersistentMap maps uint32_t keys, such as channel ids or user
+// sessions, to immutable values. Copying a PersistentMap is O(1),
+// and the copies share their structure: Set and Erase never modify
+// a node, but copy the O(log n) nodes on the path to the key.
+//
+// The map is a bitmap-compressed trie that consumes five bits of
+// the key per level, starting with the least significant ones.
+// Channel ids and sessions are mostly small and sequential, so the
+// trie stays balanced without hashing; 5000 keys fit in three levels.
+//
+// A PersistentMap must not be modified while it is being copied,
+// but copies can be read from other threads while the original is
+// being modified.
+template <typename T>
+class PersistentMap {
+public:
+	PersistentMap() : size_(0) {}
+
+	// Find returns the value stored for *key*, or null.
+	const T *Find(uint32_t key) const {
+		const Node *node = root_.get();
+		for (int shift = 0; node != nullptr; shift += kBits) {
+			uint32_t bit = 1U << ((key >> shift) & kMask);
+			if ((node->bitmap & bit) == 0) {
+				return nullptr;
+			}
+			const Entry &e = node->entries[Index(node->bitmap, bit)];
+			if (e.child == nullptr) {
+				return e.key == key ? e.value.get() : nullptr;
+			}
+			node = e.child.get();
+		}
+		return nullptr;
+	}
+
+	// Set stores *value* for *key*, replacing any previous value.
+	void Set(uint32_t key, const std::shared_ptr<const T> &value) {
+		bool added = false;
+		root_ = Insert(root_.get(), key, value, 0, &added);
+		if (added) {
+			size_++;
+		}
+	}
+
+	// Erase removes *key*, if present.
+	void Erase(uint32_t key) {
+		bool removed = false;
+		NodePtr root = Remove(root_, key, 0, &removed);
+		if (removed) {
+			root_ = root;
+			size_--;
+		}
+	}
+
+	void Clear() {
+		root_.reset();
+		size_ = 0;
+	}
+
+	size_t Size() const {
+		return size_;
+	}
+
+	// ForEach calls *fn* with each value, in no particular order.
+	template <typename Fn>
+	void ForEach(const Fn &fn) const {
+		if (root_ != nullptr) {
+			Visit(root_.get(), fn);
+		}
+	}
+
+private:
+	static const int       kBits = 5;
+	static const uint32_t  kMask = (1U << kBits) - 1;
+
+	struct Node;
+	typedef std::shared_ptr<const Node> NodePtr;
+
+	// Entry is either a child node, or a leaf holding
+	// a key and its value.
+	struct Entry {
+		Entry() : key(0) {}
+		NodePtr                   child;
+		uint32_t                  key;
+		std::shared_ptr<const T>  value;
+	};
+
+	struct Node {
+		Node() : bitmap(0) {}
+		uint32_t            bitmap;
+		std::vector<Entry>  entries;
+	};
+
+	// Index returns the position in a node's entries of the
+	// entry for *bit*, which is the number of lower bits set.
+	static int Index(uint32_t bitmap, uint32_t bit) {
+		uint32_t v = bitmap & (bit - 1);
+		v = v - ((v >> 1) & 0x55555555);
+		v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+		return static_cast<int>((((v + (v >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24);
+	}
+
+	static NodePtr Insert(const Node *node, uint32_t key, const std::shared_ptr<const T> &value, int shift, bool *added) {
+		std::shared_ptr<Node> copy = node != nullptr ? std::make_shared<Node>(*node) : std::make_shared<Node>();
+		uint32_t bit = 1U << ((key >> shift) & kMask);
+		int i = Index(copy->bitmap, bit);
+		if ((copy->bitmap & bit) == 0) {
+			Entry e;
+			e.key = key;
+			e.value = value;
+			copy->entries.insert(copy->entries.begin() + i, e);
+			copy->bitmap |= bit;
+			*added = true;
+			return copy;
+		}
+
+		Entry &e = copy->entries[i];
+		if (e.child != nullptr) {
+			e.child = Insert(e.child.get(), key, value, shift + kBits, added);
+		} else if (e.key == key) {
+			e.value = value;
+		} else {
+			// Two keys share this slot; push both down a level. Keys
+			// are 32 bits wide, so they differ by the seventh level.
+			bool ignored = false;
+			NodePtr child = Insert(nullptr, e.key, e.value, shift + kBits, &ignored);
+			e.child = Insert(child.get(), key, value, shift + kBits, added);
+			e.value.reset();
+		}
+		return copy;
+	}
+
+	// Remove returns *node* without *key*. It returns *node* itself
+	// if *key* is not present, and null if the result would be empty.
+	static NodePtr Remove(const NodePtr &node, uint32_t key, int shift, bool *removed) {
+		if (node == nullptr) {
+			return node;
+		}
+		uint32_t bit = 1U << ((key >> shift) & kMask);
+		if ((node->bitmap & bit) == 0) {
+			return node;
+		}
+		int i = Index(node->bitmap, bit);
+		const Entry &e = node->entries[i];
+
+		NodePtr child;
+		if (e.child != nullptr) {
+			child = Remove(e.child, key, shift + kBits, removed);
+			if (!*removed) {
+				return node;
+			}
+		} else if (e.key != key) {
+			return node;
+		} else {
+			*removed = true;
+			if (node->entries.size() == 1) {
+				return NodePtr();
+			}
+		}
+
+		std::shared_ptr<Node> copy = std::make_shared<Node>(*node);
+		if (child == nullptr) {
+			copy->entries.erase(copy->entries.begin() + i);
+			copy->bitmap &= ~bit;
+			if (copy->entries.empty()) {
+				return NodePtr();
+			}
+		} else if (child->entries.size() == 1 && child->entries[0].child == nullptr) {
+			// Pull a lone leaf up, so the trie stays as shallow as
+			// its keys allow.
+			copy->entries[i] = child->entries[0];
+		} else {
+			copy->entries[i].child = child;
+		}
+		return copy;
+	}
+
+	template <typename Fn>
+	static void Visit(const Node *node, const Fn &fn) {
+		for (const Entry &e : node->entries) {
+			if (e.child != nullptr) {
+				Visit(e.child.get(), fn);
+			} else {
+				fn(*e.value);
+			}
+		}
+	}
+
+	NodePtr  root_;
+	size_t   size_;
+};
+
+}
+
+#endif
@@ -0,0 +1,118 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/ServerState.h>
+#include "ServerState_p.h"
+
+namespace mumble {
+
+ServerChannel::ServerChannel()
+	: channel_id(0), has_parent(false), parent(0), position(0), temporary(false) {
+}
+
+ServerUser::ServerUser()
+	: session(0), channel_id(0), has_user_id(false), user_id(0), mute(false), deaf(false),
+	  suppress(false), self_mute(false), self_deaf(false), priority_speaker(false), recording(false) {
+}
+
+ServerStateSnapshot::ServerStateSnapshot() : version_(0) {
+}
+
+ServerStateSnapshot::~ServerStateSnapshot() {
+}
+
+uint64_t ServerStateSnapshot::Version() const {
+	return version_;
+}
+
+const ServerChannel *ServerStateSnapshot::Channel(uint32_t channel_id) const {
+	return tree_->channels_.Find(channel_id);
+}
+
+const ServerUser *ServerStateSnapshot::User(uint32_t session) const {
+	return tree_->users_.Find(session);
+}
+
+int ServerStateSnapshot::NumChannels() const {
+	return static_cast<int>(tree_->channels_.Size());
+}
+
+int ServerStateSnapshot::NumUsers() const {
+	return static_cast<int>(tree_->users_.Size());
+}
+
+void ServerStateSnapshot::ForEachChannel(const std::function<void (const ServerChannel &channel)> &fn) const {
+	tree_->channels_.ForEach(fn);
+}
+
+void ServerStateSnapshot::ForEachUser(const std::function<void (const ServerUser &user)> &fn) const {
+	tree_->users_.ForEach(fn);
+}
+
+ServerState::ServerState() : priv_(new ServerStatePrivate) {
+}
+
+ServerState::~ServerState() {
+}
+
+bool ServerState::Apply(MessageType type, const ByteView &payload) {
+	bool ok = priv_->Apply(type, payload);
+	priv_->Flush();
+	return ok;
+}
+
+void ServerState::ApplyChannelState(const LazyChannelState &msg) {
+	priv_->ApplyChannelState(msg);
+	priv_->Flush();
+}
+
+void ServerState::ApplyChannelRemove(uint32_t channel_id) {
+	priv_->ApplyChannelRemove(channel_id);
+	priv_->Flush();
+}
+
+void ServerState::ApplyUserState(const LazyUserState &msg) {
+	priv_->ApplyUserState(msg);
+	priv_->Flush();
+}
+
+void ServerState::ApplyUserRemove(uint32_t session) {
+	priv_->ApplyUserRemove(session);
+	priv_->Flush();
+}
+
+void ServerState::Clear() {
+	priv_->Clear();
+}
+
+uint64_t ServerState::Version() const {
+	return priv_->version_;
+}
+
+const ServerChannel *ServerState::Channel(uint32_t channel_id) const {
+	return priv_->tables_.Channel(channel_id);
+}
+
+const ServerUser *ServerState::User(uint32_t session) const {
+	return priv_->tables_.User(session);
+}
+
+int ServerState::NumChannels() const {
+	return static_cast<int>(priv_->tables_.channels_.size());
+}
+
+int ServerState::NumUsers() const {
+	return static_cast<int>(priv_->tables_.users_.size());
+}
+
+std::shared_ptr<const ServerStateSnapshot> ServerState::Snapshot() const {
+	return priv_->Snapshot();
+}
+
+ServerState& ServerState::SetChangeHandler(ServerStateChangeHandler fn) {
+	priv_->change_handler_ = fn;
+	return *this;
+}
+
+}
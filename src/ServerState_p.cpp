@@ -0,0 +1,479 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "ServerState_p.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace mumble {
+
+// kUnregistered is the user_id that servers send for
+// users whose registration has been removed.
+static const uint32_t kUnregistered = 0xffffffff;
+
+static void AddId(std::vector<uint32_t> *ids, uint32_t id) {
+	if (std::find(ids->begin(), ids->end(), id) == ids->end()) {
+		ids->push_back(id);
+	}
+}
+
+static void RemoveId(std::vector<uint32_t> *ids, uint32_t id) {
+	std::vector<uint32_t>::iterator it = std::find(ids->begin(), ids->end(), id);
+	if (it != ids->end()) {
+		*it = ids->back();
+		ids->pop_back();
+	}
+}
+
+// Blob returns a shared copy of *view*, or null if it is empty.
+static std::shared_ptr<const std::string> Blob(const ByteView &view) {
+	if (view.Length() == 0) {
+		return std::shared_ptr<const std::string>();
+	}
+	return std::make_shared<const std::string>(view.ConstData(), view.Length());
+}
+
+static void Assign(std::string *s, const ByteView &view) {
+	s->assign(view.ConstData() != nullptr ? view.ConstData() : "", view.Length());
+}
+
+const ServerChannel *ServerStateTables::Channel(uint32_t channel_id) const {
+	int i = channel_index_.Find(channel_id);
+	return i < 0 ? nullptr : &channels_[i];
+}
+
+ServerChannel *ServerStateTables::MutableChannel(uint32_t channel_id) {
+	int i = channel_index_.Find(channel_id);
+	if (i >= 0) {
+		dirty_channels_.push_back(channel_id);
+	}
+	return i < 0 ? nullptr : &channels_[i];
+}
+
+ServerChannel *ServerStateTables::AddChannel(uint32_t channel_id) {
+	dirty_channels_.push_back(channel_id);
+	channel_index_.Set(channel_id, static_cast<int>(channels_.size()));
+	channels_.push_back(ServerChannel());
+	channels_.back().channel_id = channel_id;
+	return &channels_.back();
+}
+
+void ServerStateTables::RemoveChannel(uint32_t channel_id) {
+	int i = channel_index_.Find(channel_id);
+	if (i < 0) {
+		return;
+	}
+	dirty_channels_.push_back(channel_id);
+	int last = static_cast<int>(channels_.size()) - 1;
+	if (i != last) {
+		std::swap(channels_[i], channels_[last]);
+		channel_index_.Set(channels_[i].channel_id, i);
+	}
+	channels_.pop_back();
+	channel_index_.Erase(channel_id);
+}
+
+const ServerUser *ServerStateTables::User(uint32_t session) const {
+	int i = user_index_.Find(session);
+	return i < 0 ? nullptr : &users_[i];
+}
+
+ServerUser *ServerStateTables::MutableUser(uint32_t session) {
+	int i = user_index_.Find(session);
+	if (i >= 0) {
+		dirty_users_.push_back(session);
+	}
+	return i < 0 ? nullptr : &users_[i];
+}
+
+ServerUser *ServerStateTables::AddUser(uint32_t session) {
+	dirty_users_.push_back(session);
+	user_index_.Set(session, static_cast<int>(users_.size()));
+	users_.push_back(ServerUser());
+	users_.back().session = session;
+	return &users_.back();
+}
+
+void ServerStateTables::RemoveUser(uint32_t session) {
+	int i = user_index_.Find(session);
+	if (i < 0) {
+		return;
+	}
+	dirty_users_.push_back(session);
+	int last = static_cast<int>(users_.size()) - 1;
+	if (i != last) {
+		std::swap(users_[i], users_[last]);
+		user_index_.Set(users_[i].session, i);
+	}
+	users_.pop_back();
+	user_index_.Erase(session);
+}
+
+void ServerStateTables::Clear() {
+	channels_.clear();
+	channel_index_.Clear();
+	users_.clear();
+	user_index_.Clear();
+	dirty_channels_.clear();
+	dirty_users_.clear();
+}
+
+bool ServerRemoveMessage::Validate() const {
+	return HasScalar(1);
+}
+
+ServerStatePrivate::ServerStatePrivate() : version_(0), published_version_(0) {
+	Publish();
+}
+
+bool ServerStatePrivate::Apply(MessageType type, const ByteView &payload) {
+	switch (type) {
+		case MESSAGE_TYPE_CHANNEL_STATE:
+			if (!channel_state_.Parse(payload)) {
+				return false;
+			}
+			ApplyChannelState(channel_state_);
+			channel_state_.Clear();
+			return true;
+		case MESSAGE_TYPE_USER_STATE:
+			if (!user_state_.Parse(payload)) {
+				return false;
+			}
+			ApplyUserState(user_state_);
+			user_state_.Clear();
+			return true;
+		case MESSAGE_TYPE_CHANNEL_REMOVE:
+			if (!remove_.Parse(payload)) {
+				return false;
+			}
+			ApplyChannelRemove(remove_.Id());
+			return true;
+		case MESSAGE_TYPE_USER_REMOVE:
+			if (!remove_.Parse(payload)) {
+				return false;
+			}
+			ApplyUserRemove(remove_.Id());
+			return true;
+		default:
+			return true;
+	}
+}
+
+// ApplyChannelState creates or updates a channel. Servers announce
+// parents before their sub-channels, so a channel is added to its
+// parent's children as soon as its parent is set.
+void ServerStatePrivate::ApplyChannelState(const LazyChannelState &msg) {
+	if (!msg.HasChannelId()) {
+		return;
+	}
+	uint32_t id = msg.ChannelId();
+	bool added = false;
+	ServerChannel *c = tables_.MutableChannel(id);
+	if (c == nullptr) {
+		c = tables_.AddChannel(id);
+		added = true;
+	}
+
+	if (msg.HasParent() && msg.Parent() != id && (!c->has_parent || c->parent != msg.Parent())) {
+		if (c->has_parent) {
+			ServerChannel *old = tables_.MutableChannel(c->parent);
+			if (old != nullptr) {
+				RemoveId(&old->children, id);
+			}
+		}
+		c->has_parent = true;
+		c->parent = msg.Parent();
+		ServerChannel *parent = tables_.MutableChannel(c->parent);
+		if (parent != nullptr) {
+			AddId(&parent->children, id);
+		}
+	}
+	if (msg.HasName()) {
+		Assign(&c->name, msg.Name());
+	}
+	if (msg.HasPosition()) {
+		c->position = msg.Position();
+	}
+	if (msg.HasTemporary()) {
+		c->temporary = msg.Temporary();
+	}
+	if (msg.HasDescription()) {
+		c->description = Blob(msg.Description());
+	}
+	if (msg.HasDescriptionHash()) {
+		Assign(&c->description_hash, msg.DescriptionHash());
+	}
+
+	// A non-empty list of links replaces the channel's links.
+	if (!msg.Links().empty()) {
+		std::vector<uint32_t> old = c->links;
+		for (uint32_t l : old) {
+			if (std::find(msg.Links().begin(), msg.Links().end(), l) == msg.Links().end()) {
+				Unlink(id, l);
+			}
+		}
+		for (uint32_t l : msg.Links()) {
+			Link(id, l);
+		}
+	}
+	for (uint32_t l : msg.LinksAdd()) {
+		Link(id, l);
+	}
+	for (uint32_t l : msg.LinksRemove()) {
+		Unlink(id, l);
+	}
+
+	Notify(added ? SERVER_STATE_CHANNEL_ADDED : SERVER_STATE_CHANNEL_UPDATED, id);
+}
+
+// ApplyChannelRemove removes a channel. Servers move or remove the
+// channel's users and sub-channels first; anything that is left is
+// moved to the channel's parent.
+void ServerStatePrivate::ApplyChannelRemove(uint32_t channel_id) {
+	ServerChannel *c = tables_.MutableChannel(channel_id);
+	if (c == nullptr) {
+		return;
+	}
+	bool has_parent = c->has_parent && c->parent != channel_id;
+	uint32_t parent_id = c->parent;
+	std::vector<uint32_t> links = c->links;
+	std::vector<uint32_t> children = c->children;
+	std::vector<uint32_t> users = c->users;
+
+	for (uint32_t l : links) {
+		Unlink(channel_id, l);
+	}
+	ServerChannel *parent = has_parent ? tables_.MutableChannel(parent_id) : nullptr;
+	if (parent != nullptr) {
+		RemoveId(&parent->children, channel_id);
+	}
+	for (uint32_t child_id : children) {
+		ServerChannel *child = tables_.MutableChannel(child_id);
+		if (child == nullptr) {
+			continue;
+		}
+		child->has_parent = parent != nullptr;
+		child->parent = parent != nullptr ? parent_id : 0;
+		if (parent != nullptr) {
+			AddId(&parent->children, child_id);
+		}
+	}
+	tables_.RemoveChannel(channel_id);
+
+	if (has_parent && tables_.Channel(parent_id) != nullptr) {
+		for (uint32_t session : users) {
+			ServerUser *u = tables_.MutableUser(session);
+			if (u != nullptr) {
+				MoveUser(u, parent_id);
+				Notify(SERVER_STATE_USER_MOVED, session);
+			}
+		}
+	}
+	Notify(SERVER_STATE_CHANNEL_REMOVED, channel_id);
+}
+
+// ApplyUserState creates or updates a user. New users that are
+// announced without a channel are in the root channel.
+void ServerStatePrivate::ApplyUserState(const LazyUserState &msg) {
+	if (!msg.HasSession()) {
+		return;
+	}
+	uint32_t session = msg.Session();
+	bool added = false;
+	bool moved = false;
+	ServerUser *u = tables_.MutableUser(session);
+	if (u == nullptr) {
+		u = tables_.AddUser(session);
+		u->channel_id = msg.HasChannelId() ? msg.ChannelId() : 0;
+		ServerChannel *c = tables_.MutableChannel(u->channel_id);
+		if (c != nullptr) {
+			AddId(&c->users, session);
+		}
+		added = true;
+	} else if (msg.HasChannelId() && msg.ChannelId() != u->channel_id) {
+		MoveUser(u, msg.ChannelId());
+		moved = true;
+	}
+
+	if (msg.HasName()) {
+		Assign(&u->name, msg.Name());
+	}
+	if (msg.HasUserId()) {
+		u->has_user_id = msg.UserId() != kUnregistered;
+		u->user_id = u->has_user_id ? msg.UserId() : 0;
+	}
+	if (msg.HasHash()) {
+		Assign(&u->hash, msg.Hash());
+	}
+	if (msg.HasMute()) {
+		u->mute = msg.Mute();
+	}
+	if (msg.HasDeaf()) {
+		u->deaf = msg.Deaf();
+	}
+	if (msg.HasSuppress()) {
+		u->suppress = msg.Suppress();
+	}
+	if (msg.HasSelfMute()) {
+		u->self_mute = msg.SelfMute();
+	}
+	if (msg.HasSelfDeaf()) {
+		u->self_deaf = msg.SelfDeaf();
+	}
+	if (msg.HasPrioritySpeaker()) {
+		u->priority_speaker = msg.PrioritySpeaker();
+	}
+	if (msg.HasRecording()) {
+		u->recording = msg.Recording();
+	}
+	if (msg.HasTexture()) {
+		u->texture = Blob(msg.Texture());
+	}
+	if (msg.HasTextureHash()) {
+		Assign(&u->texture_hash, msg.TextureHash());
+	}
+	if (msg.HasComment()) {
+		u->comment = Blob(msg.Comment());
+	}
+	if (msg.HasCommentHash()) {
+		Assign(&u->comment_hash, msg.CommentHash());
+	}
+	if (msg.HasPluginContext()) {
+		Assign(&u->plugin_context, msg.PluginContext());
+	}
+	if (msg.HasPluginIdentity()) {
+		Assign(&u->plugin_identity, msg.PluginIdentity());
+	}
+
+	Notify(added ? SERVER_STATE_USER_ADDED : (moved ? SERVER_STATE_USER_MOVED : SERVER_STATE_USER_UPDATED), session);
+}
+
+void ServerStatePrivate::ApplyUserRemove(uint32_t session) {
+	ServerUser *u = tables_.MutableUser(session);
+	if (u == nullptr) {
+		return;
+	}
+	ServerChannel *c = tables_.MutableChannel(u->channel_id);
+	if (c != nullptr) {
+		RemoveId(&c->users, session);
+	}
+	tables_.RemoveUser(session);
+	Notify(SERVER_STATE_USER_REMOVED, session);
+}
+
+void ServerStatePrivate::Clear() {
+	tables_.Clear();
+	tree_.channels_.Clear();
+	tree_.users_.Clear();
+	version_++;
+	Publish();
+}
+
+// Flush copies the channels and users that were modified since the
+// last call from tables_ into tree_, publishes a new snapshot if the
+// state has changed, and only then calls the change handler, so the
+// handler sees the new snapshot.
+//
+// Copying a record and setting it in tree_ takes O(log n), and only
+// copies the nodes on its path, so applying a UserState that does
+// not move the user costs the same regardless of the number of users.
+void ServerStatePrivate::Flush() {
+	std::sort(tables_.dirty_channels_.begin(), tables_.dirty_channels_.end());
+	std::vector<uint32_t>::iterator end = std::unique(tables_.dirty_channels_.begin(), tables_.dirty_channels_.end());
+	for (std::vector<uint32_t>::iterator it = tables_.dirty_channels_.begin(); it != end; ++it) {
+		const ServerChannel *c = tables_.Channel(*it);
+		if (c != nullptr) {
+			tree_.channels_.Set(*it, std::make_shared<const ServerChannel>(*c));
+		} else {
+			tree_.channels_.Erase(*it);
+		}
+	}
+	tables_.dirty_channels_.clear();
+
+	std::sort(tables_.dirty_users_.begin(), tables_.dirty_users_.end());
+	end = std::unique(tables_.dirty_users_.begin(), tables_.dirty_users_.end());
+	for (std::vector<uint32_t>::iterator it = tables_.dirty_users_.begin(); it != end; ++it) {
+		const ServerUser *u = tables_.User(*it);
+		if (u != nullptr) {
+			tree_.users_.Set(*it, std::make_shared<const ServerUser>(*u));
+		} else {
+			tree_.users_.Erase(*it);
+		}
+	}
+	tables_.dirty_users_.clear();
+
+	if (version_ != published_version_) {
+		Publish();
+	}
+
+	if (!pending_.empty()) {
+		// The handler may apply further messages.
+		std::vector<std::pair<ServerStateChange, uint32_t> > changes;
+		changes.swap(pending_);
+		for (const std::pair<ServerStateChange, uint32_t> &change : changes) {
+			change_handler_(change.first, change.second);
+		}
+	}
+}
+
+// Publish makes a snapshot of tree_ available to Snapshot. The
+// snapshot shares all of its nodes and records with tree_.
+void ServerStatePrivate::Publish() {
+	ServerStateSnapshot *snapshot = new ServerStateSnapshot;
+	snapshot->tree_.reset(new ServerStateTree(tree_));
+	snapshot->version_ = version_;
+	std::atomic_store(&published_, std::shared_ptr<const ServerStateSnapshot>(snapshot));
+	published_version_ = version_;
+}
+
+std::shared_ptr<const ServerStateSnapshot> ServerStatePrivate::Snapshot() const {
+	return std::atomic_load(&published_);
+}
+
+// Link links channels *a* and *b* in both directions.
+void ServerStatePrivate::Link(uint32_t a, uint32_t b) {
+	if (a == b) {
+		return;
+	}
+	ServerChannel *ca = tables_.MutableChannel(a);
+	ServerChannel *cb = tables_.MutableChannel(b);
+	if (ca == nullptr || cb == nullptr) {
+		return;
+	}
+	AddId(&ca->links, b);
+	AddId(&cb->links, a);
+}
+
+void ServerStatePrivate::Unlink(uint32_t a, uint32_t b) {
+	ServerChannel *ca = tables_.MutableChannel(a);
+	ServerChannel *cb = tables_.MutableChannel(b);
+	if (ca != nullptr) {
+		RemoveId(&ca->links, b);
+	}
+	if (cb != nullptr) {
+		RemoveId(&cb->links, a);
+	}
+}
+
+void ServerStatePrivate::MoveUser(ServerUser *user, uint32_t channel_id) {
+	ServerChannel *from = tables_.MutableChannel(user->channel_id);
+	if (from != nullptr) {
+		RemoveId(&from->users, user->session);
+	}
+	ServerChannel *to = tables_.MutableChannel(channel_id);
+	if (to != nullptr) {
+		AddId(&to->users, user->session);
+	}
+	user->channel_id = channel_id;
+}
+
+void ServerStatePrivate::Notify(ServerStateChange change, uint32_t id) {
+	version_++;
+	if (change_handler_) {
+		pending_.push_back(std::make_pair(change, id));
+	}
+}
+
+}
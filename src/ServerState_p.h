@@ -0,0 +1,108 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_SERVERSTATE_P_H_
+#define MUMBLE_SERVERSTATE_P_H_
+
+#include <mumble/ServerState.h>
+#include <mumble/LazyMessage.h>
+
+#include "FlatIndex.h"
+#include "PersistentMap.h"
+
+#include <vector>
+#include <utility>
+
+namespace mumble {
+
+// ServerStateTables holds the channels and users of a ServerState
+// in two flat tables, each with an index by id. Removing an entry
+// moves the last entry of its table into the hole.
+//
+// The ids of the channels and users handed out for modification,
+// added or removed are recorded, so that only those need to be
+// copied into the ServerState's ServerStateTree.
+class ServerStateTables {
+public:
+	const ServerChannel *Channel(uint32_t channel_id) const;
+	ServerChannel *MutableChannel(uint32_t channel_id);
+	ServerChannel *AddChannel(uint32_t channel_id);
+	void RemoveChannel(uint32_t channel_id);
+
+	const ServerUser *User(uint32_t session) const;
+	ServerUser *MutableUser(uint32_t session);
+	ServerUser *AddUser(uint32_t session);
+	void RemoveUser(uint32_t session);
+
+	void Clear();
+
+	std::vector<ServerChannel>  channels_;
+	FlatIndex                   channel_index_;
+	std::vector<ServerUser>     users_;
+	FlatIndex                   user_index_;
+	std::vector<uint32_t>       dirty_channels_;
+	std::vector<uint32_t>       dirty_users_;
+};
+
+// ServerStateTree holds the channels and users of a ServerStateSnapshot.
+// Snapshots share the records and most of the tree with the snapshots
+// taken before and after them.
+class ServerStateTree {
+public:
+	PersistentMap<ServerChannel>  channels_;
+	PersistentMap<ServerUser>     users_;
+};
+
+// ServerRemoveMessage is a lazily decoded ChannelRemove
+// or UserRemove message. Both carry the id of what is
+// removed in field 1.
+class ServerRemoveMessage : public LazyMessage {
+public:
+	uint32_t Id() const { return static_cast<uint32_t>(Scalar(1)); }
+
+protected:
+	virtual bool Validate() const;
+};
+
+class ServerStatePrivate {
+public:
+	ServerStatePrivate();
+
+	bool Apply(MessageType type, const ByteView &payload);
+	void ApplyChannelState(const LazyChannelState &msg);
+	void ApplyChannelRemove(uint32_t channel_id);
+	void ApplyUserState(const LazyUserState &msg);
+	void ApplyUserRemove(uint32_t session);
+	void Clear();
+	void Flush();
+	void Publish();
+	std::shared_ptr<const ServerStateSnapshot> Snapshot() const;
+
+	void Link(uint32_t a, uint32_t b);
+	void Unlink(uint32_t a, uint32_t b);
+	void MoveUser(ServerUser *user, uint32_t channel_id);
+	void Notify(ServerStateChange change, uint32_t id);
+
+	ServerStateTables                                         tables_;
+	uint64_t                                                  version_;
+	ServerStateChangeHandler                                  change_handler_;
+	std::vector<std::pair<ServerStateChange, uint32_t> >      pending_;
+
+	// tree_ follows tables_, and is copied into each published
+	// snapshot. published_ is only accessed through std::atomic_load
+	// and std::atomic_store, as it is read from other threads.
+	ServerStateTree                                           tree_;
+	uint64_t                                                  published_version_;
+	std::shared_ptr<const ServerStateSnapshot>                published_;
+
+	// The messages that Apply parses into are
+	// kept around for their allocations.
+	LazyChannelState                                          channel_state_;
+	LazyUserState                                             user_state_;
+	ServerRemoveMessage                                       remove_;
+};
+
+}
+
+#endif
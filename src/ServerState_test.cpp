@@ -0,0 +1,430 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/ServerState.h>
+
+#include "Mumble.pb.h"
+#include "PersistentMap.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "uv.h"
+
+using namespace mumble;
+
+static bool Apply(ServerState &state, MessageType type, const ::google::protobuf::MessageLite &msg) {
+	std::string wire = msg.SerializeAsString();
+	return state.Apply(type, ByteView(wire.data(), static_cast<int>(wire.size())));
+}
+
+static void AddChannel(ServerState &state, uint32_t id, uint32_t parent, const std::string &name) {
+	MumbleProto::ChannelState cs;
+	cs.set_channel_id(id);
+	if (id != parent) {
+		cs.set_parent(parent);
+	}
+	cs.set_name(name);
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_CHANNEL_STATE, cs));
+}
+
+static void SetUserChannel(ServerState &state, uint32_t session, uint32_t channel_id) {
+	MumbleProto::UserState us;
+	us.set_session(session);
+	us.set_channel_id(channel_id);
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_USER_STATE, us));
+}
+
+static bool Contains(const std::vector<uint32_t> &ids, uint32_t id) {
+	return std::find(ids.begin(), ids.end(), id) != ids.end();
+}
+
+TEST(ServerStateTest, ChannelTree) {
+	ServerState state;
+	AddChannel(state, 0, 0, "Root");
+	AddChannel(state, 1, 0, "A");
+	AddChannel(state, 2, 0, "B");
+	AddChannel(state, 3, 1, "A1");
+
+	ASSERT_EQ(4, state.NumChannels());
+	const ServerChannel *root = state.Channel(0);
+	ASSERT_TRUE(root != nullptr);
+	EXPECT_FALSE(root->has_parent);
+	EXPECT_EQ("Root", root->name);
+	EXPECT_EQ(2U, root->children.size());
+	EXPECT_TRUE(Contains(root->children, 1));
+	EXPECT_TRUE(Contains(root->children, 2));
+	EXPECT_TRUE(Contains(state.Channel(1)->children, 3));
+
+	// Move A1 from A to B.
+	MumbleProto::ChannelState cs;
+	cs.set_channel_id(3);
+	cs.set_parent(2);
+	cs.set_description(std::string(1000, 'd'));
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_CHANNEL_STATE, cs));
+	EXPECT_TRUE(state.Channel(1)->children.empty());
+	EXPECT_TRUE(Contains(state.Channel(2)->children, 3));
+	EXPECT_EQ(2U, state.Channel(3)->parent);
+	EXPECT_EQ("A1", state.Channel(3)->name);
+	ASSERT_TRUE(state.Channel(3)->description != nullptr);
+	EXPECT_EQ(1000U, state.Channel(3)->description->size());
+	EXPECT_TRUE(state.Channel(4) == nullptr);
+}
+
+TEST(ServerStateTest, UsersMove) {
+	ServerState state;
+	AddChannel(state, 0, 0, "Root");
+	AddChannel(state, 1, 0, "A");
+
+	MumbleProto::UserState us;
+	us.set_session(10);
+	us.set_name("alice");
+	us.set_user_id(7);
+	us.set_texture(std::string(5000, 't'));
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_USER_STATE, us));
+
+	const ServerUser *alice = state.User(10);
+	ASSERT_TRUE(alice != nullptr);
+	EXPECT_EQ("alice", alice->name);
+	EXPECT_EQ(0U, alice->channel_id);
+	EXPECT_TRUE(alice->has_user_id);
+	EXPECT_EQ(7U, alice->user_id);
+	ASSERT_TRUE(alice->texture != nullptr);
+	EXPECT_EQ(5000U, alice->texture->size());
+	EXPECT_TRUE(Contains(state.Channel(0)->users, 10));
+
+	SetUserChannel(state, 10, 1);
+	alice = state.User(10);
+	EXPECT_EQ(1U, alice->channel_id);
+	EXPECT_EQ("alice", alice->name);
+	EXPECT_TRUE(state.Channel(0)->users.empty());
+	EXPECT_TRUE(Contains(state.Channel(1)->users, 10));
+
+	// An empty texture clears it; user_id 0xffffffff unregisters.
+	MumbleProto::UserState upd;
+	upd.set_session(10);
+	upd.set_texture("");
+	upd.set_user_id(0xffffffff);
+	upd.set_self_mute(true);
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_USER_STATE, upd));
+	alice = state.User(10);
+	EXPECT_TRUE(alice->texture == nullptr);
+	EXPECT_FALSE(alice->has_user_id);
+	EXPECT_TRUE(alice->self_mute);
+
+	MumbleProto::UserRemove ur;
+	ur.set_session(10);
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_USER_REMOVE, ur));
+	EXPECT_TRUE(state.User(10) == nullptr);
+	EXPECT_EQ(0, state.NumUsers());
+	EXPECT_TRUE(state.Channel(1)->users.empty());
+}
+
+TEST(ServerStateTest, Links) {
+	ServerState state;
+	AddChannel(state, 0, 0, "Root");
+	AddChannel(state, 1, 0, "A");
+	AddChannel(state, 2, 0, "B");
+	AddChannel(state, 3, 0, "C");
+
+	MumbleProto::ChannelState cs;
+	cs.set_channel_id(1);
+	cs.add_links(2);
+	cs.add_links(3);
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_CHANNEL_STATE, cs));
+	EXPECT_EQ(2U, state.Channel(1)->links.size());
+	EXPECT_TRUE(Contains(state.Channel(2)->links, 1));
+	EXPECT_TRUE(Contains(state.Channel(3)->links, 1));
+
+	// A full list of links replaces the previous one.
+	cs.Clear();
+	cs.set_channel_id(1);
+	cs.add_links(3);
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_CHANNEL_STATE, cs));
+	EXPECT_EQ(1U, state.Channel(1)->links.size());
+	EXPECT_TRUE(state.Channel(2)->links.empty());
+
+	cs.Clear();
+	cs.set_channel_id(2);
+	cs.add_links_add(3);
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_CHANNEL_STATE, cs));
+	EXPECT_EQ(2U, state.Channel(3)->links.size());
+
+	cs.Clear();
+	cs.set_channel_id(3);
+	cs.add_links_remove(1);
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_CHANNEL_STATE, cs));
+	EXPECT_TRUE(state.Channel(1)->links.empty());
+	EXPECT_EQ(1U, state.Channel(3)->links.size());
+}
+
+TEST(ServerStateTest, ChannelRemove) {
+	ServerState state;
+	AddChannel(state, 0, 0, "Root");
+	AddChannel(state, 1, 0, "A");
+	AddChannel(state, 2, 1, "A1");
+	AddChannel(state, 3, 0, "B");
+	SetUserChannel(state, 20, 1);
+
+	MumbleProto::ChannelState cs;
+	cs.set_channel_id(1);
+	cs.add_links_add(3);
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_CHANNEL_STATE, cs));
+
+	MumbleProto::ChannelRemove cr;
+	cr.set_channel_id(1);
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_CHANNEL_REMOVE, cr));
+
+	EXPECT_EQ(3, state.NumChannels());
+	EXPECT_TRUE(state.Channel(1) == nullptr);
+	EXPECT_EQ(0U, state.Channel(2)->parent);
+	EXPECT_TRUE(Contains(state.Channel(0)->children, 2));
+	EXPECT_FALSE(Contains(state.Channel(0)->children, 1));
+	EXPECT_TRUE(state.Channel(3)->links.empty());
+	EXPECT_EQ(0U, state.User(20)->channel_id);
+	EXPECT_TRUE(Contains(state.Channel(0)->users, 20));
+}
+
+TEST(ServerStateTest, ChangeHandler) {
+	ServerState state;
+	std::vector<std::pair<ServerStateChange, uint32_t>> changes;
+	state.SetChangeHandler([&](ServerStateChange change, uint32_t id) {
+		changes.push_back(std::make_pair(change, id));
+	});
+
+	AddChannel(state, 0, 0, "Root");
+	AddChannel(state, 1, 0, "A");
+	AddChannel(state, 1, 0, "A'");
+	SetUserChannel(state, 5, 0);
+	SetUserChannel(state, 5, 1);
+	SetUserChannel(state, 5, 1);
+	MumbleProto::UserRemove ur;
+	ur.set_session(5);
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_USER_REMOVE, ur));
+
+	ASSERT_EQ(7U, changes.size());
+	EXPECT_EQ(SERVER_STATE_CHANNEL_ADDED, changes[0].first);
+	EXPECT_EQ(SERVER_STATE_CHANNEL_ADDED, changes[1].first);
+	EXPECT_EQ(SERVER_STATE_CHANNEL_UPDATED, changes[2].first);
+	EXPECT_EQ(1U, changes[2].second);
+	EXPECT_EQ(SERVER_STATE_USER_ADDED, changes[3].first);
+	EXPECT_EQ(SERVER_STATE_USER_MOVED, changes[4].first);
+	EXPECT_EQ(SERVER_STATE_USER_UPDATED, changes[5].first);
+	EXPECT_EQ(SERVER_STATE_USER_REMOVED, changes[6].first);
+	EXPECT_EQ(5U, changes[6].second);
+	EXPECT_EQ(7U, state.Version());
+}
+
+TEST(ServerStateTest, Snapshot) {
+	ServerState state;
+	AddChannel(state, 0, 0, "Root");
+	SetUserChannel(state, 1, 0);
+
+	std::shared_ptr<const ServerStateSnapshot> snap = state.Snapshot();
+	EXPECT_EQ(state.Snapshot().get(), snap.get());
+	EXPECT_EQ(state.Version(), snap->Version());
+
+	SetUserChannel(state, 2, 0);
+	AddChannel(state, 1, 0, "A");
+	SetUserChannel(state, 1, 1);
+
+	// The old snapshot is unchanged.
+	EXPECT_EQ(1, snap->NumUsers());
+	EXPECT_EQ(1, snap->NumChannels());
+	EXPECT_EQ(0U, snap->User(1)->channel_id);
+	EXPECT_TRUE(snap->User(2) == nullptr);
+
+	std::shared_ptr<const ServerStateSnapshot> snap2 = state.Snapshot();
+	EXPECT_NE(snap.get(), snap2.get());
+	EXPECT_EQ(2, snap2->NumUsers());
+	EXPECT_EQ(1U, snap2->User(1)->channel_id);
+	int n = 0;
+	snap2->ForEachChannel([&](const ServerChannel &) { n++; });
+	EXPECT_EQ(2, n);
+}
+
+TEST(ServerStateTest, SnapshotIsPublishedBeforeChangeHandler) {
+	ServerState state;
+	AddChannel(state, 0, 0, "Root");
+	uint32_t seen = 0;
+	state.SetChangeHandler([&](ServerStateChange change, uint32_t id) {
+		std::shared_ptr<const ServerStateSnapshot> snap = state.Snapshot();
+		EXPECT_EQ(state.Version(), snap->Version());
+		if (change == SERVER_STATE_USER_ADDED && snap->User(id) != nullptr) {
+			seen = id;
+		}
+	});
+	SetUserChannel(state, 42, 0);
+	EXPECT_EQ(42U, seen);
+}
+
+TEST(ServerStateTest, SnapshotOutlivesRemoval) {
+	ServerState state;
+	AddChannel(state, 0, 0, "Root");
+	MumbleProto::UserState us;
+	us.set_session(3);
+	us.set_comment(std::string(2000, 'c'));
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_USER_STATE, us));
+
+	std::shared_ptr<const ServerStateSnapshot> snap = state.Snapshot();
+	const ServerUser *u = snap->User(3);
+	ASSERT_TRUE(u != nullptr);
+
+	MumbleProto::UserRemove ur;
+	ur.set_session(3);
+	ASSERT_TRUE(Apply(state, MESSAGE_TYPE_USER_REMOVE, ur));
+	state.Clear();
+
+	EXPECT_EQ(0, state.Snapshot()->NumUsers());
+	EXPECT_EQ(0, state.Snapshot()->NumChannels());
+	EXPECT_EQ(u, snap->User(3));
+	EXPECT_EQ(2000U, u->comment->size());
+}
+
+struct SnapshotReader {
+	ServerState        *state;
+	std::atomic<bool>  done;
+	int                snapshots;
+	int                errors;
+};
+
+static void ReadSnapshots(void *arg) {
+	SnapshotReader *r = static_cast<SnapshotReader *>(arg);
+	while (!r->done.load()) {
+		std::shared_ptr<const ServerStateSnapshot> snap = r->state->Snapshot();
+		// Every user in a snapshot is in its channel's member list.
+		int users = 0;
+		snap->ForEachUser([&](const ServerUser &u) {
+			const ServerChannel *c = snap->Channel(u.channel_id);
+			if (c == nullptr || std::find(c->users.begin(), c->users.end(), u.session) == c->users.end()) {
+				r->errors++;
+			}
+			users++;
+		});
+		if (users != snap->NumUsers()) {
+			r->errors++;
+		}
+		r->snapshots++;
+	}
+}
+
+TEST(ServerStateTest, ConcurrentReaders) {
+	ServerState state;
+	AddChannel(state, 0, 0, "Root");
+	for (uint32_t i = 1; i <= 20; i++) {
+		AddChannel(state, i, 0, "Channel");
+	}
+
+	SnapshotReader reader;
+	reader.state = &state;
+	reader.done = false;
+	reader.snapshots = 0;
+	reader.errors = 0;
+	uv_thread_t thread;
+	ASSERT_EQ(0, uv_thread_create(&thread, ReadSnapshots, &reader));
+
+	for (uint32_t i = 0; i < 20000; i++) {
+		SetUserChannel(state, 1 + i % 500, i % 21);
+		if (i % 7 == 0) {
+			MumbleProto::UserRemove ur;
+			ur.set_session(1 + (i * 13) % 500);
+			ASSERT_TRUE(Apply(state, MESSAGE_TYPE_USER_REMOVE, ur));
+		}
+	}
+	reader.done = true;
+	uv_thread_join(&thread);
+
+	EXPECT_EQ(0, reader.errors);
+	EXPECT_LT(0, reader.snapshots);
+	EXPECT_EQ(state.Version(), state.Snapshot()->Version());
+	EXPECT_EQ(state.NumUsers(), state.Snapshot()->NumUsers());
+}
+
+TEST(ServerStateTest, ManyUsers) {
+	ServerState state;
+	AddChannel(state, 0, 0, "Root");
+	for (uint32_t i = 1; i <= 1000; i++) {
+		SetUserChannel(state, i, 0);
+	}
+	for (uint32_t i = 1; i <= 1000; i += 2) {
+		MumbleProto::UserRemove ur;
+		ur.set_session(i);
+		ASSERT_TRUE(Apply(state, MESSAGE_TYPE_USER_REMOVE, ur));
+	}
+	EXPECT_EQ(500, state.NumUsers());
+	for (uint32_t i = 1; i <= 1000; i++) {
+		const ServerUser *u = state.User(i);
+		if (i % 2 == 1) {
+			EXPECT_TRUE(u == nullptr);
+		} else {
+			ASSERT_TRUE(u != nullptr);
+			EXPECT_EQ(i, u->session);
+		}
+	}
+}
+
+TEST(ServerStateTest, Malformed) {
+	ServerState state;
+	std::string bad("\x08", 1);
+	EXPECT_FALSE(state.Apply(MESSAGE_TYPE_USER_STATE, ByteView(bad.data(), 1)));
+	EXPECT_FALSE(state.Apply(MESSAGE_TYPE_USER_REMOVE, ByteView()));
+	EXPECT_TRUE(state.Apply(MESSAGE_TYPE_PING, ByteView(bad.data(), 1)));
+	EXPECT_EQ(0, state.NumUsers());
+	EXPECT_EQ(0U, state.Version());
+}
+
+TEST(PersistentMapTest, MatchesMap) {
+	PersistentMap<int> pm;
+	std::map<uint32_t, int> m;
+	std::vector<PersistentMap<int> > copies;
+	std::vector<std::map<uint32_t, int> > expected;
+
+	srand(1);
+	for (int i = 0; i < 20000; i++) {
+		// Mostly small keys, with some that only differ in their
+		// high bits, to build deep paths.
+		uint32_t key = static_cast<uint32_t>(rand() % 2000);
+		if (i % 5 == 0) {
+			key |= static_cast<uint32_t>(rand() % 4) << 30;
+		}
+		if (rand() % 3 == 0) {
+			pm.Erase(key);
+			m.erase(key);
+		} else {
+			pm.Set(key, std::make_shared<const int>(i));
+			m[key] = i;
+		}
+		if (i % 2000 == 0) {
+			copies.push_back(pm);
+			expected.push_back(m);
+		}
+	}
+
+	copies.push_back(pm);
+	expected.push_back(m);
+	for (size_t c = 0; c < copies.size(); c++) {
+		ASSERT_EQ(expected[c].size(), copies[c].Size());
+		size_t n = 0;
+		copies[c].ForEach([&](const int &) { n++; });
+		EXPECT_EQ(expected[c].size(), n);
+		for (const std::pair<const uint32_t, int> &kv : expected[c]) {
+			const int *v = copies[c].Find(kv.first);
+			ASSERT_TRUE(v != nullptr);
+			EXPECT_EQ(kv.second, *v);
+		}
+	}
+
+	for (std::pair<const uint32_t, int> kv : m) {
+		pm.Erase(kv.first);
+	}
+	EXPECT_EQ(0U, pm.Size());
+	EXPECT_TRUE(pm.Find(m.begin()->first) == nullptr);
+	EXPECT_EQ(expected.back().size(), copies.back().Size());
+}
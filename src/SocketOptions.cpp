@@ -0,0 +1,141 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "SocketOptions.h"
+#include <mumble/TLSConnection.h>
+#include <mumble/Error.h>
+#include "SocketUtils.h"
+
+#include "uv.h"
+
+#include <string>
+
+#ifndef LIBMUMBLE_OS_WINDOWS
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <netinet/tcp.h>
+#else
+# include <winsock2.h>
+#endif
+
+namespace mumble {
+
+static Error ErrorNotSupported(const std::string &what) {
+	return Error::ErrorFromDescription(
+		std::string("TLSConnection"),
+		0L,
+		what + std::string(" is not supported on this platform")
+	);
+}
+
+static Error SetIntOption(uv_os_sock_t sock, int level, int name, int value, const std::string &what) {
+	if (setsockopt(sock, level, name, reinterpret_cast<const char *>(&value), sizeof(value)) != 0) {
+		return SocketUtils::ErrorFromSocketError(std::string("TLSConnection"), std::string("unable to set ") + what, SocketUtils::LastError());
+	}
+	return Error::NoError();
+}
+
+bool SocketOptions::NeedsSocket(const TLSConnectionOptions &opts) {
+	return opts.send_buffer_size > 0 || opts.receive_buffer_size > 0 ||
+	       opts.not_sent_low_water_mark > 0 || opts.dscp >= 0 ||
+	       opts.tcp_quick_ack || opts.busy_poll_usec > 0;
+}
+
+Error SocketOptions::OpenSocket(uv_tcp_t *tcp, uv_os_sock_t *sockp) {
+	uv_os_sock_t sock = SocketUtils::InvalidSocket();
+	Error err = SocketUtils::OpenSocket(std::string("TLSConnection"), SOCK_STREAM, &sock);
+	if (err.HasError()) {
+		return err;
+	}
+
+	if (uv_tcp_open(tcp, sock) != UV_OK) {
+		SocketUtils::Close(sock);
+		return Error::ErrorFromStaticDescription(
+			"TLSConnection",
+			0L,
+			"unable to open socket in libuv"
+		);
+	}
+
+	*sockp = sock;
+	return Error::NoError();
+}
+
+Error SocketOptions::Apply(uv_os_sock_t sock, const TLSConnectionOptions &opts) {
+	Error err;
+
+	if (opts.send_buffer_size > 0) {
+		err = SetIntOption(sock, SOL_SOCKET, SO_SNDBUF, opts.send_buffer_size, std::string("SO_SNDBUF"));
+		if (err.HasError()) {
+			return err;
+		}
+	}
+
+	if (opts.receive_buffer_size > 0) {
+		err = SetIntOption(sock, SOL_SOCKET, SO_RCVBUF, opts.receive_buffer_size, std::string("SO_RCVBUF"));
+		if (err.HasError()) {
+			return err;
+		}
+	}
+
+	if (opts.not_sent_low_water_mark > 0) {
+#ifdef TCP_NOTSENT_LOWAT
+		err = SetIntOption(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, opts.not_sent_low_water_mark, std::string("TCP_NOTSENT_LOWAT"));
+		if (err.HasError()) {
+			return err;
+		}
+#else
+		return ErrorNotSupported(std::string("TCP_NOTSENT_LOWAT"));
+#endif
+	}
+
+	if (opts.dscp >= 0) {
+		if (opts.dscp > 63) {
+			return Error::ErrorFromStaticDescription(
+				"TLSConnection",
+				0L,
+				"dscp must be between 0 and 63"
+			);
+		}
+		// The code point occupies the upper six bits of the TOS byte.
+		err = SetIntOption(sock, IPPROTO_IP, IP_TOS, opts.dscp << 2, std::string("IP_TOS"));
+		if (err.HasError()) {
+			return err;
+		}
+	}
+
+	if (opts.tcp_quick_ack) {
+#ifdef TCP_QUICKACK
+		err = SetIntOption(sock, IPPROTO_TCP, TCP_QUICKACK, 1, std::string("TCP_QUICKACK"));
+		if (err.HasError()) {
+			return err;
+		}
+#else
+		return ErrorNotSupported(std::string("TCP_QUICKACK"));
+#endif
+	}
+
+	if (opts.busy_poll_usec > 0) {
+#ifdef SO_BUSY_POLL
+		err = SetIntOption(sock, SOL_SOCKET, SO_BUSY_POLL, opts.busy_poll_usec, std::string("SO_BUSY_POLL"));
+		if (err.HasError()) {
+			return err;
+		}
+#else
+		return ErrorNotSupported(std::string("SO_BUSY_POLL"));
+#endif
+	}
+
+	return Error::NoError();
+}
+
+void SocketOptions::RearmQuickAck(uv_os_sock_t sock) {
+#ifdef TCP_QUICKACK
+	int one = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+#endif
+}
+
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_SOCKET_OPTIONS_H_
+#define MUMBLE_SOCKET_OPTIONS_H_
+
+#include <mumble/TLSConnection.h>
+#include <mumble/Error.h>
+
+#include "uv.h"
+
+namespace mumble {
+
+// SocketOptions applies the socket-level settings of a
+// TLSConnectionOptions to the socket of a TCP connection.
+//
+// libuv does not hand out the socket of a TCP handle, so
+// the socket is passed in by whoever created or accepted it.
+class SocketOptions {
+public:
+	// NeedsSocket returns whether *opts* has any settings that
+	// SocketOptions must apply. If it does not, a TCP handle can
+	// be left to create its socket lazily.
+	static bool NeedsSocket(const TLSConnectionOptions &opts);
+
+	// OpenSocket creates an IPv4 TCP socket and opens *tcp* with it,
+	// such that options can be applied before connecting. The socket
+	// is stored in *sock*.
+	static Error OpenSocket(uv_tcp_t *tcp, uv_os_sock_t *sock);
+
+	// Apply applies all socket-level settings in *opts* to *sock*.
+	// It stops at, and returns, the first failure.
+	static Error Apply(uv_os_sock_t sock, const TLSConnectionOptions &opts);
+
+	// RearmQuickAck disables delayed ACKs on *sock* again. The
+	// kernel re-enables them on its own after a while.
+	static void RearmQuickAck(uv_os_sock_t sock);
+};
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/TLSConnection.h>
+#include "SocketOptions.h"
+#include "SocketUtils.h"
+
+#include <uv.h>
+
+#include <string>
+
+#ifndef LIBMUMBLE_OS_WINDOWS
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <netinet/tcp.h>
+#else
+# include <winsock2.h>
+# include <ws2tcpip.h>
+#endif
+
+using namespace mumble;
+
+// SocketOptionsTest opens a TCP handle with a socket of
+// its own, the way TLSConnection does before connecting.
+class SocketOptionsTest : public ::testing::Test {
+protected:
+	virtual void SetUp() {
+		loop_ = uv_loop_new();
+		uv_tcp_init(loop_, &tcp_);
+		sock_ = SocketUtils::InvalidSocket();
+		ASSERT_FALSE(SocketOptions::OpenSocket(&tcp_, &sock_).HasError());
+		ASSERT_NE(SocketUtils::InvalidSocket(), sock_);
+	}
+
+	virtual void TearDown() {
+		uv_close(reinterpret_cast<uv_handle_t *>(&tcp_), nullptr);
+		uv_run(loop_, UV_RUN_DEFAULT);
+		uv_loop_delete(loop_);
+	}
+
+	int IntOption(int level, int name) {
+		int value = 0;
+		socklen_t len = sizeof(value);
+		EXPECT_EQ(0, getsockopt(sock_, level, name, reinterpret_cast<char *>(&value), &len));
+		return value;
+	}
+
+	uv_loop_t     *loop_;
+	uv_tcp_t      tcp_;
+	uv_os_sock_t  sock_;
+};
+
+TEST(SocketOptionsNeedsSocketTest, OnlyForSocketSettings) {
+	TLSConnectionOptions opts;
+	EXPECT_FALSE(SocketOptions::NeedsSocket(opts));
+
+	opts.tcp_no_delay = !opts.tcp_no_delay;
+	opts.bulk_chunk_size = 1024;
+	EXPECT_FALSE(SocketOptions::NeedsSocket(opts));
+
+	TLSConnectionOptions sndbuf;
+	sndbuf.send_buffer_size = 65536;
+	EXPECT_TRUE(SocketOptions::NeedsSocket(sndbuf));
+
+	TLSConnectionOptions rcvbuf;
+	rcvbuf.receive_buffer_size = 65536;
+	EXPECT_TRUE(SocketOptions::NeedsSocket(rcvbuf));
+
+	TLSConnectionOptions lowat;
+	lowat.not_sent_low_water_mark = 16384;
+	EXPECT_TRUE(SocketOptions::NeedsSocket(lowat));
+
+	TLSConnectionOptions dscp;
+	dscp.dscp = 0;
+	EXPECT_TRUE(SocketOptions::NeedsSocket(dscp));
+
+	TLSConnectionOptions quickack;
+	quickack.tcp_quick_ack = true;
+	EXPECT_TRUE(SocketOptions::NeedsSocket(quickack));
+
+	TLSConnectionOptions busypoll;
+	busypoll.busy_poll_usec = 50;
+	EXPECT_TRUE(SocketOptions::NeedsSocket(busypoll));
+}
+
+TEST_F(SocketOptionsTest, DefaultsLeaveSocketAlone) {
+	int sndbuf = IntOption(SOL_SOCKET, SO_SNDBUF);
+	int tos = IntOption(IPPROTO_IP, IP_TOS);
+
+	TLSConnectionOptions opts;
+	ASSERT_FALSE(SocketOptions::Apply(sock_, opts).HasError());
+	EXPECT_EQ(sndbuf, IntOption(SOL_SOCKET, SO_SNDBUF));
+	EXPECT_EQ(tos, IntOption(IPPROTO_IP, IP_TOS));
+}
+
+TEST_F(SocketOptionsTest, AppliesBufferSizesAndDSCP) {
+	TLSConnectionOptions opts;
+	opts.send_buffer_size = 96 * 1024;
+	opts.receive_buffer_size = 80 * 1024;
+	opts.dscp = 46;
+	ASSERT_FALSE(SocketOptions::Apply(sock_, opts).HasError());
+
+	// Some kernels double the buffer sizes they are
+	// given, to make room for their own bookkeeping.
+	EXPECT_GE(IntOption(SOL_SOCKET, SO_SNDBUF), opts.send_buffer_size);
+	EXPECT_GE(IntOption(SOL_SOCKET, SO_RCVBUF), opts.receive_buffer_size);
+	EXPECT_EQ(46 << 2, IntOption(IPPROTO_IP, IP_TOS));
+}
+
+TEST_F(SocketOptionsTest, RejectsOutOfRangeDSCP) {
+	TLSConnectionOptions opts;
+	opts.dscp = 64;
+	EXPECT_TRUE(SocketOptions::Apply(sock_, opts).HasError());
+}
+
+TEST_F(SocketOptionsTest, PlatformSpecificOptions) {
+	TLSConnectionOptions lowat;
+	lowat.not_sent_low_water_mark = 16384;
+	Error err = SocketOptions::Apply(sock_, lowat);
+#ifdef TCP_NOTSENT_LOWAT
+	ASSERT_FALSE(err.HasError());
+	EXPECT_EQ(16384, IntOption(IPPROTO_TCP, TCP_NOTSENT_LOWAT));
+#else
+	EXPECT_TRUE(err.HasError());
+#endif
+
+	TLSConnectionOptions quickack;
+	quickack.tcp_quick_ack = true;
+	err = SocketOptions::Apply(sock_, quickack);
+#ifdef TCP_QUICKACK
+	ASSERT_FALSE(err.HasError());
+	EXPECT_EQ(1, IntOption(IPPROTO_TCP, TCP_QUICKACK));
+#else
+	EXPECT_TRUE(err.HasError());
+#endif
+}
+
+TEST(SocketOptionsErrorTest, DescribesSocketErrors) {
+	TLSConnectionOptions opts;
+	opts.send_buffer_size = 65536;
+	Error err = SocketOptions::Apply(SocketUtils::InvalidSocket(), opts);
+	ASSERT_TRUE(err.HasError());
+	EXPECT_NE(0L, err.Code());
+	EXPECT_EQ(0U, err.Description().find("unable to set SO_SNDBUF: "));
+	EXPECT_GT(err.Description().size(), std::string("unable to set SO_SNDBUF: ").size());
+}
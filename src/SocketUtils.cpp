@@ -0,0 +1,115 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "SocketUtils.h"
+#include <mumble/Error.h>
+
+#include "uv.h"
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+
+#ifndef LIBMUMBLE_OS_WINDOWS
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <fcntl.h>
+# include <unistd.h>
+#else
+# include <winsock2.h>
+#endif
+
+namespace mumble {
+
+uv_os_sock_t SocketUtils::InvalidSocket() {
+#ifndef LIBMUMBLE_OS_WINDOWS
+	return -1;
+#else
+	return INVALID_SOCKET;
+#endif
+}
+
+int SocketUtils::LastError() {
+#ifndef LIBMUMBLE_OS_WINDOWS
+	return errno;
+#else
+	return WSAGetLastError();
+#endif
+}
+
+bool SocketUtils::WouldBlock(int err) {
+#ifndef LIBMUMBLE_OS_WINDOWS
+	return err == EAGAIN || err == EWOULDBLOCK;
+#else
+	return err == WSAEWOULDBLOCK;
+#endif
+}
+
+bool SocketUtils::Interrupted(int err) {
+#ifndef LIBMUMBLE_OS_WINDOWS
+	return err == EINTR;
+#else
+	return false;
+#endif
+}
+
+Error SocketUtils::OpenSocket(const std::string &domain, int type, uv_os_sock_t *sockp) {
+	uv_os_sock_t sock = socket(AF_INET, type, 0);
+	if (sock == InvalidSocket()) {
+		return ErrorFromSocketError(domain, std::string("unable to create socket"), LastError());
+	}
+	Error err = SetNonBlocking(domain, sock);
+	if (err.HasError()) {
+		Close(sock);
+		return err;
+	}
+	*sockp = sock;
+	return Error::NoError();
+}
+
+Error SocketUtils::SetNonBlocking(const std::string &domain, uv_os_sock_t sock) {
+#ifndef LIBMUMBLE_OS_WINDOWS
+	int flags = fcntl(sock, F_GETFL);
+	if (flags == -1 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1) {
+		return ErrorFromSocketError(domain, std::string("unable to set O_NONBLOCK"), errno);
+	}
+#else
+	u_long nonblocking = 1;
+	if (ioctlsocket(sock, FIONBIO, &nonblocking) != 0) {
+		return ErrorFromSocketError(domain, std::string("unable to set FIONBIO"), WSAGetLastError());
+	}
+#endif
+	return Error::NoError();
+}
+
+void SocketUtils::Close(uv_os_sock_t sock) {
+#ifndef LIBMUMBLE_OS_WINDOWS
+	close(sock);
+#else
+	closesocket(sock);
+#endif
+}
+
+// strerror only knows about errno values, so
+// Winsock errors are looked up with FormatMessage.
+Error SocketUtils::ErrorFromSocketError(const std::string &domain, const std::string &desc, int err) {
+#ifndef LIBMUMBLE_OS_WINDOWS
+	std::string msg(strerror(err));
+#else
+	char buf[256];
+	DWORD n = FormatMessageA(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, nullptr,
+	                         static_cast<DWORD>(err), 0, buf, sizeof(buf), nullptr);
+	while (n > 0 && (buf[n-1] == '\r' || buf[n-1] == '\n')) {
+		n--;
+	}
+	std::string msg(buf, n);
+#endif
+	return Error::ErrorFromDescription(
+		domain,
+		static_cast<long>(err),
+		desc + std::string(": ") + msg
+	);
+}
+
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_SOCKET_UTILS_H_
+#define MUMBLE_SOCKET_UTILS_H_
+
+#include <mumble/Error.h>
+
+#include "uv.h"
+
+#include <string>
+
+namespace mumble {
+
+// SocketUtils wraps the OS socket calls that differ
+// between Winsock and BSD sockets.
+class SocketUtils {
+public:
+	// InvalidSocket returns the value that stands
+	// for no socket on this platform.
+	static uv_os_sock_t InvalidSocket();
+
+	// LastError returns the error of the last socket
+	// call that failed on the calling thread.
+	static int LastError();
+
+	// WouldBlock returns whether *err* means that a call on
+	// a non-blocking socket would have blocked.
+	static bool WouldBlock(int err);
+
+	// Interrupted returns whether *err* means that a call
+	// was interrupted by a signal, and is to be retried.
+	static bool Interrupted(int err);
+
+	// OpenSocket creates a non-blocking IPv4 socket of *type*,
+	// such as SOCK_STREAM, and stores it in *sock*. Errors are
+	// reported in *domain*.
+	static Error OpenSocket(const std::string &domain, int type, uv_os_sock_t *sock);
+
+	// SetNonBlocking makes *sock* non-blocking, as libuv
+	// expects of the sockets it is given.
+	static Error SetNonBlocking(const std::string &domain, uv_os_sock_t sock);
+
+	// Close closes *sock*.
+	static void Close(uv_os_sock_t sock);
+
+	// ErrorFromSocketError returns an Error in *domain* for the
+	// socket error *err*, as returned by LastError, described by
+	// *desc* followed by the system's description of *err*.
+	static Error ErrorFromSocketError(const std::string &domain, const std::string &desc, int err);
+};
+
+}
+
+#endif
@@ -9,6 +9,21 @@
 
 namespace mumble {
 
+TLSConnectionOptions::TLSConnectionOptions()
+	: tcp_no_delay(false), event_loop(nullptr), executor(nullptr), bulk_chunk_size(16384), send_buffer_size(0),
+	  receive_buffer_size(0), not_sent_low_water_mark(0), dscp(-1), tcp_quick_ack(false), busy_poll_usec(0),
+	  dynamic_record_sizing(true), min_record_size(1400), record_size_ramp_bytes(128 * 1024), record_size_idle_ms(1000) {
+}
+
+TLSConnectionWriteInfo::TLSConnectionWriteInfo() : enqueue_time(0), encrypt_time(0), write_time(0) {
+}
+
+TLSConnectionHandlerStats::TLSConnectionHandlerStats() : queue_length(0), executed(0), total_lag(0), max_lag(0) {
+}
+
+TLSConnectionRecordStats::TLSConnectionRecordStats() : records(0), bytes(0), small_records(0) {
+}
+
 TLSConnection::TLSConnection() : priv_(new TLSConnectionPrivate) {
 }
 
@@ -23,8 +38,16 @@ void TLSConnection::Disconnect() {
 	priv_->Disconnect();
 }
 
-void TLSConnection::Write(const ByteArray &buf) {
-	priv_->Write(buf);
+void TLSConnection::Write(const ByteArray &buf, TLSConnectionWritePriority prio, TLSConnectionWriteCompletionHandler done) {
+	priv_->Write(buf, prio, done);
+}
+
+TLSConnectionHandlerStats TLSConnection::HandlerStats() const {
+	return priv_->HandlerStats();
+}
+
+TLSConnectionRecordStats TLSConnection::RecordStats() const {
+	return priv_->RecordStats();
 }
 
 TLSConnection& TLSConnection::SetChainVerifyHandler(TLSConnectionChainVerifyHandler fn) {
@@ -42,6 +65,11 @@ TLSConnection& TLSConnection::SetReadHandler(TLSConnectionReadHandler fn) {
 	return *this;
 }
 
+TLSConnection& TLSConnection::SetReadBatchHandler(TLSConnectionReadBatchHandler fn) {
+	priv_->read_batch_handler_ = fn;
+	return *this;
+}
+
 TLSConnection& TLSConnection::SetErrorHandler(TLSConnectionErrorHandler fn) {
 	priv_->error_handler_ = fn;
 	return *this;
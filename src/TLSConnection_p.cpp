@@ -8,12 +8,19 @@
 #include "X509Certificate_p.h"
 #include <mumble/Error.h>
 #include <mumble/X509Verifier.h>
+#include <mumble/EventLoop.h>
+#include "EventLoop_p.h"
 #include "OpenSSLUtils.h"
 #include "UVUtils.h"
 #include "UVBio.h"
+#include "SocketOptions.h"
+#include "SocketUtils.h"
+#include "BufferPool.h"
 #include "Utils.h"
 
+#include <algorithm>
 #include <string>
+#include <cstring>
 #include <iostream>
 #include <assert.h>
 
@@ -24,59 +31,233 @@
 
 namespace mumble {
 
-TLSConnectionPrivate::TLSConnectionPrivate() : thread_id_(0) {
+TLSConnectionPrivate::TLSConnectionPrivate()
+	: state_(TLS_CONNECTION_STATE_INVALID), own_loop_(nullptr), evloop_(nullptr), loop_(nullptr),
+	  sock_(SocketUtils::InvalidSocket()), open_handles_(0), thread_id_(0), biostate_(nullptr), server_(false), owns_ctx_(false),
+	  ctx_(nullptr), ssl_(nullptr), bio_(nullptr), wq_bulk_off_(0), record_ramp_bytes_(0),
+	  last_record_time_(0), records_sent_(0), record_bytes_sent_(0), small_records_sent_(0) {
 	OpenSSLUtils::EnsureInitialized();
+	uv_mutex_init(&wqlock_);
 }
 
 TLSConnectionPrivate::~TLSConnectionPrivate() {
+	if (own_loop_ != nullptr) {
+		Disconnect();
+		delete own_loop_;
+	}
+	FreeSSL();
+	uv_mutex_destroy(&wqlock_);
 }
 
 Error TLSConnectionPrivate::Connect(const std::string &ipaddr, int port, TLSConnectionOptions *opts) {
-	int err;
+	if (opts != nullptr) {
+		opts_ = *opts;
+	}
+	SetupStrand();
 
-	loop_ = uv_loop_new();
+	EventLoopPrivate *loop = nullptr;
+	if (opts_.event_loop != nullptr) {
+		loop = opts_.event_loop->priv_.get();
+	// Without a shared EventLoop, the TLSConnection runs on an
+	// I/O thread of its own.
+	} else {
+		delete own_loop_;
+		own_loop_ = new EventLoop;
+		Error err = own_loop_->Start(&opts_.thread_options);
+		if (err.HasError()) {
+			delete own_loop_;
+			own_loop_ = nullptr;
+			return err;
+		}
+		loop = own_loop_->priv_.get();
+	}
 
 	struct sockaddr_in addr = uv_ip4_addr(ipaddr.c_str(), port);
 
-	err = uv_tcp_init(loop_, &tcpsock_);
-	if (err != UV_OK) {
-		return UVUtils::ErrorFromLastUVError(loop_);
+	Error err;
+	bool ok = loop->RunSync([&] {
+		err = AttachToLoop(loop);
+		if (!err.HasError()) {
+			err = StartConnect(addr);
+		}
+	});
+	if (!ok) {
+		return Error::ErrorFromStaticDescription(
+			"TLSConnection",
+			0L,
+			"event loop is not running"
+		);
 	}
 
-	if (opts != nullptr) {
-		uv_tcp_nodelay(&tcpsock_, opts->tcp_no_delay ? 1 : 0);
-	}
+	return err;
+}
 
-	tcpconn_.data = static_cast<void *>(this);
-	tcpsock_.data = static_cast<void *>(this);
-	err = uv_tcp_connect(&tcpconn_, &tcpsock_, addr, TLSConnectionPrivate::OnConnect);
+// AttachToLoop prepares the TLSConnection for running on *loop*.
+// Must be called on the thread of *loop*.
+Error TLSConnectionPrivate::AttachToLoop(EventLoopPrivate *loop) {
+	int err;
+
+	evloop_ = loop;
+	loop_ = loop->loop_;
+
+	err = uv_tcp_init(loop_, &tcpsock_);
 	if (err != UV_OK) {
 		return UVUtils::ErrorFromLastUVError(loop_);
 	}
+	tcpsock_.data = static_cast<void *>(this);
 
-	uv_mutex_init(&wqlock_);
 	uv_async_init(loop_, &wqasync_, TLSConnectionPrivate::OnDrainWriteQueue);
 	wqasync_.data = this;
 
 	uv_async_init(loop_, &dcasync_, TLSConnectionPrivate::OnDisconnectRequest);
 	dcasync_.data = this;
 
+	record_ramp_bytes_ = 0;
+	last_record_time_ = 0;
+	records_sent_ = 0;
+	record_bytes_sent_ = 0;
+	small_records_sent_ = 0;
+
+	open_handles_ = 3;
+	thread_id_.store(uv_thread_self());
+
+	return Error::NoError();
+}
+
+Error TLSConnectionPrivate::StartConnect(struct sockaddr_in addr) {
+	int err;
+
+	// Socket options must be in place before connecting, since
+	// the buffer sizes determine the TCP window scale negotiated
+	// during the handshake. libuv only creates the socket once it
+	// connects, so create it up front.
+	if (SocketOptions::NeedsSocket(opts_)) {
+		Error sockerr = SocketOptions::OpenSocket(&tcpsock_, &sock_);
+		if (!sockerr.HasError()) {
+			sockerr = SocketOptions::Apply(sock_, opts_);
+		}
+		if (sockerr.HasError()) {
+			state_ = TLS_CONNECTION_STATE_INVALID;
+			Shutdown(TLS_CONNECTION_STATE_INVALID);
+			return sockerr;
+		}
+	}
+
+	uv_tcp_nodelay(&tcpsock_, opts_.tcp_no_delay ? 1 : 0);
+
 	state_ = TLS_CONNECTION_STATE_PRE_CONNECT;
 
-	err = uv_thread_create(&thread_, TLSConnectionPrivate::TLSConnectionThread, this);
-	if (err  == -1) {
-		return Error::ErrorFromDescription(
-			std::string("TLSConnection"),
-			0L,
-			std::string("unable to create connection thread")
-		);
+	tcpconn_.data = static_cast<void *>(this);
+	err = uv_tcp_connect(&tcpconn_, &tcpsock_, addr, TLSConnectionPrivate::OnConnect);
+	if (err != UV_OK) {
+		Error uverr = UVUtils::ErrorFromLastUVError(loop_);
+		// Tear down silently; the error is reported to
+		// the caller of Connect instead of the handlers.
+		state_ = TLS_CONNECTION_STATE_INVALID;
+		Shutdown(TLS_CONNECTION_STATE_INVALID);
+		return uverr;
+	}
+
+	return Error::NoError();
+}
+
+Error TLSConnectionPrivate::AcceptSocket(EventLoopPrivate *loop, uv_os_sock_t sock, SSL_CTX *ctx, TLSConnectionOptions *opts) {
+	Error err = AttachToLoop(loop);
+	if (err.HasError()) {
+		return err;
+	}
+
+	if (uv_tcp_open(&tcpsock_, sock) != UV_OK) {
+		err = UVUtils::ErrorFromLastUVError(loop_);
+		Shutdown(TLS_CONNECTION_STATE_INVALID);
+		return err;
+	}
+	sock_ = sock;
+
+	return StartAccept(loop, ctx, opts);
+}
+
+// StartAccept begins the server side of the TLS handshake
+// on an accepted TCP connection.
+Error TLSConnectionPrivate::StartAccept(EventLoopPrivate *loop, SSL_CTX *ctx, TLSConnectionOptions *opts) {
+	if (opts != nullptr) {
+		opts_ = *opts;
+	}
+	SetupStrand();
+
+	uv_tcp_nodelay(&tcpsock_, opts_.tcp_no_delay ? 1 : 0);
+
+	Error sockerr = SocketOptions::Apply(sock_, opts_);
+	if (sockerr.HasError()) {
+		Shutdown(TLS_CONNECTION_STATE_INVALID);
+		return sockerr;
+	}
+
+	int err = uv_read_start(reinterpret_cast<uv_stream_t *>(&tcpsock_), TLSConnectionPrivate::AllocCallback, TLSConnectionPrivate::OnRead);
+	if (err != UV_OK) {
+		Error uverr = UVUtils::ErrorFromLastUVError(loop_);
+		Shutdown(TLS_CONNECTION_STATE_INVALID);
+		return uverr;
+	}
+
+	Error sslerr = SetupSSL(ctx, true);
+	if (sslerr.HasError()) {
+		Shutdown(TLS_CONNECTION_STATE_INVALID);
+		return sslerr;
+	}
+
+	state_ = TLS_CONNECTION_STATE_STARVED_SSL_CONNECT;
+	HandleStarvedConnectState();
+
+	return Error::NoError();
+}
+
+// SetupSSL creates the TLSConnection's SSL object, and hooks
+// it up to the TLSConnection's socket via a UVBio.
+Error TLSConnectionPrivate::SetupSSL(SSL_CTX *ctx, bool server) {
+	server_ = server;
+	ctx_ = ctx;
+	ssl_ = SSL_new(ctx_);
+	SSL_set_app_data(ssl_, this);
+	if (!opts_.cipher_list.empty()) {
+		if (SSL_set_cipher_list(ssl_, opts_.cipher_list.c_str()) != 1) {
+			return OpenSSLUtils::ErrorFromLastCryptoError();
+		}
 	}
+	if (server) {
+		SSL_set_accept_state(ssl_);
+	} else {
+		SSL_set_connect_state(ssl_);
+	}
+	bio_ = BIO_new(UVBioState::GetMethod());
+	biostate_ = new UVBioState(reinterpret_cast<uv_stream_t *>(&tcpsock_));
+	biostate_->write_done_handler_ = [this](int status) {
+		OnSocketWriteDone(status);
+	};
+	bio_->ptr = biostate_;
+	SSL_set_bio(ssl_, bio_, bio_);
 
 	return Error::NoError();
 }
 
+void TLSConnectionPrivate::FreeSSL() {
+	// SSL_free also frees the BIO.
+	if (ssl_ != nullptr) {
+		SSL_free(ssl_);
+		ssl_ = nullptr;
+		bio_ = nullptr;
+	}
+	delete biostate_;
+	biostate_ = nullptr;
+	if (owns_ctx_ && ctx_ != nullptr) {
+		SSL_CTX_free(ctx_);
+	}
+	ctx_ = nullptr;
+	owns_ctx_ = false;
+}
+
 bool TLSConnectionPrivate::HandleStarvedConnectState() {
-	int err = SSL_connect(ssl_);
+	int err = SSL_do_handshake(ssl_);
 	if (err < 0) {
 		int SSLerr = SSL_get_error(ssl_, err);
 		if (SSLerr != SSL_ERROR_WANT_READ && SSLerr != SSL_ERROR_WANT_WRITE) {
@@ -97,9 +278,16 @@ bool TLSConnectionPrivate::HandleStarvedConnectState() {
 
 void TLSConnectionPrivate::TransitionToConnectionEstablishedState() {
 	state_ = TLS_CONNECTION_STATE_ESTABLISHED;
-	if (established_handler_) {
+	if (established_handler_ && strand_) {
+		strand_->Post(established_handler_);
+	} else if (established_handler_) {
 		established_handler_();
 	}
+	// Send anything that was written before the
+	// connection was established.
+	if (state_ == TLS_CONNECTION_STATE_ESTABLISHED) {
+		DrainWriteQueue();
+	}
 }
 
 // Request TLSConnection to close its connection.
@@ -114,13 +302,29 @@ void TLSConnectionPrivate::Disconnect() {
 }
 
 void TLSConnectionPrivate::Shutdown(TLSConnectionState state) {
+	bool closing = state_ == TLS_CONNECTION_STATE_DISCONNECTED_ERROR ||
+	               state_ == TLS_CONNECTION_STATE_DISCONNECTED_REMOTE ||
+	               state_ == TLS_CONNECTION_STATE_DISCONNECTED_LOCAL;
+	if (closing || open_handles_ == 0) {
+		return;
+	}
+	// A failed connection setup may already have started
+	// closing our handles while in the invalid state.
+	if (uv_is_closing(reinterpret_cast<uv_handle_t *>(&tcpsock_))) {
+		return;
+	}
+
 	state_ = state;
-	uv_close(reinterpret_cast<uv_handle_t *>(&tcpsock_), nullptr);
-	uv_close(reinterpret_cast<uv_handle_t *>(&wqasync_), nullptr);
-	uv_close(reinterpret_cast<uv_handle_t *>(&dcasync_), nullptr);
+	if (shutdown_hook_) {
+		TLSConnectionShutdownHook hook;
+		hook.swap(shutdown_hook_);
+		hook();
+	}
+	uv_close(reinterpret_cast<uv_handle_t *>(&tcpsock_), TLSConnectionPrivate::OnHandleClosed);
+	uv_close(reinterpret_cast<uv_handle_t *>(&wqasync_), TLSConnectionPrivate::OnHandleClosed);
+	uv_close(reinterpret_cast<uv_handle_t *>(&dcasync_), TLSConnectionPrivate::OnHandleClosed);
 }
 
-// Shutdown because we encountered an error.
 void TLSConnectionPrivate::ShutdownError(const Error &err) {
 	err_ = err;
 	Shutdown(TLS_CONNECTION_STATE_DISCONNECTED_ERROR);
@@ -130,75 +334,366 @@ void TLSConnectionPrivate::ShutdownRemote() {
 	Shutdown(TLS_CONNECTION_STATE_DISCONNECTED_REMOTE);
 }
 
-void TLSConnectionPrivate::Write(const ByteArray &buf) {
-	// If called from within the runloop's thread, allow the operation
-	// to go through immediately.
-	unsigned long us = uv_thread_self();
-	unsigned long it = thread_id_.load();
-	if (us == it) {
-		int nread = SSL_write(ssl_, reinterpret_cast<const void *>(buf.ConstData()), buf.Length());
-		if (nread < 0) {
-			int SSLerr = SSL_get_error(ssl_, nread);
-			this->ShutdownError(OpenSSLUtils::ErrorFromOpenSSLErrorCode(SSLerr));
-		} else if (nread == 0) {
-			this->ShutdownRemote();
-		}
-	// If called from another thread, add it to the write queue and
-	// inform the runloop that there are new bytes to be written.
-	} else if (it > 0) {
-		uv_mutex_lock(&wqlock_);
-		wq_.push(buf);
-		uv_mutex_unlock(&wqlock_);
-		uv_async_send(&wqasync_);
+void TLSConnectionPrivate::OnHandleClosed(uv_handle_t *handle) {
+	TLSConnectionPrivate *cp = static_cast<TLSConnectionPrivate *>(handle->data);
+	assert(cp != nullptr);
+
+	cp->open_handles_--;
+	if (cp->open_handles_ == 0) {
+		cp->Finish();
 	}
 }
 
-void TLSConnectionPrivate::TLSConnectionThread(void *udata) {
-	TLSConnectionPrivate *cp = static_cast<TLSConnectionPrivate *>(udata);
+// Finish is called once all of the TLSConnection's handles have
+// been closed. It releases the connection's resources and notifies
+// the TLSConnection's handlers.
+void TLSConnectionPrivate::Finish() {
+	thread_id_.store(0);
 
-	cp->thread_id_.store(uv_thread_self());
+	FailWrites();
+	FreeSSL();
 
-	uv_loop_t *loop = cp->loop_;
-	int err;
-
-	err = uv_run(loop, UV_RUN_DEFAULT);
-	if (err != UV_OK) {
-		cp->state_ = TLS_CONNECTION_STATE_DISCONNECTED_ERROR;
-		cp->err_ = UVUtils::ErrorFromLastUVError(loop);
+	// Let our own I/O thread exit once we're done here. If a
+	// handler calls Connect again, it gets a fresh one.
+	if (own_loop_ != nullptr) {
+		own_loop_->Stop();
 	}
 
-	cp->thread_id_.store(0);
-
-	uv_loop_delete(loop);
+	// The finished hook may destroy the TLSConnection, so it
+	// must not be called via a member.
+	TLSConnectionFinishedHook hook = finished_hook_;
 
-	uv_mutex_lock(&cp->wqlock_);
-	cp->wq_ = std::queue<ByteArray>();
-	uv_mutex_unlock(&cp->wqlock_);
-
-	switch (cp->state_) {
+	std::function<void ()> handler;
+	switch (state_) {
 		case TLS_CONNECTION_STATE_DISCONNECTED_LOCAL:
-			if (cp->disconnect_handler_) {
-				cp->disconnect_handler_(true);
+			if (disconnect_handler_) {
+				TLSConnectionDisconnectHandler fn = disconnect_handler_;
+				handler = [fn] { fn(true); };
 			}
 			break;
 		case TLS_CONNECTION_STATE_DISCONNECTED_REMOTE:
-			if (cp->disconnect_handler_) {
-				cp->disconnect_handler_(false);
+			if (disconnect_handler_) {
+				TLSConnectionDisconnectHandler fn = disconnect_handler_;
+				handler = [fn] { fn(false); };
 			}
 			break;
 		case TLS_CONNECTION_STATE_DISCONNECTED_ERROR:
-			if (cp->error_handler_) {
-				cp->error_handler_(cp->err_);
+			if (error_handler_) {
+				TLSConnectionErrorHandler fn = error_handler_;
+				Error err = err_;
+				handler = [fn, err] { fn(err); };
 			}
 			break;
 		default:
-			NotReached();
+			// Setup failed, and the error has already been
+			// returned to the caller.
+			break;
+	}
+
+	// With an Executor, the finished hook runs on the strand
+	// as well, such that it only runs once all handler calls
+	// of the connection are done.
+	if (strand_) {
+		if (handler) {
+			strand_->Post(handler);
+		}
+		if (hook) {
+			strand_->Post(hook);
+		}
+		return;
+	}
+
+	if (handler) {
+		handler();
+	}
+	if (hook) {
+		hook();
+	}
+}
+
+void TLSConnectionPrivate::Write(const ByteArray &buf, TLSConnectionWritePriority prio, const TLSConnectionWriteCompletionHandler &done) {
+	WriteData(buf.ConstData(), buf.Length(), nullptr, prio, done);
+}
+
+// WriteData writes *len* bytes starting at *data*. If *buf* is non-null,
+// it holds the same data, and its storage is handed over to the write
+// queue if the data cannot be sent right away. Otherwise, the data is
+// only copied if it has to be queued.
+void TLSConnectionPrivate::WriteData(const char *data, int len, ByteArray *buf, TLSConnectionWritePriority prio, const TLSConnectionWriteCompletionHandler &done) {
+	unsigned long us = uv_thread_self();
+	unsigned long it = thread_id_.load();
+	if (it == 0) {
+		if (done) {
+			done(Error::ErrorFromStaticDescription(
+				"TLSConnection",
+				0L,
+				"not connected"
+			), TLSConnectionWriteInfo());
+		}
+		return;
+	}
+
+	uint64_t enqueue_time = done ? uv_hrtime() : 0;
+
+	int lane = static_cast<int>(prio);
+	if (lane < 0 || lane >= kNumWriteLanes) {
+		lane = TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE;
+	}
+
+	// If called from within the runloop's thread, and nothing else
+	// is waiting to be sent, allow the operation to go through
+	// immediately.
+	if (us == it && state_ == TLS_CONNECTION_STATE_ESTABLISHED && CanWrite() &&
+	    (lane != TLS_CONNECTION_WRITE_PRIORITY_BULK || len <= BulkChunkSize())) {
+		uv_mutex_lock(&wqlock_);
+		bool idle = wq_[0].empty() && wq_[1].empty() && wq_[2].empty();
+		uv_mutex_unlock(&wqlock_);
+		if (idle) {
+			if (WriteRecord(data, len, lane) && done) {
+				AddCompletion(done, enqueue_time);
+			}
+			return;
+		}
+	}
+
+	// Otherwise, add it to its lane of the write queue and
+	// drain the queue, or inform the runloop that there are
+	// new bytes to be written.
+	ByteArray copy;
+	if (buf != nullptr) {
+		copy.Swap(*buf);
+	} else {
+		ByteArray tmp(const_cast<char *>(data), len);
+		copy.Swap(tmp);
+	}
+	uv_mutex_lock(&wqlock_);
+	wq_[lane].emplace(ByteArray(), done, enqueue_time);
+	wq_[lane].back().buf.Swap(copy);
+	uv_mutex_unlock(&wqlock_);
+	if (us != it) {
+		uv_async_send(&wqasync_);
+	} else if (state_ == TLS_CONNECTION_STATE_ESTABLISHED) {
+		DrainWriteQueue();
+	}
+}
+
+// WriteRecord encrypts and sends *len* bytes starting at *buf*, which
+// were written on *lane*. The data is split into TLS records of the
+// size picked by RecordSize, and of at most a chunk for bulk data.
+// Returns false if the TLSConnection was shut down in the process.
+bool TLSConnectionPrivate::WriteRecord(const char *buf, int len, int lane) {
+	while (len > 0) {
+		int limit = RecordSize(lane);
+		if (lane == TLS_CONNECTION_WRITE_PRIORITY_BULK) {
+			limit = std::min(limit, BulkChunkSize());
+		}
+		int size = len < limit ? len : limit;
+		int nwritten = SSL_write(ssl_, reinterpret_cast<const void *>(buf), size);
+		if (nwritten < 0) {
+			int SSLerr = SSL_get_error(ssl_, nwritten);
+			ShutdownError(OpenSSLUtils::ErrorFromOpenSSLErrorCode(SSLerr));
+			return false;
+		} else if (nwritten == 0) {
+			ShutdownRemote();
+			return false;
+		}
+
+		if (limit < BufferPool::kTLSRecordSize) {
+			small_records_sent_.fetch_add(1, std::memory_order_relaxed);
+		}
+		records_sent_.fetch_add(1, std::memory_order_relaxed);
+		record_bytes_sent_.fetch_add(size, std::memory_order_relaxed);
+		record_ramp_bytes_ += size;
+		buf += size;
+		len -= size;
+	}
+	return true;
+}
+
+// RecordSize returns the largest amount of plaintext to put into the
+// next TLS record written on *lane*. With dynamic record sizing, the
+// connection starts out with records that fit into a single TCP segment,
+// such that the receiver can decrypt each of them as soon as it arrives,
+// and switches to full-size records once enough data has been sent
+// without a break.
+int TLSConnectionPrivate::RecordSize(int lane) {
+	if (!opts_.dynamic_record_sizing) {
+		return BufferPool::kTLSRecordSize;
+	}
+
+	uint64_t now = uv_now(loop_);
+	if (now - last_record_time_ >= static_cast<uint64_t>(opts_.record_size_idle_ms)) {
+		record_ramp_bytes_ = 0;
+	}
+	last_record_time_ = now;
+
+	int small = opts_.min_record_size;
+	if (small <= 0 || small > BufferPool::kTLSRecordSize) {
+		small = BufferPool::kTLSRecordSize;
+	}
+	if (lane == TLS_CONNECTION_WRITE_PRIORITY_REALTIME ||
+	    record_ramp_bytes_ < static_cast<uint64_t>(opts_.record_size_ramp_bytes)) {
+		return small;
+	}
+	return BufferPool::kTLSRecordSize;
+}
+
+// AddCompletion registers *done* to be called once the
+// latest write to the socket has completed.
+void TLSConnectionPrivate::AddCompletion(const TLSConnectionWriteCompletionHandler &done, uint64_t enqueue_time) {
+	PendingCompletion pc;
+	pc.seq = biostate_->write_seq_;
+	pc.done = done;
+	pc.info.enqueue_time = enqueue_time;
+	pc.info.encrypt_time = uv_hrtime();
+
+	// Nothing was written to the socket on behalf of
+	// this write (it was empty), so it is already done.
+	if (pc.seq <= biostate_->write_done_seq_ && completions_.empty()) {
+		pc.info.write_time = pc.info.encrypt_time;
+		CallCompletion(done, Error::NoError(), pc.info);
+		return;
+	}
+
+	completions_.push_back(pc);
+}
+
+// RunCompletions calls the completion handlers of
+// all writes that have been handed to the kernel.
+void TLSConnectionPrivate::RunCompletions() {
+	if (completions_.empty()) {
+		return;
+	}
+
+	uint64_t now = uv_hrtime();
+	while (!completions_.empty() && completions_.front().seq <= biostate_->write_done_seq_) {
+		// A handler may write again, and thereby add
+		// to completions_, so take the entry off first.
+		PendingCompletion pc = completions_.front();
+		completions_.pop_front();
+		pc.info.write_time = now;
+		CallCompletion(pc.done, Error::NoError(), pc.info);
+		if (biostate_ == nullptr) {
+			return;
+		}
+	}
+}
+
+// FailWrites empties the write queue, and calls the
+// completion handlers of all writes that did not make
+// it to the kernel.
+void TLSConnectionPrivate::FailWrites() {
+	std::vector<QueuedWrite> failed;
+	uv_mutex_lock(&wqlock_);
+	for (int i = 0; i < kNumWriteLanes; i++) {
+		while (!wq_[i].empty()) {
+			if (wq_[i].front().done) {
+				failed.push_back(wq_[i].front());
+			}
+			wq_[i].pop();
+		}
+	}
+	wq_bulk_off_ = 0;
+	uv_mutex_unlock(&wqlock_);
+
+	std::deque<PendingCompletion> pending;
+	pending.swap(completions_);
+
+	if (failed.empty() && pending.empty()) {
+		return;
+	}
+
+	Error err = Error::ErrorFromStaticDescription(
+		"TLSConnection",
+		0L,
+		"connection closed before the write completed"
+	);
+	for (const PendingCompletion &pc : pending) {
+		CallCompletion(pc.done, err, pc.info);
+	}
+	for (const QueuedWrite &qw : failed) {
+		TLSConnectionWriteInfo info;
+		info.enqueue_time = qw.enqueue_time;
+		CallCompletion(qw.done, err, info);
+	}
+}
+
+// SetupStrand creates the strand that the handlers of a new
+// connection run on, if the options ask for an Executor.
+void TLSConnectionPrivate::SetupStrand() {
+	if (opts_.executor != nullptr) {
+		strand_ = std::make_shared<HandlerStrand>(opts_.executor);
+	} else {
+		strand_.reset();
+	}
+}
+
+TLSConnectionHandlerStats TLSConnectionPrivate::HandlerStats() const {
+	if (strand_) {
+		return strand_->Stats();
+	}
+	return TLSConnectionHandlerStats();
+}
+
+TLSConnectionRecordStats TLSConnectionPrivate::RecordStats() const {
+	TLSConnectionRecordStats stats;
+	stats.records = records_sent_.load(std::memory_order_relaxed);
+	stats.bytes = record_bytes_sent_.load(std::memory_order_relaxed);
+	stats.small_records = small_records_sent_.load(std::memory_order_relaxed);
+	return stats;
+}
+
+// CallCompletion calls the write completion handler *done*,
+// on the connection's Executor if it has one.
+void TLSConnectionPrivate::CallCompletion(const TLSConnectionWriteCompletionHandler &done, const Error &err, const TLSConnectionWriteInfo &info) {
+	if (strand_) {
+		TLSConnectionWriteCompletionHandler fn = done;
+		strand_->Post([fn, err, info] {
+			fn(err, info);
+		});
+		return;
+	}
+	done(err, info);
+}
+
+// OnSocketWriteDone is called by the UVBio whenever
+// a write to the socket has completed.
+void TLSConnectionPrivate::OnSocketWriteDone(int status) {
+	if (status != 0) {
+		if (state_ == TLS_CONNECTION_STATE_ESTABLISHED) {
+			ShutdownError(UVUtils::ErrorFromLastUVError(loop_));
+		}
+		return;
+	}
+
+	RunCompletions();
+
+	// The socket has room again. Continue with
+	// whatever is left in the write queue.
+	if (state_ == TLS_CONNECTION_STATE_ESTABLISHED) {
+		DrainWriteQueue();
+	}
+}
+
+// CanWrite returns true if the socket can take more data without
+// building up a queue in front of it. Data that has been handed to
+// the socket can no longer be overtaken by writes with a higher
+// priority, so the drain holds back once a chunk's worth is queued.
+bool TLSConnectionPrivate::CanWrite() const {
+	const uv_stream_t *stream = reinterpret_cast<const uv_stream_t *>(&tcpsock_);
+	return stream->write_queue_size < static_cast<size_t>(BulkChunkSize());
+}
+
+int TLSConnectionPrivate::BulkChunkSize() const {
+	if (opts_.bulk_chunk_size <= 0 || opts_.bulk_chunk_size > BufferPool::kTLSRecordSize) {
+		return BufferPool::kTLSRecordSize;
 	}
+	return opts_.bulk_chunk_size;
 }
 
 uv_buf_t TLSConnectionPrivate::AllocCallback(uv_handle_t *handle, size_t suggested_size) {
-	char *buf = static_cast<char *>(calloc(suggested_size, 1));
-	return uv_buf_init(buf, suggested_size);
+	BufferPool &pool = BufferPool::ReadPool();
+	return uv_buf_init(pool.Acquire(), pool.BlockSize());
 }
 
 void TLSConnectionPrivate::OnRead(uv_stream_t *stream, ssize_t nread, uv_buf_t buf) {
@@ -209,6 +704,9 @@ void TLSConnectionPrivate::OnRead(uv_stream_t *stream, ssize_t nread, uv_buf_t b
 	// the STARVED_SSL_CONNECT and ESTABLISHED states.
 	bool bad = cp->state_ != TLS_CONNECTION_STATE_STARVED_SSL_CONNECT &&
 	           cp->state_ != TLS_CONNECTION_STATE_ESTABLISHED;
+	if (bad || nread <= 0) {
+		BufferPool::ReadPool().Release(buf.base);
+	}
 	if (bad) {
 		return;
 	}
@@ -222,12 +720,18 @@ void TLSConnectionPrivate::OnRead(uv_stream_t *stream, ssize_t nread, uv_buf_t b
 		}
 		return;
 	} else if (nread == 0) {
-		cp->ShutdownRemote();
+		// libuv allocated a buffer, but did not need it
+		// after all. This does not signal EOF.
 		return;
 	}
 
-	ByteArray b(buf.base, nread, buf.len);
-	cp->biostate_->PutNewBuffer(b);
+	if (cp->opts_.tcp_quick_ack) {
+		SocketOptions::RearmQuickAck(cp->sock_);
+	}
+
+	// Hand the buffer to the BIO as-is. It is returned to
+	// the pool once OpenSSL has consumed all of it.
+	cp->biostate_->PutNewBuffer(buf.base, static_cast<int>(nread), &BufferPool::ReadPool());
 
 	if (cp->state_ == TLS_CONNECTION_STATE_STARVED_SSL_CONNECT) {
 		if (!cp->HandleStarvedConnectState()) {
@@ -235,11 +739,17 @@ void TLSConnectionPrivate::OnRead(uv_stream_t *stream, ssize_t nread, uv_buf_t b
 		}
 	}
 
-	if (cp->state_ == TLS_CONNECTION_STATE_ESTABLISHED) {
-		ByteArray processed(static_cast<int>(nread));
+	if (cp->state_ == TLS_CONNECTION_STATE_ESTABLISHED && cp->read_batch_handler_) {
+		cp->ReadBatch();
+	} else if (cp->state_ == TLS_CONNECTION_STATE_ESTABLISHED) {
+		// SSL_read never returns more than the plaintext of a
+		// single record, so size the buffer to fit one. Sizing it
+		// after the amount read from the socket would split
+		// records into many small reads.
+		ByteArray processed(BufferPool::kTLSRecordSize);
 
 		bool backoff = false;
-		while (!backoff) {
+		while (!backoff && cp->state_ == TLS_CONNECTION_STATE_ESTABLISHED) {
 			int nread = SSL_read(cp->ssl_, reinterpret_cast<void *>(processed.Data()), processed.Capacity());
 			if (nread == -1) {
 				int err = SSL_get_error(cp->ssl_, nread);
@@ -256,7 +766,15 @@ void TLSConnectionPrivate::OnRead(uv_stream_t *stream, ssize_t nread, uv_buf_t b
 			}
 
 			processed.Truncate(nread);
-			if (cp->read_handler_) {
+			if (cp->read_handler_ && cp->strand_) {
+				// processed is reused for the next record,
+				// so the handler gets a copy of its own.
+				TLSConnectionReadHandler fn = cp->read_handler_;
+				ByteArray copy(processed.Data(), processed.Length());
+				cp->strand_->Post([fn, copy] {
+					fn(copy);
+				});
+			} else if (cp->read_handler_) {
 				cp->read_handler_(processed);
 			}
 		}
@@ -265,6 +783,95 @@ void TLSConnectionPrivate::OnRead(uv_stream_t *stream, ssize_t nread, uv_buf_t b
 	return;
 }
 
+// ReadBatch decrypts everything that is currently available from
+// the TLS layer into pooled, record-sized blocks, and delivers the
+// result to the read batch handler in a single call.
+void TLSConnectionPrivate::ReadBatch() {
+	BufferPool &pool = BufferPool::RecordPool();
+	const int blocksize = pool.BlockSize();
+
+	char *block = nullptr;
+	int used = 0;
+	bool remote_closed = false;
+	int SSLerr = SSL_ERROR_NONE;
+
+	while (true) {
+		if (block == nullptr) {
+			block = pool.Acquire();
+			used = 0;
+			batch_blocks_.push_back(block);
+		}
+
+		int nread = SSL_read(ssl_, reinterpret_cast<void *>(block + used), blocksize - used);
+		if (nread > 0) {
+			used += nread;
+			// The block is full. Hand it over to the chain and
+			// continue in a fresh one.
+			if (used == blocksize) {
+				batch_views_.push_back(ByteView(block, used));
+				block = nullptr;
+			}
+			continue;
+		} else if (nread == 0) {
+			remote_closed = true;
+			break;
+		}
+
+		int err = SSL_get_error(ssl_, nread);
+		if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+			SSLerr = err;
+		}
+		// OpenSSL needs to be fed more data. Back off.
+		break;
+	}
+
+	if (block != nullptr && used > 0) {
+		batch_views_.push_back(ByteView(block, used));
+	}
+
+	// Deliver whatever was decrypted before the connection
+	// was closed or failed.
+	if (!batch_views_.empty() && strand_) {
+		// The blocks go back to the pool right away, so
+		// the handler gets a copy of the batch instead.
+		int total = 0;
+		for (const ByteView &view : batch_views_) {
+			total += view.Length();
+		}
+		ByteArray copy(total);
+		int off = 0;
+		for (const ByteView &view : batch_views_) {
+			memcpy(copy.Data() + off, view.ConstData(), view.Length());
+			off += view.Length();
+		}
+		TLSConnectionReadBatchHandler fn = read_batch_handler_;
+		strand_->Post([fn, copy] {
+			ByteViewChain chain;
+			chain.push_back(ByteView(copy));
+			fn(chain);
+		});
+	} else if (!batch_views_.empty()) {
+		read_batch_handler_(batch_views_);
+	}
+
+	for (char *blk : batch_blocks_) {
+		pool.Release(blk);
+	}
+	batch_blocks_.clear();
+	batch_views_.clear();
+
+	// The handler may have shut down the connection itself.
+	if (state_ != TLS_CONNECTION_STATE_ESTABLISHED) {
+		return;
+	}
+
+	if (SSLerr != SSL_ERROR_NONE) {
+		ShutdownError(OpenSSLUtils::ErrorFromOpenSSLErrorCode(SSLerr));
+	} else if (remote_closed) {
+		ShutdownRemote();
+	}
+}
+
 // OnDrainWriteQueue ensures that all ByteArrays queued up in the TLSConnection's
 // write queue are sent.
 void TLSConnectionPrivate::OnDrainWriteQueue(uv_async_t *handle, int status) {
@@ -273,13 +880,65 @@ void TLSConnectionPrivate::OnDrainWriteQueue(uv_async_t *handle, int status) {
 
 	TLSConnectionPrivate *cp = static_cast<TLSConnectionPrivate *>(handle->data);
 	if (cp->state_ == TLS_CONNECTION_STATE_ESTABLISHED) {
-		uv_mutex_lock(&cp->wqlock_);
-		while (cp->wq_.size() > 0) {
-			const ByteArray &buf = cp->wq_.front();
-			cp->Write(buf);
-			cp->wq_.pop();
+		cp->DrainWriteQueue();
+	}
+}
+
+// DrainWriteQueue sends queued writes, highest priority first, until
+// the queue is empty or the socket has enough data queued up. In the
+// latter case, draining continues once a write to the socket completes.
+void TLSConnectionPrivate::DrainWriteQueue() {
+	while (state_ == TLS_CONNECTION_STATE_ESTABLISHED && CanWrite()) {
+		QueuedWrite *qw = nullptr;
+		int lane;
+
+		uv_mutex_lock(&wqlock_);
+		for (lane = 0; lane < kNumWriteLanes; lane++) {
+			if (!wq_[lane].empty()) {
+				qw = &wq_[lane].front();
+				break;
+			}
+		}
+		uv_mutex_unlock(&wqlock_);
+		if (qw == nullptr) {
+			break;
+		}
+		const ByteArray *buf = &qw->buf;
+
+		// Bulk writes go out one chunk at a time, such
+		// that other lanes get a chance in between.
+		const char *data = buf->ConstData();
+		int len = buf->Length();
+		bool last = true;
+		if (lane == TLS_CONNECTION_WRITE_PRIORITY_BULK) {
+			data += wq_bulk_off_;
+			len -= wq_bulk_off_;
+			if (len > BulkChunkSize()) {
+				len = BulkChunkSize();
+				last = false;
+			}
+		}
+
+		if (!WriteRecord(data, len, lane)) {
+			return;
+		}
+
+		if (!last) {
+			wq_bulk_off_ += len;
+			continue;
+		}
+		if (lane == TLS_CONNECTION_WRITE_PRIORITY_BULK) {
+			wq_bulk_off_ = 0;
+		}
+		TLSConnectionWriteCompletionHandler done;
+		done.swap(qw->done);
+		uint64_t enqueue_time = qw->enqueue_time;
+		uv_mutex_lock(&wqlock_);
+		wq_[lane].pop();
+		uv_mutex_unlock(&wqlock_);
+		if (done) {
+			AddCompletion(done, enqueue_time);
 		}
-		uv_mutex_unlock(&cp->wqlock_);
 	}
 }
 
@@ -293,7 +952,11 @@ void TLSConnectionPrivate::OnDisconnectRequest(uv_async_t *handle, int status) {
 
 void TLSConnectionPrivate::OnConnect(uv_connect_t *connect, int status) {
 	TLSConnectionPrivate *cp = static_cast<TLSConnectionPrivate *>(connect->data);
-	assert(cp->state_ == TLS_CONNECTION_STATE_PRE_CONNECT);
+
+	// A Disconnect raced the connection attempt.
+	if (cp->state_ != TLS_CONNECTION_STATE_PRE_CONNECT) {
+		return;
+	}
 
 	// Unable to connect.
 	if (status == -1) {
@@ -308,32 +971,47 @@ void TLSConnectionPrivate::OnConnect(uv_connect_t *connect, int status) {
 		return;
 	}
 
-	// Set up the OpenSSL context
-	const SSL_METHOD *meth = TLSv1_client_method();
-	cp->ctx_ = SSL_CTX_new(meth);
+	cp->owns_ctx_ = true;
+	Error sslerr = cp->SetupSSL(TLSConnectionPrivate::CreateClientContext(), false);
+	if (sslerr.HasError()) {
+		cp->ShutdownError(sslerr);
+		return;
+	}
+
+	cp->state_ = TLS_CONNECTION_STATE_STARVED_SSL_CONNECT;
+	cp->HandleStarvedConnectState();
+}
 
-	SSL_CTX_set_verify(cp->ctx_, SSL_VERIFY_PEER|SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
-	SSL_CTX_set_cert_verify_callback(cp->ctx_, TLSConnectionPrivate::SSLVerifyCallback, cp);
+SSL_CTX *TLSConnectionPrivate::CreateClientContext() {
+	// Negotiate the highest protocol version both sides
+	// support, but never fall back to SSL.
+	const SSL_METHOD *meth = SSLv23_client_method();
+	SSL_CTX *ctx = SSL_CTX_new(meth);
+	SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2|SSL_OP_NO_SSLv3);
 
-	cp->ssl_ = SSL_new(cp->ctx_);
-	SSL_set_connect_state(cp->ssl_);
-	cp->bio_ = BIO_new(UVBioState::GetMethod());
-	cp->biostate_ = new UVBioState(connect);
-	cp->bio_->ptr = cp->biostate_;
-	SSL_set_bio(cp->ssl_, cp->bio_, cp->bio_);
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER|SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+	SSL_CTX_set_cert_verify_callback(ctx, TLSConnectionPrivate::SSLVerifyCallback, nullptr);
 
 	// Set an empty X509_STORE as our SSL_CTX cert store.
 	// The default store should be empty as well, but let's
 	// make sure.
 	X509_STORE *store = X509_STORE_new();
-	SSL_CTX_set_cert_store(cp->ctx_, store);
+	SSL_CTX_set_cert_store(ctx, store);
 
-	cp->state_ = TLS_CONNECTION_STATE_STARVED_SSL_CONNECT;
-	cp->HandleStarvedConnectState();
+	return ctx;
+}
+
+// FromSSL returns the TLSConnectionPrivate that owns *ssl*.
+TLSConnectionPrivate *TLSConnectionPrivate::FromSSL(SSL *ssl) {
+	return static_cast<TLSConnectionPrivate *>(SSL_get_app_data(ssl));
 }
 
 int TLSConnectionPrivate::SSLVerifyCallback(X509_STORE_CTX *ctx, void *udata) {
-	TLSConnectionPrivate *cp = static_cast<TLSConnectionPrivate *>(udata);
+	// The SSL_CTX may be shared between many connections (such as
+	// connections accepted by a TLSListener), so look up the
+	// connection via the SSL object being verified.
+	SSL *ssl = static_cast<SSL *>(X509_STORE_CTX_get_ex_data(ctx, SSL_get_ex_data_X509_STORE_CTX_idx()));
+	TLSConnectionPrivate *cp = TLSConnectionPrivate::FromSSL(ssl);
 
 	X509 *cert = ctx->cert;
 	STACK_OF(X509) *chain = ctx->untrusted;
@@ -364,6 +1042,11 @@ int TLSConnectionPrivate::SSLVerifyCallback(X509_STORE_CTX *ctx, void *udata) {
 			return 1;
 		}
 		return 0;
+	} else if (cp->server_) {
+		// Client certificates are typically self-signed, and
+		// are merely used to identify users. Without a chain
+		// verify handler, accept any client certificate.
+		return 1;
 	} else {
 		X509Verifier &v = X509Verifier::SystemVerifier();
 		X509VerifierOptions opts;
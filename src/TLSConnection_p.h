@@ -7,22 +7,41 @@
 
 #include <memory>
 #include <atomic>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <stdint.h>
 
 #include "uv.h"
 
 #include <openssl/ssl.h>
 
 #include <mumble/TLSConnection.h>
+#include <mumble/EventLoop.h>
 #include "UVBio.h"
+#include "HandlerStrand.h"
 
 namespace mumble {
 
+class EventLoopPrivate;
+
+// TLSConnectionFinishedHook is called once a TLSConnection has been fully
+// torn down, after its disconnect or error handler has run. It is used by
+// components that own TLSConnections, such as TLSListener, to dispose of them.
+typedef std::function<void ()> TLSConnectionFinishedHook;
+
+// TLSConnectionShutdownHook is called on the loop thread when a TLSConnection
+// starts shutting down. It is used by components that open handles of their
+// own on the connection's loop, such as VoiceChannel, to close them along with
+// the connection's handles. The hook is cleared before it is called.
+typedef std::function<void ()> TLSConnectionShutdownHook;
+
 class TLSConnectionPrivate {
 public:
 	enum TLSConnectionState {
 		TLS_CONNECTION_STATE_INVALID,
 		TLS_CONNECTION_STATE_PRE_CONNECT,         // uv_connect has not yet succeeded.
-		TLS_CONNECTION_STATE_STARVED_SSL_CONNECT, // SSL_connect has not yet succeded, but failed with a SSL_ERROR_WANT_READ
+		TLS_CONNECTION_STATE_STARVED_SSL_CONNECT, // The TLS handshake has not yet succeded, but failed with a SSL_ERROR_WANT_READ
 		TLS_CONNECTION_STATE_ESTABLISHED,
 		TLS_CONNECTION_STATE_DISCONNECTED_ERROR,  // We've been disconnected by an error.
 		TLS_CONNECTION_STATE_DISCONNECTED_REMOTE, // Remote end closed the connection.
@@ -34,52 +53,140 @@ public:
 
 	Error Connect(const std::string &ipaddr, int port, TLSConnectionOptions *opts);
 	void Disconnect();
-	void Write(const ByteArray &buf);
+	void Write(const ByteArray &buf, TLSConnectionWritePriority prio, const TLSConnectionWriteCompletionHandler &done);
+	void WriteData(const char *data, int len, ByteArray *buf, TLSConnectionWritePriority prio, const TLSConnectionWriteCompletionHandler &done);
+
+	// AcceptSocket sets up a server-side TLSConnection for an already
+	// accepted socket. Must be called on the thread of *loop*.
+	Error AcceptSocket(EventLoopPrivate *loop, uv_os_sock_t sock, SSL_CTX *ctx, TLSConnectionOptions *opts);
 
 	void Shutdown(TLSConnectionState state);
 	void ShutdownRemote();
 	void ShutdownError(const Error &err);
 
 	TLSConnectionState                state_;
+	TLSConnectionOptions              opts_;
 
+	// own_loop_ is the EventLoop created by Connect when
+	// no shared EventLoop was given in the options.
+	EventLoop                         *own_loop_;
+	EventLoopPrivate                  *evloop_;
 	uv_loop_t                         *loop_;
-	uv_thread_t                       thread_;
 	uv_tcp_t                          tcpsock_;
+	// sock_ is the socket of tcpsock_, if the TLSConnection
+	// created or was given it. Otherwise, libuv creates the
+	// socket when it connects, and sock_ stays invalid.
+	uv_os_sock_t                      sock_;
 	uv_connect_t                      tcpconn_;
+	int                               open_handles_;
 
 	std::atomic<unsigned long>        thread_id_;
 
 	UVBioState                        *biostate_;
 
+	bool                              server_;
+	bool                              owns_ctx_;
 	SSL_CTX                           *ctx_;
 	SSL                               *ssl_;
 	BIO                               *bio_;
 
+	// The write queue has a lane for each TLSConnectionWritePriority.
+	// Lanes are only popped on the loop thread, which is what allows
+	// the drain to write from the front of a lane without holding
+	// wqlock_. wq_bulk_off_ is the number of bytes of the front bulk
+	// write that have already been sent.
+	struct QueuedWrite {
+		QueuedWrite(const ByteArray &b, const TLSConnectionWriteCompletionHandler &d, uint64_t t)
+			: buf(b), done(d), enqueue_time(t) {}
+
+		ByteArray                            buf;
+		TLSConnectionWriteCompletionHandler  done;
+		uint64_t                             enqueue_time;
+	};
+	static const int                  kNumWriteLanes = 3;
 	uv_mutex_t                        wqlock_;
 	uv_async_t                        wqasync_;
-	std::queue<ByteArray>             wq_;
+	std::queue<QueuedWrite>           wq_[kNumWriteLanes];
+	int                               wq_bulk_off_;
+
+	// PendingCompletion is a write that has been handed to the
+	// socket, and whose completion handler is waiting for socket
+	// write number *seq* to complete. Only used on the loop thread.
+	struct PendingCompletion {
+		uint64_t                             seq;
+		TLSConnectionWriteCompletionHandler  done;
+		TLSConnectionWriteInfo               info;
+	};
+	std::deque<PendingCompletion>     completions_;
+
+	// Dynamic record sizing state. Only used on the loop thread.
+	// record_ramp_bytes_ is the number of bytes sent since the
+	// connection was last idle, and last_record_time_ is the loop
+	// time of the latest record, in milliseconds.
+	uint64_t                          record_ramp_bytes_;
+	uint64_t                          last_record_time_;
+
+	// The record statistics are only written on the loop
+	// thread, but may be read from any thread.
+	std::atomic<uint64_t>             records_sent_;
+	std::atomic<uint64_t>             record_bytes_sent_;
+	std::atomic<uint64_t>             small_records_sent_;
 
 	uv_async_t                        dcasync_;
 
 	Error                             err_;
 
+	ByteViewChain                     batch_views_;
+	std::vector<char *>               batch_blocks_;
+
 	TLSConnectionChainVerifyHandler   chain_verify_handler_;
 	TLSConnectionEstablishedHandler   established_handler_;
 	TLSConnectionReadHandler          read_handler_;
+	TLSConnectionReadBatchHandler     read_batch_handler_;
 	TLSConnectionErrorHandler         error_handler_;
 	TLSConnectionDisconnectHandler    disconnect_handler_;
-
+	TLSConnectionFinishedHook         finished_hook_;
+	TLSConnectionShutdownHook         shutdown_hook_;
+
+	// strand_ runs the handlers on opts_.executor, if the current
+	// connection uses one. Queued handler calls keep the strand
+	// alive, so a new connection always starts a fresh strand.
+	std::shared_ptr<HandlerStrand>    strand_;
+
+	Error StartConnect(struct sockaddr_in addr);
+	Error StartAccept(EventLoopPrivate *loop, SSL_CTX *ctx, TLSConnectionOptions *opts);
+	Error AttachToLoop(EventLoopPrivate *loop);
+	Error SetupSSL(SSL_CTX *ctx, bool server);
 	bool HandleStarvedConnectState();
 	void TransitionToConnectionEstablishedState();
+	void DrainWriteQueue();
+	bool WriteRecord(const char *buf, int len, int lane);
+	int RecordSize(int lane);
+	void AddCompletion(const TLSConnectionWriteCompletionHandler &done, uint64_t enqueue_time);
+	void RunCompletions();
+	void FailWrites();
+	void OnSocketWriteDone(int status);
+	void CallCompletion(const TLSConnectionWriteCompletionHandler &done, const Error &err, const TLSConnectionWriteInfo &info);
+	void SetupStrand();
+	TLSConnectionHandlerStats HandlerStats() const;
+	TLSConnectionRecordStats RecordStats() const;
+	bool CanWrite() const;
+	int BulkChunkSize() const;
+	void ReadBatch();
+	void Finish();
+	void FreeSSL();
+
+	// CreateClientContext creates the SSL_CTX used by client connections.
+	static SSL_CTX *CreateClientContext();
 
-	static void InitializeSSL();
-	static void TLSConnectionThread(void *conn);
 	static void OnConnect(uv_connect_t *conn, int status);
+	static void OnHandleClosed(uv_handle_t *handle);
 	static void OnRead(uv_stream_t *stream, ssize_t nread, uv_buf_t buf);
 	static void OnDrainWriteQueue(uv_async_t *handle, int status);
 	static void OnDisconnectRequest(uv_async_t *handle, int status);
 	static uv_buf_t AllocCallback(uv_handle_t *handle, size_t suggested_size);
 	static int SSLVerifyCallback(X509_STORE_CTX *store, void *udata);
+	static TLSConnectionPrivate *FromSSL(SSL *ssl);
 };
 
 }
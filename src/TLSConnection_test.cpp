@@ -0,0 +1,401 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/TLSListener.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/X509Certificate.h>
+#include <mumble/ByteArray.h>
+#include <mumble/ByteView.h>
+
+#include <uv.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace mumble;
+
+// DiscardConnectionTest connects a TLSConnection to a TLSListener
+// that discards everything it receives.
+class DiscardConnectionTest : public ::testing::Test {
+protected:
+	virtual void SetUp() {
+		uv_sem_init(&sem_, 0);
+		X509Certificate cert = X509Certificate::GenerateSelfSignedCertificate("DiscardConnectionTest");
+		listener_.SetAcceptHandler([](TLSConnection &conn) {
+			conn.SetReadHandler([](const ByteArray &buf) {});
+		});
+		ASSERT_FALSE(listener_.Listen("127.0.0.1", 0, cert, nullptr).HasError());
+	}
+
+	virtual void TearDown() {
+		conn_.Disconnect();
+		uv_sem_wait(&sem_);
+		uv_sem_destroy(&sem_);
+	}
+
+	void Connect(TLSConnectionOptions *opts) {
+		uv_sem_t *sem = &sem_;
+		conn_.SetChainVerifyHandler([](const std::vector<X509Certificate> &chain) {
+			return true;
+		}).SetEstablishedHandler([sem] {
+			uv_sem_post(sem);
+		}).SetDisconnectHandler([sem](bool local) {
+			uv_sem_post(sem);
+		}).SetErrorHandler([sem](const Error &err) {
+			uv_sem_post(sem);
+		});
+		ASSERT_FALSE(conn_.Connect("127.0.0.1", listener_.Port(), opts).HasError());
+		uv_sem_wait(&sem_);
+	}
+
+	// Write writes *len* bytes on *prio*, and waits
+	// for the write to complete.
+	void Write(int len, TLSConnectionWritePriority prio) {
+		ByteArray buf(len);
+		memset(buf.Data(), 'r', len);
+		uv_sem_t *sem = &sem_;
+		bool ok = false;
+		conn_.Write(buf, prio, [sem, &ok](const Error &err, const TLSConnectionWriteInfo &info) {
+			ok = !err.HasError();
+			uv_sem_post(sem);
+		});
+		uv_sem_wait(&sem_);
+		EXPECT_TRUE(ok);
+	}
+
+	uv_sem_t       sem_;
+	TLSListener    listener_;
+	TLSConnection  conn_;
+};
+
+// RecordSizingTest checks the sizes of the TLS records
+// that writes are split into.
+class RecordSizingTest : public DiscardConnectionTest {
+};
+
+TEST_F(RecordSizingTest, RampsUpToFullRecords) {
+	TLSConnectionOptions opts;
+	opts.dynamic_record_sizing = true;
+	opts.min_record_size = 1000;
+	opts.record_size_ramp_bytes = 10000;
+	opts.record_size_idle_ms = 60000;
+	Connect(&opts);
+
+	// 10 small records make up the ramp, after
+	// which the rest goes out in full-size records.
+	Write(10000 + 2 * 16384, TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE);
+	TLSConnectionRecordStats stats = conn_.RecordStats();
+	EXPECT_EQ(12U, stats.records);
+	EXPECT_EQ(10U, stats.small_records);
+	EXPECT_EQ(static_cast<uint64_t>(10000 + 2 * 16384), stats.bytes);
+
+	// Realtime writes always use small records.
+	Write(2500, TLS_CONNECTION_WRITE_PRIORITY_REALTIME);
+	stats = conn_.RecordStats();
+	EXPECT_EQ(15U, stats.records);
+	EXPECT_EQ(13U, stats.small_records);
+}
+
+TEST_F(RecordSizingTest, Disabled) {
+	TLSConnectionOptions opts;
+	opts.dynamic_record_sizing = false;
+	Connect(&opts);
+
+	Write(4 * 16384, TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE);
+	Write(2500, TLS_CONNECTION_WRITE_PRIORITY_REALTIME);
+	TLSConnectionRecordStats stats = conn_.RecordStats();
+	EXPECT_EQ(5U, stats.records);
+	EXPECT_EQ(0U, stats.small_records);
+}
+
+TEST_F(RecordSizingTest, BulkChunks) {
+	TLSConnectionOptions opts;
+	opts.dynamic_record_sizing = false;
+	opts.bulk_chunk_size = 4096;
+	Connect(&opts);
+
+	// Bulk writes go out one chunk per record, other
+	// lanes in records of up to the full size.
+	Write(16 * 4096, TLS_CONNECTION_WRITE_PRIORITY_BULK);
+	EXPECT_EQ(16U, conn_.RecordStats().records);
+	EXPECT_EQ(16U, conn_.RecordStats().small_records);
+	Write(16 * 4096, TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE);
+	EXPECT_EQ(20U, conn_.RecordStats().records);
+	EXPECT_EQ(16U, conn_.RecordStats().small_records);
+}
+
+TEST_F(RecordSizingTest, BulkRampsUpToFullRecords) {
+	TLSConnectionOptions opts;
+	opts.dynamic_record_sizing = true;
+	opts.min_record_size = 1024;
+	opts.record_size_ramp_bytes = 2 * 16384;
+	opts.record_size_idle_ms = 60000;
+	Connect(&opts);
+
+	// With the default chunk size, a sustained bulk write
+	// goes out in 32 small records during the ramp, and in
+	// full-size records after it.
+	Write(6 * 16384, TLS_CONNECTION_WRITE_PRIORITY_BULK);
+	TLSConnectionRecordStats stats = conn_.RecordStats();
+	EXPECT_EQ(36U, stats.records);
+	EXPECT_EQ(32U, stats.small_records);
+	EXPECT_EQ(static_cast<uint64_t>(6 * 16384), stats.bytes);
+}
+
+// WriteCompletionTest checks the completion handlers of writes.
+class WriteCompletionTest : public DiscardConnectionTest {
+};
+
+// CalledOnceInOrder checks that the completion handler of each write
+// is called exactly once, in write order within each lane, and with
+// timestamps that follow the write through the connection.
+TEST_F(WriteCompletionTest, CalledOnceInOrder) {
+	const int kWrites = 200;
+	Connect(nullptr);
+
+	std::vector<int> calls(kWrites, 0);
+	std::vector<TLSConnectionWriteInfo> infos(kWrites);
+	std::vector<int> order[3];
+	bool ok = true;
+	uv_sem_t *sem = &sem_;
+	for (int i = 0; i < kWrites; i++) {
+		TLSConnectionWritePriority prio = static_cast<TLSConnectionWritePriority>(i % 3);
+		ByteArray buf(1 + (i * 7919) % 40000);
+		memset(buf.Data(), 'w', buf.Length());
+		conn_.Write(buf, prio, [i, prio, sem, &calls, &infos, &order, &ok](const Error &err, const TLSConnectionWriteInfo &info) {
+			if (err.HasError()) {
+				ok = false;
+			}
+			calls[i]++;
+			infos[i] = info;
+			order[prio].push_back(i);
+			uv_sem_post(sem);
+		});
+	}
+	for (int i = 0; i < kWrites; i++) {
+		uv_sem_wait(&sem_);
+	}
+
+	EXPECT_TRUE(ok);
+	for (int i = 0; i < kWrites; i++) {
+		EXPECT_EQ(1, calls[i]);
+		EXPECT_GT(infos[i].enqueue_time, 0U);
+		EXPECT_LE(infos[i].enqueue_time, infos[i].encrypt_time);
+		EXPECT_LE(infos[i].encrypt_time, infos[i].write_time);
+	}
+	for (int lane = 0; lane < 3; lane++) {
+		EXPECT_TRUE(std::is_sorted(order[lane].begin(), order[lane].end()));
+	}
+}
+
+// WriteLaneTest connects a TLSConnection to a TLSListener that
+// records everything it receives, to check the order in which
+// writes on different lanes are sent.
+class WriteLaneTest : public ::testing::Test {
+protected:
+	WriteLaneTest() : expected_(0), hold_established_(false), hold_first_read_(false) {}
+
+	virtual void SetUp() {
+		uv_mutex_init(&lock_);
+		uv_sem_init(&sem_, 0);
+		uv_sem_init(&received_sem_, 0);
+		uv_sem_init(&held_, 0);
+		uv_sem_init(&resume_, 0);
+	}
+
+	virtual void TearDown() {
+		conn_.Disconnect();
+		uv_sem_wait(&sem_);
+		uv_sem_destroy(&resume_);
+		uv_sem_destroy(&held_);
+		uv_sem_destroy(&received_sem_);
+		uv_sem_destroy(&sem_);
+		uv_mutex_destroy(&lock_);
+	}
+
+	// Listen starts the listener. If hold_first_read_ is set, the
+	// listener's loop is held up in the first read handler call,
+	// until resume_ is posted.
+	void Listen(TLSListenerOptions *opts) {
+		X509Certificate cert = X509Certificate::GenerateSelfSignedCertificate("WriteLaneTest");
+		listener_.SetAcceptHandler([this](TLSConnection &conn) {
+			conn.SetReadHandler([this](const ByteArray &buf) {
+				uv_mutex_lock(&lock_);
+				bool hold = hold_first_read_;
+				hold_first_read_ = false;
+				received_.append(buf.ConstData(), buf.Length());
+				bool done = received_.size() == expected_;
+				uv_mutex_unlock(&lock_);
+				if (hold) {
+					uv_sem_post(&held_);
+					uv_sem_wait(&resume_);
+				}
+				if (done) {
+					uv_sem_post(&received_sem_);
+				}
+			});
+		});
+		ASSERT_FALSE(listener_.Listen("127.0.0.1", 0, cert, opts).HasError());
+	}
+
+	// Connect connects the TLSConnection. If hold_established_ is
+	// set, the connection's loop is held up in the established
+	// handler, until resume_ is posted, so that writes made in
+	// the meantime are all queued by the time it drains them.
+	void Connect(TLSConnectionOptions *opts) {
+		conn_.SetChainVerifyHandler([](const std::vector<X509Certificate> &chain) {
+			return true;
+		}).SetEstablishedHandler([this] {
+			uv_sem_post(&sem_);
+			if (hold_established_) {
+				uv_sem_wait(&resume_);
+			}
+		}).SetDisconnectHandler([this](bool local) {
+			uv_sem_post(&sem_);
+		}).SetErrorHandler([this](const Error &err) {
+			uv_sem_post(&sem_);
+		});
+		ASSERT_FALSE(conn_.Connect("127.0.0.1", listener_.Port(), opts).HasError());
+		uv_sem_wait(&sem_);
+	}
+
+	void Write(size_t len, char c, TLSConnectionWritePriority prio) {
+		ByteArray buf(static_cast<int>(len));
+		memset(buf.Data(), c, len);
+		conn_.Write(buf, prio);
+	}
+
+	uv_mutex_t     lock_;
+	uv_sem_t       sem_;
+	uv_sem_t       received_sem_;
+	uv_sem_t       held_;
+	uv_sem_t       resume_;
+	std::string    received_;
+	size_t         expected_;
+	bool           hold_established_;
+	bool           hold_first_read_;
+	TLSListener    listener_;
+	TLSConnection  conn_;
+};
+
+TEST_F(WriteLaneTest, LanesInPriorityOrder) {
+	const size_t kBulk = 64 * 1024;
+	const size_t kSmall = 100;
+
+	hold_established_ = true;
+	Listen(nullptr);
+	Connect(nullptr);
+
+	expected_ = kBulk + 2 * kSmall;
+	Write(kBulk, 'b', TLS_CONNECTION_WRITE_PRIORITY_BULK);
+	Write(kSmall, 'i', TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE);
+	Write(kSmall, 'r', TLS_CONNECTION_WRITE_PRIORITY_REALTIME);
+	uv_sem_post(&resume_);
+	uv_sem_wait(&received_sem_);
+
+	EXPECT_TRUE(received_ == std::string(kSmall, 'r') + std::string(kSmall, 'i') + std::string(kBulk, 'b'));
+}
+
+// ControlOvertakesBulk stalls a large bulk write by holding up
+// the receiver, and checks that a control message written in the
+// meantime is sent between two chunks, long before the bulk write
+// has been sent in full.
+TEST_F(WriteLaneTest, ControlOvertakesBulk) {
+	const size_t kBulk = 8 * 1024 * 1024;
+	const size_t kSmall = 100;
+
+	TLSListenerOptions lopts;
+	lopts.connection_options.receive_buffer_size = 64 * 1024;
+	hold_first_read_ = true;
+	Listen(&lopts);
+
+	TLSConnectionOptions copts;
+	copts.send_buffer_size = 64 * 1024;
+	copts.bulk_chunk_size = 4096;
+	Connect(&copts);
+
+	expected_ = kBulk + kSmall;
+	Write(kBulk, 'b', TLS_CONNECTION_WRITE_PRIORITY_BULK);
+	uv_sem_wait(&held_);
+	Write(kSmall, 'i', TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE);
+	uv_sem_post(&resume_);
+	uv_sem_wait(&received_sem_);
+
+	ASSERT_EQ(kBulk + kSmall, received_.size());
+	size_t pos = received_.find('i');
+	ASSERT_NE(std::string::npos, pos);
+	EXPECT_LT(pos, kBulk / 4);
+	EXPECT_TRUE(received_.compare(pos, kSmall, std::string(kSmall, 'i')) == 0);
+	EXPECT_EQ(kBulk, static_cast<size_t>(std::count(received_.begin(), received_.end(), 'b')));
+}
+
+// ReadBatch echoes a bulk transfer back to a TLSConnection that reads
+// in batched mode, and checks that every byte arrives, in order, in
+// chains of record-sized views, without the read handler being called.
+TEST(TLSConnectionTest, ReadBatch) {
+	const int kLen = 200 * 1024;
+
+	X509Certificate cert = X509Certificate::GenerateSelfSignedCertificate("TLSConnectionTest");
+	TLSListener listener;
+	listener.SetAcceptHandler([](TLSConnection &conn) {
+		TLSConnection *cp = &conn;
+		conn.SetReadHandler([cp](const ByteArray &buf) {
+			cp->Write(buf);
+		});
+	});
+	ASSERT_FALSE(listener.Listen("127.0.0.1", 0, cert, nullptr).HasError());
+
+	ByteArray sent(kLen);
+	for (int i = 0; i < kLen; i++) {
+		sent.Data()[i] = static_cast<char>(i * 7);
+	}
+
+	uv_sem_t done;
+	uv_sem_init(&done, 0);
+	std::string received;
+	int batches = 0;
+	bool views_ok = true;
+	bool read_handler_called = false;
+
+	TLSConnection conn;
+	TLSConnection *cp = &conn;
+	conn.SetChainVerifyHandler([](const std::vector<X509Certificate> &chain) {
+		return true;
+	}).SetEstablishedHandler([cp, &sent] {
+		cp->Write(sent);
+	}).SetReadHandler([&read_handler_called](const ByteArray &buf) {
+		read_handler_called = true;
+	}).SetReadBatchHandler([cp, &received, &batches, &views_ok](const ByteViewChain &chain) {
+		batches++;
+		if (chain.empty()) {
+			views_ok = false;
+		}
+		for (const ByteView &view : chain) {
+			if (view.Length() <= 0 || view.Length() > 16384) {
+				views_ok = false;
+			}
+			received.append(view.ConstData(), view.Length());
+		}
+		if (received.size() >= static_cast<size_t>(kLen)) {
+			cp->Disconnect();
+		}
+	}).SetDisconnectHandler([&done](bool local) {
+		uv_sem_post(&done);
+	}).SetErrorHandler([&done](const Error &err) {
+		uv_sem_post(&done);
+	});
+	ASSERT_FALSE(conn.Connect("127.0.0.1", listener.Port(), nullptr).HasError());
+	uv_sem_wait(&done);
+	uv_sem_destroy(&done);
+
+	EXPECT_FALSE(read_handler_called);
+	EXPECT_TRUE(views_ok);
+	EXPECT_GE(batches, 1);
+	ASSERT_EQ(static_cast<size_t>(kLen), received.size());
+	EXPECT_EQ(0, memcmp(sent.ConstData(), received.data(), kLen));
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/TLSListener.h>
+#include "TLSListener_p.h"
+
+#include <string>
+
+namespace mumble {
+
+TLSListenerOptions::TLSListenerOptions() : backlog(511), request_client_certificate(false), num_event_loops(1) {
+}
+
+TLSListener::TLSListener() : priv_(new TLSListenerPrivate) {
+}
+
+TLSListener::~TLSListener() {
+}
+
+Error TLSListener::Listen(const std::string &ipaddr, int port, const X509Certificate &cert, TLSListenerOptions *opts) {
+	return priv_->Listen(ipaddr, port, cert, opts);
+}
+
+int TLSListener::Port() const {
+	return priv_->port_;
+}
+
+void TLSListener::Close() {
+	priv_->Close();
+}
+
+TLSListener& TLSListener::SetAcceptHandler(TLSListenerAcceptHandler fn) {
+	priv_->accept_handler_ = fn;
+	return *this;
+}
+
+TLSListener& TLSListener::SetErrorHandler(TLSListenerErrorHandler fn) {
+	priv_->error_handler_ = fn;
+	return *this;
+}
+
+}
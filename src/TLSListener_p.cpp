@@ -0,0 +1,466 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/TLSListener.h>
+#include "TLSListener_p.h"
+#include <mumble/TLSConnection.h>
+#include "TLSConnection_p.h"
+#include <mumble/X509Certificate.h>
+#include "X509Certificate_p.h"
+#include <mumble/EventLoop.h>
+#include "EventLoop_p.h"
+#include <mumble/Error.h>
+#include "OpenSSLUtils.h"
+#include "UVUtils.h"
+#include "SocketUtils.h"
+
+#include "uv.h"
+
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <assert.h>
+
+#ifndef LIBMUMBLE_OS_WINDOWS
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <netinet/in.h>
+#else
+# include <winsock2.h>
+# include <ws2tcpip.h>
+#endif
+
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/evp.h>
+
+namespace mumble {
+
+// kMaxAcceptsPerWakeup is the number of pending clients
+// that are accepted each time the listening socket polls
+// readable.
+static const int kMaxAcceptsPerWakeup = 64;
+
+// Aborted returns whether *err* means that a pending
+// client went away before it could be accepted.
+static bool Aborted(int err) {
+#ifndef LIBMUMBLE_OS_WINDOWS
+	return err == ECONNABORTED || err == EPROTO;
+#else
+	return err == WSAECONNRESET;
+#endif
+}
+
+TLSListenerPrivate::TLSListenerPrivate()
+	: next_loop_(0), ctx_(nullptr), port_(-1), sock_(SocketUtils::InvalidSocket()), poll_(nullptr), closing_(false) {
+	OpenSSLUtils::EnsureInitialized();
+	uv_mutex_init(&connlock_);
+	uv_cond_init(&conncond_);
+}
+
+TLSListenerPrivate::~TLSListenerPrivate() {
+	Close();
+
+	uv_mutex_lock(&connlock_);
+	closing_ = true;
+	uv_mutex_unlock(&connlock_);
+
+	// Connections must be disconnected from the thread of the
+	// loop they run on. Once all of them have finished, they
+	// have removed themselves from conns_. The connections of
+	// a loop that has already stopped never finish, so they
+	// are not waited for.
+	std::vector<EventLoopPrivate *> running;
+	for (EventLoopPrivate *loop : loops_) {
+		bool ok = loop->Post([this, loop] {
+			DisconnectAll(loop);
+		});
+		if (ok) {
+			running.push_back(loop);
+		}
+	}
+
+	uv_mutex_lock(&connlock_);
+	while (HasConnectionsOn(running)) {
+		uv_cond_wait(&conncond_, &connlock_);
+	}
+	uv_mutex_unlock(&connlock_);
+
+	FreeLoops();
+
+	if (ctx_ != nullptr) {
+		SSL_CTX_free(ctx_);
+	}
+
+	uv_cond_destroy(&conncond_);
+	uv_mutex_destroy(&connlock_);
+}
+
+Error TLSListenerPrivate::Listen(const std::string &ipaddr, int port, const X509Certificate &cert, TLSListenerOptions *opts) {
+	if (!loops_.empty()) {
+		return Error::ErrorFromStaticDescription(
+			"TLSListener",
+			0L,
+			"listener already in use"
+		);
+	}
+
+	if (opts != nullptr) {
+		opts_ = *opts;
+	}
+
+	Error err = SetupContext(cert);
+	if (err.HasError()) {
+		return err;
+	}
+
+	err = SetupLoops();
+	if (err.HasError()) {
+		FreeLoops();
+		return err;
+	}
+
+	err = StartListening(ipaddr, port);
+	if (err.HasError()) {
+		FreeLoops();
+		return err;
+	}
+
+	return Error::NoError();
+}
+
+// SetupLoops sets up the loops that the TLSListener's
+// connections are spread across.
+Error TLSListenerPrivate::SetupLoops() {
+	if (!opts_.event_loops.empty()) {
+		for (EventLoop *loop : opts_.event_loops) {
+			loops_.push_back(loop->priv_.get());
+		}
+		return Error::NoError();
+	}
+
+	int n = opts_.num_event_loops > 0 ? opts_.num_event_loops : 1;
+	for (int i = 0; i < n; i++) {
+		EventLoopOptions thread_opts = opts_.thread_options;
+		if (n > 1 && !thread_opts.thread_name.empty()) {
+			char suffix[16];
+			snprintf(suffix, sizeof(suffix), "-%d", i);
+			thread_opts.thread_name += suffix;
+		}
+		EventLoop *loop = new EventLoop;
+		Error err = loop->Start(&thread_opts);
+		if (err.HasError()) {
+			delete loop;
+			return err;
+		}
+		own_loops_.push_back(loop);
+		loops_.push_back(loop->priv_.get());
+	}
+
+	return Error::NoError();
+}
+
+void TLSListenerPrivate::FreeLoops() {
+	for (EventLoop *loop : own_loops_) {
+		delete loop;
+	}
+	own_loops_.clear();
+	loops_.clear();
+}
+
+// SetupContext creates the SSL_CTX that is shared by
+// all connections accepted by the TLSListener.
+Error TLSListenerPrivate::SetupContext(const X509Certificate &cert) {
+	if (!cert.HasCertificate()) {
+		return Error::ErrorFromStaticDescription(
+			"TLSListener",
+			0L,
+			"no certificate given"
+		);
+	}
+
+	X509 *x509 = cert.dptr_->AsOpenSSLX509();
+	EVP_PKEY *pkey = cert.dptr_->AsOpenSSLPrivateKey();
+	if (x509 == nullptr || pkey == nullptr) {
+		if (x509 != nullptr) {
+			X509_free(x509);
+		}
+		if (pkey != nullptr) {
+			EVP_PKEY_free(pkey);
+		}
+		return Error::ErrorFromStaticDescription(
+			"TLSListener",
+			0L,
+			"certificate has no usable private key"
+		);
+	}
+
+	SSL_CTX *ctx = SSL_CTX_new(SSLv23_server_method());
+	SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2|SSL_OP_NO_SSLv3);
+
+	// Let idle connections give back their read and write
+	// buffers. Servers may hold thousands of them.
+	SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+
+	bool ok = SSL_CTX_use_certificate(ctx, x509) == 1 &&
+	          SSL_CTX_use_PrivateKey(ctx, pkey) == 1 &&
+	          SSL_CTX_check_private_key(ctx) == 1;
+	X509_free(x509);
+	EVP_PKEY_free(pkey);
+	if (!ok) {
+		Error err = OpenSSLUtils::ErrorFromLastCryptoError();
+		SSL_CTX_free(ctx);
+		return err;
+	}
+
+	if (opts_.request_client_certificate) {
+		SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER|SSL_VERIFY_CLIENT_ONCE, nullptr);
+		SSL_CTX_set_cert_verify_callback(ctx, TLSConnectionPrivate::SSLVerifyCallback, nullptr);
+		X509_STORE *store = X509_STORE_new();
+		SSL_CTX_set_cert_store(ctx, store);
+	} else {
+		SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+	}
+
+	static const unsigned char sid_ctx[] = "libmumble";
+	SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+
+	ctx_ = ctx;
+	return Error::NoError();
+}
+
+// StartListening binds the listening socket, and starts
+// listening on the TLSListener's first loop.
+Error TLSListenerPrivate::StartListening(const std::string &ipaddr, int port) {
+	EventLoopPrivate *loop = loops_[0];
+	struct sockaddr_in addr = uv_ip4_addr(ipaddr.c_str(), port);
+
+	uv_os_sock_t sock = SocketUtils::InvalidSocket();
+	Error err = SocketUtils::OpenSocket(std::string("TLSListener"), SOCK_STREAM, &sock);
+	if (err.HasError()) {
+		return err;
+	}
+
+#ifndef LIBMUMBLE_OS_WINDOWS
+	int on = 1;
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#endif
+
+	if (bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+		err = SocketUtils::ErrorFromSocketError(std::string("TLSListener"), std::string("unable to bind"), SocketUtils::LastError());
+		SocketUtils::Close(sock);
+		return err;
+	}
+	if (listen(sock, opts_.backlog) != 0) {
+		err = SocketUtils::ErrorFromSocketError(std::string("TLSListener"), std::string("unable to listen"), SocketUtils::LastError());
+		SocketUtils::Close(sock);
+		return err;
+	}
+
+	struct sockaddr_in name;
+	socklen_t namelen = sizeof(name);
+	if (getsockname(sock, reinterpret_cast<struct sockaddr *>(&name), &namelen) == 0) {
+		port_ = ntohs(name.sin_port);
+	} else {
+		port_ = port;
+	}
+
+	bool ok = loop->RunSync([&] {
+		uv_poll_t *poll = new uv_poll_t;
+		if (uv_poll_init_socket(loop->loop_, poll, sock) != UV_OK) {
+			err = UVUtils::ErrorFromLastUVError(loop->loop_);
+			delete poll;
+			return;
+		}
+		poll->data = this;
+
+		if (uv_poll_start(poll, UV_READABLE, TLSListenerPrivate::OnReadable) != UV_OK) {
+			err = UVUtils::ErrorFromLastUVError(loop->loop_);
+			uv_close(reinterpret_cast<uv_handle_t *>(poll), TLSListenerPrivate::OnPollClosed);
+			return;
+		}
+
+		sock_ = sock;
+		poll_ = poll;
+	});
+	if (!ok) {
+		err = Error::ErrorFromStaticDescription(
+			"TLSListener",
+			0L,
+			"event loop is not running"
+		);
+	}
+	if (err.HasError()) {
+		SocketUtils::Close(sock);
+		port_ = -1;
+	}
+
+	return err;
+}
+
+void TLSListenerPrivate::Close() {
+	if (loops_.empty()) {
+		return;
+	}
+
+	loops_[0]->RunSync([this] {
+		if (poll_ != nullptr) {
+			uv_close(reinterpret_cast<uv_handle_t *>(poll_), TLSListenerPrivate::OnPollClosed);
+			poll_ = nullptr;
+		}
+	});
+	// The socket may be closed once its poll handle is closing. If
+	// the loop has already stopped, the handle is never polled again.
+	if (sock_ != SocketUtils::InvalidSocket()) {
+		SocketUtils::Close(sock_);
+		sock_ = SocketUtils::InvalidSocket();
+	}
+	port_ = -1;
+}
+
+void TLSListenerPrivate::OnReadable(uv_poll_t *poll, int status, int events) {
+	TLSListenerPrivate *lp = static_cast<TLSListenerPrivate *>(poll->data);
+	assert(lp != nullptr);
+
+	if (status == -1) {
+		lp->ReportError(UVUtils::ErrorFromLastUVError(poll->loop));
+		return;
+	}
+
+	lp->AcceptPending();
+}
+
+// AcceptPending takes the clients that are pending on the listening
+// socket, up to kMaxAcceptsPerWakeup of them, so that a flood of new
+// clients doesn't starve the connections running on the first loop.
+// Any that are left make the socket readable again.
+// It is called on the thread of the first loop.
+void TLSListenerPrivate::AcceptPending() {
+	for (int i = 0; i < kMaxAcceptsPerWakeup; i++) {
+		uv_os_sock_t sock = accept(sock_, nullptr, nullptr);
+		if (sock == SocketUtils::InvalidSocket()) {
+			int err = SocketUtils::LastError();
+			if (SocketUtils::WouldBlock(err)) {
+				return;
+			}
+			if (SocketUtils::Interrupted(err) || Aborted(err)) {
+				continue;
+			}
+			ReportError(SocketUtils::ErrorFromSocketError(std::string("TLSListener"), std::string("unable to accept"), err));
+			return;
+		}
+
+		Error err = SocketUtils::SetNonBlocking(std::string("TLSListener"), sock);
+		if (err.HasError()) {
+			SocketUtils::Close(sock);
+			ReportError(err);
+			continue;
+		}
+
+		DispatchConnection(sock);
+	}
+}
+
+// DispatchConnection picks a loop for an accepted socket,
+// and hands the socket over to it. A libuv handle cannot
+// move between loops, but a socket that no handle owns yet
+// can be opened on any of them.
+// It is called on the thread of the first loop.
+void TLSListenerPrivate::DispatchConnection(uv_os_sock_t sock) {
+	EventLoopPrivate *loop = loops_[next_loop_ % loops_.size()];
+	next_loop_++;
+
+	if (loop == loops_[0]) {
+		AcceptConnection(loop, sock);
+		return;
+	}
+
+	bool ok = loop->Post([this, loop, sock] {
+		AcceptConnection(loop, sock);
+	});
+	if (!ok) {
+		SocketUtils::Close(sock);
+	}
+}
+
+// AcceptConnection creates a TLSConnection for the accepted
+// socket *sock*, and starts its handshake.
+// It is called on the thread of *loop*.
+void TLSListenerPrivate::AcceptConnection(EventLoopPrivate *loop, uv_os_sock_t sock) {
+	uv_mutex_lock(&connlock_);
+	if (closing_) {
+		uv_mutex_unlock(&connlock_);
+		SocketUtils::Close(sock);
+		return;
+	}
+	TLSConnection *conn = new TLSConnection;
+	conns_.insert(conn);
+	uv_mutex_unlock(&connlock_);
+
+	TLSConnectionPrivate *cp = conn->priv_.get();
+	cp->finished_hook_ = [this, conn] {
+		uv_mutex_lock(&connlock_);
+		conns_.erase(conn);
+		delete conn;
+		uv_cond_broadcast(&conncond_);
+		uv_mutex_unlock(&connlock_);
+	};
+
+	if (accept_handler_) {
+		accept_handler_(*conn);
+	}
+
+	Error err = cp->AcceptSocket(loop, sock, ctx_, &opts_.connection_options);
+
+	if (err.HasError()) {
+		// If the connection never got as far as opening its
+		// handles, it won't finish on its own.
+		if (cp->open_handles_ == 0) {
+			SocketUtils::Close(sock);
+			uv_mutex_lock(&connlock_);
+			conns_.erase(conn);
+			delete conn;
+			uv_cond_broadcast(&conncond_);
+			uv_mutex_unlock(&connlock_);
+		}
+		ReportError(err);
+	}
+}
+
+// HasConnectionsOn returns whether any connection in conns_ runs
+// on one of *loops*. It must be called with connlock_ held.
+bool TLSListenerPrivate::HasConnectionsOn(const std::vector<EventLoopPrivate *> &loops) {
+	for (TLSConnection *conn : conns_) {
+		if (std::find(loops.begin(), loops.end(), conn->priv_->evloop_) != loops.end()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// DisconnectAll disconnects all connections that run on *loop*.
+// It is called on the thread of *loop*.
+void TLSListenerPrivate::DisconnectAll(EventLoopPrivate *loop) {
+	uv_mutex_lock(&connlock_);
+	for (TLSConnection *conn : conns_) {
+		if (conn->priv_->evloop_ == loop) {
+			conn->priv_->Disconnect();
+		}
+	}
+	uv_mutex_unlock(&connlock_);
+}
+
+void TLSListenerPrivate::ReportError(const Error &err) {
+	if (error_handler_) {
+		error_handler_(err);
+	}
+}
+
+void TLSListenerPrivate::OnPollClosed(uv_handle_t *handle) {
+	delete reinterpret_cast<uv_poll_t *>(handle);
+}
+
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_TLSLISTENER_P_H_
+#define MUMBLE_TLSLISTENER_P_H_
+
+#include <mumble/TLSListener.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/EventLoop.h>
+#include <mumble/Error.h>
+
+#include "uv.h"
+
+#include <openssl/ssl.h>
+
+#include <atomic>
+#include <set>
+#include <vector>
+
+namespace mumble {
+
+class EventLoopPrivate;
+
+class TLSListenerPrivate {
+public:
+	TLSListenerPrivate();
+	~TLSListenerPrivate();
+
+	Error Listen(const std::string &ipaddr, int port, const X509Certificate &cert, TLSListenerOptions *opts);
+	void Close();
+
+	TLSListenerOptions                opts_;
+
+	// loops_ are the loops that accepted connections are
+	// spread across. loops_[0] runs the listening socket.
+	std::vector<EventLoopPrivate *>   loops_;
+	std::vector<EventLoop *>          own_loops_;
+	size_t                            next_loop_;
+
+	SSL_CTX                           *ctx_;
+	std::atomic<int>                  port_;
+
+	// The listening socket is created with the OS socket API and
+	// watched by poll_ on loops_[0]. Clients are taken off it with
+	// accept(), so that each socket can be opened on the loop it
+	// is handed to.
+	uv_os_sock_t                      sock_;
+	uv_poll_t                         *poll_;
+
+	// conns_ holds all live connections accepted by
+	// the TLSListener. It is protected by connlock_,
+	// and conncond_ is signalled whenever a connection
+	// is removed from it.
+	uv_mutex_t                        connlock_;
+	uv_cond_t                         conncond_;
+	std::set<TLSConnection *>         conns_;
+	bool                              closing_;
+
+	TLSListenerAcceptHandler          accept_handler_;
+	TLSListenerErrorHandler           error_handler_;
+
+	Error SetupLoops();
+	void FreeLoops();
+	Error SetupContext(const X509Certificate &cert);
+	Error StartListening(const std::string &ipaddr, int port);
+	void AcceptPending();
+	void DispatchConnection(uv_os_sock_t sock);
+	void AcceptConnection(EventLoopPrivate *loop, uv_os_sock_t sock);
+	void DisconnectAll(EventLoopPrivate *loop);
+	bool HasConnectionsOn(const std::vector<EventLoopPrivate *> &loops);
+	void ReportError(const Error &err);
+
+	static void OnReadable(uv_poll_t *poll, int status, int events);
+	static void OnPollClosed(uv_handle_t *handle);
+};
+
+}
+
+#endif
@@ -0,0 +1,100 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/TLSListener.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/X509Certificate.h>
+#include <mumble/EventLoop.h>
+#include <mumble/ByteArray.h>
+
+#include <uv.h>
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+using namespace mumble;
+
+TEST(TLSListenerTest, RequiresPrivateKey) {
+	TLSListener listener;
+	X509Certificate cert;
+	Error err = listener.Listen("127.0.0.1", 0, cert, nullptr);
+	EXPECT_TRUE(err.HasError());
+	EXPECT_EQ(-1, listener.Port());
+}
+
+// LoopbackEcho connects a few thousand clients at once, to check that
+// every one of them is accepted and served across the listener's loops.
+TEST(TLSListenerTest, LoopbackEcho) {
+	const int kClients = 2000;
+
+	X509Certificate cert = X509Certificate::GenerateSelfSignedCertificate("TLSListenerTest");
+
+	TLSListener listener;
+	std::atomic<int> accepted(0);
+	listener.SetAcceptHandler([&accepted](TLSConnection &conn) {
+		accepted++;
+		TLSConnection *cp = &conn;
+		conn.SetReadHandler([cp](const ByteArray &buf) {
+			cp->Write(buf);
+		});
+	});
+
+	TLSListenerOptions lopts;
+	lopts.num_event_loops = 4;
+	lopts.backlog = kClients;
+	Error err = listener.Listen("127.0.0.1", 0, cert, &lopts);
+	ASSERT_FALSE(err.HasError());
+	ASSERT_GT(listener.Port(), 0);
+
+	EventLoop loop;
+	ASSERT_FALSE(loop.Start().HasError());
+
+	uv_sem_t done;
+	uv_sem_init(&done, 0);
+	std::atomic<int> echoed(0);
+
+	std::vector<TLSConnection *> conns;
+	for (int i = 0; i < kClients; i++) {
+		TLSConnection *conn = new TLSConnection;
+		conns.push_back(conn);
+		conn->SetChainVerifyHandler([](const std::vector<X509Certificate> &chain) {
+			return true;
+		});
+		conn->SetEstablishedHandler([conn] {
+			char msg[] = "ping";
+			conn->Write(ByteArray(msg, 4));
+		});
+		conn->SetReadHandler([conn, &echoed](const ByteArray &buf) {
+			if (buf.Length() == 4 && memcmp(buf.ConstData(), "ping", 4) == 0) {
+				echoed++;
+			}
+			conn->Disconnect();
+		});
+		conn->SetDisconnectHandler([&done](bool local) {
+			uv_sem_post(&done);
+		});
+		conn->SetErrorHandler([&done](const Error &err) {
+			uv_sem_post(&done);
+		});
+
+		TLSConnectionOptions copts;
+		copts.event_loop = &loop;
+		ASSERT_FALSE(conn->Connect("127.0.0.1", listener.Port(), &copts).HasError());
+	}
+
+	for (int i = 0; i < kClients; i++) {
+		uv_sem_wait(&done);
+	}
+	uv_sem_destroy(&done);
+
+	EXPECT_EQ(kClients, accepted.load());
+	EXPECT_EQ(kClients, echoed.load());
+
+	for (TLSConnection *conn : conns) {
+		delete conn;
+	}
+}
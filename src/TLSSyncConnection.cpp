@@ -0,0 +1,39 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/TLSSyncConnection.h>
+#include "TLSSyncConnection_p.h"
+
+#include <string>
+
+namespace mumble {
+
+TLSSyncConnection::TLSSyncConnection() : priv_(new TLSSyncConnectionPrivate) {
+}
+
+TLSSyncConnection::~TLSSyncConnection() {
+}
+
+Error TLSSyncConnection::Connect(const std::string &ipaddr, int port, int timeout_ms, TLSConnectionOptions *opts) {
+	return priv_->Connect(ipaddr, port, timeout_ms, opts);
+}
+
+Error TLSSyncConnection::Read(ByteArray *buf, int timeout_ms) {
+	return priv_->Read(buf, timeout_ms);
+}
+
+Error TLSSyncConnection::Write(const ByteArray &buf, int timeout_ms) {
+	return priv_->Write(buf, timeout_ms);
+}
+
+void TLSSyncConnection::Disconnect() {
+	priv_->Disconnect();
+}
+
+TLSSyncConnection& TLSSyncConnection::SetChainVerifyHandler(TLSConnectionChainVerifyHandler fn) {
+	priv_->chain_verify_handler_ = fn;
+	return *this;
+}
+
+}
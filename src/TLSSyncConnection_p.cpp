@@ -0,0 +1,217 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/TLSSyncConnection.h>
+#include "TLSSyncConnection_p.h"
+#include <mumble/TLSConnection.h>
+#include "TLSConnection_p.h"
+#include <mumble/EventLoop.h>
+#include "EventLoop_p.h"
+#include <mumble/Error.h>
+
+#include "uv.h"
+
+#include <string>
+#include <assert.h>
+
+namespace mumble {
+
+// kTearDownTimeoutMs is how long TearDown waits for the
+// connection to shut down, before it closes it by force.
+static const int kTearDownTimeoutMs = 5000;
+
+TLSSyncConnectionPrivate::TLSSyncConnectionPrivate()
+	: loop_(nullptr), timed_out_(false), conn_(nullptr), established_(false), closed_(false), writes_started_(0), writes_done_(0) {
+}
+
+TLSSyncConnectionPrivate::~TLSSyncConnectionPrivate() {
+	TearDown();
+}
+
+Error TLSSyncConnectionPrivate::Connect(const std::string &ipaddr, int port, int timeout_ms, TLSConnectionOptions *opts) {
+	TearDown();
+
+	Error err = SetUp();
+	if (err.HasError()) {
+		return err;
+	}
+
+	TLSConnectionOptions copts;
+	if (opts != nullptr) {
+		copts = *opts;
+	}
+	copts.event_loop = loop_;
+	copts.executor = nullptr;
+
+	err = conn_->Connect(ipaddr, port, &copts);
+	if (err.HasError()) {
+		TearDown();
+		return err;
+	}
+
+	if (!RunUntil([this] { return established_ || closed_; }, timeout_ms)) {
+		TearDown();
+		return ErrorFromCode(TLS_SYNC_CONNECTION_ERROR_TIMEOUT, "timed out while connecting");
+	}
+	if (!established_) {
+		err = err_;
+		TearDown();
+		return err;
+	}
+
+	return Error::NoError();
+}
+
+Error TLSSyncConnectionPrivate::Read(ByteArray *buf, int timeout_ms) {
+	if (conn_ == nullptr) {
+		return ErrorFromCode(TLS_SYNC_CONNECTION_ERROR_CLOSED, "not connected");
+	}
+
+	if (!RunUntil([this] { return pending_.Length() > 0 || closed_; }, timeout_ms)) {
+		return ErrorFromCode(TLS_SYNC_CONNECTION_ERROR_TIMEOUT, "timed out while reading");
+	}
+
+	if (pending_.Length() > 0) {
+		// Hand over the received data, and keep the
+		// caller's old buffer for the next read.
+		buf->Swap(pending_);
+		if (!pending_.IsNull()) {
+			pending_.Truncate(0);
+		}
+		return Error::NoError();
+	}
+	return err_;
+}
+
+Error TLSSyncConnectionPrivate::Write(const ByteArray &buf, int timeout_ms) {
+	if (conn_ == nullptr || closed_) {
+		return ErrorFromCode(TLS_SYNC_CONNECTION_ERROR_CLOSED, "not connected");
+	}
+
+	// Writes complete in order, so waiting for this write
+	// means waiting for the number of completed writes to
+	// catch up with it. A write that timed out completes
+	// during a later call.
+	uint64_t seq = ++writes_started_;
+	conn_->Write(buf, TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE, [this](const Error &err, const TLSConnectionWriteInfo &) {
+		writes_done_++;
+		write_err_ = err;
+	});
+	if (!RunUntil([this, seq] { return writes_done_ >= seq; }, timeout_ms)) {
+		return ErrorFromCode(TLS_SYNC_CONNECTION_ERROR_TIMEOUT, "timed out while writing");
+	}
+	return write_err_;
+}
+
+void TLSSyncConnectionPrivate::Disconnect() {
+	TearDown();
+}
+
+Error TLSSyncConnectionPrivate::SetUp() {
+	established_ = false;
+	closed_ = false;
+	err_ = Error::NoError();
+	writes_started_ = 0;
+	writes_done_ = 0;
+	if (!pending_.IsNull()) {
+		pending_.Truncate(0);
+	}
+
+	loop_ = new EventLoop;
+	Error err = loop_->priv_->StartOnCurrentThread();
+	if (err.HasError()) {
+		delete loop_;
+		loop_ = nullptr;
+		return err;
+	}
+
+	uv_timer_init(loop_->priv_->loop_, &timer_);
+	timer_.data = this;
+
+	conn_ = new TLSConnection;
+	conn_->SetChainVerifyHandler(chain_verify_handler_);
+	conn_->SetEstablishedHandler([this] {
+		established_ = true;
+	});
+	conn_->SetReadBatchHandler([this](const ByteViewChain &chain) {
+		AppendChain(&pending_, chain);
+	});
+	conn_->SetErrorHandler([this](const Error &err) {
+		closed_ = true;
+		err_ = err;
+	});
+	conn_->SetDisconnectHandler([this](bool local) {
+		closed_ = true;
+		err_ = ErrorFromCode(TLS_SYNC_CONNECTION_ERROR_CLOSED, local ? "connection closed" : "connection closed by remote");
+	});
+
+	return Error::NoError();
+}
+
+void TLSSyncConnectionPrivate::TearDown() {
+	if (loop_ == nullptr) {
+		return;
+	}
+
+	// Run the loop until the connection has shut down,
+	// such that its handles are closed before the loop
+	// is freed. If it doesn't shut down in time, close
+	// its handles directly. Their close callbacks are
+	// run on the next turn of the loop.
+	if (!closed_) {
+		conn_->Disconnect();
+		if (!RunUntil([this] { return closed_; }, kTearDownTimeoutMs)) {
+			TLSConnectionPrivate *cp = conn_->priv_.get();
+			cp->Shutdown(TLSConnectionPrivate::TLS_CONNECTION_STATE_DISCONNECTED_LOCAL);
+			RunUntil([cp] { return cp->open_handles_ == 0; }, kTearDownTimeoutMs);
+		}
+	}
+	delete conn_;
+	conn_ = nullptr;
+
+	uv_close(reinterpret_cast<uv_handle_t *>(&timer_), nullptr);
+	// Deleting the EventLoop runs it until all of
+	// its handles have been closed.
+	delete loop_;
+	loop_ = nullptr;
+}
+
+template <typename Done>
+bool TLSSyncConnectionPrivate::RunUntil(Done done, int timeout_ms) {
+	if (done()) {
+		return true;
+	}
+
+	timed_out_ = false;
+	if (timeout_ms >= 0) {
+		uv_timer_start(&timer_, TLSSyncConnectionPrivate::OnTimeout, timeout_ms, 0);
+	}
+	uv_loop_t *loop = loop_->priv_->loop_;
+	while (!done() && !timed_out_) {
+		// Once there are no active handles left, nothing
+		// can change the outcome anymore.
+		if (uv_run(loop, UV_RUN_ONCE) == 0) {
+			break;
+		}
+	}
+	uv_timer_stop(&timer_);
+
+	return done();
+}
+
+Error TLSSyncConnectionPrivate::ErrorFromCode(TLSSyncConnectionErrorCode code, const char *desc) {
+	return Error::ErrorFromStaticDescription(
+		"TLSSyncConnection",
+		static_cast<long>(code),
+		desc
+	);
+}
+
+void TLSSyncConnectionPrivate::OnTimeout(uv_timer_t *timer, int status) {
+	TLSSyncConnectionPrivate *sp = static_cast<TLSSyncConnectionPrivate *>(timer->data);
+	assert(sp != nullptr);
+	sp->timed_out_ = true;
+}
+
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_TLSSYNCCONNECTION_P_H_
+#define MUMBLE_TLSSYNCCONNECTION_P_H_
+
+#include <mumble/TLSSyncConnection.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/EventLoop.h>
+#include <mumble/ByteArray.h>
+#include <mumble/ByteView.h>
+#include <mumble/Error.h>
+
+#include "uv.h"
+
+#include <stdint.h>
+
+namespace mumble {
+
+class TLSSyncConnectionPrivate {
+public:
+	TLSSyncConnectionPrivate();
+	~TLSSyncConnectionPrivate();
+
+	Error Connect(const std::string &ipaddr, int port, int timeout_ms, TLSConnectionOptions *opts);
+	Error Read(ByteArray *buf, int timeout_ms);
+	Error Write(const ByteArray &buf, int timeout_ms);
+	void Disconnect();
+
+	// Each call to Connect sets up a fresh event loop and
+	// TLSConnection on the calling thread. TearDown closes
+	// the connection, and frees both of them again.
+	Error SetUp();
+	void TearDown();
+
+	// RunUntil runs the loop until *done* returns true, or until
+	// *timeout_ms* have passed. Returns false on timeout.
+	template <typename Done>
+	bool RunUntil(Done done, int timeout_ms);
+
+	Error ErrorFromCode(TLSSyncConnectionErrorCode code, const char *desc);
+
+	EventLoop                         *loop_;
+	uv_timer_t                        timer_;
+	bool                              timed_out_;
+
+	// conn_ runs on loop_, and must be destroyed before it.
+	TLSConnection                     *conn_;
+	TLSConnectionChainVerifyHandler   chain_verify_handler_;
+	bool                              established_;
+	bool                              closed_;
+	Error                             err_;
+	ByteArray                         pending_;
+	uint64_t                          writes_started_;
+	uint64_t                          writes_done_;
+	Error                             write_err_;
+
+	static void OnTimeout(uv_timer_t *timer, int status);
+};
+
+}
+
+#endif
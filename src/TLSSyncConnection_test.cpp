@@ -0,0 +1,139 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/TLSSyncConnection.h>
+#include <mumble/TLSListener.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/X509Certificate.h>
+#include <mumble/ByteArray.h>
+
+#include <uv.h>
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace mumble;
+
+// SyncEchoServer is a TLSListener that echoes everything back, except
+// for messages that start with "quiet", which are swallowed.
+class SyncEchoServer {
+public:
+	SyncEchoServer() {
+		cert_ = X509Certificate::GenerateSelfSignedCertificate("TLSSyncConnectionTest");
+		listener_.SetAcceptHandler([](TLSConnection &conn) {
+			TLSConnection *cp = &conn;
+			conn.SetReadHandler([cp](const ByteArray &buf) {
+				if (buf.Length() < 5 || memcmp(buf.ConstData(), "quiet", 5) != 0) {
+					cp->Write(buf);
+				}
+			});
+		});
+	}
+
+	int Listen() {
+		if (listener_.Listen("127.0.0.1", 0, cert_, nullptr).HasError()) {
+			return -1;
+		}
+		return listener_.Port();
+	}
+
+private:
+	X509Certificate  cert_;
+	TLSListener      listener_;
+};
+
+static bool AcceptAll(const std::vector<X509Certificate> &chain) {
+	return true;
+}
+
+TEST(TLSSyncConnectionTest, WriteAndRead) {
+	SyncEchoServer server;
+	int port = server.Listen();
+	ASSERT_GT(port, 0);
+
+	TLSSyncConnection conn;
+	conn.SetChainVerifyHandler(AcceptAll);
+	Error err = conn.Connect("127.0.0.1", port, 5000, nullptr);
+	ASSERT_FALSE(err.HasError()) << err.String();
+
+	char msg[] = "hello";
+	err = conn.Write(ByteArray(msg, 5), 5000);
+	ASSERT_FALSE(err.HasError()) << err.String();
+
+	std::string got;
+	ByteArray buf;
+	while (got.size() < 5) {
+		err = conn.Read(&buf, 5000);
+		ASSERT_FALSE(err.HasError()) << err.String();
+		got.append(buf.ConstData(), buf.Length());
+	}
+	EXPECT_EQ(std::string("hello"), got);
+
+	// Nothing more is coming, so a read times out,
+	// and leaves the connection usable.
+	char quiet[] = "quiet";
+	ASSERT_FALSE(conn.Write(ByteArray(quiet, 5), 5000).HasError());
+	err = conn.Read(&buf, 50);
+	EXPECT_EQ(std::string("TLSSyncConnection"), err.Domain());
+	EXPECT_EQ(TLS_SYNC_CONNECTION_ERROR_TIMEOUT, err.Code());
+	ASSERT_FALSE(conn.Write(ByteArray(msg, 5), 5000).HasError());
+	ASSERT_FALSE(conn.Read(&buf, 5000).HasError());
+
+	conn.Disconnect();
+	err = conn.Read(&buf, 0);
+	EXPECT_EQ(TLS_SYNC_CONNECTION_ERROR_CLOSED, err.Code());
+}
+
+TEST(TLSSyncConnectionTest, ConnectRefused) {
+	TLSSyncConnection conn;
+	Error err = conn.Connect("127.0.0.1", 1, 5000, nullptr);
+	EXPECT_TRUE(err.HasError());
+	EXPECT_TRUE(conn.Write(ByteArray(1), 0).HasError());
+}
+
+// ManyThreads runs sequential probes from a few threads, none
+// of which creates an event loop thread of its own.
+TEST(TLSSyncConnectionTest, ManyThreads) {
+	const int kThreads = 4;
+	const int kProbesPerThread = 10;
+
+	SyncEchoServer server;
+	int port = server.Listen();
+	ASSERT_GT(port, 0);
+
+	struct Probe {
+		int               port;
+		std::atomic<int>  *ok;
+	};
+	std::atomic<int> ok(0);
+	Probe probe = { port, &ok };
+
+	std::vector<uv_thread_t> threads(kThreads);
+	for (int i = 0; i < kThreads; i++) {
+		uv_thread_create(&threads[i], [](void *udata) {
+			Probe *p = static_cast<Probe *>(udata);
+			for (int j = 0; j < kProbesPerThread; j++) {
+				TLSSyncConnection conn;
+				conn.SetChainVerifyHandler(AcceptAll);
+				if (conn.Connect("127.0.0.1", p->port, 5000, nullptr).HasError()) {
+					continue;
+				}
+				char msg[] = "ping";
+				ByteArray buf;
+				if (!conn.Write(ByteArray(msg, 4), 5000).HasError() && !conn.Read(&buf, 5000).HasError()) {
+					(*p->ok)++;
+				}
+			}
+		}, &probe);
+	}
+	for (int i = 0; i < kThreads; i++) {
+		uv_thread_join(&threads[i]);
+	}
+
+	EXPECT_EQ(kThreads * kProbesPerThread, ok.load());
+}
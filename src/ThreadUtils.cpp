@@ -0,0 +1,157 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "ThreadUtils.h"
+#include <mumble/EventLoop.h>
+#include <mumble/Error.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+
+#if defined(LIBMUMBLE_OS_WINDOWS)
+# include <windows.h>
+#else
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+#if defined(LIBMUMBLE_OS_LINUX) || defined(LIBMUMBLE_OS_ANDROID)
+# include <unistd.h>
+# include <sys/syscall.h>
+# include <sys/resource.h>
+#endif
+
+namespace mumble {
+
+static Error ThreadError(const std::string &desc, int err) {
+	return Error::ErrorFromDescription(
+		std::string("EventLoop"),
+		static_cast<long>(err),
+		desc + std::string(": ") + std::string(strerror(err))
+	);
+}
+
+static Error ThreadOptionNotSupported(const std::string &what) {
+	return Error::ErrorFromDescription(
+		std::string("EventLoop"),
+		0L,
+		what + std::string(" is not supported on this platform")
+	);
+}
+
+static void SetThreadName(const std::string &name) {
+#if defined(LIBMUMBLE_OS_LINUX) || defined(LIBMUMBLE_OS_ANDROID)
+	// The kernel limits thread names to 16 bytes,
+	// including the terminating NUL.
+	pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#elif defined(LIBMUMBLE_OS_MAC) || defined(LIBMUMBLE_OS_IOS)
+	pthread_setname_np(name.c_str());
+#endif
+}
+
+static Error SetThreadAffinity(const std::vector<int> &cpus) {
+#if defined(LIBMUMBLE_OS_LINUX) || defined(LIBMUMBLE_OS_ANDROID)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu : cpus) {
+		if (cpu < 0 || cpu >= CPU_SETSIZE) {
+			return ThreadError(std::string("invalid CPU in cpu_affinity"), EINVAL);
+		}
+		CPU_SET(cpu, &set);
+	}
+	// sched_setaffinity with a thread id only affects the calling
+	// thread, and is available on Android, unlike
+	// pthread_setaffinity_np.
+	pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+	if (sched_setaffinity(tid, sizeof(set), &set) != 0) {
+		return ThreadError(std::string("unable to set CPU affinity"), errno);
+	}
+	return Error::NoError();
+#elif defined(LIBMUMBLE_OS_WINDOWS)
+	DWORD_PTR mask = 0;
+	for (int cpu : cpus) {
+		if (cpu < 0 || cpu >= static_cast<int>(sizeof(mask) * 8)) {
+			return ThreadError(std::string("invalid CPU in cpu_affinity"), EINVAL);
+		}
+		mask |= static_cast<DWORD_PTR>(1) << cpu;
+	}
+	if (SetThreadAffinityMask(GetCurrentThread(), mask) == 0) {
+		return Error::ErrorFromStaticDescription(
+			"EventLoop",
+			static_cast<long>(GetLastError()),
+			"unable to set CPU affinity"
+		);
+	}
+	return Error::NoError();
+#else
+	return ThreadOptionNotSupported(std::string("cpu_affinity"));
+#endif
+}
+
+static Error SetRealtimePriority(int priority) {
+#if defined(LIBMUMBLE_OS_WINDOWS)
+	return ThreadOptionNotSupported(std::string("realtime_priority"));
+#else
+	if (priority < sched_get_priority_min(SCHED_FIFO) || priority > sched_get_priority_max(SCHED_FIFO)) {
+		return ThreadError(std::string("realtime_priority is out of range"), EINVAL);
+	}
+	struct sched_param param;
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (err != 0) {
+		return ThreadError(std::string("unable to set SCHED_FIFO"), err);
+	}
+	return Error::NoError();
+#endif
+}
+
+static Error SetNiceValue(int nice) {
+#if defined(LIBMUMBLE_OS_LINUX) || defined(LIBMUMBLE_OS_ANDROID)
+	// On Linux, the nice value is a per-thread attribute,
+	// addressed by the thread id.
+	id_t tid = static_cast<id_t>(syscall(SYS_gettid));
+	if (setpriority(PRIO_PROCESS, tid, nice) != 0) {
+		return ThreadError(std::string("unable to set nice value"), errno);
+	}
+	return Error::NoError();
+#else
+	return ThreadOptionNotSupported(std::string("nice_value"));
+#endif
+}
+
+Error ThreadUtils::ApplyOptions(const EventLoopOptions &opts) {
+	Error err;
+
+	if (!opts.thread_name.empty()) {
+		SetThreadName(opts.thread_name);
+	}
+
+	if (!opts.cpu_affinity.empty()) {
+		err = SetThreadAffinity(opts.cpu_affinity);
+		if (err.HasError()) {
+			return err;
+		}
+	}
+
+	if (opts.realtime_priority != 0) {
+		err = SetRealtimePriority(opts.realtime_priority);
+		if (err.HasError()) {
+			return err;
+		}
+	}
+
+	if (opts.nice_value != 0) {
+		err = SetNiceValue(opts.nice_value);
+		if (err.HasError()) {
+			return err;
+		}
+	}
+
+	return Error::NoError();
+}
+
+}
@@ -0,0 +1,22 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_THREAD_UTILS_H_
+#define MUMBLE_THREAD_UTILS_H_
+
+#include <mumble/EventLoop.h>
+#include <mumble/Error.h>
+
+namespace mumble {
+
+class ThreadUtils {
+public:
+	// ApplyOptions applies *opts* to the calling thread. It stops
+	// at, and returns, the first option that cannot be applied.
+	static Error ApplyOptions(const EventLoopOptions &opts);
+};
+
+}
+
+#endif
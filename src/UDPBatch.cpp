@@ -0,0 +1,313 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "UDPBatch.h"
+#include "SocketUtils.h"
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+
+#ifndef LIBMUMBLE_OS_WINDOWS
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <netinet/in.h>
+#else
+# include <winsock2.h>
+#endif
+
+#if defined(LIBMUMBLE_OS_LINUX)
+# include <netinet/udp.h>
+# ifndef SOL_UDP
+#  define SOL_UDP 17
+# endif
+# ifndef UDP_SEGMENT
+#  define UDP_SEGMENT 103
+# endif
+#endif
+
+namespace mumble {
+
+#if defined(LIBMUMBLE_OS_LINUX)
+// A segmented message may carry at most 64 datagrams,
+// and no more than an IPv4 UDP datagram's payload.
+static const int kMaxSegments = 64;
+static const int kMaxSegmentedSize = 65507;
+#endif
+
+UDPBatch::UDPBatch(bool batch_io)
+	: send_calls_(0), recv_calls_(0), sent_(0), received_(0), dropped_(0),
+	  batch_io_(batch_io), gso_(false), open_(false), recv_buf_(kMaxBatch * (kSlotSize + 1)),
+	  send_buf_(kMaxBatch * kSlotSize), queued_(0) {
+#if !defined(LIBMUMBLE_OS_LINUX)
+	batch_io_ = false;
+#endif
+	memset(recv_len_, 0, sizeof(recv_len_));
+	memset(recv_from_, 0, sizeof(recv_from_));
+	memset(send_len_, 0, sizeof(send_len_));
+}
+
+UDPBatch::~UDPBatch() {
+	Close();
+}
+
+Error UDPBatch::Open(struct sockaddr_in addr) {
+	Close();
+
+	uv_os_sock_t sock = SocketUtils::InvalidSocket();
+	Error err = SocketUtils::OpenSocket(std::string("VoiceChannel"), SOCK_DGRAM, &sock);
+	if (err.HasError()) {
+		return err;
+	}
+
+	if (bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+		int bind_err = SocketUtils::LastError();
+		SocketUtils::Close(sock);
+		return SocketUtils::ErrorFromSocketError(std::string("VoiceChannel"), std::string("unable to bind socket"), bind_err);
+	}
+
+	gso_ = false;
+#if defined(LIBMUMBLE_OS_LINUX)
+	// Kernels that know UDP_SEGMENT let it be read back.
+	if (batch_io_) {
+		int size = 0;
+		socklen_t len = sizeof(size);
+		gso_ = getsockopt(sock, SOL_UDP, UDP_SEGMENT, &size, &len) == 0;
+	}
+#endif
+
+	sock_ = sock;
+	open_ = true;
+	queued_ = 0;
+	return Error::NoError();
+}
+
+void UDPBatch::Close() {
+	if (!open_) {
+		return;
+	}
+	SocketUtils::Close(sock_);
+	open_ = false;
+	queued_ = 0;
+}
+
+int UDPBatch::LocalPort() const {
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+#ifndef LIBMUMBLE_OS_WINDOWS
+	socklen_t len = sizeof(addr);
+#else
+	int len = sizeof(addr);
+#endif
+	if (!open_ || getsockname(sock_, reinterpret_cast<struct sockaddr *>(&addr), &len) != 0) {
+		return 0;
+	}
+	return ntohs(addr.sin_port);
+}
+
+int UDPBatch::Receive() {
+	if (!open_) {
+		return 0;
+	}
+	const int slot = kSlotSize + 1;
+	int n = 0;
+
+#if defined(LIBMUMBLE_OS_LINUX)
+	if (batch_io_) {
+		struct mmsghdr msgs[kMaxBatch];
+		struct iovec iov[kMaxBatch];
+		memset(msgs, 0, sizeof(msgs));
+		for (int i = 0; i < kMaxBatch; i++) {
+			iov[i].iov_base = &recv_buf_[i * slot];
+			iov[i].iov_len = slot;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &recv_from_[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(recv_from_[i]);
+		}
+		int r;
+		do {
+			r = recvmmsg(sock_, msgs, kMaxBatch, MSG_DONTWAIT, nullptr);
+			recv_calls_++;
+		} while (r < 0 && errno == EINTR);
+		for (int i = 0; i < r; i++) {
+			recv_len_[i] = static_cast<int>(msgs[i].msg_len);
+			if ((msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0) {
+				recv_len_[i] = slot;
+			}
+		}
+		n = r > 0 ? r : 0;
+		received_ += n;
+		return n;
+	}
+#endif
+
+	while (n < kMaxBatch) {
+#ifndef LIBMUMBLE_OS_WINDOWS
+		socklen_t addrlen = sizeof(recv_from_[n]);
+		ssize_t r = recvfrom(sock_, &recv_buf_[n * slot], slot, 0,
+		                     reinterpret_cast<struct sockaddr *>(&recv_from_[n]), &addrlen);
+#else
+		int addrlen = sizeof(recv_from_[n]);
+		int r = recvfrom(sock_, &recv_buf_[n * slot], slot, 0,
+		                 reinterpret_cast<struct sockaddr *>(&recv_from_[n]), &addrlen);
+#endif
+		recv_calls_++;
+		if (r < 0) {
+			if (SocketUtils::Interrupted(SocketUtils::LastError())) {
+				continue;
+			}
+#ifdef LIBMUMBLE_OS_WINDOWS
+			// Datagrams larger than the buffer fail with WSAEMSGSIZE,
+			// but are still consumed, so they are marked as cut.
+			if (SocketUtils::LastError() == WSAEMSGSIZE) {
+				recv_len_[n++] = slot;
+				continue;
+			}
+#endif
+			break;
+		}
+		recv_len_[n++] = static_cast<int>(r);
+	}
+	received_ += n;
+	return n;
+}
+
+char *UDPBatch::Reserve() {
+	if (queued_ == kMaxBatch) {
+		return nullptr;
+	}
+	return &send_buf_[queued_ * kSlotSize];
+}
+
+void UDPBatch::Commit(int len) {
+	send_len_[queued_++] = len;
+}
+
+int UDPBatch::Flush(const struct sockaddr_in &to) {
+	if (queued_ == 0) {
+		return 0;
+	}
+	int sent = 0;
+	if (open_) {
+		sent = batch_io_ ? FlushBatch(0, to) : FlushEach(0, to);
+	}
+	sent_ += sent;
+	dropped_ += queued_ - sent;
+	queued_ = 0;
+	return sent;
+}
+
+// FlushEach sends the queued datagrams from *first* on, one at a time,
+// and stops at the first one the kernel does not take.
+int UDPBatch::FlushEach(int first, const struct sockaddr_in &to) {
+	int sent = 0;
+	for (int i = first; i < queued_; i++) {
+		int r;
+		do {
+			r = sendto(sock_, &send_buf_[i * kSlotSize], send_len_[i], 0,
+			           reinterpret_cast<const struct sockaddr *>(&to), sizeof(to));
+			send_calls_++;
+		} while (r < 0 && SocketUtils::Interrupted(SocketUtils::LastError()));
+		// Errors on an unconnected UDP socket are transient, such as
+		// ICMP errors for earlier datagrams, so only a full send
+		// buffer ends the batch.
+		if (r < 0 && SocketUtils::WouldBlock(SocketUtils::LastError())) {
+			break;
+		}
+		if (r >= 0) {
+			sent++;
+		}
+	}
+	return sent;
+}
+
+// FlushBatch sends the queued datagrams from *first* on with sendmmsg.
+// With UDP_SEGMENT, each message carries a run of datagrams of the same
+// size, optionally followed by a shorter one, which the kernel splits
+// back into datagrams. Otherwise, each message carries one datagram.
+int UDPBatch::FlushBatch(int first, const struct sockaddr_in &to) {
+#if defined(LIBMUMBLE_OS_LINUX)
+	struct mmsghdr msgs[kMaxBatch];
+	struct iovec iov[kMaxBatch];
+	int msg_first[kMaxBatch + 1];
+	union {
+		char buf[CMSG_SPACE(sizeof(uint16_t))];
+		struct cmsghdr align;
+	} control[kMaxBatch];
+	memset(msgs, 0, sizeof(msgs));
+
+	int nmsgs = 0;
+	int i = first;
+	while (i < queued_) {
+		int seg = send_len_[i];
+		int j = i + 1;
+		if (gso_) {
+			int total = seg;
+			while (j < queued_ && j - i < kMaxSegments && send_len_[j] <= seg && total + send_len_[j] <= kMaxSegmentedSize) {
+				total += send_len_[j];
+				j++;
+				if (send_len_[j - 1] < seg) {
+					break;
+				}
+			}
+		}
+		for (int k = i; k < j; k++) {
+			iov[k].iov_base = &send_buf_[k * kSlotSize];
+			iov[k].iov_len = send_len_[k];
+		}
+		struct msghdr *hdr = &msgs[nmsgs].msg_hdr;
+		hdr->msg_name = const_cast<struct sockaddr_in *>(&to);
+		hdr->msg_namelen = sizeof(to);
+		hdr->msg_iov = &iov[i];
+		hdr->msg_iovlen = j - i;
+		if (j - i > 1) {
+			hdr->msg_control = control[nmsgs].buf;
+			hdr->msg_controllen = sizeof(control[nmsgs].buf);
+			struct cmsghdr *cm = CMSG_FIRSTHDR(hdr);
+			cm->cmsg_level = SOL_UDP;
+			cm->cmsg_type = UDP_SEGMENT;
+			cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			uint16_t size = static_cast<uint16_t>(seg);
+			memcpy(CMSG_DATA(cm), &size, sizeof(size));
+		}
+		msg_first[nmsgs++] = i;
+		i = j;
+	}
+	msg_first[nmsgs] = queued_;
+
+	int done = 0;
+	int failed = 0;
+	while (done < nmsgs) {
+		int r = sendmmsg(sock_, &msgs[done], nmsgs - done, MSG_DONTWAIT);
+		send_calls_++;
+		if (r > 0) {
+			done += r;
+			continue;
+		}
+		int err = errno;
+		if (err == EINTR) {
+			continue;
+		}
+		// A device that cannot segment fails with EIO, and an old kernel
+		// rejects the control message with EINVAL. Both disable UDP_SEGMENT
+		// for good, and the message is sent again as single datagrams.
+		if (gso_ && msgs[done].msg_hdr.msg_iovlen > 1 && (err == EIO || err == EINVAL)) {
+			gso_ = false;
+			return msg_first[done] - first - failed + FlushBatch(msg_first[done], to);
+		}
+		if (SocketUtils::WouldBlock(err)) {
+			break;
+		}
+		// As with sendto, other errors only fail the message at hand.
+		failed += msg_first[done + 1] - msg_first[done];
+		done++;
+	}
+	return msg_first[done] - first - failed;
+#else
+	return FlushEach(first, to);
+#endif
+}
+
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_UDPBATCH_H_
+#define MUMBLE_UDPBATCH_H_
+
+#include <mumble/Error.h>
+
+#include "uv.h"
+
+#include <vector>
+#include <stdint.h>
+
+namespace mumble {
+
+// UDPBatch sends and receives datagrams on a non-blocking IPv4 UDP
+// socket, a batch at a time.
+//
+// On Linux, a batch is received with a single recvmmsg, and sent with
+// a single sendmmsg, in which runs of equally sized datagrams are
+// coalesced into one message with UDP_SEGMENT, where the kernel
+// supports it. Elsewhere, or if batching is disabled, each datagram
+// takes a recvfrom or sendto of its own.
+//
+// The socket is meant to be watched with a uv_poll_t, which must be
+// closed before the UDPBatch is.
+class UDPBatch {
+public:
+	// kMaxBatch is the largest number of datagrams
+	// that are received or sent at once.
+	static const int kMaxBatch = 64;
+
+	// kSlotSize is the largest datagram that can be sent. Received
+	// datagrams that are larger are cut to kSlotSize + 1 bytes, so
+	// that they can be told apart.
+	static const int kSlotSize = 1024;
+
+	explicit UDPBatch(bool batch_io = true);
+	~UDPBatch();
+
+	// Open creates the socket, and binds it to *addr*.
+	Error Open(struct sockaddr_in addr);
+
+	// Close closes the socket. Queued datagrams are dropped.
+	void Close();
+
+	uv_os_sock_t Socket() const { return sock_; }
+
+	// LocalPort returns the port the socket is bound to.
+	int LocalPort() const;
+
+	// Receive reads up to kMaxBatch datagrams, without blocking,
+	// and returns how many it read. The datagrams are valid until
+	// the next call to Receive.
+	int Receive();
+	const char *Data(int i) const { return &recv_buf_[i * (kSlotSize + 1)]; }
+	int Length(int i) const { return recv_len_[i]; }
+	const struct sockaddr_in &From(int i) const { return recv_from_[i]; }
+
+	// Reserve returns a kSlotSize buffer for the next datagram to be
+	// sent, or null if kMaxBatch datagrams are already queued. Commit
+	// queues the first *len* bytes of that buffer.
+	char *Reserve();
+	void Commit(int len);
+	int Queued() const { return queued_; }
+
+	// Flush sends all queued datagrams to *to*, and returns how many
+	// the kernel accepted. Voice is not worth queueing, so datagrams
+	// that do not fit into the socket's send buffer are dropped.
+	int Flush(const struct sockaddr_in &to);
+
+	bool BatchesIO() const { return batch_io_; }
+	bool SegmentsIO() const { return gso_; }
+
+	// The number of syscalls made, and of datagrams sent, received
+	// and dropped, since the UDPBatch was created.
+	uint64_t  send_calls_;
+	uint64_t  recv_calls_;
+	uint64_t  sent_;
+	uint64_t  received_;
+	uint64_t  dropped_;
+
+private:
+	UDPBatch(const UDPBatch &);
+	UDPBatch &operator=(const UDPBatch &);
+
+	int FlushEach(int first, const struct sockaddr_in &to);
+	int FlushBatch(int first, const struct sockaddr_in &to);
+
+	bool                batch_io_;
+	bool                gso_;
+	uv_os_sock_t        sock_;
+	bool                open_;
+	std::vector<char>   recv_buf_;
+	int                 recv_len_[kMaxBatch];
+	struct sockaddr_in  recv_from_[kMaxBatch];
+	std::vector<char>   send_buf_;
+	int                 send_len_[kMaxBatch];
+	int                 queued_;
+};
+
+}
+
+#endif
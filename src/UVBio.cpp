@@ -2,8 +2,8 @@
 // The use of this source code is goverened by a BSD-style
 // license that can be found in the LICENSE-file.
 
-#include <mumble/ByteArray.h>
 #include "UVBio.h"
+#include "BufferPool.h"
 
 #include "uv.h"
 #include <openssl/bio.h>
@@ -30,30 +30,54 @@ BIO_METHOD *UVBioState::GetMethod() {
 	return &UVBioState::method_;
 }
 
-UVBioState::UVBioState(uv_connect_t *connect) {
-	connect_ = connect;
+// The initial number of entries in the input ring.
+// Must be a power of two.
+static const size_t kInitialRingSize = 8;
+
+UVBioState::UVBioState(uv_stream_t *stream) : write_seq_(0), write_done_seq_(0), ring_(kInitialRingSize), head_(0), count_(0), pending_(0) {
+	stream_ = stream;
 }
 
 UVBioState::~UVBioState() {
+	while (count_ > 0) {
+		InputBuffer &ib = ring_[head_];
+		ib.pool->Release(ib.buf);
+		head_ = (head_ + 1) & (ring_.size() - 1);
+		count_--;
+	}
 }
 
-void UVBioState::PutNewBuffer(ByteArray ba) {
-	bufs_.push_back(ba);
+// GrowRing doubles the size of the input ring, keeping the
+// queued entries in order. This only happens if OpenSSL falls
+// behind the socket, so it is not part of the steady state.
+void UVBioState::GrowRing() {
+	std::vector<InputBuffer> larger(ring_.size() * 2);
+	for (size_t i = 0; i < count_; i++) {
+		larger[i] = ring_[(head_ + i) & (ring_.size() - 1)];
+	}
+	ring_.swap(larger);
+	head_ = 0;
 }
 
-void UVBioState::PutOldBuffer(ByteArray ba) {
-	bufs_.push_front(ba);
+void UVBioState::PutNewBuffer(char *buf, int len, BufferPool *pool) {
+	if (count_ == ring_.size()) {
+		GrowRing();
+	}
+	InputBuffer &ib = ring_[(head_ + count_) & (ring_.size() - 1)];
+	ib.buf = buf;
+	ib.len = len;
+	ib.off = 0;
+	ib.pool = pool;
+	count_++;
+	pending_ += len;
 }
 
 bool UVBioState::HasBuffers() {
-	return bufs_.size() > 0;
+	return count_ > 0;
 }
 
-ByteArray UVBioState::GetBuffer() {
-	assert(bufs_.size() > 0);
-	ByteArray front = bufs_.front();
-	bufs_.pop_front();
-	return front;
+int UVBioState::Pending() const {
+	return pending_;
 }
 
 int UVBioState::Create(BIO *b) {
@@ -76,70 +100,92 @@ int UVBioState::Destroy(BIO *b) {
 
 int UVBioState::Read(BIO *b, char *buf, int len) {
 	UVBioState *state = static_cast<UVBioState *>(b->ptr);
-	uv_connect_t *connect = state->connect_;
-	uv_stream_t *stream = connect->handle;
+
+	BIO_clear_retry_flags(b);
 
 	if (!state->HasBuffers()) {
 		BIO_set_retry_read(b);
 		return -1;
 	}
 
-	// Get the front-most buffer
-	ByteArray ba = state->GetBuffer();
-	// Buffer is bigger than what the Read function
-	// has space for in its buffer.  Slice our buffer
-	// up, and give the Read function what it can take.
-	if (ba.Length() > len) {
-		// Slice away the remaining part of the
-		// buffer and put it back into the queue.
-		ByteArray remain = ba.Slice(len);
-		state->PutOldBuffer(remain);
-		// Copy data from our original ByteArray
-		// into the Read functions buffer.
-		memcpy(buf, ba.Data(), len);
-		return len;
-	// We have less space in our buffer than the Read
-	// function requested. Give the Read function what
-	// we have.
-	} else {
-		memcpy(buf, ba.Data(), ba.Length());
-		return ba.Length();
+	// Hand out as much as we can from the front-most
+	// buffer. If OpenSSL asked for less than what the
+	// buffer holds, the remainder stays in place and is
+	// picked up by the next Read by advancing its offset.
+	InputBuffer &ib = state->ring_[state->head_];
+	int avail = ib.len - ib.off;
+	int n = avail < len ? avail : len;
+	memcpy(buf, ib.buf + ib.off, n);
+	ib.off += n;
+	state->pending_ -= n;
+
+	// The buffer has been fully consumed. Return it to its pool.
+	if (ib.off == ib.len) {
+		ib.pool->Release(ib.buf);
+		ib.buf = nullptr;
+		state->head_ = (state->head_ + 1) & (state->ring_.size() - 1);
+		state->count_--;
 	}
 
-	/* NOTREACHED */
-	assert(1 == 0);
-	return -1;
+	return n;
 }
 
 void UVBioState::WriteCallback(uv_write_t *req, int status) {
 	assert(req != NULL);
 
-	// todo(mkrautz): should we propagate write errors as errors to the TLSConnection?
-	if (status != 0) {
-		std::cerr << "UVBioState::WriteCallback status = " << status << std::endl;
-		return;
+	WriteRequest *wr = reinterpret_cast<WriteRequest *>(req);
+	UVBioState *state = wr->state;
+	state->write_done_seq_ = wr->seq;
+	if (wr->pool != nullptr) {
+		wr->pool->Release(wr->buf);
+	} else {
+		free(wr->buf);
+	}
+	delete wr;
+
+	if (state->write_done_handler_) {
+		state->write_done_handler_(status);
 	}
 }
 
 int UVBioState::Write(BIO *b, const char *buf, int len) {
 	UVBioState *state = static_cast<UVBioState *>(b->ptr);
-	uv_connect_t *connect = state->connect_;
-	uv_stream_t *stream = connect->handle;
+	uv_stream_t *stream = state->stream_;
+
+	// Records fit in a pooled block. Anything larger is
+	// written via a one-off allocation.
+	WriteRequest *wr = new WriteRequest;
+	wr->state = state;
+	BufferPool &pool = BufferPool::WritePool();
+	if (len <= pool.BlockSize()) {
+		wr->buf = pool.Acquire();
+		wr->pool = &pool;
+	} else {
+		wr->buf = static_cast<char *>(malloc(len));
+		wr->pool = nullptr;
+	}
+	memcpy(wr->buf, buf, len);
 
-	uv_write_t *req = static_cast<uv_write_t *>(calloc(sizeof(*req), 1));
 	uv_buf_t uvbuf;
-	uvbuf.base = const_cast<char *>(buf);
+	uvbuf.base = wr->buf;
 #ifdef LIBMUMBLE_OS_WINDOWS
 	uvbuf.len = static_cast<ULONG>(len);
 #else
 	uvbuf.len = static_cast<size_t>(len);
 #endif
 
-	int err = uv_write(req, stream, &uvbuf, 1, UVBioState::WriteCallback);
+	int err = uv_write(&wr->req, stream, &uvbuf, 1, UVBioState::WriteCallback);
 	if (err != UV_OK) {
 		std::cerr << "uv_write failed!" << std::endl;
+		if (wr->pool != nullptr) {
+			wr->pool->Release(wr->buf);
+		} else {
+			free(wr->buf);
+		}
+		delete wr;
 		return -1;
 	}
+	wr->seq = ++state->write_seq_;
 
 	return len;
 }
@@ -153,8 +199,22 @@ int UVBioState::Gets(BIO *B, char *buf, int len) {
 }
 
 long UVBioState::Ctrl(BIO *b, int cmd, long num, void *ptr) {
-	if (cmd == BIO_CTRL_FLUSH) {
-		return 1;
+	UVBioState *state = static_cast<UVBioState *>(b->ptr);
+
+	switch (cmd) {
+		case BIO_CTRL_FLUSH:
+			return 1;
+		// Let OpenSSL know how much input is ready to be
+		// read, so it can plan its reads accordingly.
+		case BIO_CTRL_PENDING:
+			if (state == nullptr) {
+				return 0;
+			}
+			return static_cast<long>(state->Pending());
+		// Written data is handed to libuv right away, so
+		// there is never anything pending on the write side.
+		case BIO_CTRL_WPENDING:
+			return 0;
 	}
 	return 0;
 }
@@ -5,27 +5,57 @@
 #ifndef MUMBLE_UVBIO_H_
 #define MUMBLE_UVBIO_H_
 
-#include <mumble/ByteArray.h>
-
 #include "uv.h"
 
 #include <openssl/bio.h>
 
-#include <list>
+#include <vector>
+#include <functional>
+#include <stdint.h>
 
 namespace mumble {
 
+class BufferPool;
+
 class UVBioState {
 public:
 	static BIO_METHOD *GetMethod();
 
-	UVBioState(uv_connect_t *connect);
+	UVBioState(uv_stream_t *stream);
 	~UVBioState();
 
-	void PutNewBuffer(ByteArray ba);
-	void PutOldBuffer(ByteArray ba);
+	// PutNewBuffer queues *len* bytes starting at *buf* as input
+	// for OpenSSL. The UVBioState takes ownership of *buf*, and
+	// hands it back to *pool* once all of its bytes have been
+	// consumed.
+	void PutNewBuffer(char *buf, int len, BufferPool *pool);
 	bool HasBuffers();
-	ByteArray GetBuffer();
+	// Pending returns the number of input bytes that have
+	// not yet been consumed by OpenSSL.
+	int Pending() const;
+
+	// WriteRequest is a pending write to the stream. OpenSSL
+	// reuses its output buffer as soon as a BIO write returns,
+	// so the data is copied into a block of its own.
+	struct WriteRequest {
+		uv_write_t  req;
+		UVBioState  *state;
+		uint64_t    seq;
+		char        *buf;
+		BufferPool  *pool;
+	};
+
+	// Each write to the stream is given a sequence number.
+	// write_seq_ is the sequence number of the latest write.
+	// Writes to a stream complete in order, so all writes up
+	// to and including write_done_seq_ have completed.
+	uint64_t                  write_seq_;
+	uint64_t                  write_done_seq_;
+
+	// write_done_handler_ is called whenever a write to
+	// the stream has completed, with the libuv status of
+	// the write.
+	std::function<void (int status)>  write_done_handler_;
 
 	static int Create(BIO *b);
 	static int Destroy(BIO *b);
@@ -36,9 +66,23 @@ public:
 	static int Gets(BIO *B, char *buf, int len);
 	static long Ctrl(BIO *b, int cmd, long num, void *ptr);
 
-	static BIO_METHOD    method_;
-	uv_connect_t         *connect_;
-	std::list<ByteArray>  bufs_;
+	// InputBuffer is an entry in the input ring. Reads from the
+	// BIO consume an InputBuffer by advancing its offset.
+	struct InputBuffer {
+		char        *buf;
+		int         len;
+		int         off;
+		BufferPool  *pool;
+	};
+
+	void GrowRing();
+
+	static BIO_METHOD         method_;
+	uv_stream_t               *stream_;
+	std::vector<InputBuffer>  ring_;
+	size_t                    head_;
+	size_t                    count_;
+	int                       pending_;
 };
 
 }
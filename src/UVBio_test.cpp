@@ -0,0 +1,137 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include "UVBio.h"
+#include "BufferPool.h"
+
+#include <openssl/bio.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace mumble;
+
+// UVBioTest reads from a UVBioState through an OpenSSL BIO,
+// the way the TLS layer does. The stream is never written to.
+class UVBioTest : public ::testing::Test {
+protected:
+	UVBioTest() : pool_(64, 1024), state_(nullptr), next_(0), read_(0) {}
+
+	virtual void SetUp() {
+		bio_ = BIO_new(UVBioState::GetMethod());
+		bio_->ptr = &state_;
+	}
+
+	virtual void TearDown() {
+		BIO_free(bio_);
+	}
+
+	// Put queues a block holding the next *len*
+	// bytes of a counting sequence.
+	void Put(int len) {
+		char *block = pool_.Acquire();
+		for (int i = 0; i < len; i++) {
+			block[i] = static_cast<char>(next_++);
+		}
+		blocks_.push_back(block);
+		state_.PutNewBuffer(block, len, &pool_);
+	}
+
+	// Read reads up to *len* bytes from the BIO,
+	// and checks that they continue the sequence.
+	int Read(int len) {
+		std::vector<char> buf(len);
+		int n = BIO_read(bio_, &buf[0], len);
+		for (int i = 0; i < n; i++) {
+			EXPECT_EQ(static_cast<char>(read_++), buf[i]);
+		}
+		return n;
+	}
+
+	BufferPool          pool_;
+	UVBioState          state_;
+	BIO                 *bio_;
+	std::vector<char *> blocks_;
+	int                 next_;
+	int                 read_;
+};
+
+TEST_F(UVBioTest, EmptyReadRetries) {
+	char buf[16];
+	ASSERT_EQ(-1, BIO_read(bio_, buf, sizeof(buf)));
+	ASSERT_TRUE(BIO_should_retry(bio_));
+	ASSERT_TRUE(BIO_should_read(bio_));
+	ASSERT_EQ(0, static_cast<int>(BIO_pending(bio_)));
+}
+
+TEST_F(UVBioTest, PartialReadsAdvanceOffset) {
+	Put(50);
+	Put(30);
+	ASSERT_EQ(80, static_cast<int>(BIO_pending(bio_)));
+
+	// A read never spans two buffers.
+	ASSERT_EQ(20, Read(20));
+	ASSERT_EQ(60, static_cast<int>(BIO_pending(bio_)));
+	ASSERT_EQ(30, Read(64));
+	ASSERT_EQ(30, static_cast<int>(BIO_pending(bio_)));
+	ASSERT_EQ(30, Read(64));
+	ASSERT_EQ(0, static_cast<int>(BIO_pending(bio_)));
+	ASSERT_FALSE(state_.HasBuffers());
+	ASSERT_EQ(-1, Read(64));
+}
+
+// GrowsWrappedRing fills the ring while its head is not at the start,
+// so that growing it has to unwrap the queued buffers in order.
+TEST_F(UVBioTest, GrowsWrappedRing) {
+	for (int i = 0; i < 6; i++) {
+		Put(10);
+	}
+	for (int i = 0; i < 5; i++) {
+		ASSERT_EQ(10, Read(10));
+	}
+	for (int i = 0; i < 40; i++) {
+		Put(1 + i);
+	}
+	int pending = 10 + 40 * 41 / 2;
+	ASSERT_EQ(pending, static_cast<int>(BIO_pending(bio_)));
+	while (pending > 0) {
+		int n = Read(64);
+		ASSERT_GT(n, 0);
+		pending -= n;
+		ASSERT_EQ(pending, static_cast<int>(BIO_pending(bio_)));
+	}
+	ASSERT_EQ(next_, read_);
+	ASSERT_FALSE(state_.HasBuffers());
+
+	// Every block was handed back to the pool once consumed. Blocks
+	// released early were reused by later puts.
+	std::sort(blocks_.begin(), blocks_.end());
+	blocks_.erase(std::unique(blocks_.begin(), blocks_.end()), blocks_.end());
+	std::vector<char *> released;
+	for (size_t i = 0; i < blocks_.size(); i++) {
+		released.push_back(pool_.Acquire());
+	}
+	std::sort(released.begin(), released.end());
+	ASSERT_TRUE(released == blocks_);
+	for (char *block : released) {
+		pool_.Release(block);
+	}
+}
+
+TEST(UVBioStateTest, ReleasesUnreadBuffersOnDestruction) {
+	BufferPool pool(64, 16);
+	char *block = pool.Acquire();
+	{
+		UVBioState state(nullptr);
+		state.PutNewBuffer(block, 64, &pool);
+		ASSERT_EQ(64, state.Pending());
+	}
+	char *again = pool.Acquire();
+	ASSERT_EQ(block, again);
+	pool.Release(again);
+}
@@ -14,11 +14,20 @@ Error UVUtils::ErrorFromLastUVError(uv_loop_t *loop) {
 	return UVUtils::ErrorFromUVError(last);
 }
 
+// DescribeUVError returns libuv's description of
+// the uv_err_code *code*.
+static const char *DescribeUVError(long code) {
+	uv_err_t err;
+	err.code = static_cast<uv_err_code>(code);
+	err.sys_errno_ = 0;
+	return uv_strerror(err);
+}
+
 Error UVUtils::ErrorFromUVError(uv_err_t err) {
-	return Error::ErrorFromDescription(
-		std::string("uv"),
+	return Error::ErrorFromCode(
+		"uv",
 		static_cast<long>(err.code),
-		std::string(uv_strerror(err))
+		DescribeUVError
 	);
 }
 
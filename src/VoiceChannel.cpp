@@ -0,0 +1,84 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/VoiceChannel.h>
+#include "VoiceChannel_p.h"
+
+namespace mumble {
+
+VoiceChannelOptions::VoiceChannelOptions() : ping_interval_ms(2000), udp_timeout_ms(5000), batch_io(true) {
+}
+
+VoiceChannelStats::VoiceChannelStats()
+	: good(0), late(0), lost(0), resync(0), udp_packets(0), udp_ping_avg(0), udp_ping_var(0) {
+}
+
+int VoiceChannel::MaxPacketSize() {
+	return VoiceChannelPrivate::kMaxDatagramSize - CryptState::kHeaderSize;
+}
+
+VoiceChannel::VoiceChannel(TLSConnection &conn, const VoiceChannelOptions *opts)
+	: priv_(new VoiceChannelPrivate(conn, opts != nullptr ? *opts : VoiceChannelOptions())) {
+}
+
+VoiceChannel::~VoiceChannel() {
+}
+
+Error VoiceChannel::SetKey(const ByteView &key, const ByteView &client_nonce, const ByteView &server_nonce) {
+	return priv_->SetKey(key, client_nonce, server_nonce);
+}
+
+Error VoiceChannel::SetServerNonce(const ByteView &server_nonce) {
+	return priv_->SetServerNonce(server_nonce);
+}
+
+ByteArray VoiceChannel::ClientNonce() const {
+	return priv_->ClientNonce();
+}
+
+Error VoiceChannel::Start(const std::string &ipaddr, int port) {
+	return priv_->Start(ipaddr, port);
+}
+
+void VoiceChannel::Stop() {
+	priv_->Stop();
+}
+
+VoiceChannel& VoiceChannel::SetTunnel(ControlChannel *tunnel) {
+	priv_->tunnel_ = tunnel;
+	return *this;
+}
+
+Error VoiceChannel::Send(const ByteView &packet) {
+	return priv_->Send(packet);
+}
+
+void VoiceChannel::HandleTunnelPacket(const ByteView &packet) {
+	priv_->HandlePacket(packet);
+}
+
+VoiceChannelPath VoiceChannel::Path() const {
+	return priv_->Path();
+}
+
+VoiceChannelStats VoiceChannel::Stats() const {
+	return priv_->Stats();
+}
+
+VoiceChannel& VoiceChannel::SetPacketHandler(VoiceChannelPacketHandler fn) {
+	priv_->packet_handler_ = fn;
+	return *this;
+}
+
+VoiceChannel& VoiceChannel::SetResyncHandler(VoiceChannelResyncHandler fn) {
+	priv_->resync_handler_ = fn;
+	return *this;
+}
+
+VoiceChannel& VoiceChannel::SetPathHandler(VoiceChannelPathHandler fn) {
+	priv_->path_handler_ = fn;
+	return *this;
+}
+
+}
@@ -0,0 +1,473 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "VoiceChannel_p.h"
+#include <mumble/VoicePacket.h>
+#include "TLSConnection_p.h"
+#include "EventLoop_p.h"
+#include "UVUtils.h"
+
+#include <cstring>
+
+namespace mumble {
+
+// VoiceSend is a packet posted to the loop thread by Send.
+struct VoiceSend {
+	std::shared_ptr<VoiceSocket>  sock;
+	int                           len;
+	unsigned char                 data[VoiceChannelPrivate::kMaxDatagramSize];
+};
+
+static Error InvalidKeyError() {
+	return Error::ErrorFromStaticDescription(
+		"VoiceChannel",
+		VOICE_CHANNEL_ERROR_INVALID_KEY,
+		"keys and nonces must be 16 bytes long"
+	);
+}
+
+// Pings are voice packets of type 1, whose payload is a timestamp,
+// which the server sends back unchanged.
+static const unsigned char kPingHeader = VOICE_PACKET_TYPE_PING << 5;
+
+// kReceiveBatches is how many batches of datagrams are read each
+// time the socket becomes readable, before other handles get a turn.
+static const int kReceiveBatches = 4;
+
+VoiceChannelPrivate::VoiceChannelPrivate(TLSConnection &conn, const VoiceChannelOptions &opts)
+	: conn_(conn), opts_(opts), tunnel_(nullptr), path_(VOICE_CHANNEL_PATH_UDP), ping_count_(0), ping_mean_(0), ping_m2_(0),
+	  last_good_(0), last_resync_(0), last_pong_(0) {
+	uv_mutex_init(&lock_);
+	memset(&remote_, 0, sizeof(remote_));
+}
+
+VoiceChannelPrivate::~VoiceChannelPrivate() {
+	Stop();
+	uv_mutex_destroy(&lock_);
+}
+
+Error VoiceChannelPrivate::NotConnectedError() {
+	return Error::ErrorFromStaticDescription(
+		"VoiceChannel",
+		VOICE_CHANNEL_ERROR_NOT_CONNECTED,
+		"connection is not established"
+	);
+}
+
+Error VoiceChannelPrivate::SetKey(const ByteView &key, const ByteView &client_nonce, const ByteView &server_nonce) {
+	if (key.Length() != CryptState::kBlockSize ||
+	    client_nonce.Length() != CryptState::kBlockSize ||
+	    server_nonce.Length() != CryptState::kBlockSize) {
+		return InvalidKeyError();
+	}
+	uv_mutex_lock(&lock_);
+	bool ok = crypt_.SetKey(reinterpret_cast<const unsigned char *>(key.ConstData()),
+	                        reinterpret_cast<const unsigned char *>(client_nonce.ConstData()),
+	                        reinterpret_cast<const unsigned char *>(server_nonce.ConstData()));
+	uv_mutex_unlock(&lock_);
+	if (!ok) {
+		return InvalidKeyError();
+	}
+	return Error::NoError();
+}
+
+Error VoiceChannelPrivate::SetServerNonce(const ByteView &server_nonce) {
+	if (server_nonce.Length() != CryptState::kBlockSize) {
+		return InvalidKeyError();
+	}
+	uv_mutex_lock(&lock_);
+	crypt_.SetDecryptIV(reinterpret_cast<const unsigned char *>(server_nonce.ConstData()));
+	uv_mutex_unlock(&lock_);
+	return Error::NoError();
+}
+
+ByteArray VoiceChannelPrivate::ClientNonce() const {
+	ByteArray nonce(CryptState::kBlockSize);
+	uv_mutex_lock(&lock_);
+	memcpy(nonce.Data(), crypt_.EncryptIV(), CryptState::kBlockSize);
+	uv_mutex_unlock(&lock_);
+	return nonce;
+}
+
+VoiceChannelStats VoiceChannelPrivate::Stats() const {
+	VoiceChannelStats stats;
+	uv_mutex_lock(&lock_);
+	stats.good = crypt_.good_;
+	stats.late = crypt_.late_;
+	stats.lost = crypt_.lost_;
+	stats.resync = crypt_.resync_;
+	stats.udp_packets = ping_count_;
+	stats.udp_ping_avg = static_cast<float>(ping_mean_);
+	stats.udp_ping_var = ping_count_ > 1 ? static_cast<float>(ping_m2_ / (ping_count_ - 1)) : 0.0f;
+	uv_mutex_unlock(&lock_);
+	return stats;
+}
+
+VoiceChannelPath VoiceChannelPrivate::Path() const {
+	uv_mutex_lock(&lock_);
+	bool udp = sock_ != nullptr && crypt_.IsValid() && path_ == VOICE_CHANNEL_PATH_UDP;
+	uv_mutex_unlock(&lock_);
+	if (udp || tunnel_ == nullptr) {
+		return VOICE_CHANNEL_PATH_UDP;
+	}
+	return VOICE_CHANNEL_PATH_TUNNEL;
+}
+
+// Start opens the socket on the TLSConnection's loop. The
+// connection must be established, which means that its
+// loop has been set up.
+Error VoiceChannelPrivate::Start(const std::string &ipaddr, int port) {
+	EventLoopPrivate *loop = conn_.priv_->evloop_;
+	if (loop == nullptr) {
+		return NotConnectedError();
+	}
+	struct sockaddr_in addr = uv_ip4_addr(ipaddr.c_str(), port);
+
+	Error err;
+	bool ok = loop->RunSync([&] {
+		err = Open(addr);
+	});
+	if (!ok) {
+		return NotConnectedError();
+	}
+	return err;
+}
+
+// Stop closes the socket, unless the TLSConnection has already
+// closed it while shutting down. In that case, the connection's
+// loop may be gone, so it must not be touched. The loop is taken
+// from the socket, which is read under lock_.
+void VoiceChannelPrivate::Stop() {
+	uv_mutex_lock(&lock_);
+	std::shared_ptr<VoiceSocket> sock = sock_;
+	uv_mutex_unlock(&lock_);
+	if (sock == nullptr) {
+		return;
+	}
+	sock->loop->RunSync([this] {
+		Close();
+	});
+}
+
+Error VoiceChannelPrivate::Open(struct sockaddr_in addr) {
+	TLSConnectionPrivate *cp = conn_.priv_.get();
+	if (cp->state_ != TLSConnectionPrivate::TLS_CONNECTION_STATE_ESTABLISHED) {
+		return NotConnectedError();
+	}
+	Close();
+
+	std::shared_ptr<VoiceSocket> sock = std::make_shared<VoiceSocket>(opts_.batch_io);
+	Error err = sock->batch.Open(uv_ip4_addr("0.0.0.0", 0));
+	if (err.HasError()) {
+		return err;
+	}
+	if (uv_poll_init_socket(cp->loop_, &sock->poll, sock->batch.Socket()) != UV_OK) {
+		return UVUtils::ErrorFromLastUVError(cp->loop_);
+	}
+	uv_timer_init(cp->loop_, &sock->timer);
+	uv_prepare_init(cp->loop_, &sock->flush);
+	sock->poll.data = sock.get();
+	sock->timer.data = sock.get();
+	sock->flush.data = sock.get();
+	sock->remote = addr;
+	sock->loop = cp->evloop_;
+	sock->priv = this;
+	sock->closing = false;
+	sock->flushing = false;
+	sock->open_handles = 3;
+	sock->self = sock;
+
+	if (uv_poll_start(&sock->poll, UV_READABLE, VoiceChannelPrivate::OnPoll) != UV_OK) {
+		err = UVUtils::ErrorFromLastUVError(cp->loop_);
+		CloseSocket(sock.get());
+		return err;
+	}
+
+	remote_ = addr;
+	last_good_ = uv_now(cp->loop_);
+	last_resync_ = last_good_;
+	last_pong_ = last_good_;
+
+	// With a tunnel, packets only go over UDP
+	// once the server has answered a ping.
+	uv_mutex_lock(&lock_);
+	sock_ = sock;
+	path_ = tunnel_ != nullptr ? VOICE_CHANNEL_PATH_TUNNEL : VOICE_CHANNEL_PATH_UDP;
+	uv_mutex_unlock(&lock_);
+
+	uv_timer_start(&sock->timer, VoiceChannelPrivate::OnPingTimer, 0, opts_.ping_interval_ms);
+
+	// The socket keeps the connection's loop alive, so it
+	// has to be closed along with the connection.
+	cp->shutdown_hook_ = [this] {
+		Close();
+	};
+	return Error::NoError();
+}
+
+// Close closes the socket. Packets sent after that go through
+// the tunnel, if there is one, but the path handler is not called,
+// as Close may be called while the VoiceChannel is destroyed.
+void VoiceChannelPrivate::Close() {
+	std::shared_ptr<VoiceSocket> sock;
+	uv_mutex_lock(&lock_);
+	sock.swap(sock_);
+	path_ = tunnel_ != nullptr ? VOICE_CHANNEL_PATH_TUNNEL : VOICE_CHANNEL_PATH_UDP;
+	uv_mutex_unlock(&lock_);
+	if (sock == nullptr) {
+		return;
+	}
+	conn_.priv_->shutdown_hook_ = TLSConnectionShutdownHook();
+	CloseSocket(sock.get());
+}
+
+// CloseSocket sends what is still queued, and closes the socket
+// right after its poll handle, which libuv no longer touches then.
+void VoiceChannelPrivate::CloseSocket(VoiceSocket *sock) {
+	sock->batch.Flush(sock->remote);
+	sock->priv = nullptr;
+	sock->closing = true;
+	uv_close(reinterpret_cast<uv_handle_t *>(&sock->poll), VoiceChannelPrivate::OnSocketClosed);
+	uv_close(reinterpret_cast<uv_handle_t *>(&sock->timer), VoiceChannelPrivate::OnSocketClosed);
+	uv_close(reinterpret_cast<uv_handle_t *>(&sock->flush), VoiceChannelPrivate::OnSocketClosed);
+	sock->batch.Close();
+}
+
+void VoiceChannelPrivate::OnSocketClosed(uv_handle_t *handle) {
+	VoiceSocket *sock = static_cast<VoiceSocket *>(handle->data);
+	sock->open_handles--;
+	if (sock->open_handles == 0) {
+		std::shared_ptr<VoiceSocket> self;
+		self.swap(sock->self);
+	}
+}
+
+// Send picks the path of *packet* while holding lock_, so that
+// each packet is sent on exactly one path, even while the path
+// changes. The packet is sent after lock_ is released, as a send
+// over the tunnel may shut down the connection, which calls Close.
+// Packets for UDP are queued right away on the loop thread, and
+// are posted to it from any other thread.
+Error VoiceChannelPrivate::Send(const ByteView &packet) {
+	if (packet.Length() > kMaxDatagramSize - CryptState::kHeaderSize) {
+		return Error::ErrorFromStaticDescription(
+			"VoiceChannel",
+			VOICE_CHANNEL_ERROR_PACKET_TOO_LARGE,
+			"packet too large"
+		);
+	}
+
+	uv_mutex_lock(&lock_);
+	bool started = sock_ != nullptr;
+	bool keyed = crypt_.IsValid();
+	bool udp = started && keyed && path_ == VOICE_CHANNEL_PATH_UDP;
+	ControlChannel *tunnel = tunnel_;
+	std::shared_ptr<VoiceSocket> sock = sock_;
+	uv_mutex_unlock(&lock_);
+
+	if (!udp && tunnel != nullptr) {
+		return tunnel->SendRaw(MESSAGE_TYPE_UDP_TUNNEL, packet);
+	}
+
+	if (!started) {
+		return Error::ErrorFromStaticDescription(
+			"VoiceChannel",
+			VOICE_CHANNEL_ERROR_NOT_STARTED,
+			"voice channel is not started"
+		);
+	}
+	if (!keyed) {
+		return Error::ErrorFromStaticDescription(
+			"VoiceChannel",
+			VOICE_CHANNEL_ERROR_NO_KEY,
+			"no key has been set"
+		);
+	}
+
+	EventLoopPrivate *loop = sock->loop;
+	if (loop->IsLoopThread()) {
+		Transmit(sock.get(), reinterpret_cast<const unsigned char *>(packet.ConstData()), packet.Length());
+		return Error::NoError();
+	}
+	VoiceSend *vs = NewSend(sock, packet);
+	bool ok = loop->Post([this, vs] {
+		Transmit(vs->sock.get(), vs->data, vs->len);
+		delete vs;
+	});
+	if (!ok) {
+		delete vs;
+		return NotConnectedError();
+	}
+	return Error::NoError();
+}
+
+VoiceSend *VoiceChannelPrivate::NewSend(const std::shared_ptr<VoiceSocket> &sock, const ByteView &packet) {
+	VoiceSend *vs = new VoiceSend;
+	vs->sock = sock;
+	vs->len = packet.Length();
+	memcpy(vs->data, packet.ConstData(), packet.Length());
+	return vs;
+}
+
+// Transmit encrypts *packet* into the socket's send batch, unless
+// the socket was closed while the packet was waiting for the loop
+// thread. Packets are only encrypted here, on the loop thread, so
+// that they are sent in the order of their nonces, pings included.
+// The batch is flushed before the loop blocks, or when it is full.
+void VoiceChannelPrivate::Transmit(VoiceSocket *sock, const unsigned char *packet, int len) {
+	if (sock->closing) {
+		return;
+	}
+	char *slot = sock->batch.Reserve();
+	if (slot == nullptr) {
+		sock->batch.Flush(sock->remote);
+		slot = sock->batch.Reserve();
+	}
+	uv_mutex_lock(&lock_);
+	crypt_.Encrypt(packet, reinterpret_cast<unsigned char *>(slot), len);
+	uv_mutex_unlock(&lock_);
+	sock->batch.Commit(len + CryptState::kHeaderSize);
+
+	if (!sock->flushing) {
+		sock->flushing = true;
+		uv_prepare_start(&sock->flush, VoiceChannelPrivate::OnFlush);
+	}
+}
+
+void VoiceChannelPrivate::OnFlush(uv_prepare_t *prepare, int status) {
+	VoiceSocket *sock = static_cast<VoiceSocket *>(prepare->data);
+	sock->batch.Flush(sock->remote);
+	sock->flushing = false;
+	uv_prepare_stop(prepare);
+}
+
+void VoiceChannelPrivate::OnPingTimer(uv_timer_t *timer, int status) {
+	VoiceSocket *sock = static_cast<VoiceSocket *>(timer->data);
+	if (sock->priv != nullptr) {
+		sock->priv->OnPingTimer();
+	}
+}
+
+// OnPingTimer falls back to the tunnel once pings have gone
+// unanswered for too long, and sends the next ping, which is
+// also what brings the VoiceChannel back to UDP.
+void VoiceChannelPrivate::OnPingTimer() {
+	uint64_t now = uv_now(conn_.priv_->loop_);
+	if (tunnel_ != nullptr && path_ == VOICE_CHANNEL_PATH_UDP && now - last_pong_ > static_cast<uint64_t>(opts_.udp_timeout_ms)) {
+		SetPath(VOICE_CHANNEL_PATH_TUNNEL);
+	}
+
+	unsigned char ping[1 + VoicePacket::kMaxVarintSize];
+	ping[0] = kPingHeader;
+	int len = 1 + VoicePacket::EncodeVarint(now, ping + 1);
+
+	uv_mutex_lock(&lock_);
+	std::shared_ptr<VoiceSocket> sock = sock_;
+	bool keyed = crypt_.IsValid();
+	uv_mutex_unlock(&lock_);
+	if (sock != nullptr && keyed) {
+		Transmit(sock.get(), ping, len);
+	}
+}
+
+// RecordPong records the round trip time of an answered *ping*.
+// Must be called with lock_ held, such that Stats counts it along
+// with the decryption. Returns false if *ping* is not one of ours.
+bool VoiceChannelPrivate::RecordPong(const unsigned char *ping, int len, uint64_t now) {
+	uint64_t sent;
+	int n = VoicePacket::DecodeVarint(ping + 1, len - 1, &sent);
+	if (n == 0 || 1 + n != len || sent > now) {
+		return false;
+	}
+	double rtt = static_cast<double>(now - sent);
+	ping_count_++;
+	double delta = rtt - ping_mean_;
+	ping_mean_ += delta / ping_count_;
+	ping_m2_ += delta * (rtt - ping_mean_);
+	return true;
+}
+
+void VoiceChannelPrivate::SetPath(VoiceChannelPath path) {
+	uv_mutex_lock(&lock_);
+	path_ = path;
+	uv_mutex_unlock(&lock_);
+	if (path_handler_) {
+		path_handler_(path);
+	}
+}
+
+// OnPoll reads the datagrams that have arrived, a batch at a time.
+// Errors on an unconnected UDP socket are transient, such as ICMP
+// errors for earlier datagrams, and cut datagrams are not valid voice
+// packets. A handler may stop the VoiceChannel, which ends the loop.
+void VoiceChannelPrivate::OnPoll(uv_poll_t *poll, int status, int events) {
+	VoiceSocket *sock = static_cast<VoiceSocket *>(poll->data);
+	for (int batch = 0; batch < kReceiveBatches && sock->priv != nullptr; batch++) {
+		int n = sock->batch.Receive();
+		for (int i = 0; i < n && sock->priv != nullptr; i++) {
+			int len = sock->batch.Length(i);
+			if (len > kMaxDatagramSize) {
+				continue;
+			}
+			sock->priv->OnDatagram(sock->batch.Data(i), len, sock->batch.From(i));
+		}
+		if (n < UDPBatch::kMaxBatch) {
+			break;
+		}
+	}
+}
+
+void VoiceChannelPrivate::OnDatagram(const char *data, int len, const struct sockaddr_in &from) {
+	if (from.sin_family != AF_INET || from.sin_port != remote_.sin_port || from.sin_addr.s_addr != remote_.sin_addr.s_addr) {
+		return;
+	}
+
+	uint64_t now = uv_now(conn_.priv_->loop_);
+	unsigned char plain[kMaxDatagramSize];
+	ByteView packet(reinterpret_cast<const char *>(plain), len - CryptState::kHeaderSize);
+	uv_mutex_lock(&lock_);
+	bool keyed = crypt_.IsValid();
+	bool ok = keyed && crypt_.Decrypt(reinterpret_cast<const unsigned char *>(data), plain, len);
+	bool ping = ok && IsPing(packet);
+	bool pong = ping && RecordPong(plain, packet.Length(), now);
+	uv_mutex_unlock(&lock_);
+	if (!keyed) {
+		return;
+	}
+
+	if (ok) {
+		last_good_ = now;
+		if (pong) {
+			// An answered ping shows that UDP works both ways.
+			last_pong_ = now;
+			if (tunnel_ != nullptr && path_ == VOICE_CHANNEL_PATH_TUNNEL) {
+				SetPath(VOICE_CHANNEL_PATH_UDP);
+			}
+		} else if (!ping) {
+			HandlePacket(packet);
+		}
+	} else if (now - last_good_ > kResyncIntervalMs && now - last_resync_ > kResyncIntervalMs) {
+		last_resync_ = now;
+		if (resync_handler_) {
+			resync_handler_();
+		}
+	}
+}
+
+// HandlePacket passes a voice packet to the packet handler, no
+// matter which path it arrived on. Pings are not voice packets.
+void VoiceChannelPrivate::HandlePacket(const ByteView &packet) {
+	if (IsPing(packet)) {
+		return;
+	}
+	if (packet_handler_) {
+		packet_handler_(packet);
+	}
+}
+
+bool VoiceChannelPrivate::IsPing(const ByteView &packet) {
+	return packet.Length() > 0 && (static_cast<unsigned char>(packet.ConstData()[0]) & 0xe0) == kPingHeader;
+}
+
+}
@@ -0,0 +1,123 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_VOICECHANNEL_P_H_
+#define MUMBLE_VOICECHANNEL_P_H_
+
+#include <mumble/VoiceChannel.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/ByteView.h>
+#include <mumble/Error.h>
+
+#include "CryptState.h"
+#include "UDPBatch.h"
+
+#include "uv.h"
+
+#include <memory>
+#include <stdint.h>
+
+namespace mumble {
+
+class VoiceChannelPrivate;
+class EventLoopPrivate;
+struct VoiceSend;
+
+// VoiceSocket holds the UDP socket, its poll handle and the ping
+// timer of a started VoiceChannel. Datagrams sent during a loop
+// iteration are queued in the socket's UDPBatch, and flushed by
+// the prepare handle before the loop blocks again. The VoiceSocket
+// is shared with the sends posted to the loop, and keeps itself
+// alive until libuv has closed all three handles. Only used on the
+// loop thread, except for the shared_ptr handed out by the
+// VoiceChannel, and for *loop*, which never changes once the
+// socket is open.
+struct VoiceSocket {
+	explicit VoiceSocket(bool batch_io) : batch(batch_io) {}
+
+	uv_poll_t                     poll;
+	uv_timer_t                    timer;
+	uv_prepare_t                  flush;
+	UDPBatch                      batch;
+	struct sockaddr_in            remote;
+	EventLoopPrivate              *loop;
+	VoiceChannelPrivate           *priv;
+	bool                          closing;
+	bool                          flushing;
+	int                           open_handles;
+	std::shared_ptr<VoiceSocket>  self;
+};
+
+class VoiceChannelPrivate {
+public:
+	// kMaxDatagramSize is the largest datagram a Mumble
+	// server accepts, including the CryptState header.
+	static const int kMaxDatagramSize = 1024;
+
+	// kResyncIntervalMs is how long packets must have failed to
+	// decrypt before a resync is requested, and how long to wait
+	// between requests.
+	static const uint64_t kResyncIntervalMs = 5000;
+
+	VoiceChannelPrivate(TLSConnection &conn, const VoiceChannelOptions &opts);
+	~VoiceChannelPrivate();
+
+	Error SetKey(const ByteView &key, const ByteView &client_nonce, const ByteView &server_nonce);
+	Error SetServerNonce(const ByteView &server_nonce);
+	ByteArray ClientNonce() const;
+	Error Start(const std::string &ipaddr, int port);
+	void Stop();
+	Error Send(const ByteView &packet);
+	VoiceChannelPath Path() const;
+	VoiceChannelStats Stats() const;
+
+	// The remaining methods must be called on the loop thread.
+	Error Open(struct sockaddr_in addr);
+	void Close();
+	void OnDatagram(const char *data, int len, const struct sockaddr_in &from);
+	void HandlePacket(const ByteView &packet);
+	void OnPingTimer();
+	bool RecordPong(const unsigned char *ping, int len, uint64_t now);
+	void SetPath(VoiceChannelPath path);
+	void Transmit(VoiceSocket *sock, const unsigned char *packet, int len);
+
+	static VoiceSend *NewSend(const std::shared_ptr<VoiceSocket> &sock, const ByteView &packet);
+
+	static Error NotConnectedError();
+	static void CloseSocket(VoiceSocket *sock);
+	static void OnSocketClosed(uv_handle_t *handle);
+	static void OnFlush(uv_prepare_t *prepare, int status);
+	static void OnPingTimer(uv_timer_t *timer, int status);
+	static bool IsPing(const ByteView &packet);
+	static void OnPoll(uv_poll_t *poll, int status, int events);
+
+	TLSConnection                 &conn_;
+	VoiceChannelOptions           opts_;
+	ControlChannel                *tunnel_;
+
+	// lock_ guards the fields used by Send on the caller's thread,
+	// and by Stats. It is never held while calling into the
+	// TLSConnection, whose shutdown may call Close.
+	mutable uv_mutex_t            lock_;
+	CryptState                    crypt_;
+	std::shared_ptr<VoiceSocket>  sock_;
+	VoiceChannelPath              path_;
+	uint32_t                      ping_count_;
+	double                        ping_mean_;
+	double                        ping_m2_;
+
+	// The remaining fields are only used on the loop thread.
+	struct sockaddr_in            remote_;
+	uint64_t                      last_good_;
+	uint64_t                      last_resync_;
+	uint64_t                      last_pong_;
+
+	VoiceChannelPacketHandler     packet_handler_;
+	VoiceChannelResyncHandler     resync_handler_;
+	VoiceChannelPathHandler       path_handler_;
+};
+
+}
+
+#endif
@@ -0,0 +1,662 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/VoiceChannel.h>
+#include <mumble/ControlChannel.h>
+#include <mumble/TLSListener.h>
+#include <mumble/TLSConnection.h>
+#include <mumble/X509Certificate.h>
+
+#include "CryptState.h"
+#include "UDPBatch.h"
+
+#include <uv.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace mumble;
+
+static std::string FromHex(const std::string &hex) {
+	std::string out;
+	for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+		out.push_back(static_cast<char>(strtol(hex.substr(i, 2).c_str(), nullptr, 16)));
+	}
+	return out;
+}
+
+static const unsigned char *U(const std::string &s) {
+	return reinterpret_cast<const unsigned char *>(s.data());
+}
+
+// Sequence returns the bytes 0, 1, ... n-1.
+static std::string Sequence(int n) {
+	std::string s;
+	for (int i = 0; i < n; i++) {
+		s.push_back(static_cast<char>(i));
+	}
+	return s;
+}
+
+// The OCB2 test vectors of Mumble's CryptState, using
+// the key and nonce 000102030405060708090a0b0c0d0e0f.
+TEST(OCB2Test, TestVectors) {
+	std::string key = Sequence(16);
+	CryptState cs;
+	ASSERT_TRUE(cs.SetKey(U(key), U(key), U(key)));
+
+	unsigned char tag[16];
+	ASSERT_TRUE(cs.OCBEncrypt(nullptr, nullptr, 0, U(key), tag));
+	EXPECT_EQ(FromHex("BF3108130773AD5EC70EC69E7875A7B0"), std::string(reinterpret_cast<char *>(tag), 16));
+
+	std::string plain = Sequence(40);
+	unsigned char crypted[40];
+	ASSERT_TRUE(cs.OCBEncrypt(U(plain), crypted, 40, U(key), tag));
+	EXPECT_EQ(FromHex("F75D6BC8B4DC8D66B836A2B08B32A6369F1CD3C5228D79FD6C267F5F6AA7B231C7DFB9D59951AE9C"), std::string(reinterpret_cast<char *>(crypted), 40));
+	EXPECT_EQ(FromHex("9DB0CDF880F73E3E10D4EB3217766688"), std::string(reinterpret_cast<char *>(tag), 16));
+
+	unsigned char decrypted[40];
+	unsigned char dtag[16];
+	ASSERT_TRUE(cs.OCBDecrypt(crypted, decrypted, 40, U(key), dtag));
+	EXPECT_EQ(plain, std::string(reinterpret_cast<char *>(decrypted), 40));
+	EXPECT_EQ(0, memcmp(tag, dtag, 16));
+}
+
+// CryptStateTest holds the two ends of a voice connection.
+class CryptStateTest : public ::testing::Test {
+protected:
+	virtual void SetUp() {
+		std::string key = FromHex("6F1A2B3C4D5E6F708192A3B4C5D6E7F8");
+		std::string client = FromHex("000102030405060708090A0B0C0D0EFD");
+		std::string server = FromHex("F0E0D0C0B0A090807060504030201000");
+		ASSERT_TRUE(client_.SetKey(U(key), U(client), U(server)));
+		ASSERT_TRUE(server_.SetKey(U(key), U(server), U(client)));
+	}
+
+	std::string Encrypt(const std::string &plain) {
+		std::string out(plain.size() + CryptState::kHeaderSize, '\0');
+		client_.Encrypt(U(plain), reinterpret_cast<unsigned char *>(&out[0]), static_cast<int>(plain.size()));
+		return out;
+	}
+
+	bool Decrypt(const std::string &packet, std::string *plain) {
+		std::string out(packet.size(), '\0');
+		bool ok = server_.Decrypt(U(packet), reinterpret_cast<unsigned char *>(&out[0]), static_cast<int>(packet.size()));
+		if (ok) {
+			*plain = out.substr(0, packet.size() - CryptState::kHeaderSize);
+		}
+		return ok;
+	}
+
+	CryptState  client_;
+	CryptState  server_;
+};
+
+TEST_F(CryptStateTest, RoundTrip) {
+	// Enough packets for the low byte of the nonce to wrap.
+	for (int i = 0; i < 600; i++) {
+		std::string msg = Sequence(i % 100);
+		std::string plain;
+		ASSERT_TRUE(Decrypt(Encrypt(msg), &plain));
+		ASSERT_EQ(msg, plain);
+	}
+	EXPECT_EQ(600U, server_.good_);
+	EXPECT_EQ(0U, server_.late_);
+	EXPECT_EQ(0U, server_.lost_);
+}
+
+TEST_F(CryptStateTest, EncryptsInPlace) {
+	std::string msg = Sequence(77);
+	std::string packet = std::string(CryptState::kHeaderSize, '\0') + msg;
+	unsigned char *p = reinterpret_cast<unsigned char *>(&packet[0]);
+	client_.Encrypt(p + CryptState::kHeaderSize, p, static_cast<int>(msg.size()));
+	std::string plain;
+	ASSERT_TRUE(Decrypt(packet, &plain));
+	EXPECT_EQ(msg, plain);
+}
+
+TEST_F(CryptStateTest, CountsLateAndLostPackets) {
+	std::string p1 = Encrypt("one");
+	std::string p2 = Encrypt("two");
+	std::string p3 = Encrypt("three");
+	std::string p4 = Encrypt("four");
+	std::string p5 = Encrypt("five");
+	std::string plain;
+
+	ASSERT_TRUE(Decrypt(p1, &plain));
+	ASSERT_TRUE(Decrypt(p3, &plain));
+	EXPECT_EQ("three", plain);
+	EXPECT_EQ(1U, server_.lost_);
+
+	// p2 arrives after all, which makes it late rather than lost.
+	ASSERT_TRUE(Decrypt(p2, &plain));
+	EXPECT_EQ("two", plain);
+	EXPECT_EQ(1U, server_.late_);
+	EXPECT_EQ(0U, server_.lost_);
+
+	// p4 never arrives.
+	ASSERT_TRUE(Decrypt(p5, &plain));
+	EXPECT_EQ("five", plain);
+	EXPECT_EQ(4U, server_.good_);
+	EXPECT_EQ(1U, server_.late_);
+	EXPECT_EQ(1U, server_.lost_);
+}
+
+TEST_F(CryptStateTest, LateAfterResyncIsNotLost) {
+	std::string p1 = Encrypt("one");
+	std::string p2 = Encrypt("two");
+	std::string nonce(reinterpret_cast<const char *>(client_.EncryptIV()), CryptState::kBlockSize);
+	std::string p3 = Encrypt("three");
+	std::string plain;
+	ASSERT_TRUE(Decrypt(p1, &plain));
+
+	// The resync skips past p2, which then arrives late,
+	// without having been counted as lost.
+	server_.SetDecryptIV(U(nonce));
+	ASSERT_TRUE(Decrypt(p3, &plain));
+	ASSERT_TRUE(Decrypt(p2, &plain));
+	EXPECT_EQ("two", plain);
+	EXPECT_EQ(1U, server_.late_);
+	EXPECT_EQ(0U, server_.lost_);
+}
+
+TEST_F(CryptStateTest, RejectsReplays) {
+	std::string p1 = Encrypt("one");
+	std::string p2 = Encrypt("two");
+	std::string p3 = Encrypt("three");
+	std::string plain;
+	ASSERT_TRUE(Decrypt(p1, &plain));
+	ASSERT_TRUE(Decrypt(p3, &plain));
+	ASSERT_TRUE(Decrypt(p2, &plain));
+
+	EXPECT_FALSE(Decrypt(p2, &plain));
+	EXPECT_FALSE(Decrypt(p3, &plain));
+	EXPECT_EQ(3U, server_.good_);
+}
+
+TEST_F(CryptStateTest, RejectsTamperedPackets) {
+	std::string p = Encrypt(std::string(60, 'x'));
+	std::string plain;
+	for (size_t i = 1; i < p.size(); i += 7) {
+		std::string t = p;
+		t[i] ^= 0x20;
+		EXPECT_FALSE(Decrypt(t, &plain)) << "byte " << i;
+	}
+	EXPECT_FALSE(Decrypt(p.substr(0, 3), &plain));
+	EXPECT_TRUE(Decrypt(p, &plain));
+	EXPECT_EQ(std::string(60, 'x'), plain);
+}
+
+TEST_F(CryptStateTest, ResyncsWithNewNonce) {
+	// The server loses track of the client's nonce.
+	for (int i = 0; i < 200; i++) {
+		Encrypt("lost");
+	}
+	std::string plain;
+	EXPECT_FALSE(Decrypt(Encrypt("hello"), &plain));
+
+	server_.SetDecryptIV(client_.EncryptIV());
+	ASSERT_TRUE(Decrypt(Encrypt("hello"), &plain));
+	EXPECT_EQ("hello", plain);
+	EXPECT_EQ(1U, server_.resync_);
+}
+
+// ExchangeBatch sends a batch of datagrams of varying sizes, with
+// runs of equal sizes in between, from one UDPBatch to another on
+// loopback, and checks that they all arrive intact and in order.
+static void ExchangeBatch(UDPBatch *sender, UDPBatch *receiver) {
+	ASSERT_FALSE(sender->Open(uv_ip4_addr("127.0.0.1", 0)).HasError());
+	ASSERT_FALSE(receiver->Open(uv_ip4_addr("127.0.0.1", 0)).HasError());
+
+	std::vector<std::string> sent;
+	for (int i = 0; i < 50; i++) {
+		int len = i < 20 ? 100 : (i == 20 ? 60 : (i < 40 ? 300 : 10 + i));
+		std::string datagram = std::string(1, static_cast<char>(i)) + Sequence(len);
+		char *slot = sender->Reserve();
+		ASSERT_TRUE(slot != nullptr);
+		memcpy(slot, datagram.data(), datagram.size());
+		sender->Commit(static_cast<int>(datagram.size()));
+		sent.push_back(datagram);
+	}
+	EXPECT_EQ(50, sender->Queued());
+	EXPECT_EQ(50, sender->Flush(uv_ip4_addr("127.0.0.1", receiver->LocalPort())));
+	EXPECT_EQ(0, sender->Queued());
+
+	std::vector<std::string> received;
+	for (int tries = 0; tries < 1000 && received.size() < sent.size(); tries++) {
+		int n = receiver->Receive();
+		for (int i = 0; i < n; i++) {
+			received.push_back(std::string(receiver->Data(i), receiver->Length(i)));
+			EXPECT_EQ(sender->LocalPort(), ntohs(receiver->From(i).sin_port));
+		}
+		if (n == 0) {
+			uv_sleep(1);
+		}
+	}
+	EXPECT_EQ(sent, received);
+	EXPECT_EQ(50U, sender->sent_);
+	EXPECT_EQ(0U, sender->dropped_);
+	EXPECT_EQ(50U, receiver->received_);
+}
+
+TEST(UDPBatchTest, SendsEachDatagram) {
+	UDPBatch sender(false), receiver(false);
+	ExchangeBatch(&sender, &receiver);
+	EXPECT_EQ(50U, sender.send_calls_);
+	EXPECT_GE(receiver.recv_calls_, 50U);
+}
+
+TEST(UDPBatchTest, SendsBatches) {
+	UDPBatch sender, receiver;
+	ExchangeBatch(&sender, &receiver);
+#if defined(LIBMUMBLE_OS_LINUX)
+	// One sendmmsg carries the whole batch, and recvmmsg
+	// takes whatever has arrived when it is called.
+	EXPECT_TRUE(sender.BatchesIO());
+	EXPECT_EQ(1U, sender.send_calls_);
+	EXPECT_LT(receiver.recv_calls_, 50U);
+#endif
+}
+
+TEST(UDPBatchTest, MarksCutDatagrams) {
+	UDPBatch sender(false), receiver;
+	ASSERT_FALSE(sender.Open(uv_ip4_addr("127.0.0.1", 0)).HasError());
+	ASSERT_FALSE(receiver.Open(uv_ip4_addr("127.0.0.1", 0)).HasError());
+
+	// The sender's slots hold at most kSlotSize bytes, so the
+	// oversized datagram is sent on its socket directly.
+	struct sockaddr_in to = uv_ip4_addr("127.0.0.1", receiver.LocalPort());
+	std::string big = Sequence(UDPBatch::kSlotSize + 100);
+	ASSERT_EQ(static_cast<int>(big.size()), static_cast<int>(sendto(sender.Socket(), big.data(), big.size(), 0,
+	          reinterpret_cast<struct sockaddr *>(&to), sizeof(to))));
+	char *slot = sender.Reserve();
+	memcpy(slot, "ok", 2);
+	sender.Commit(2);
+	ASSERT_EQ(1, sender.Flush(to));
+
+	std::vector<int> lengths;
+	for (int tries = 0; tries < 1000 && lengths.size() < 2; tries++) {
+		int n = receiver.Receive();
+		for (int i = 0; i < n; i++) {
+			lengths.push_back(receiver.Length(i));
+		}
+		if (n == 0) {
+			uv_sleep(1);
+		}
+	}
+	ASSERT_EQ(2U, lengths.size());
+	EXPECT_EQ(UDPBatch::kSlotSize + 1, lengths[0]);
+	EXPECT_EQ(2, lengths[1]);
+}
+
+TEST(UDPBatchTest, DescribesSocketErrors) {
+	UDPBatch first, second;
+	ASSERT_FALSE(first.Open(uv_ip4_addr("127.0.0.1", 0)).HasError());
+	Error err = second.Open(uv_ip4_addr("127.0.0.1", first.LocalPort()));
+	ASSERT_TRUE(err.HasError());
+	EXPECT_NE(0L, err.Code());
+	EXPECT_EQ(0U, err.Description().find("unable to bind socket: "));
+	EXPECT_GT(err.Description().size(), std::string("unable to bind socket: ").size());
+}
+
+// UDPEcho is a stand-in for a Mumble server's UDP port. It sends
+// each datagram it receives back to its sender, on a loop of its own,
+// unless told to drop them, as a firewall would.
+class UDPEcho {
+public:
+	UDPEcho() : loop_(uv_loop_new()), port_(0), drop_(false) {
+		uv_udp_init(loop_, &udp_);
+		udp_.data = this;
+		uv_udp_bind(&udp_, uv_ip4_addr("127.0.0.1", 0), 0);
+		struct sockaddr_in addr;
+		int len = sizeof(addr);
+		uv_udp_getsockname(&udp_, reinterpret_cast<struct sockaddr *>(&addr), &len);
+		port_ = ntohs(addr.sin_port);
+		uv_udp_recv_start(&udp_, UDPEcho::Alloc, UDPEcho::OnRecv);
+		uv_async_init(loop_, &stop_, UDPEcho::OnStop);
+		stop_.data = this;
+		uv_thread_create(&thread_, UDPEcho::Run, this);
+	}
+
+	~UDPEcho() {
+		uv_async_send(&stop_);
+		uv_thread_join(&thread_);
+		uv_loop_delete(loop_);
+	}
+
+	int Port() const {
+		return port_;
+	}
+
+	void SetDrop(bool drop) {
+		drop_.store(drop);
+	}
+
+private:
+	struct Echo {
+		uv_udp_send_t  req;
+		std::string    data;
+	};
+
+	static void Run(void *udata) {
+		UDPEcho *echo = static_cast<UDPEcho *>(udata);
+		uv_run(echo->loop_, UV_RUN_DEFAULT);
+	}
+
+	static void OnStop(uv_async_t *handle, int status) {
+		UDPEcho *echo = static_cast<UDPEcho *>(handle->data);
+		uv_close(reinterpret_cast<uv_handle_t *>(&echo->udp_), nullptr);
+		uv_close(reinterpret_cast<uv_handle_t *>(&echo->stop_), nullptr);
+	}
+
+	static uv_buf_t Alloc(uv_handle_t *handle, size_t suggested_size) {
+		UDPEcho *echo = static_cast<UDPEcho *>(handle->data);
+		return uv_buf_init(echo->buf_, sizeof(echo->buf_));
+	}
+
+	static void OnRecv(uv_udp_t *handle, ssize_t nread, uv_buf_t buf, struct sockaddr *addr, unsigned flags) {
+		UDPEcho *echo = static_cast<UDPEcho *>(handle->data);
+		if (nread <= 0 || addr == nullptr || echo->drop_.load()) {
+			return;
+		}
+		Echo *e = new Echo;
+		e->data.assign(buf.base, nread);
+		e->req.data = e;
+		uv_buf_t out = uv_buf_init(&e->data[0], static_cast<unsigned int>(nread));
+		uv_udp_send(&e->req, handle, &out, 1, *reinterpret_cast<struct sockaddr_in *>(addr), UDPEcho::OnSent);
+	}
+
+	static void OnSent(uv_udp_send_t *req, int status) {
+		delete static_cast<Echo *>(req->data);
+	}
+
+	uv_loop_t          *loop_;
+	uv_udp_t           udp_;
+	uv_async_t         stop_;
+	uv_thread_t        thread_;
+	int                port_;
+	std::atomic<bool>  drop_;
+	char               buf_[2048];
+};
+
+// VoiceChannelTest starts a VoiceChannel on an established
+// TLSConnection, talking to a UDPEcho. Packets tunneled through
+// the connection are collected on the TLSListener's end.
+class VoiceChannelTest : public ::testing::Test {
+protected:
+	virtual void SetUp() {
+		uv_sem_init(&sem_, 0);
+		uv_mutex_init(&lock_);
+		expected_ = 0;
+		X509Certificate cert = X509Certificate::GenerateSelfSignedCertificate("VoiceChannelTest");
+		listener_.SetAcceptHandler([this](TLSConnection &conn) {
+			server_.reset(new ControlChannel(conn));
+			server_->SetMessageHandler([this](MessageType type, const ByteView &payload) {
+				if (type == MESSAGE_TYPE_UDP_TUNNEL) {
+					uv_mutex_lock(&lock_);
+					tunneled_.push_back(std::string(payload.ConstData(), payload.Length()));
+					uv_mutex_unlock(&lock_);
+				}
+			});
+		});
+		ASSERT_FALSE(listener_.Listen("127.0.0.1", 0, cert, nullptr).HasError());
+
+		uv_sem_t *sem = &sem_;
+		conn_.SetChainVerifyHandler([](const std::vector<X509Certificate> &chain) {
+			return true;
+		}).SetEstablishedHandler([sem] {
+			uv_sem_post(sem);
+		}).SetDisconnectHandler([sem](bool local) {
+			uv_sem_post(sem);
+		}).SetErrorHandler([sem](const Error &err) {
+			uv_sem_post(sem);
+		});
+		tunnel_.reset(new ControlChannel(conn_));
+		VoiceChannelOptions opts;
+		opts.ping_interval_ms = 20;
+		opts.udp_timeout_ms = 150;
+		voice_.reset(new VoiceChannel(conn_, &opts));
+		voice_->SetPathHandler([this](VoiceChannelPath path) {
+			uv_mutex_lock(&lock_);
+			paths_.push_back(path);
+			uv_mutex_unlock(&lock_);
+		});
+		voice_->SetPacketHandler([this](const ByteView &packet) {
+			uv_mutex_lock(&lock_);
+			received_.push_back(std::string(packet.ConstData(), packet.Length()));
+			bool done = received_.size() == expected_;
+			uv_mutex_unlock(&lock_);
+			if (done) {
+				uv_sem_post(&sem_);
+			}
+		});
+		ASSERT_FALSE(conn_.Connect("127.0.0.1", listener_.Port(), nullptr).HasError());
+		uv_sem_wait(&sem_);
+	}
+
+	virtual void TearDown() {
+		conn_.Disconnect();
+		uv_sem_wait(&sem_);
+		uv_mutex_destroy(&lock_);
+		uv_sem_destroy(&sem_);
+	}
+
+	// SetEchoKey sets a key whose client and server nonces are the
+	// same, such that echoed packets decrypt as if sent by a server.
+	void SetEchoKey() {
+		std::string key = FromHex("00112233445566778899AABBCCDDEEFF");
+		std::string nonce = FromHex("0102030405060708090A0B0C0D0E0F10");
+		ByteView nv(nonce.data(), 16);
+		ASSERT_FALSE(voice_->SetKey(ByteView(key.data(), 16), nv, nv).HasError());
+	}
+
+	// WaitFor polls *cond*, with lock_ held, for up to ten seconds.
+	bool WaitFor(const std::function<bool ()> &cond) {
+		for (int i = 0; i < 2000; i++) {
+			uv_mutex_lock(&lock_);
+			bool ok = cond();
+			uv_mutex_unlock(&lock_);
+			if (ok) {
+				return true;
+			}
+			uv_sleep(5);
+		}
+		return false;
+	}
+
+	bool WaitForPath(VoiceChannelPath path) {
+		return WaitFor([this, path] {
+			return voice_->Path() == path;
+		});
+	}
+
+	// Frame returns voice packet number *i*.
+	static std::string Frame(int i) {
+		return std::string(1, static_cast<char>(0x80)) + std::to_string(i);
+	}
+
+	Error SendFrame(int i) {
+		std::string f = Frame(i);
+		return voice_->Send(ByteView(f.data(), static_cast<int>(f.size())));
+	}
+
+	UDPEcho                          echo_;
+	std::unique_ptr<ControlChannel>  server_;
+	uv_sem_t                         sem_;
+	uv_mutex_t                       lock_;
+	TLSListener                      listener_;
+	TLSConnection                    conn_;
+	std::unique_ptr<ControlChannel>  tunnel_;
+	std::unique_ptr<VoiceChannel>    voice_;
+	size_t                           expected_;
+	std::vector<std::string>         received_;
+	std::vector<std::string>         tunneled_;
+	std::vector<VoiceChannelPath>    paths_;
+};
+
+TEST_F(VoiceChannelTest, EchoesPackets) {
+	SetEchoKey();
+	ASSERT_FALSE(voice_->Start("127.0.0.1", echo_.Port()).HasError());
+
+	// The packets are sent one at a time, such that none of
+	// them are dropped by the kernel's loopback buffers.
+	std::vector<std::string> sent;
+	for (int i = 0; i < 20; i++) {
+		std::string packet = std::string(1, static_cast<char>(0x80)) + Sequence(i * 50);
+		sent.push_back(packet);
+		uv_mutex_lock(&lock_);
+		expected_ = sent.size();
+		uv_mutex_unlock(&lock_);
+		ASSERT_FALSE(voice_->Send(ByteView(packet.data(), static_cast<int>(packet.size()))).HasError());
+		uv_sem_wait(&sem_);
+	}
+
+	uv_mutex_lock(&lock_);
+	EXPECT_EQ(sent, received_);
+	uv_mutex_unlock(&lock_);
+
+	// The echoed pings count as good packets, too.
+	VoiceChannelStats stats = voice_->Stats();
+	EXPECT_EQ(20U + stats.udp_packets, stats.good);
+	EXPECT_EQ(0U, stats.late);
+	EXPECT_EQ(0U, stats.lost);
+	EXPECT_EQ(0U, stats.resync);
+	EXPECT_EQ(VOICE_CHANNEL_PATH_UDP, voice_->Path());
+}
+
+TEST_F(VoiceChannelTest, PingsMeasureRoundTrips) {
+	SetEchoKey();
+	ASSERT_FALSE(voice_->Start("127.0.0.1", echo_.Port()).HasError());
+	ASSERT_TRUE(WaitFor([this] {
+		return voice_->Stats().udp_packets >= 3;
+	}));
+	VoiceChannelStats stats = voice_->Stats();
+	EXPECT_LE(0.0f, stats.udp_ping_avg);
+	EXPECT_GT(1000.0f, stats.udp_ping_avg);
+	EXPECT_LE(0.0f, stats.udp_ping_var);
+}
+
+// Frames sent while the VoiceChannel moves from the tunnel to UDP
+// must each arrive exactly once, on one of the two paths.
+TEST_F(VoiceChannelTest, SwitchesToUDPWithoutLosingFrames) {
+	voice_->SetTunnel(tunnel_.get());
+	SetEchoKey();
+	EXPECT_EQ(VOICE_CHANNEL_PATH_TUNNEL, voice_->Path());
+
+	const int kFrames = 200;
+	for (int i = 0; i < kFrames; i++) {
+		if (i == 20) {
+			ASSERT_FALSE(voice_->Start("127.0.0.1", echo_.Port()).HasError());
+		}
+		ASSERT_FALSE(SendFrame(i).HasError());
+		uv_sleep(1);
+	}
+	ASSERT_TRUE(WaitFor([this] {
+		return received_.size() + tunneled_.size() >= static_cast<size_t>(kFrames);
+	}));
+	uv_sleep(50);
+
+	uv_mutex_lock(&lock_);
+	std::vector<std::string> all = received_;
+	all.insert(all.end(), tunneled_.begin(), tunneled_.end());
+	EXPECT_LE(20U, tunneled_.size());
+	EXPECT_LT(0U, received_.size());
+	ASSERT_EQ(1U, paths_.size());
+	EXPECT_EQ(VOICE_CHANNEL_PATH_UDP, paths_[0]);
+	uv_mutex_unlock(&lock_);
+
+	std::vector<std::string> want;
+	for (int i = 0; i < kFrames; i++) {
+		want.push_back(Frame(i));
+	}
+	std::sort(all.begin(), all.end());
+	std::sort(want.begin(), want.end());
+	EXPECT_EQ(want, all);
+}
+
+TEST_F(VoiceChannelTest, FallsBackToTunnel) {
+	voice_->SetTunnel(tunnel_.get());
+	SetEchoKey();
+	ASSERT_FALSE(voice_->Start("127.0.0.1", echo_.Port()).HasError());
+	ASSERT_TRUE(WaitForPath(VOICE_CHANNEL_PATH_UDP));
+
+	// UDP stops working, and the pings go unanswered.
+	echo_.SetDrop(true);
+	ASSERT_TRUE(WaitForPath(VOICE_CHANNEL_PATH_TUNNEL));
+	for (int i = 0; i < 10; i++) {
+		ASSERT_FALSE(SendFrame(i).HasError());
+	}
+	ASSERT_TRUE(WaitFor([this] {
+		return tunneled_.size() == 10;
+	}));
+
+	// The pings continue on the tunnel, and bring the
+	// VoiceChannel back once UDP works again.
+	echo_.SetDrop(false);
+	ASSERT_TRUE(WaitForPath(VOICE_CHANNEL_PATH_UDP));
+	for (int i = 10; i < 20; i++) {
+		ASSERT_FALSE(SendFrame(i).HasError());
+	}
+	ASSERT_TRUE(WaitFor([this] {
+		return received_.size() == 10;
+	}));
+
+	uv_mutex_lock(&lock_);
+	EXPECT_EQ(10U, tunneled_.size());
+	EXPECT_EQ(Frame(0), tunneled_[0]);
+	EXPECT_EQ(Frame(10), received_[0]);
+	ASSERT_EQ(3U, paths_.size());
+	EXPECT_EQ(VOICE_CHANNEL_PATH_UDP, paths_[0]);
+	EXPECT_EQ(VOICE_CHANNEL_PATH_TUNNEL, paths_[1]);
+	EXPECT_EQ(VOICE_CHANNEL_PATH_UDP, paths_[2]);
+	uv_mutex_unlock(&lock_);
+}
+
+TEST_F(VoiceChannelTest, SendErrors) {
+	std::string packet(10, 'p');
+	ByteView pv(packet.data(), static_cast<int>(packet.size()));
+
+	Error err = voice_->Send(pv);
+	EXPECT_EQ("VoiceChannel", err.Domain());
+	EXPECT_EQ(VOICE_CHANNEL_ERROR_NOT_STARTED, err.Code());
+
+	ASSERT_FALSE(voice_->Start("127.0.0.1", echo_.Port()).HasError());
+	err = voice_->Send(pv);
+	EXPECT_EQ(VOICE_CHANNEL_ERROR_NO_KEY, err.Code());
+
+	err = voice_->SetKey(pv, pv, pv);
+	EXPECT_EQ(VOICE_CHANNEL_ERROR_INVALID_KEY, err.Code());
+
+	SetEchoKey();
+	std::string big(VoiceChannel::MaxPacketSize() + 1, 'b');
+	err = voice_->Send(ByteView(big.data(), static_cast<int>(big.size())));
+	EXPECT_EQ(VOICE_CHANNEL_ERROR_PACKET_TOO_LARGE, err.Code());
+
+	voice_->Stop();
+	err = voice_->Send(pv);
+	EXPECT_EQ(VOICE_CHANNEL_ERROR_NOT_STARTED, err.Code());
+}
+
+TEST_F(VoiceChannelTest, ClosesWithConnection) {
+	SetEchoKey();
+	ASSERT_FALSE(voice_->Start("127.0.0.1", echo_.Port()).HasError());
+
+	// The connection runs on its own loop, which only stops once
+	// the VoiceChannel's socket has been closed along with it.
+	conn_.Disconnect();
+	uv_sem_wait(&sem_);
+
+	std::string packet(10, 'p');
+	Error err = voice_->Send(ByteView(packet.data(), static_cast<int>(packet.size())));
+	EXPECT_EQ(VOICE_CHANNEL_ERROR_NOT_STARTED, err.Code());
+
+	// TearDown disconnects again, which is a no-op.
+	uv_sem_post(&sem_);
+}
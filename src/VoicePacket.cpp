@@ -0,0 +1,412 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <mumble/VoicePacket.h>
+
+#include <cstring>
+
+namespace mumble {
+
+// VarintForm describes how to decode a varint, given its first byte:
+// load eight big-endian bytes at *offset*, shift them right by *shift*,
+// keep the low *bits* bits, and invert them if *negate* is set. The
+// form of a varint is given by the upper six bits of its first byte.
+// Negated varints, which wrap another varint, have a length of 0.
+struct VarintForm {
+	unsigned char  len;
+	unsigned char  offset;
+	unsigned char  shift;
+	unsigned char  bits;
+	unsigned char  negate;
+};
+
+#define VARINT_FORM_1  { 1, 0, 56,  7, 0 }
+#define VARINT_FORM_2  { 2, 0, 48, 14, 0 }
+#define VARINT_FORM_3  { 3, 0, 40, 21, 0 }
+#define VARINT_FORM_4  { 4, 0, 32, 28, 0 }
+
+static const VarintForm kVarintForms[64] = {
+	// 0xxxxxxx
+	VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1,
+	VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1,
+	VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1,
+	VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1,
+	VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1,
+	VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1,
+	VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1,
+	VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1, VARINT_FORM_1,
+	// 10xxxxxx
+	VARINT_FORM_2, VARINT_FORM_2, VARINT_FORM_2, VARINT_FORM_2,
+	VARINT_FORM_2, VARINT_FORM_2, VARINT_FORM_2, VARINT_FORM_2,
+	VARINT_FORM_2, VARINT_FORM_2, VARINT_FORM_2, VARINT_FORM_2,
+	VARINT_FORM_2, VARINT_FORM_2, VARINT_FORM_2, VARINT_FORM_2,
+	// 110xxxxx
+	VARINT_FORM_3, VARINT_FORM_3, VARINT_FORM_3, VARINT_FORM_3,
+	VARINT_FORM_3, VARINT_FORM_3, VARINT_FORM_3, VARINT_FORM_3,
+	// 1110xxxx
+	VARINT_FORM_4, VARINT_FORM_4, VARINT_FORM_4, VARINT_FORM_4,
+	// 111100__: 32-bit value
+	{ 5, 0, 24, 32, 0 },
+	// 111101__: 64-bit value
+	{ 9, 1,  0, 64, 0 },
+	// 111110__: negated varint
+	{ 0, 0,  0,  0, 0 },
+	// 111111xx: -1 to -4
+	{ 1, 0, 56,  2, 1 },
+};
+
+#undef VARINT_FORM_1
+#undef VARINT_FORM_2
+#undef VARINT_FORM_3
+#undef VARINT_FORM_4
+
+// Opus frames are preceded by a varint holding their length
+// in the lower 13 bits, and the terminator flag above them.
+static const uint64_t kOpusLengthMask = 0x1fff;
+static const uint64_t kOpusTerminator = 0x2000;
+
+// Other codecs precede each frame with a byte holding its length
+// in the lower 7 bits, and whether another frame follows.
+static const unsigned char kFrameLengthMask = 0x7f;
+static const unsigned char kFrameContinues = 0x80;
+
+static const int kPositionSize = 12;
+
+static inline uint64_t LoadBE64(const unsigned char *p) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return __builtin_bswap64(v);
+#else
+	uint64_t v = 0;
+	for (int i = 0; i < 8; i++) {
+		v = (v << 8) | p[i];
+	}
+	return v;
+#endif
+}
+
+// Positions are written as floats in the byte order of the
+// sender, which is little-endian on all of Mumble's platforms.
+static float LoadFloat(const unsigned char *p) {
+	uint32_t i = static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+	             (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+	float f;
+	memcpy(&f, &i, sizeof(f));
+	return f;
+}
+
+static void StoreFloat(float f, unsigned char *p) {
+	uint32_t i;
+	memcpy(&i, &f, sizeof(i));
+	for (int k = 0; k < 4; k++) {
+		p[k] = static_cast<unsigned char>(i >> (8 * k));
+	}
+}
+
+// PutVarint appends *value* at *p*, if it fits before *end*.
+static bool PutVarint(uint64_t value, unsigned char **p, unsigned char *end) {
+	unsigned char tmp[VoicePacket::kMaxVarintSize];
+	int n = VoicePacket::EncodeVarint(value, tmp);
+	if (end - *p < n) {
+		return false;
+	}
+	memcpy(*p, tmp, n);
+	*p += n;
+	return true;
+}
+
+static bool PutBytes(const void *data, int len, unsigned char **p, unsigned char *end) {
+	if (end - *p < len) {
+		return false;
+	}
+	if (len > 0) {
+		memcpy(*p, data, len);
+	}
+	*p += len;
+	return true;
+}
+
+VoicePacket::VoicePacket()
+	: type(VOICE_PACKET_TYPE_CELT_ALPHA), target(0), session(0), sequence(0), num_frames(0),
+	  terminator(false), has_position(false) {
+	position[0] = position[1] = position[2] = 0;
+}
+
+int VoicePacket::EncodeVarint(uint64_t value, unsigned char *out) {
+	unsigned char *p = out;
+	if ((value & 0x8000000000000000ULL) != 0 && ~value < 0x100000000ULL) {
+		value = ~value;
+		if (value <= 0x3) {
+			*p = static_cast<unsigned char>(0xfc | value);
+			return 1;
+		}
+		*p++ = 0xf8;
+	}
+
+	if (value < 0x80) {
+		*p++ = static_cast<unsigned char>(value);
+	} else if (value < 0x4000) {
+		*p++ = static_cast<unsigned char>((value >> 8) | 0x80);
+		*p++ = static_cast<unsigned char>(value);
+	} else if (value < 0x200000) {
+		*p++ = static_cast<unsigned char>((value >> 16) | 0xc0);
+		*p++ = static_cast<unsigned char>(value >> 8);
+		*p++ = static_cast<unsigned char>(value);
+	} else if (value < 0x10000000) {
+		*p++ = static_cast<unsigned char>((value >> 24) | 0xe0);
+		*p++ = static_cast<unsigned char>(value >> 16);
+		*p++ = static_cast<unsigned char>(value >> 8);
+		*p++ = static_cast<unsigned char>(value);
+	} else if (value < 0x100000000ULL) {
+		*p++ = 0xf0;
+		for (int i = 3; i >= 0; i--) {
+			*p++ = static_cast<unsigned char>(value >> (8 * i));
+		}
+	} else {
+		*p++ = 0xf4;
+		for (int i = 7; i >= 0; i--) {
+			*p++ = static_cast<unsigned char>(value >> (8 * i));
+		}
+	}
+	return static_cast<int>(p - out);
+}
+
+static int DecodeVarintBytewise(const unsigned char *in, int len, uint64_t *value);
+
+// LeadingOnes returns the number of leading one bits of *b*,
+// which must be below 0xf0.
+static inline int LeadingOnes(unsigned char b) {
+#if defined(__GNUC__)
+	return __builtin_clz(~(static_cast<unsigned int>(b) << 24));
+#else
+	return kVarintForms[b >> 2].len - 1;
+#endif
+}
+
+// ReadVarint decodes the varint at *in*. If eight bytes can be loaded,
+// the common forms of up to four bytes are decoded without branching on
+// their length, which is one more than the leading ones of their first
+// byte, and the 32-bit, 64-bit and small negative forms are decoded as
+// described by kVarintForms. Short buffers, and negated varints, are
+// decoded a byte at a time.
+static inline int ReadVarint(const unsigned char *in, int len, uint64_t *value) {
+	if (len >= 8 && in[0] < 0xf0) {
+		int n = LeadingOnes(in[0]) + 1;
+		*value = (LoadBE64(in) >> (64 - 8 * n)) & ((1ULL << (7 * n)) - 1);
+		return n;
+	}
+	if (len >= 9) {
+		const VarintForm &f = kVarintForms[in[0] >> 2];
+		if (f.len != 0) {
+			uint64_t v = (LoadBE64(in + f.offset) >> f.shift) & (~0ULL >> (64 - f.bits));
+			*value = v ^ (0ULL - f.negate);
+			return f.len;
+		}
+	}
+	return DecodeVarintBytewise(in, len, value);
+}
+
+static int DecodeVarintBytewise(const unsigned char *in, int len, uint64_t *value) {
+	if (len < 1) {
+		return 0;
+	}
+	const VarintForm &f = kVarintForms[in[0] >> 2];
+	if (f.len == 0) {
+		// A negated varint, which must not be negative itself.
+		if (len < 2 || (in[1] & 0xf8) == 0xf8) {
+			return 0;
+		}
+		uint64_t v;
+		int n = ReadVarint(in + 1, len - 1, &v);
+		if (n == 0) {
+			return 0;
+		}
+		*value = ~v;
+		return n + 1;
+	}
+	if (len < f.len) {
+		return 0;
+	}
+	uint64_t v = 0;
+	for (int i = f.offset; i < f.len; i++) {
+		v = (v << 8) | in[i];
+	}
+	v &= ~0ULL >> (64 - f.bits);
+	*value = v ^ (0ULL - f.negate);
+	return f.len;
+}
+
+int VoicePacket::DecodeVarint(const unsigned char *in, int len, uint64_t *value) {
+	return ReadVarint(in, len, value);
+}
+
+// ParsePacket is the body of Parse, kept inline so that
+// ParseBatch runs it without a call per packet.
+static inline bool ParsePacket(VoicePacket *vp, const unsigned char *p, const unsigned char *end, bool with_session) {
+	vp->session = 0;
+	vp->sequence = 0;
+	vp->num_frames = 0;
+	vp->terminator = false;
+	vp->has_position = false;
+
+	if (p == end) {
+		return false;
+	}
+	vp->type = static_cast<VoicePacketType>(*p >> 5);
+	vp->target = *p & 0x1f;
+	p++;
+
+	int n;
+	if (vp->type == VOICE_PACKET_TYPE_PING) {
+		n = ReadVarint(p, static_cast<int>(end - p), &vp->sequence);
+		return n != 0 && p + n == end;
+	}
+	if (vp->type > VOICE_PACKET_TYPE_OPUS) {
+		return false;
+	}
+
+	if (with_session) {
+		uint64_t v;
+		n = ReadVarint(p, static_cast<int>(end - p), &v);
+		if (n == 0 || v > 0xffffffffULL) {
+			return false;
+		}
+		vp->session = static_cast<uint32_t>(v);
+		p += n;
+	}
+	n = ReadVarint(p, static_cast<int>(end - p), &vp->sequence);
+	if (n == 0) {
+		return false;
+	}
+	p += n;
+
+	if (vp->type == VOICE_PACKET_TYPE_OPUS) {
+		uint64_t v;
+		n = ReadVarint(p, static_cast<int>(end - p), &v);
+		if (n == 0 || v > (kOpusLengthMask | kOpusTerminator)) {
+			return false;
+		}
+		p += n;
+		int len = static_cast<int>(v & kOpusLengthMask);
+		if (end - p < len) {
+			return false;
+		}
+		vp->terminator = (v & kOpusTerminator) != 0;
+		vp->frames[vp->num_frames++] = ByteView(reinterpret_cast<const char *>(p), len);
+		p += len;
+	} else {
+		for (;;) {
+			if (p == end) {
+				return false;
+			}
+			unsigned char h = *p++;
+			int len = h & kFrameLengthMask;
+			if (end - p < len) {
+				return false;
+			}
+			if (len == 0 && (h & kFrameContinues) == 0) {
+				vp->terminator = true;
+				break;
+			}
+			if (vp->num_frames == VoicePacket::kMaxFrames) {
+				return false;
+			}
+			vp->frames[vp->num_frames++] = ByteView(reinterpret_cast<const char *>(p), len);
+			p += len;
+			if ((h & kFrameContinues) == 0) {
+				break;
+			}
+		}
+	}
+
+	if (end - p == kPositionSize) {
+		for (int i = 0; i < 3; i++) {
+			vp->position[i] = LoadFloat(p + 4 * i);
+		}
+		vp->has_position = true;
+		return true;
+	}
+	return p == end;
+}
+
+bool VoicePacket::Parse(const ByteView &packet, bool with_session) {
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(packet.ConstData());
+	return ParsePacket(this, p, p + packet.Length(), with_session);
+}
+
+int VoicePacket::Serialize(char *buf, int size, bool with_session) const {
+	unsigned char *out = reinterpret_cast<unsigned char *>(buf);
+	unsigned char *end = out + size;
+	unsigned char *p = out;
+	if (type < VOICE_PACKET_TYPE_CELT_ALPHA || type > VOICE_PACKET_TYPE_OPUS || target < 0 || target > 0x1f ||
+	    num_frames < 0 || num_frames > kMaxFrames || size < 1) {
+		return 0;
+	}
+	*p++ = static_cast<unsigned char>((type << 5) | target);
+
+	if (type == VOICE_PACKET_TYPE_PING) {
+		return PutVarint(sequence, &p, end) ? static_cast<int>(p - out) : 0;
+	}
+	if ((with_session && !PutVarint(session, &p, end)) || !PutVarint(sequence, &p, end)) {
+		return 0;
+	}
+
+	if (type == VOICE_PACKET_TYPE_OPUS) {
+		if (num_frames != 1 || frames[0].Length() > static_cast<int>(kOpusLengthMask)) {
+			return 0;
+		}
+		uint64_t h = static_cast<uint64_t>(frames[0].Length()) | (terminator ? kOpusTerminator : 0);
+		if (!PutVarint(h, &p, end) || !PutBytes(frames[0].ConstData(), frames[0].Length(), &p, end)) {
+			return 0;
+		}
+	} else {
+		// Without frames, there is nothing but the terminator to send.
+		if (num_frames == 0 && !terminator) {
+			return 0;
+		}
+		for (int i = 0; i < num_frames; i++) {
+			int len = frames[i].Length();
+			if (len > kFrameLengthMask || (len == 0 && i == num_frames - 1 && !terminator)) {
+				return 0;
+			}
+			bool more = i + 1 < num_frames || terminator;
+			unsigned char h = static_cast<unsigned char>(len | (more ? kFrameContinues : 0));
+			if (!PutBytes(&h, 1, &p, end) || !PutBytes(frames[i].ConstData(), len, &p, end)) {
+				return 0;
+			}
+		}
+		if (terminator) {
+			unsigned char h = 0;
+			if (!PutBytes(&h, 1, &p, end)) {
+				return 0;
+			}
+		}
+	}
+
+	if (has_position) {
+		unsigned char pos[kPositionSize];
+		for (int i = 0; i < 3; i++) {
+			StoreFloat(position[i], pos + 4 * i);
+		}
+		if (!PutBytes(pos, kPositionSize, &p, end)) {
+			return 0;
+		}
+	}
+	return static_cast<int>(p - out);
+}
+
+// ParseBatch parses the packets in a single loop, with ParsePacket
+// inlined into it.
+int VoicePacket::ParseBatch(const ByteView *packets, int count, bool with_session, VoicePacket *out, bool *ok) {
+	int parsed = 0;
+	for (int i = 0; i < count; i++) {
+		const unsigned char *p = reinterpret_cast<const unsigned char *>(packets[i].ConstData());
+		ok[i] = ParsePacket(&out[i], p, p + packets[i].Length(), with_session);
+		parsed += ok[i] ? 1 : 0;
+	}
+	return parsed;
+}
+
+}
@@ -0,0 +1,340 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include <gtest/gtest.h>
+
+#include <mumble/VoicePacket.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace mumble;
+
+static std::string FromHex(const std::string &hex) {
+	std::string out;
+	for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+		out.push_back(static_cast<char>(strtol(hex.substr(i, 2).c_str(), nullptr, 16)));
+	}
+	return out;
+}
+
+static std::string Str(const ByteView &view) {
+	return std::string(view.ConstData(), view.Length());
+}
+
+static ByteView View(const std::string &s) {
+	return ByteView(s.data(), static_cast<int>(s.size()));
+}
+
+static const unsigned char *U(const std::string &s) {
+	return reinterpret_cast<const unsigned char *>(s.data());
+}
+
+static std::string Encode(uint64_t value) {
+	unsigned char buf[VoicePacket::kMaxVarintSize];
+	int n = VoicePacket::EncodeVarint(value, buf);
+	return std::string(reinterpret_cast<char *>(buf), n);
+}
+
+static std::string Serialize(const VoicePacket &vp, bool with_session) {
+	char buf[2048];
+	int n = vp.Serialize(buf, sizeof(buf), with_session);
+	return std::string(buf, n);
+}
+
+// ExpectSame compares all fields of two VoicePackets. Positions
+// are compared bitwise, as random bytes may make them NaNs.
+static void ExpectSame(const VoicePacket &a, const VoicePacket &b) {
+	EXPECT_EQ(a.type, b.type);
+	EXPECT_EQ(a.target, b.target);
+	EXPECT_EQ(a.session, b.session);
+	EXPECT_EQ(a.sequence, b.sequence);
+	EXPECT_EQ(a.terminator, b.terminator);
+	ASSERT_EQ(a.num_frames, b.num_frames);
+	for (int i = 0; i < a.num_frames; i++) {
+		EXPECT_EQ(Str(a.frames[i]), Str(b.frames[i]));
+	}
+	EXPECT_EQ(a.has_position, b.has_position);
+	if (a.has_position && b.has_position) {
+		EXPECT_EQ(0, memcmp(a.position, b.position, sizeof(a.position)));
+	}
+}
+
+// The encodings of Mumble's PacketDataStream.
+TEST(VoicePacketTest, VarintEncodings) {
+	struct {
+		uint64_t     value;
+		const char  *hex;
+	} cases[] = {
+		{ 0, "00" },
+		{ 0x7f, "7f" },
+		{ 0x80, "8080" },
+		{ 0x3fff, "bfff" },
+		{ 0x4000, "c04000" },
+		{ 0x1fffff, "dfffff" },
+		{ 0x200000, "e0200000" },
+		{ 0xfffffff, "efffffff" },
+		{ 0x10000000, "f010000000" },
+		{ 0xffffffffULL, "f0ffffffff" },
+		{ 0x100000000ULL, "f40000000100000000" },
+		{ 0x8000000000000000ULL, "f48000000000000000" },
+		{ ~0ULL, "fc" },
+		{ ~3ULL, "ff" },
+		{ ~4ULL, "f804" },
+		{ ~0x4000ULL, "f8c04000" },
+		{ ~0xffffffffULL, "f8f0ffffffff" },
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		std::string wire = FromHex(cases[i].hex);
+		EXPECT_EQ(wire, Encode(cases[i].value)) << cases[i].hex;
+
+		// Decoded from the exact bytes, and followed by enough
+		// bytes to take the fast path.
+		uint64_t value = 0;
+		EXPECT_EQ(static_cast<int>(wire.size()), VoicePacket::DecodeVarint(U(wire), static_cast<int>(wire.size()), &value)) << cases[i].hex;
+		EXPECT_EQ(cases[i].value, value) << cases[i].hex;
+		std::string padded = wire + std::string(16, '\xaa');
+		value = 0;
+		EXPECT_EQ(static_cast<int>(wire.size()), VoicePacket::DecodeVarint(U(padded), static_cast<int>(padded.size()), &value)) << cases[i].hex;
+		EXPECT_EQ(cases[i].value, value) << cases[i].hex;
+
+		for (size_t len = 0; len < wire.size(); len++) {
+			EXPECT_EQ(0, VoicePacket::DecodeVarint(U(wire), static_cast<int>(len), &value)) << cases[i].hex;
+		}
+	}
+}
+
+TEST(VoicePacketTest, VarintRejectsNestedNegatives) {
+	uint64_t value;
+	std::string wire = FromHex("f8fc");
+	EXPECT_EQ(0, VoicePacket::DecodeVarint(U(wire), static_cast<int>(wire.size()), &value));
+	wire = FromHex("f8f804");
+	EXPECT_EQ(0, VoicePacket::DecodeVarint(U(wire), static_cast<int>(wire.size()), &value));
+}
+
+TEST(VoicePacketTest, ParsesOpusFromServer) {
+	// Opus to target 2, from session 5, sequence 300, with a
+	// three byte terminating frame and a position.
+	std::string wire = FromHex("82" "05" "812c" "a003") + "abc" + FromHex("0000803f" "00000040" "000040c0");
+	VoicePacket vp;
+	ASSERT_TRUE(vp.Parse(View(wire), true));
+	EXPECT_EQ(VOICE_PACKET_TYPE_OPUS, vp.type);
+	EXPECT_EQ(2, vp.target);
+	EXPECT_EQ(5U, vp.session);
+	EXPECT_EQ(300U, vp.sequence);
+	ASSERT_EQ(1, vp.num_frames);
+	EXPECT_EQ("abc", Str(vp.frames[0]));
+	EXPECT_TRUE(vp.terminator);
+	ASSERT_TRUE(vp.has_position);
+	EXPECT_EQ(1.0f, vp.position[0]);
+	EXPECT_EQ(2.0f, vp.position[1]);
+	EXPECT_EQ(-3.0f, vp.position[2]);
+
+	// The frame is not copied.
+	EXPECT_EQ(wire.data() + 6, vp.frames[0].ConstData());
+
+	EXPECT_EQ(wire, Serialize(vp, true));
+}
+
+TEST(VoicePacketTest, ParsesSpeexFrames) {
+	// Speex from a client, sequence 7: two frames and a terminator.
+	std::string wire = FromHex("40" "07" "82") + "hi" + FromHex("83") + "you" + FromHex("00");
+	VoicePacket vp;
+	ASSERT_TRUE(vp.Parse(View(wire), false));
+	EXPECT_EQ(VOICE_PACKET_TYPE_SPEEX, vp.type);
+	EXPECT_EQ(0, vp.target);
+	EXPECT_EQ(7U, vp.sequence);
+	ASSERT_EQ(2, vp.num_frames);
+	EXPECT_EQ("hi", Str(vp.frames[0]));
+	EXPECT_EQ("you", Str(vp.frames[1]));
+	EXPECT_TRUE(vp.terminator);
+	EXPECT_FALSE(vp.has_position);
+	EXPECT_EQ(wire, Serialize(vp, false));
+
+	// Without the terminator.
+	wire = FromHex("40" "07" "82") + "hi" + FromHex("03") + "you";
+	ASSERT_TRUE(vp.Parse(View(wire), false));
+	EXPECT_EQ(2, vp.num_frames);
+	EXPECT_FALSE(vp.terminator);
+	EXPECT_EQ(wire, Serialize(vp, false));
+}
+
+TEST(VoicePacketTest, ParsesPings) {
+	std::string wire = FromHex("20") + Encode(123456789);
+	VoicePacket vp;
+	ASSERT_TRUE(vp.Parse(View(wire), true));
+	EXPECT_EQ(VOICE_PACKET_TYPE_PING, vp.type);
+	EXPECT_EQ(123456789U, vp.sequence);
+	EXPECT_EQ(0, vp.num_frames);
+	EXPECT_EQ(wire, Serialize(vp, true));
+}
+
+TEST(VoicePacketTest, RejectsMalformedPackets) {
+	const char *cases[] = {
+		"",                // empty
+		"a0",              // unknown type 5
+		"8005",            // no sequence
+		"800581",          // truncated sequence
+		"8005000a61",      // Opus frame longer than the packet
+		"800500c04000",    // Opus frame header above the terminator bit
+		"400500",          // no frame header
+		"4005000261",      // frame longer than the packet
+		"400500826869",    // continuation without a next frame
+		"40050002686900",  // trailing byte
+		"2001ff",          // ping with a trailing byte
+		"80f4",            // truncated 64-bit session
+	};
+	VoicePacket vp;
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		std::string wire = FromHex(cases[i]);
+		EXPECT_FALSE(vp.Parse(View(wire), true)) << cases[i];
+	}
+
+	// Sessions must fit 32 bits.
+	std::string wire = FromHex("80") + Encode(0x100000000ULL) + FromHex("00" "00");
+	EXPECT_FALSE(vp.Parse(View(wire), true));
+
+	// At most kMaxFrames frames.
+	std::string frames = FromHex("4000");
+	for (int i = 0; i < VoicePacket::kMaxFrames; i++) {
+		frames += FromHex("81") + "x";
+	}
+	EXPECT_TRUE(vp.Parse(View(frames + FromHex("00")), false));
+	EXPECT_FALSE(vp.Parse(View(frames + FromHex("01") + "x"), false));
+}
+
+TEST(VoicePacketTest, SerializeChecksFields) {
+	VoicePacket vp;
+	char buf[64];
+	vp.type = VOICE_PACKET_TYPE_OPUS;
+	EXPECT_EQ(0, vp.Serialize(buf, sizeof(buf), false));  // no frame
+	vp.num_frames = 1;
+	vp.frames[0] = ByteView("voice", 5);
+	EXPECT_EQ(8, vp.Serialize(buf, sizeof(buf), false));
+	EXPECT_EQ(0, vp.Serialize(buf, 7, false));             // too small
+	vp.target = 32;
+	EXPECT_EQ(0, vp.Serialize(buf, sizeof(buf), false));
+
+	vp.target = 0;
+	vp.type = VOICE_PACKET_TYPE_CELT_ALPHA;
+	std::string big(200, 'b');
+	vp.frames[0] = View(big);
+	EXPECT_EQ(0, vp.Serialize(buf, sizeof(buf), false));  // frame over 127 bytes
+}
+
+TEST(VoicePacketTest, ParseBatch) {
+	std::vector<std::string> wires;
+	wires.push_back(FromHex("82" "05" "812c" "03") + "abc");
+	wires.push_back(FromHex("a0"));
+	wires.push_back(FromHex("40" "05" "07" "02") + "hi");
+	std::vector<ByteView> views;
+	for (size_t i = 0; i < wires.size(); i++) {
+		views.push_back(View(wires[i]));
+	}
+	VoicePacket out[3];
+	bool ok[3];
+	EXPECT_EQ(2, VoicePacket::ParseBatch(&views[0], 3, true, out, ok));
+	EXPECT_TRUE(ok[0]);
+	EXPECT_FALSE(ok[1]);
+	EXPECT_TRUE(ok[2]);
+	EXPECT_EQ(300U, out[0].sequence);
+	EXPECT_EQ(5U, out[2].session);
+	EXPECT_EQ("hi", Str(out[2].frames[0]));
+}
+
+// RandomValue returns a random value of a random bit width, so
+// that each of the varint forms is covered.
+static uint64_t RandomValue() {
+	uint64_t v = 0;
+	for (int i = 0; i < 4; i++) {
+		v = (v << 16) | static_cast<uint64_t>(rand() & 0xffff);
+	}
+	int bits = rand() % 65;
+	v = bits == 64 ? v : v & ((1ULL << bits) - 1);
+	return rand() % 4 == 0 ? ~v : v;
+}
+
+TEST(VoicePacketTest, FuzzVarints) {
+	srand(1);
+	for (int i = 0; i < 100000; i++) {
+		uint64_t value = RandomValue();
+		std::string wire = Encode(value);
+		uint64_t decoded = 0;
+		ASSERT_EQ(static_cast<int>(wire.size()), VoicePacket::DecodeVarint(U(wire), static_cast<int>(wire.size()), &decoded));
+		ASSERT_EQ(value, decoded);
+	}
+
+	// Random bytes either fail to decode, or decode to a
+	// value that encodes to no more bytes than were read.
+	for (int i = 0; i < 100000; i++) {
+		unsigned char buf[12];
+		for (size_t k = 0; k < sizeof(buf); k++) {
+			buf[k] = static_cast<unsigned char>(rand());
+		}
+		int len = rand() % static_cast<int>(sizeof(buf) + 1);
+		uint64_t value;
+		int n = VoicePacket::DecodeVarint(buf, len, &value);
+		ASSERT_LE(n, len);
+		if (n > 0) {
+			std::string wire = Encode(value);
+			ASSERT_LE(static_cast<int>(wire.size()), n);
+			uint64_t again;
+			ASSERT_EQ(static_cast<int>(wire.size()), VoicePacket::DecodeVarint(U(wire), static_cast<int>(wire.size()), &again));
+			ASSERT_EQ(value, again);
+		}
+	}
+}
+
+// FuzzPackets feeds random packets, and mutations of valid ones, to
+// Parse. Whatever parses must serialize, and parse back the same.
+TEST(VoicePacketTest, FuzzPackets) {
+	srand(2);
+	int parsed = 0;
+	for (int i = 0; i < 200000; i++) {
+		std::string wire;
+		if (i % 2 == 0) {
+			int len = rand() % 48;
+			for (int k = 0; k < len; k++) {
+				wire.push_back(static_cast<char>(rand()));
+			}
+		} else {
+			VoicePacket vp;
+			vp.type = static_cast<VoicePacketType>(rand() % 5);
+			vp.target = rand() % 32;
+			vp.session = static_cast<uint32_t>(RandomValue());
+			vp.sequence = RandomValue();
+			std::string audio(300, 'a');
+			vp.num_frames = vp.type == VOICE_PACKET_TYPE_OPUS ? 1 : 1 + rand() % 4;
+			for (int k = 0; k < vp.num_frames; k++) {
+				vp.frames[k] = ByteView(audio.data(), 1 + rand() % 100);
+			}
+			vp.terminator = rand() % 2 == 0;
+			vp.has_position = rand() % 2 == 0;
+			vp.position[0] = 1.5f;
+			wire = Serialize(vp, true);
+			ASSERT_FALSE(wire.empty());
+			for (int m = rand() % 3; m > 0; m--) {
+				wire[rand() % wire.size()] = static_cast<char>(rand());
+			}
+			if (rand() % 4 == 0) {
+				wire.resize(rand() % wire.size());
+			}
+		}
+
+		bool with_session = rand() % 2 == 0;
+		VoicePacket vp;
+		if (!vp.Parse(View(wire), with_session)) {
+			continue;
+		}
+		parsed++;
+		std::string again = Serialize(vp, with_session);
+		ASSERT_FALSE(again.empty());
+		VoicePacket other;
+		ASSERT_TRUE(other.Parse(View(again), with_session));
+		ExpectSame(vp, other);
+	}
+	EXPECT_GT(parsed, 10000);
+}
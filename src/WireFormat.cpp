@@ -0,0 +1,100 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#include "WireFormat.h"
+
+namespace mumble {
+
+WireReader::WireReader(const ByteView &view)
+	: p_(reinterpret_cast<const unsigned char *>(view.ConstData())),
+	  end_(p_ + view.Length()), failed_(false) {
+}
+
+bool WireReader::Next(int *field, int *type) {
+	if (failed_ || p_ == end_) {
+		return false;
+	}
+	uint64_t key;
+	if (!ReadVarint(&key)) {
+		return false;
+	}
+	uint64_t num = key >> 3;
+	if (num == 0 || num > 0x1fffffff) {
+		failed_ = true;
+		return false;
+	}
+	*field = static_cast<int>(num);
+	*type = static_cast<int>(key & 0x7);
+	return true;
+}
+
+bool WireReader::ReadVarint(uint64_t *value) {
+	uint64_t v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (p_ == end_) {
+			failed_ = true;
+			return false;
+		}
+		unsigned char b = *p_++;
+		v |= static_cast<uint64_t>(b & 0x7f) << shift;
+		if ((b & 0x80) == 0) {
+			*value = v;
+			return true;
+		}
+	}
+	failed_ = true;
+	return false;
+}
+
+bool WireReader::ReadFixed(int type, uint64_t *value) {
+	int n = type == WIRE_TYPE_FIXED64 ? 8 : 4;
+	if (end_ - p_ < n) {
+		failed_ = true;
+		return false;
+	}
+	uint64_t v = 0;
+	for (int i = n - 1; i >= 0; i--) {
+		v = (v << 8) | p_[i];
+	}
+	p_ += n;
+	*value = v;
+	return true;
+}
+
+bool WireReader::ReadLengthDelimited(ByteView *view) {
+	uint64_t len;
+	if (!ReadVarint(&len)) {
+		return false;
+	}
+	if (len > static_cast<uint64_t>(end_ - p_)) {
+		failed_ = true;
+		return false;
+	}
+	*view = ByteView(reinterpret_cast<const char *>(p_), static_cast<int>(len));
+	p_ += len;
+	return true;
+}
+
+bool WireReader::Skip(int type) {
+	uint64_t v;
+	ByteView view;
+	switch (type) {
+		case WIRE_TYPE_VARINT:
+			return ReadVarint(&v);
+		case WIRE_TYPE_FIXED64:
+		case WIRE_TYPE_FIXED32:
+			return ReadFixed(type, &v);
+		case WIRE_TYPE_LENGTH_DELIMITED:
+			return ReadLengthDelimited(&view);
+		default:
+			failed_ = true;
+			return false;
+	}
+}
+
+bool WireReader::Done() const {
+	return !failed_ && p_ == end_;
+}
+
+}
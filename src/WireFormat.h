@@ -0,0 +1,67 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+#ifndef MUMBLE_WIREFORMAT_H_
+#define MUMBLE_WIREFORMAT_H_
+
+#include <mumble/ByteView.h>
+
+#include <stdint.h>
+
+namespace mumble {
+
+// The wire types of the protocol buffer encoding.
+enum WireType {
+	WIRE_TYPE_VARINT           = 0,
+	WIRE_TYPE_FIXED64          = 1,
+	WIRE_TYPE_LENGTH_DELIMITED = 2,
+	WIRE_TYPE_START_GROUP      = 3,
+	WIRE_TYPE_END_GROUP        = 4,
+	WIRE_TYPE_FIXED32          = 5,
+};
+
+// WireReader walks the fields of a serialized protocol
+// buffer message without copying or allocating.
+//
+//     WireReader r(payload);
+//     int field, type;
+//     while (r.Next(&field, &type)) {
+//         ... read or skip the value ...
+//     }
+//     if (!r.Done()) { ... malformed ... }
+class WireReader {
+public:
+	explicit WireReader(const ByteView &view);
+
+	// Next reads the key of the next field. Returns false at
+	// the end of the message, or if the message is malformed.
+	bool Next(int *field, int *type);
+
+	// ReadVarint reads a varint value.
+	bool ReadVarint(uint64_t *value);
+
+	// ReadFixed reads a fixed64 or fixed32 value, as given by *type*.
+	bool ReadFixed(int type, uint64_t *value);
+
+	// ReadLengthDelimited reads a length-delimited value,
+	// and returns it as a view into the message.
+	bool ReadLengthDelimited(ByteView *view);
+
+	// Skip skips a value of the given wire *type*. Groups
+	// are not used by Mumble.proto, and are rejected.
+	bool Skip(int type);
+
+	// Done returns true if the whole message has been
+	// read without encountering any errors.
+	bool Done() const;
+
+private:
+	const unsigned char  *p_;
+	const unsigned char  *end_;
+	bool                 failed_;
+};
+
+}
+
+#endif
@@ -189,6 +189,20 @@ X509 *X509CertificatePrivate::AsOpenSSLX509() const {
 	return d2i_X509(nullptr, reinterpret_cast<const unsigned char **>(&p), cert_der_.Length());
 }
 
+// AsOpenSSLPrivateKey returns the certificate's
+// private key as an OpenSSL EVP_PKEY pointer, or
+// nullptr if the certificate has no private key.
+// It is the responsibility of the caller to ensure
+// that the returned EVP_PKEY pointer is freed by
+// a call to EVP_PKEY_free().
+EVP_PKEY *X509CertificatePrivate::AsOpenSSLPrivateKey() const {
+	if (priv_der_.IsNull() || priv_der_.Length() == 0) {
+		return nullptr;
+	}
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(priv_der_.ConstData());
+	return d2i_AutoPrivateKey(nullptr, &p, priv_der_.Length());
+}
+
 std::time_t X509CertificatePrivate::NotBeforeTime() const {
 	return not_before_;
 }
@@ -50,6 +50,7 @@ public:
 	static std::vector<X509Certificate> FromPKCS12(const ByteArray &pkcs12, const std::string &password);
 
 	X509 *AsOpenSSLX509() const;
+	EVP_PKEY *AsOpenSSLPrivateKey() const;
 
 	ByteArray Digest(const std::string &name) const;
 
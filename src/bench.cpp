@@ -0,0 +1,1088 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+// libmumble-bench measures the throughput and round-trip latency of
+// TLSConnection against a TLS echo peer running on the loopback
+// interface, and prints the results as a single JSON object.
+//
+// Usage: libmumble-bench [--size=N] [--concurrency=N] [--connections=N]
+//                        [--messages=N] [--cipher=LIST]
+//                        [--client-loops=N] [--server-loops=N]
+//                        [--write-timestamps=0|1]
+//                        [--no-delay=0|1] [--sndbuf=N] [--rcvbuf=N]
+//                        [--notsent-lowat=N] [--dscp=N] [--quickack=0|1]
+//                        [--busy-poll=USEC] [--executor-threads=N]
+//                        [--record-sizing=0|1] [--min-record=N]
+//                        [--record-ramp=N] [--record-idle-ms=N]
+//        libmumble-bench --error-path=N
+//        libmumble-bench --lazy-decode=N
+//        libmumble-bench --server-state=N
+//        libmumble-bench --voice-udp=N
+//        libmumble-bench --voice-packets=N
+//
+// The socket options are applied to both the client connections and
+// the echo peer's connections. With --executor-threads, the client
+// connections run their handlers on a WorkQueueExecutor with N threads
+// instead of on their I/O threads. The record sizing options control
+// dynamic TLS record sizing on both sides; the number and size of the
+// records sent by the clients are included in the results.
+//
+// With --error-path, libmumble-bench instead measures the cost of the
+// error paths of Connect and Write, and of creating and copying Errors,
+// over N iterations each.
+//
+// With --lazy-decode, libmumble-bench instead compares decoding a
+// UserState with a large texture and comment, and a UserList with
+// thousands of entries, into MumbleProto messages and into the lazily
+// decoded messages of LazyMessage.h, over N iterations each.
+//
+// With --server-state, libmumble-bench instead fills a ServerState with
+// 1000 channels and 5000 users, and measures N UserState deltas applied
+// to it, with and without a thread that keeps taking and reading its
+// snapshots, against copying all of its channels and users.
+//
+// With --voice-udp, libmumble-bench instead sends N encrypted voice
+// packets over loopback, a batch at a time, and decrypts them on
+// arrival, once with a syscall per datagram and once with the batched
+// I/O of UDPBatch.h, and reports packets per second per core.
+//
+// With --voice-packets, libmumble-bench instead parses the headers of
+// voice packets from 5000 senders, N packets per run, with VoicePacket
+// and with a byte-at-a-time varint reader, and serializes them again.
+
+#include <mumble/TLSConnection.h>
+#include <mumble/TLSListener.h>
+#include <mumble/X509Certificate.h>
+#include <mumble/EventLoop.h>
+#include <mumble/Executor.h>
+#include <mumble/ByteArray.h>
+#include <mumble/ByteView.h>
+#include <mumble/Error.h>
+#include <mumble/LazyMessage.h>
+#include <mumble/ServerState.h>
+#include <mumble/VoicePacket.h>
+
+#include "Mumble.pb.h"
+#include "CryptState.h"
+#include "UDPBatch.h"
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+#ifndef LIBMUMBLE_OS_WINDOWS
+# include <sys/time.h>
+# include <sys/resource.h>
+#endif
+
+#include "uv.h"
+
+struct BenchOptions {
+	BenchOptions()
+		: size(1024), concurrency(1), connections(1), messages(10000), client_loops(1), server_loops(1),
+		  write_timestamps(false), no_delay(true), sndbuf(0), rcvbuf(0), notsent_lowat(0), dscp(-1),
+		  quickack(false), busy_poll(0), executor_threads(0), record_sizing(true), min_record(1400),
+		  record_ramp(128 * 1024), record_idle_ms(1000), error_path(0),
+		  lazy_decode(0), server_state(0), voice_udp(0), voice_packets(0) {}
+
+	int          size;
+	int          concurrency;
+	int          connections;
+	int          messages;
+	int          client_loops;
+	int          server_loops;
+	bool         write_timestamps;
+	bool         no_delay;
+	int          sndbuf;
+	int          rcvbuf;
+	int          notsent_lowat;
+	int          dscp;
+	bool         quickack;
+	int          busy_poll;
+	int          executor_threads;
+	bool         record_sizing;
+	int          min_record;
+	int          record_ramp;
+	int          record_idle_ms;
+	int          error_path;
+	int          lazy_decode;
+	int          server_state;
+	int          voice_udp;
+	int          voice_packets;
+	std::string  cipher;
+};
+
+// BenchClient drives a single TLSConnection. It keeps up to
+// *concurrency* messages in flight, and records the round-trip
+// time of each message once its echo has been fully received.
+//
+// All of BenchClient's handlers run on the thread of the
+// EventLoop that its connection runs on.
+struct BenchClient {
+	BenchClient(const BenchOptions &opts, const mumble::ByteArray &msg)
+		: opts_(opts), msg_(msg), sent_(0), received_(0), received_bytes_(0),
+		  sent_at_(opts.messages), rtt_(opts.messages), ready_(false), failed_(false) {}
+
+	// Start sends the first *concurrency* messages. It is called
+	// from the main thread. All state is set up before the first
+	// Write hands control over to the connection's thread.
+	void Start() {
+		uint64_t now = uv_hrtime();
+		for (int i = 0; i < opts_.concurrency; i++) {
+			sent_at_[i] = now;
+		}
+		sent_ = opts_.concurrency;
+		for (int i = 0; i < opts_.concurrency; i++) {
+			Write();
+		}
+	}
+
+	void Send() {
+		sent_at_[sent_] = uv_hrtime();
+		sent_++;
+		Write();
+	}
+
+	// Write writes a message, and with --write-timestamps, records
+	// how long it spent in the write queue, and how long it took to
+	// reach the kernel once encrypted.
+	void Write() {
+		if (!opts_.write_timestamps) {
+			conn_.Write(msg_);
+			return;
+		}
+		conn_.Write(msg_, mumble::TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE,
+			[this](const mumble::Error &err, const mumble::TLSConnectionWriteInfo &info) {
+				if (!err.HasError()) {
+					queue_delay_.push_back(info.encrypt_time - info.enqueue_time);
+					socket_delay_.push_back(info.write_time - info.encrypt_time);
+				}
+			});
+	}
+
+	void OnRead(const mumble::ByteViewChain &chain) {
+		for (const mumble::ByteView &view : chain) {
+			received_bytes_ += view.Length();
+		}
+		while (received_bytes_ >= static_cast<uint64_t>(opts_.size) && received_ < sent_) {
+			received_bytes_ -= opts_.size;
+			rtt_[received_] = uv_hrtime() - sent_at_[received_];
+			received_++;
+			if (sent_ < opts_.messages) {
+				Send();
+			}
+		}
+		if (received_ == opts_.messages) {
+			conn_.Disconnect();
+		}
+	}
+
+	const BenchOptions     &opts_;
+	mumble::ByteArray      msg_;
+	mumble::TLSConnection  conn_;
+
+	int                    sent_;
+	int                    received_;
+	uint64_t               received_bytes_;
+	std::vector<uint64_t>  sent_at_;
+	std::vector<uint64_t>  rtt_;
+	std::vector<uint64_t>  queue_delay_;
+	std::vector<uint64_t>  socket_delay_;
+
+	// ready_ is set once the connection has either been
+	// established or has failed to do so.
+	bool                   ready_;
+	bool                   failed_;
+};
+
+static bool ParseOptions(int argc, char **argv, BenchOptions *opts) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		size_t eq = arg.find('=');
+		if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+			std::cerr << "libmumble-bench: bad argument: " << arg << std::endl;
+			return false;
+		}
+
+		std::string key = arg.substr(2, eq - 2);
+		std::string value = arg.substr(eq + 1);
+		int n = std::atoi(value.c_str());
+
+		if (key == "size") {
+			opts->size = n;
+		} else if (key == "concurrency") {
+			opts->concurrency = n;
+		} else if (key == "connections") {
+			opts->connections = n;
+		} else if (key == "messages") {
+			opts->messages = n;
+		} else if (key == "client-loops") {
+			opts->client_loops = n;
+		} else if (key == "server-loops") {
+			opts->server_loops = n;
+		} else if (key == "write-timestamps") {
+			opts->write_timestamps = n != 0;
+		} else if (key == "no-delay") {
+			opts->no_delay = n != 0;
+		} else if (key == "sndbuf") {
+			opts->sndbuf = n;
+		} else if (key == "rcvbuf") {
+			opts->rcvbuf = n;
+		} else if (key == "notsent-lowat") {
+			opts->notsent_lowat = n;
+		} else if (key == "dscp") {
+			opts->dscp = n;
+		} else if (key == "quickack") {
+			opts->quickack = n != 0;
+		} else if (key == "busy-poll") {
+			opts->busy_poll = n;
+		} else if (key == "executor-threads") {
+			opts->executor_threads = n;
+		} else if (key == "record-sizing") {
+			opts->record_sizing = n != 0;
+		} else if (key == "min-record") {
+			opts->min_record = n;
+		} else if (key == "record-ramp") {
+			opts->record_ramp = n;
+		} else if (key == "record-idle-ms") {
+			opts->record_idle_ms = n;
+		} else if (key == "error-path") {
+			opts->error_path = n;
+		} else if (key == "lazy-decode") {
+			opts->lazy_decode = n;
+		} else if (key == "server-state") {
+			opts->server_state = n;
+		} else if (key == "voice-udp") {
+			opts->voice_udp = n;
+		} else if (key == "voice-packets") {
+			opts->voice_packets = n;
+		} else if (key == "cipher") {
+			opts->cipher = value;
+		} else {
+			std::cerr << "libmumble-bench: unknown option: " << key << std::endl;
+			return false;
+		}
+	}
+
+	if (opts->size < 1 || opts->concurrency < 1 || opts->connections < 1 ||
+	    opts->messages < 1 || opts->client_loops < 1 || opts->server_loops < 1) {
+		std::cerr << "libmumble-bench: all numeric options must be positive" << std::endl;
+		return false;
+	}
+	opts->concurrency = std::min(opts->concurrency, opts->messages);
+	return true;
+}
+
+// SetConnectionOptions copies the connection-level
+// settings of *opts* into *copts*.
+static void SetConnectionOptions(const BenchOptions &opts, mumble::TLSConnectionOptions *copts) {
+	copts->tcp_no_delay = opts.no_delay;
+	copts->cipher_list = opts.cipher;
+	copts->send_buffer_size = opts.sndbuf;
+	copts->receive_buffer_size = opts.rcvbuf;
+	copts->not_sent_low_water_mark = opts.notsent_lowat;
+	copts->dscp = opts.dscp;
+	copts->tcp_quick_ack = opts.quickack;
+	copts->busy_poll_usec = opts.busy_poll;
+	copts->dynamic_record_sizing = opts.record_sizing;
+	copts->min_record_size = opts.min_record;
+	copts->record_size_ramp_bytes = opts.record_ramp;
+	copts->record_size_idle_ms = opts.record_idle_ms;
+}
+
+// CPUTime returns the user and system CPU time
+// used by the process so far, in microseconds.
+static uint64_t CPUTime() {
+#ifndef LIBMUMBLE_OS_WINDOWS
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) != 0) {
+		return 0;
+	}
+	uint64_t usec = 0;
+	usec += static_cast<uint64_t>(ru.ru_utime.tv_sec) * 1000000 + ru.ru_utime.tv_usec;
+	usec += static_cast<uint64_t>(ru.ru_stime.tv_sec) * 1000000 + ru.ru_stime.tv_usec;
+	return usec;
+#else
+	return 0;
+#endif
+}
+
+static double Percentile(const std::vector<uint64_t> &sorted, double p) {
+	if (sorted.empty()) {
+		return 0;
+	}
+	size_t idx = static_cast<size_t>(p * sorted.size());
+	if (idx >= sorted.size()) {
+		idx = sorted.size() - 1;
+	}
+	return sorted[idx] / 1000.0;
+}
+
+// ErrorPathNanos returns the average time, in nanoseconds,
+// of *iterations* calls to *fn*.
+template <typename Fn>
+static double ErrorPathNanos(int iterations, Fn fn) {
+	uint64_t start = uv_hrtime();
+	for (int i = 0; i < iterations; i++) {
+		fn();
+	}
+	return static_cast<double>(uv_hrtime() - start) / iterations;
+}
+
+// RunErrorPathBench measures the error paths of TLSConnection,
+// and the cost of creating and copying Errors.
+static int RunErrorPathBench(const BenchOptions &opts) {
+	int n = opts.error_path;
+	uint64_t failures = 0;
+
+	double no_error = ErrorPathNanos(n, [&failures] {
+		mumble::Error err = mumble::Error::NoError();
+		mumble::Error copy = err;
+		failures += copy.HasError() ? 1 : 0;
+	});
+
+	mumble::Error dynamic = mumble::Error::ErrorFromDescription(std::string("bench"), 1L, std::string("a dynamic description"));
+	double copy_dynamic = ErrorPathNanos(n, [&failures, &dynamic] {
+		mumble::Error copy = dynamic;
+		failures += copy.HasError() ? 1 : 0;
+	});
+
+	double from_description = ErrorPathNanos(n, [&failures] {
+		mumble::Error err = mumble::Error::ErrorFromDescription(std::string("bench"), 1L, std::string("a dynamic description"));
+		failures += err.HasError() ? 1 : 0;
+	});
+
+	mumble::TLSConnection conn;
+	double write = ErrorPathNanos(n, [&failures, &conn] {
+		conn.Write(mumble::ByteArray(), mumble::TLS_CONNECTION_WRITE_PRIORITY_INTERACTIVE,
+			[&failures](const mumble::Error &err, const mumble::TLSConnectionWriteInfo &info) {
+				failures += err.HasError() ? 1 : 0;
+			});
+	});
+
+	// Connecting on an EventLoop that has not been started
+	// fails before any socket is created.
+	mumble::EventLoop stopped;
+	mumble::TLSConnectionOptions copts;
+	copts.event_loop = &stopped;
+	double connect = ErrorPathNanos(n, [&failures, &conn, &copts] {
+		mumble::Error err = conn.Connect(std::string("127.0.0.1"), 1, &copts);
+		failures += err.HasError() ? 1 : 0;
+	});
+
+	std::ostringstream out;
+	out << "{"
+	    << "\"iterations\": " << n << ", "
+	    << "\"error_path_ns\": {"
+	    <<   "\"no_error\": " << no_error << ", "
+	    <<   "\"copy_dynamic\": " << copy_dynamic << ", "
+	    <<   "\"from_description\": " << from_description << ", "
+	    <<   "\"write_not_connected\": " << write << ", "
+	    <<   "\"connect_loop_stopped\": " << connect
+	    << "}, "
+	    << "\"errors\": " << failures
+	    << "}";
+	std::cout << out.str() << std::endl;
+	return 0;
+}
+
+// RunLazyDecodeBench measures how long it takes to decode large
+// control messages into MumbleProto messages, and into their lazily
+// decoded counterparts, when only a few scalar fields are used.
+static int RunLazyDecodeBench(const BenchOptions &opts) {
+	int n = opts.lazy_decode;
+	uint64_t sum = 0;
+	bool ok = true;
+
+	MumbleProto::UserState us;
+	us.set_session(1);
+	us.set_channel_id(2);
+	us.set_name("libmumble-bench");
+	us.set_texture(std::string(1024 * 1024, 't'));
+	us.set_comment(std::string(16 * 1024, 'c'));
+	std::string user_state = us.SerializeAsString();
+
+	MumbleProto::UserList ul;
+	for (int i = 0; i < 5000; i++) {
+		MumbleProto::UserList_User *u = ul.add_users();
+		u->set_user_id(i);
+		u->set_name("registered user");
+		u->set_last_seen("2013-01-01 00:00:00");
+		u->set_last_channel(i % 100);
+	}
+	std::string user_list = ul.SerializeAsString();
+
+	// Both kinds of messages are reused across iterations,
+	// as a MessageDispatcher would.
+	MumbleProto::UserState full_us;
+	double full_user_state = ErrorPathNanos(n, [&] {
+		ok &= full_us.ParseFromArray(user_state.data(), static_cast<int>(user_state.size()));
+		sum += full_us.session() + full_us.channel_id();
+	});
+
+	mumble::LazyUserState lazy_us;
+	double lazy_user_state = ErrorPathNanos(n, [&] {
+		ok &= lazy_us.ParseFromArray(user_state.data(), static_cast<int>(user_state.size()));
+		sum += lazy_us.Session() + lazy_us.ChannelId();
+	});
+
+	MumbleProto::UserList full_ul;
+	double full_user_list = ErrorPathNanos(n, [&] {
+		ok &= full_ul.ParseFromArray(user_list.data(), static_cast<int>(user_list.size()));
+		sum += full_ul.users(full_ul.users_size() - 1).user_id();
+	});
+
+	mumble::LazyUserList lazy_ul;
+	mumble::LazyUserListEntry entry;
+	double lazy_user_list = ErrorPathNanos(n, [&] {
+		ok &= lazy_ul.ParseFromArray(user_list.data(), static_cast<int>(user_list.size()));
+		ok &= lazy_ul.User(lazy_ul.UserSize() - 1, &entry);
+		sum += entry.UserId();
+	});
+
+	std::ostringstream out;
+	out << "{"
+	    << "\"iterations\": " << n << ", "
+	    << "\"user_state_bytes\": " << user_state.size() << ", "
+	    << "\"user_list_bytes\": " << user_list.size() << ", "
+	    << "\"decode_ns\": {"
+	    <<   "\"user_state_full\": " << full_user_state << ", "
+	    <<   "\"user_state_lazy\": " << lazy_user_state << ", "
+	    <<   "\"user_list_full\": " << full_user_list << ", "
+	    <<   "\"user_list_lazy\": " << lazy_user_list
+	    << "}, "
+	    << "\"checksum\": " << sum << ", "
+	    << "\"ok\": " << (ok ? "true" : "false")
+	    << "}";
+	std::cout << out.str() << std::endl;
+	return ok ? 0 : 1;
+}
+
+// ServerStateReader keeps taking snapshots of a ServerState, and
+// looks up every user's channel in them, until it is told to stop.
+struct ServerStateReader {
+	const mumble::ServerState  *state;
+	std::atomic<bool>          done;
+	uint64_t                   snapshots;
+	uint64_t                   lookups;
+};
+
+static void ReadServerState(void *arg) {
+	ServerStateReader *r = static_cast<ServerStateReader *>(arg);
+	while (!r->done.load()) {
+		std::shared_ptr<const mumble::ServerStateSnapshot> snap = r->state->Snapshot();
+		snap->ForEachUser([&](const mumble::ServerUser &u) {
+			r->lookups += snap->Channel(u.channel_id) != nullptr ? 1 : 0;
+		});
+		r->snapshots++;
+	}
+}
+
+// RunServerStateBench measures how long it takes to apply a
+// UserState delta to a large ServerState, which includes publishing
+// a new snapshot, compared to copying all channels and users.
+static int RunServerStateBench(const BenchOptions &opts) {
+	const uint32_t kChannels = 1000;
+	const uint32_t kUsers = 5000;
+	int n = opts.server_state;
+	bool ok = true;
+
+	mumble::ServerState state;
+	for (uint32_t i = 0; i < kChannels; i++) {
+		MumbleProto::ChannelState cs;
+		cs.set_channel_id(i);
+		if (i > 0) {
+			cs.set_parent((i - 1) / 10);
+		}
+		cs.set_name("channel");
+		cs.set_description(std::string(256, 'd'));
+		std::string wire = cs.SerializeAsString();
+		ok &= state.Apply(mumble::MESSAGE_TYPE_CHANNEL_STATE, mumble::ByteView(wire.data(), static_cast<int>(wire.size())));
+	}
+	for (uint32_t i = 1; i <= kUsers; i++) {
+		MumbleProto::UserState us;
+		us.set_session(i);
+		us.set_channel_id(i % kChannels);
+		us.set_name("libmumble-bench user");
+		us.set_hash(std::string(40, 'h'));
+		us.set_comment(std::string(1024, 'c'));
+		std::string wire = us.SerializeAsString();
+		ok &= state.Apply(mumble::MESSAGE_TYPE_USER_STATE, mumble::ByteView(wire.data(), static_cast<int>(wire.size())));
+	}
+
+	// Each delta toggles self_mute of a user, and every tenth one
+	// moves a user to another channel.
+	std::vector<std::string> deltas;
+	for (uint32_t i = 0; i < 1000; i++) {
+		MumbleProto::UserState us;
+		us.set_session(1 + (i * 7919) % kUsers);
+		us.set_self_mute(i % 2 == 0);
+		if (i % 10 == 0) {
+			us.set_channel_id((i * 31) % kChannels);
+		}
+		deltas.push_back(us.SerializeAsString());
+	}
+	size_t next = 0;
+	auto apply = [&] {
+		const std::string &wire = deltas[next++ % deltas.size()];
+		ok &= state.Apply(mumble::MESSAGE_TYPE_USER_STATE, mumble::ByteView(wire.data(), static_cast<int>(wire.size())));
+	};
+
+	double apply_ns = ErrorPathNanos(n, apply);
+
+	ServerStateReader reader;
+	reader.state = &state;
+	reader.done = false;
+	reader.snapshots = 0;
+	reader.lookups = 0;
+	uv_thread_t thread;
+	uv_thread_create(&thread, ReadServerState, &reader);
+	double apply_with_reader_ns = ErrorPathNanos(n, apply);
+	reader.done = true;
+	uv_thread_join(&thread);
+
+	uint64_t sum = 0;
+	double snapshot_ns = ErrorPathNanos(n, [&] {
+		sum += state.Snapshot()->Version();
+	});
+
+	// A full copy is what each delta would cost if snapshots
+	// were taken by copying the state.
+	std::vector<mumble::ServerChannel> channels;
+	std::vector<mumble::ServerUser> users;
+	std::shared_ptr<const mumble::ServerStateSnapshot> snap = state.Snapshot();
+	snap->ForEachChannel([&](const mumble::ServerChannel &c) { channels.push_back(c); });
+	snap->ForEachUser([&](const mumble::ServerUser &u) { users.push_back(u); });
+	int copies = std::max(1, n / 100);
+	double full_copy_ns = ErrorPathNanos(copies, [&] {
+		std::vector<mumble::ServerChannel> c(channels);
+		std::vector<mumble::ServerUser> u(users);
+		sum += c.size() + u.size();
+	});
+
+	ok &= snap->NumChannels() == static_cast<int>(kChannels) && snap->NumUsers() == static_cast<int>(kUsers);
+
+	std::ostringstream out;
+	out << "{"
+	    << "\"iterations\": " << n << ", "
+	    << "\"channels\": " << snap->NumChannels() << ", "
+	    << "\"users\": " << snap->NumUsers() << ", "
+	    << "\"ns\": {"
+	    <<   "\"apply_user_state\": " << apply_ns << ", "
+	    <<   "\"apply_user_state_with_reader\": " << apply_with_reader_ns << ", "
+	    <<   "\"snapshot\": " << snapshot_ns << ", "
+	    <<   "\"full_copy\": " << full_copy_ns
+	    << "}, "
+	    << "\"reader_snapshots\": " << reader.snapshots << ", "
+	    << "\"reader_lookups\": " << reader.lookups << ", "
+	    << "\"checksum\": " << sum << ", "
+	    << "\"ok\": " << (ok ? "true" : "false")
+	    << "}";
+	std::cout << out.str() << std::endl;
+	return ok ? 0 : 1;
+}
+
+// VoiceUDPResult holds the outcome of a RunVoiceUDP.
+struct VoiceUDPResult {
+	double    secs;
+	double    cpu_secs;
+	uint64_t  received;
+	uint64_t  send_calls;
+	uint64_t  recv_calls;
+	bool      segmented;
+};
+
+// RunVoiceUDP sends *n* voice packets from one UDPBatch to another on
+// loopback, encrypting each into its datagram, and decrypting it once
+// it arrives. Everything runs on one thread, so the packets per CPU
+// second are the packets per second a core can handle.
+static VoiceUDPResult RunVoiceUDP(int n, bool batch_io) {
+	// A 20 ms Opus frame at about 32 kbit/s, with its voice header.
+	const int kFrameSize = 80;
+
+	VoiceUDPResult res;
+	memset(&res, 0, sizeof(res));
+	mumble::UDPBatch sender(batch_io);
+	mumble::UDPBatch receiver(batch_io);
+	if (sender.Open(uv_ip4_addr("127.0.0.1", 0)).HasError() ||
+	    receiver.Open(uv_ip4_addr("127.0.0.1", 0)).HasError()) {
+		return res;
+	}
+	struct sockaddr_in to = uv_ip4_addr("127.0.0.1", receiver.LocalPort());
+
+	unsigned char key[mumble::CryptState::kBlockSize];
+	memset(key, 'k', sizeof(key));
+	mumble::CryptState enc;
+	mumble::CryptState dec;
+	enc.SetKey(key, key, key);
+	dec.SetKey(key, key, key);
+	unsigned char frame[kFrameSize];
+	memset(frame, 'v', sizeof(frame));
+	frame[0] = 0x80;
+	unsigned char plain[mumble::UDPBatch::kSlotSize];
+
+	uint64_t start = uv_hrtime();
+	uint64_t cpu_start = CPUTime();
+	int sent = 0;
+	while (sent < n) {
+		int batch = std::min(static_cast<int>(mumble::UDPBatch::kMaxBatch), n - sent);
+		for (int i = 0; i < batch; i++) {
+			char *slot = sender.Reserve();
+			enc.Encrypt(frame, reinterpret_cast<unsigned char *>(slot), kFrameSize);
+			sender.Commit(kFrameSize + mumble::CryptState::kHeaderSize);
+		}
+		sender.Flush(to);
+		sent += batch;
+
+		// Loopback delivers datagrams as they are sent, so the
+		// whole batch is waiting, unless some were dropped.
+		int arrived = 0;
+		while (arrived < batch) {
+			int got = receiver.Receive();
+			if (got == 0) {
+				break;
+			}
+			for (int i = 0; i < got; i++) {
+				const unsigned char *data = reinterpret_cast<const unsigned char *>(receiver.Data(i));
+				if (dec.Decrypt(data, plain, receiver.Length(i))) {
+					res.received++;
+				}
+			}
+			arrived += got;
+		}
+	}
+	res.secs = (uv_hrtime() - start) / 1e9;
+	res.cpu_secs = (CPUTime() - cpu_start) / 1e6;
+	res.send_calls = sender.send_calls_;
+	res.recv_calls = receiver.recv_calls_;
+	res.segmented = sender.SegmentsIO();
+	return res;
+}
+
+static std::string VoiceUDPJSON(const VoiceUDPResult &res) {
+	double packets = static_cast<double>(res.received);
+	std::ostringstream out;
+	out << "{"
+	    << "\"pps\": " << (res.secs > 0 ? packets / res.secs : 0) << ", "
+	    << "\"pps_per_core\": " << (res.cpu_secs > 0 ? packets / res.cpu_secs : 0) << ", "
+	    << "\"send_calls\": " << res.send_calls << ", "
+	    << "\"recv_calls\": " << res.recv_calls << ", "
+	    << "\"syscalls_per_packet\": " << (packets > 0 ? (res.send_calls + res.recv_calls) / packets : 0) << ", "
+	    << "\"segmented\": " << (res.segmented ? "true" : "false")
+	    << "}";
+	return out.str();
+}
+
+// RunVoiceUDPBench compares sending and receiving voice packets
+// with a syscall per datagram against batched I/O.
+static int RunVoiceUDPBench(const BenchOptions &opts) {
+	int n = opts.voice_udp;
+	VoiceUDPResult each = RunVoiceUDP(n, false);
+	VoiceUDPResult batch = RunVoiceUDP(n, true);
+	bool ok = each.received == static_cast<uint64_t>(n) && batch.received == static_cast<uint64_t>(n);
+
+	double each_pps = each.cpu_secs > 0 ? each.received / each.cpu_secs : 0;
+	double batch_pps = batch.cpu_secs > 0 ? batch.received / batch.cpu_secs : 0;
+
+	std::ostringstream out;
+	out << "{"
+	    << "\"packets\": " << n << ", "
+	    << "\"each\": " << VoiceUDPJSON(each) << ", "
+	    << "\"batch\": " << VoiceUDPJSON(batch) << ", "
+	    << "\"speedup_per_core\": " << (each_pps > 0 ? batch_pps / each_pps : 0) << ", "
+	    << "\"ok\": " << (ok ? "true" : "false")
+	    << "}";
+	std::cout << out.str() << std::endl;
+	return ok ? 0 : 1;
+}
+
+// ReadVarintBytewise reads a varint a byte at a time, the way
+// Mumble's PacketDataStream does. It is the baseline for VoicePacket.
+static bool ReadVarintBytewise(const unsigned char **p, const unsigned char *end, uint64_t *value) {
+	if (*p == end) {
+		return false;
+	}
+	uint64_t v = *(*p)++;
+	int more;
+	if ((v & 0x80) == 0x00) {
+		*value = v & 0x7f;
+		return true;
+	} else if ((v & 0xc0) == 0x80) {
+		v &= 0x3f;
+		more = 1;
+	} else if ((v & 0xe0) == 0xc0) {
+		v &= 0x1f;
+		more = 2;
+	} else if ((v & 0xf0) == 0xe0) {
+		v &= 0x0f;
+		more = 3;
+	} else if ((v & 0xfc) == 0xf0) {
+		v = 0;
+		more = 4;
+	} else if ((v & 0xfc) == 0xf4) {
+		v = 0;
+		more = 8;
+	} else if ((v & 0xfc) == 0xf8) {
+		if (!ReadVarintBytewise(p, end, &v)) {
+			return false;
+		}
+		*value = ~v;
+		return true;
+	} else {
+		*value = ~(v & 0x03);
+		return true;
+	}
+	for (int i = 0; i < more; i++) {
+		if (*p == end) {
+			return false;
+		}
+		v = (v << 8) | *(*p)++;
+	}
+	*value = v;
+	return true;
+}
+
+// RunVoicePacketBench measures parsing the headers of Opus packets
+// from the server, as a bot that follows many speakers does.
+static int RunVoicePacketBench(const BenchOptions &opts) {
+	const int kSenders = 5000;
+	const int kPackets = 4096;
+	int n = opts.voice_packets;
+	int runs = std::max(1, n / kPackets);
+
+	// Sessions and sequence numbers of all sizes, and Opus frames
+	// of 40 to 120 bytes, half of them with a position.
+	std::string audio(128, 'a');
+	std::vector<std::string> wires;
+	for (int i = 0; i < kPackets; i++) {
+		mumble::VoicePacket vp;
+		vp.type = mumble::VOICE_PACKET_TYPE_OPUS;
+		vp.session = 1 + (static_cast<uint32_t>(i) * 7919) % kSenders * 97;
+		vp.sequence = static_cast<uint64_t>(i) * (i % 3 == 0 ? 1 : 4099);
+		vp.num_frames = 1;
+		vp.frames[0] = mumble::ByteView(audio.data(), 40 + i % 81);
+		vp.has_position = i % 2 == 0;
+		char buf[mumble::UDPBatch::kSlotSize];
+		wires.push_back(std::string(buf, vp.Serialize(buf, sizeof(buf), true)));
+	}
+	std::vector<mumble::ByteView> views;
+	for (size_t i = 0; i < wires.size(); i++) {
+		views.push_back(mumble::ByteView(wires[i].data(), static_cast<int>(wires[i].size())));
+	}
+
+	// The header varints of all packets, back to back.
+	std::string stream;
+	int nvarints = 0;
+	for (int i = 0; i < kPackets; i++) {
+		mumble::VoicePacket vp;
+		vp.Parse(views[i], true);
+		unsigned char buf[mumble::VoicePacket::kMaxVarintSize];
+		stream.append(reinterpret_cast<char *>(buf), mumble::VoicePacket::EncodeVarint(vp.session, buf));
+		stream.append(reinterpret_cast<char *>(buf), mumble::VoicePacket::EncodeVarint(vp.sequence, buf));
+		nvarints += 2;
+	}
+	const unsigned char *begin = reinterpret_cast<const unsigned char *>(stream.data());
+	const unsigned char *end = begin + stream.size();
+
+	uint64_t sum_bytewise = 0;
+	double bytewise_ns = ErrorPathNanos(runs, [&] {
+		const unsigned char *p = begin;
+		uint64_t v;
+		while (ReadVarintBytewise(&p, end, &v)) {
+			sum_bytewise += v;
+		}
+	}) / nvarints;
+
+	uint64_t sum_table = 0;
+	double table_ns = ErrorPathNanos(runs, [&] {
+		const unsigned char *p = begin;
+		uint64_t v;
+		int len;
+		while ((len = mumble::VoicePacket::DecodeVarint(p, static_cast<int>(end - p), &v)) != 0) {
+			sum_table += v;
+			p += len;
+		}
+	}) / nvarints;
+
+	std::vector<mumble::VoicePacket> out(kPackets);
+	int parsed = 0;
+	double parse_ns = ErrorPathNanos(runs, [&] {
+		for (int i = 0; i < kPackets; i++) {
+			parsed += out[i].Parse(views[i], true) ? 1 : 0;
+		}
+	}) / kPackets;
+
+	std::unique_ptr<bool[]> ok(new bool[kPackets]);
+	int parsed_batch = 0;
+	double batch_ns = ErrorPathNanos(runs, [&] {
+		parsed_batch += mumble::VoicePacket::ParseBatch(&views[0], kPackets, true, &out[0], ok.get());
+	}) / kPackets;
+
+	char buf[mumble::UDPBatch::kSlotSize];
+	uint64_t bytes = 0;
+	double serialize_ns = ErrorPathNanos(runs, [&] {
+		for (int i = 0; i < kPackets; i++) {
+			bytes += out[i].Serialize(buf, sizeof(buf), true);
+		}
+	}) / kPackets;
+
+	uint64_t total = static_cast<uint64_t>(runs) * kPackets;
+	bool all_ok = sum_bytewise == sum_table && parsed == static_cast<int>(total) &&
+	              parsed_batch == static_cast<int>(total) && bytes > 0;
+	std::ostringstream json;
+	json << "{"
+	     << "\"packets\": " << total << ", "
+	     << "\"senders\": " << kSenders << ", "
+	     << "\"ns_per_varint\": {"
+	     <<   "\"bytewise\": " << bytewise_ns << ", "
+	     <<   "\"table\": " << table_ns
+	     << "}, "
+	     << "\"ns_per_packet\": {"
+	     <<   "\"parse\": " << parse_ns << ", "
+	     <<   "\"parse_batch\": " << batch_ns << ", "
+	     <<   "\"serialize\": " << serialize_ns
+	     << "}, "
+	     << "\"parse_batch_per_s\": " << (batch_ns > 0 ? 1e9 / batch_ns : 0) << ", "
+	     << "\"checksum\": " << sum_table << ", "
+	     << "\"ok\": " << (all_ok ? "true" : "false")
+	     << "}";
+	std::cout << json.str() << std::endl;
+	return all_ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+	BenchOptions opts;
+	if (!ParseOptions(argc, argv, &opts)) {
+		return 2;
+	}
+	if (opts.error_path > 0) {
+		return RunErrorPathBench(opts);
+	}
+	if (opts.lazy_decode > 0) {
+		return RunLazyDecodeBench(opts);
+	}
+	if (opts.server_state > 0) {
+		return RunServerStateBench(opts);
+	}
+	if (opts.voice_udp > 0) {
+		return RunVoiceUDPBench(opts);
+	}
+	if (opts.voice_packets > 0) {
+		return RunVoicePacketBench(opts);
+	}
+
+	// Set up the echo peer.
+	mumble::X509Certificate cert = mumble::X509Certificate::GenerateSelfSignedCertificate("libmumble-bench");
+	mumble::TLSListener listener;
+	listener.SetAcceptHandler([](mumble::TLSConnection &conn) {
+		mumble::TLSConnection *peer = &conn;
+		conn.SetReadHandler([peer](const mumble::ByteArray &buf) {
+			peer->Write(buf);
+		});
+	});
+
+	mumble::TLSListenerOptions lopts;
+	lopts.num_event_loops = opts.server_loops;
+	lopts.backlog = std::max(511, opts.connections);
+	SetConnectionOptions(opts, &lopts.connection_options);
+
+	mumble::Error err = listener.Listen(std::string("127.0.0.1"), 0, cert, &lopts);
+	if (err.HasError()) {
+		std::cerr << "libmumble-bench: unable to listen: " << err.String() << std::endl;
+		return 1;
+	}
+
+	std::vector<mumble::EventLoop *> loops;
+	for (int i = 0; i < opts.client_loops; i++) {
+		mumble::EventLoop *loop = new mumble::EventLoop;
+		err = loop->Start();
+		if (err.HasError()) {
+			std::cerr << "libmumble-bench: unable to start event loop: " << err.String() << std::endl;
+			return 1;
+		}
+		loops.push_back(loop);
+	}
+
+	mumble::WorkQueueExecutor executor;
+	if (opts.executor_threads > 0) {
+		mumble::WorkQueueExecutorOptions eopts;
+		eopts.num_threads = opts.executor_threads;
+		err = executor.Start(&eopts);
+		if (err.HasError()) {
+			std::cerr << "libmumble-bench: unable to start executor: " << err.String() << std::endl;
+			return 1;
+		}
+	}
+
+	mumble::ByteArray msg(opts.size);
+	memset(msg.Data(), 'm', opts.size);
+
+	// Connect all clients, and wait for their handshakes to
+	// finish, such that they're not part of the measurement.
+	uv_sem_t established;
+	uv_sem_t done;
+	uv_sem_init(&established, 0);
+	uv_sem_init(&done, 0);
+
+	std::vector<BenchClient *> clients;
+	for (int i = 0; i < opts.connections; i++) {
+		BenchClient *client = new BenchClient(opts, msg);
+		clients.push_back(client);
+
+		client->conn_.SetChainVerifyHandler([](const std::vector<mumble::X509Certificate> &chain) {
+			return true;
+		}).SetEstablishedHandler([client, &established] {
+			client->ready_ = true;
+			uv_sem_post(&established);
+		}).SetReadBatchHandler([client](const mumble::ByteViewChain &chain) {
+			client->OnRead(chain);
+		}).SetErrorHandler([client, &established, &done](const mumble::Error &err) {
+			std::cerr << "libmumble-bench: connection error: " << err.String() << std::endl;
+			client->failed_ = true;
+			if (!client->ready_) {
+				client->ready_ = true;
+				uv_sem_post(&established);
+			}
+			uv_sem_post(&done);
+		}).SetDisconnectHandler([client, &established, &done](bool local) {
+			if (!client->ready_) {
+				client->ready_ = true;
+				client->failed_ = true;
+				uv_sem_post(&established);
+			}
+			uv_sem_post(&done);
+		});
+
+		mumble::TLSConnectionOptions copts;
+		SetConnectionOptions(opts, &copts);
+		copts.event_loop = loops[i % loops.size()];
+		if (opts.executor_threads > 0) {
+			copts.executor = &executor;
+		}
+		err = client->conn_.Connect(std::string("127.0.0.1"), listener.Port(), &copts);
+		if (err.HasError()) {
+			std::cerr << "libmumble-bench: unable to connect: " << err.String() << std::endl;
+			return 1;
+		}
+	}
+	for (int i = 0; i < opts.connections; i++) {
+		uv_sem_wait(&established);
+	}
+
+	uint64_t cpu_start = CPUTime();
+	uint64_t start = uv_hrtime();
+
+	for (BenchClient *client : clients) {
+		if (!client->failed_) {
+			client->Start();
+		}
+	}
+	for (int i = 0; i < opts.connections; i++) {
+		uv_sem_wait(&done);
+	}
+
+	uint64_t elapsed = uv_hrtime() - start;
+	uint64_t cpu = CPUTime() - cpu_start;
+
+	std::vector<uint64_t> rtts;
+	std::vector<uint64_t> queue_delays;
+	std::vector<uint64_t> socket_delays;
+	bool failed = false;
+	mumble::TLSConnectionHandlerStats handler_stats;
+	mumble::TLSConnectionRecordStats record_stats;
+	for (BenchClient *client : clients) {
+		mumble::TLSConnectionRecordStats rs = client->conn_.RecordStats();
+		record_stats.records += rs.records;
+		record_stats.bytes += rs.bytes;
+		record_stats.small_records += rs.small_records;
+		mumble::TLSConnectionHandlerStats cs = client->conn_.HandlerStats();
+		handler_stats.executed += cs.executed;
+		handler_stats.total_lag += cs.total_lag;
+		handler_stats.max_lag = std::max(handler_stats.max_lag, cs.max_lag);
+		rtts.insert(rtts.end(), client->rtt_.begin(), client->rtt_.begin() + client->received_);
+		queue_delays.insert(queue_delays.end(), client->queue_delay_.begin(), client->queue_delay_.end());
+		socket_delays.insert(socket_delays.end(), client->socket_delay_.begin(), client->socket_delay_.end());
+		failed = failed || client->failed_ || client->received_ != opts.messages;
+	}
+	std::sort(rtts.begin(), rtts.end());
+	std::sort(queue_delays.begin(), queue_delays.end());
+	std::sort(socket_delays.begin(), socket_delays.end());
+
+	double secs = elapsed / 1e9;
+	double nmsgs = static_cast<double>(rtts.size());
+
+	std::ostringstream out;
+	out << "{"
+	    << "\"size\": " << opts.size << ", "
+	    << "\"concurrency\": " << opts.concurrency << ", "
+	    << "\"connections\": " << opts.connections << ", "
+	    << "\"messages\": " << rtts.size() << ", "
+	    << "\"cipher\": \"" << opts.cipher << "\", "
+	    << "\"socket\": {"
+	    <<   "\"no_delay\": " << (opts.no_delay ? "true" : "false") << ", "
+	    <<   "\"sndbuf\": " << opts.sndbuf << ", "
+	    <<   "\"rcvbuf\": " << opts.rcvbuf << ", "
+	    <<   "\"notsent_lowat\": " << opts.notsent_lowat << ", "
+	    <<   "\"dscp\": " << opts.dscp << ", "
+	    <<   "\"quickack\": " << (opts.quickack ? "true" : "false") << ", "
+	    <<   "\"busy_poll\": " << opts.busy_poll
+	    << "}, "
+	    << "\"records\": {"
+	    <<   "\"dynamic\": " << (opts.record_sizing ? "true" : "false") << ", "
+	    <<   "\"min\": " << opts.min_record << ", "
+	    <<   "\"ramp\": " << opts.record_ramp << ", "
+	    <<   "\"idle_ms\": " << opts.record_idle_ms << ", "
+	    <<   "\"count\": " << record_stats.records << ", "
+	    <<   "\"small\": " << record_stats.small_records << ", "
+	    <<   "\"avg_size\": " << (record_stats.records > 0 ? record_stats.bytes / static_cast<double>(record_stats.records) : 0)
+	    << "}, "
+	    << "\"elapsed_s\": " << secs << ", "
+	    << "\"msgs_per_s\": " << (secs > 0 ? nmsgs / secs : 0) << ", "
+	    << "\"mb_per_s\": " << (secs > 0 ? nmsgs * opts.size / secs / (1024 * 1024) : 0) << ", "
+	    << "\"rtt_us\": {"
+	    <<   "\"p50\": " << Percentile(rtts, 0.50) << ", "
+	    <<   "\"p99\": " << Percentile(rtts, 0.99) << ", "
+	    <<   "\"p999\": " << Percentile(rtts, 0.999)
+	    << "}, ";
+	if (opts.write_timestamps) {
+		out << "\"queue_us\": {"
+		    <<   "\"p50\": " << Percentile(queue_delays, 0.50) << ", "
+		    <<   "\"p99\": " << Percentile(queue_delays, 0.99)
+		    << "}, "
+		    << "\"socket_us\": {"
+		    <<   "\"p50\": " << Percentile(socket_delays, 0.50) << ", "
+		    <<   "\"p99\": " << Percentile(socket_delays, 0.99)
+		    << "}, ";
+	}
+	if (opts.executor_threads > 0) {
+		double mean = handler_stats.executed > 0 ? handler_stats.total_lag / 1000.0 / handler_stats.executed : 0;
+		out << "\"executor_threads\": " << opts.executor_threads << ", "
+		    << "\"handler_lag_us\": {"
+		    <<   "\"mean\": " << mean << ", "
+		    <<   "\"max\": " << handler_stats.max_lag / 1000.0
+		    << "}, ";
+	}
+	out << "\"cpu_us_per_msg\": " << (nmsgs > 0 ? cpu / nmsgs : 0) << ", "
+	    << "\"ok\": " << (failed ? "false" : "true")
+	    << "}";
+	std::cout << out.str() << std::endl;
+
+	for (BenchClient *client : clients) {
+		delete client;
+	}
+	for (mumble::EventLoop *loop : loops) {
+		delete loop;
+	}
+	uv_sem_destroy(&established);
+	uv_sem_destroy(&done);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,677 @@
+// Copyright (c) 2013 The libmumble Developers
+// The use of this source code is goverened by a BSD-style
+// license that can be found in the LICENSE-file.
+
+// libmumble-loadgen simulates thousands of Mumble clients in a single
+// process, runs them against a stand-in Mumble server on the loopback
+// interface, and prints aggregate message rates and latencies as a
+// single JSON object.
+//
+// Usage: libmumble-loadgen [--clients=N] [--client-loops=N] [--server-loops=N]
+//                          [--duration=S] [--connect-rate=N]
+//                          [--ping-interval=MS] [--move-interval=MS]
+//                          [--text-interval=MS] [--channels=N]
+//                          [--text-size=N] [--report-interval=S] [--seed=N]
+//
+// All clients share --client-loops EventLoops. Each client sends Version
+// and Authenticate once its TLS handshake has completed, and from then on
+// sends Pings, channel moves (UserState) and TextMessages, each on its own
+// schedule. Each schedule starts at a random offset, such that the clients
+// do not all fire at once. An interval of 0 disables that kind of message.
+// Clients are connected at a rate of --connect-rate per second.
+//
+// The stand-in server answers Version with Version and Authenticate with
+// ServerSync, and echoes Pings. It answers a UserState or TextMessage by
+// sending the message back to the client it came from, the way a real
+// server notifies the actor of a channel move, or the recipient of a text
+// message. Latencies are measured from sending a message until the answer
+// arrives; for connects, from Connect until ServerSync arrives.
+//
+// While running, the message rates of the last --report-interval seconds
+// are printed to stderr.
+
+#include <mumble/TLSConnection.h>
+#include <mumble/TLSListener.h>
+#include <mumble/ControlChannel.h>
+#include <mumble/X509Certificate.h>
+#include <mumble/EventLoop.h>
+#include <mumble/ByteView.h>
+#include <mumble/Error.h>
+
+#include "Mumble.pb.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+#ifndef LIBMUMBLE_OS_WINDOWS
+# include <signal.h>
+#endif
+
+#include "uv.h"
+
+// The kinds of requests that clients send on a schedule.
+enum RequestKind {
+	REQUEST_PING,
+	REQUEST_MOVE,
+	REQUEST_TEXT,
+	NUM_REQUEST_KINDS,
+};
+
+static const char *kRequestNames[NUM_REQUEST_KINDS] = { "ping", "move", "text" };
+
+struct LoadOptions {
+	LoadOptions()
+		: clients(1000), client_loops(2), server_loops(2), duration(10), connect_rate(500),
+		  channels(20), text_size(64), report_interval(1), seed(1) {
+		interval[REQUEST_PING] = 5000;
+		interval[REQUEST_MOVE] = 10000;
+		interval[REQUEST_TEXT] = 20000;
+	}
+
+	int  clients;
+	int  client_loops;
+	int  server_loops;
+	int  duration;
+	int  connect_rate;
+	int  interval[NUM_REQUEST_KINDS];
+	int  channels;
+	int  text_size;
+	int  report_interval;
+	int  seed;
+};
+
+// Counters holds the number of requests sent and answered,
+// for all clients. They are updated from all threads.
+struct Counters {
+	Counters() {
+		for (int i = 0; i < NUM_REQUEST_KINDS; i++) {
+			sent[i] = 0;
+			answered[i] = 0;
+		}
+		synced = 0;
+		errors = 0;
+	}
+
+	std::atomic<uint64_t>  sent[NUM_REQUEST_KINDS];
+	std::atomic<uint64_t>  answered[NUM_REQUEST_KINDS];
+	std::atomic<int>       synced;
+	std::atomic<int>       errors;
+};
+
+// LoopStats holds the latencies measured by the clients of
+// a single client EventLoop. It is only touched from that
+// EventLoop's thread while the clients are running.
+struct LoopStats {
+	std::vector<uint64_t>  connect;
+	std::vector<uint64_t>  latency[NUM_REQUEST_KINDS];
+};
+
+// ServerSession is the stand-in server's side of a
+// single connection.
+struct ServerSession {
+	ServerSession(mumble::TLSConnection &conn, uint32_t session) : conn_(conn), channel_(conn), session_(session) {
+		channel_.SetMessageHandler([this](mumble::MessageType type, const mumble::ByteView &payload) {
+			OnMessage(type, payload.ConstData(), payload.Length());
+		});
+	}
+
+	void OnMessage(mumble::MessageType type, const char *data, int len) {
+		switch (type) {
+			case mumble::MESSAGE_TYPE_VERSION: {
+				MumbleProto::Version version;
+				version.set_version(0x010205);
+				version.set_release("libmumble-loadgen");
+				channel_.Send(mumble::MESSAGE_TYPE_VERSION, version);
+				break;
+			}
+			case mumble::MESSAGE_TYPE_AUTHENTICATE: {
+				MumbleProto::ServerSync sync;
+				sync.set_session(session_);
+				sync.set_max_bandwidth(72000);
+				sync.set_welcome_text("libmumble-loadgen");
+				channel_.Send(mumble::MESSAGE_TYPE_SERVER_SYNC, sync);
+				break;
+			}
+			case mumble::MESSAGE_TYPE_PING: {
+				MumbleProto::Ping ping;
+				if (ping.ParseFromArray(data, len)) {
+					channel_.Send(mumble::MESSAGE_TYPE_PING, ping);
+				}
+				break;
+			}
+			case mumble::MESSAGE_TYPE_USER_STATE: {
+				MumbleProto::UserState us;
+				if (us.ParseFromArray(data, len)) {
+					us.set_session(session_);
+					us.set_actor(session_);
+					channel_.Send(mumble::MESSAGE_TYPE_USER_STATE, us);
+				}
+				break;
+			}
+			case mumble::MESSAGE_TYPE_TEXT_MESSAGE: {
+				MumbleProto::TextMessage tm;
+				if (tm.ParseFromArray(data, len)) {
+					tm.set_actor(session_);
+					channel_.Send(mumble::MESSAGE_TYPE_TEXT_MESSAGE, tm);
+				}
+				break;
+			}
+			default:
+				break;
+		}
+	}
+
+	mumble::TLSConnection   &conn_;
+	mumble::ControlChannel  channel_;
+	uint32_t                session_;
+};
+
+// LoadClient is a single simulated client.
+//
+// The client's handlers run on the thread of its EventLoop, while
+// its requests are sent from the main thread. The send times of
+// channel moves and text messages, which carry no timestamp of
+// their own, are passed between the two under lock_.
+struct LoadClient {
+	LoadClient(int index, LoopStats *stats, Counters *counters, uv_sem_t *done)
+		: index_(index), stats_(stats), counters_(counters), done_(done), channel_(conn_),
+		  connect_time_(0), session_(0), synced_(false), closed_(false) {
+		uv_mutex_init(&lock_);
+		channel_.SetMessageHandler([this](mumble::MessageType type, const mumble::ByteView &payload) {
+			OnMessage(type, payload.ConstData(), payload.Length());
+		});
+	}
+
+	~LoadClient() {
+		uv_mutex_destroy(&lock_);
+	}
+
+	void OnEstablished() {
+		MumbleProto::Version version;
+		version.set_version(0x010205);
+		version.set_release("libmumble-loadgen");
+		version.set_os("libmumble");
+		channel_.Send(mumble::MESSAGE_TYPE_VERSION, version);
+
+		std::ostringstream name;
+		name << "loadgen-" << index_;
+		MumbleProto::Authenticate auth;
+		auth.set_username(name.str());
+		auth.set_opus(true);
+		channel_.Send(mumble::MESSAGE_TYPE_AUTHENTICATE, auth);
+	}
+
+	void OnMessage(mumble::MessageType type, const char *data, int len) {
+		uint64_t now = uv_hrtime();
+		switch (type) {
+			case mumble::MESSAGE_TYPE_SERVER_SYNC: {
+				MumbleProto::ServerSync sync;
+				if (sync.ParseFromArray(data, len)) {
+					session_ = sync.session();
+					stats_->connect.push_back(now - connect_time_);
+					synced_ = true;
+					counters_->synced++;
+				}
+				break;
+			}
+			case mumble::MESSAGE_TYPE_PING: {
+				MumbleProto::Ping ping;
+				if (ping.ParseFromArray(data, len)) {
+					stats_->latency[REQUEST_PING].push_back(now - ping.timestamp());
+					counters_->answered[REQUEST_PING]++;
+				}
+				break;
+			}
+			case mumble::MESSAGE_TYPE_USER_STATE:
+				Answered(REQUEST_MOVE, now);
+				break;
+			case mumble::MESSAGE_TYPE_TEXT_MESSAGE:
+				Answered(REQUEST_TEXT, now);
+				break;
+			default:
+				break;
+		}
+	}
+
+	// Answered records the latency of the oldest outstanding
+	// request of the given *kind*.
+	void Answered(RequestKind kind, uint64_t now) {
+		uint64_t sent_at = 0;
+		uv_mutex_lock(&lock_);
+		std::deque<uint64_t> &q = outstanding_[kind];
+		if (!q.empty()) {
+			sent_at = q.front();
+			q.pop_front();
+		}
+		uv_mutex_unlock(&lock_);
+		if (sent_at != 0) {
+			stats_->latency[kind].push_back(now - sent_at);
+			counters_->answered[kind]++;
+		}
+	}
+
+	// OnClosed is called once the connection has gone away,
+	// whether due to an error or a disconnect.
+	void OnClosed(bool error) {
+		if (closed_.exchange(true)) {
+			return;
+		}
+		if (error) {
+			counters_->errors++;
+		}
+		uv_sem_post(done_);
+	}
+
+	// Send sends a request of the given *kind*. It is
+	// called from the main thread.
+	void Send(RequestKind kind, const LoadOptions &opts, std::mt19937 &rng) {
+		uint64_t now = uv_hrtime();
+		switch (kind) {
+			case REQUEST_PING: {
+				MumbleProto::Ping ping;
+				ping.set_timestamp(now);
+				channel_.Send(mumble::MESSAGE_TYPE_PING, ping);
+				break;
+			}
+			case REQUEST_MOVE: {
+				MumbleProto::UserState us;
+				us.set_session(session_);
+				us.set_channel_id(rng() % opts.channels);
+				Outstanding(kind, now);
+				channel_.Send(mumble::MESSAGE_TYPE_USER_STATE, us);
+				break;
+			}
+			case REQUEST_TEXT: {
+				MumbleProto::TextMessage tm;
+				tm.add_session(session_);
+				tm.set_message(std::string(opts.text_size, 'x'));
+				Outstanding(kind, now);
+				channel_.Send(mumble::MESSAGE_TYPE_TEXT_MESSAGE, tm);
+				break;
+			}
+			default:
+				return;
+		}
+		counters_->sent[kind]++;
+	}
+
+	// Outstanding records the send time of a request that is
+	// answered without a timestamp. It must be recorded before
+	// the request is written, since the answer may arrive before
+	// Write returns.
+	void Outstanding(RequestKind kind, uint64_t now) {
+		uv_mutex_lock(&lock_);
+		outstanding_[kind].push_back(now);
+		uv_mutex_unlock(&lock_);
+	}
+
+	int                    index_;
+	LoopStats              *stats_;
+	Counters               *counters_;
+	uv_sem_t               *done_;
+	mumble::TLSConnection  conn_;
+	mumble::ControlChannel channel_;
+	uint64_t               connect_time_;
+
+	std::atomic<uint32_t>  session_;
+	std::atomic<bool>      synced_;
+	std::atomic<bool>      closed_;
+
+	uv_mutex_t             lock_;
+	std::deque<uint64_t>   outstanding_[NUM_REQUEST_KINDS];
+};
+
+// ScheduledRequest is a request that is due to be
+// sent by a client at a given time.
+struct ScheduledRequest {
+	uint64_t     due;
+	int          client;
+	RequestKind  kind;
+
+	bool operator>(const ScheduledRequest &other) const {
+		return due > other.due;
+	}
+};
+
+// Driver connects the clients and sends their requests
+// on schedule. It runs on the main thread, driven by a
+// timer on the default loop.
+struct Driver {
+	Driver(const LoadOptions &opts, std::vector<LoadClient *> &clients, Counters &counters, int port)
+		: opts_(opts), clients_(clients), counters_(counters), port_(port), connected_(0), started_(0),
+		  rng_(opts.seed), start_(0), last_report_(0) {
+		for (int i = 0; i < NUM_REQUEST_KINDS; i++) {
+			last_sent_[i] = 0;
+			last_answered_[i] = 0;
+		}
+	}
+
+	void Start() {
+		start_ = uv_hrtime();
+		last_report_ = start_;
+		uv_timer_init(uv_default_loop(), &timer_);
+		timer_.data = this;
+		uv_timer_start(&timer_, Driver::OnTick, 0, kTickMs);
+	}
+
+	void Tick() {
+		uint64_t now = uv_hrtime();
+		uint64_t elapsed = now - start_;
+		if (elapsed >= static_cast<uint64_t>(opts_.duration) * 1000000000ULL) {
+			uv_timer_stop(&timer_);
+			uv_close(reinterpret_cast<uv_handle_t *>(&timer_), nullptr);
+			return;
+		}
+
+		// Connect as many clients as the connect rate allows.
+		int want = static_cast<int>(elapsed / 1000000 * opts_.connect_rate / 1000) + 1;
+		while (connected_ < std::min(want, static_cast<int>(clients_.size()))) {
+			Connect(connected_);
+			connected_++;
+		}
+
+		while (!queue_.empty() && queue_.top().due <= now) {
+			ScheduledRequest req = queue_.top();
+			queue_.pop();
+			LoadClient *client = clients_[req.client];
+			if (client->closed_) {
+				continue;
+			}
+			if (client->synced_) {
+				client->Send(req.kind, opts_, rng_);
+			}
+			req.due += static_cast<uint64_t>(opts_.interval[req.kind]) * 1000000;
+			queue_.push(req);
+		}
+
+		if (now - last_report_ >= static_cast<uint64_t>(opts_.report_interval) * 1000000000ULL) {
+			Report(now);
+		}
+	}
+
+	void Connect(int i) {
+		LoadClient *client = clients_[i];
+		mumble::TLSConnectionOptions copts;
+		copts.event_loop = loops_[i % loops_.size()];
+		client->connect_time_ = uv_hrtime();
+		mumble::Error err = client->conn_.Connect(std::string("127.0.0.1"), port_, &copts);
+		if (err.HasError()) {
+			std::cerr << "libmumble-loadgen: unable to connect: " << err.String() << std::endl;
+			counters_.errors++;
+			client->closed_ = true;
+			return;
+		}
+		started_++;
+
+		uint64_t now = uv_hrtime();
+		for (int kind = 0; kind < NUM_REQUEST_KINDS; kind++) {
+			if (opts_.interval[kind] <= 0) {
+				continue;
+			}
+			ScheduledRequest req;
+			req.due = now + static_cast<uint64_t>(rng_() % opts_.interval[kind]) * 1000000;
+			req.client = i;
+			req.kind = static_cast<RequestKind>(kind);
+			queue_.push(req);
+		}
+	}
+
+	// Report prints the request rates since the last report.
+	void Report(uint64_t now) {
+		double secs = (now - last_report_) / 1e9;
+		std::ostringstream out;
+		out << "libmumble-loadgen: t=" << (now - start_) / 1000000000ULL << "s"
+		    << " synced=" << counters_.synced
+		    << " errors=" << counters_.errors;
+		for (int i = 0; i < NUM_REQUEST_KINDS; i++) {
+			uint64_t sent = counters_.sent[i];
+			uint64_t answered = counters_.answered[i];
+			out << " " << kRequestNames[i] << "=" << static_cast<uint64_t>((sent - last_sent_[i]) / secs) << "/s"
+			    << " (" << static_cast<uint64_t>((answered - last_answered_[i]) / secs) << "/s answered)";
+			last_sent_[i] = sent;
+			last_answered_[i] = answered;
+		}
+		std::cerr << out.str() << std::endl;
+		last_report_ = now;
+	}
+
+	static void OnTick(uv_timer_t *timer, int status) {
+		static_cast<Driver *>(timer->data)->Tick();
+	}
+
+	static const int kTickMs = 5;
+
+	const LoadOptions                   &opts_;
+	std::vector<LoadClient *>           &clients_;
+	std::vector<mumble::EventLoop *>    loops_;
+	Counters                            &counters_;
+	int                                 port_;
+	int                                 connected_;
+	int                                 started_;
+	std::mt19937                        rng_;
+	uv_timer_t                          timer_;
+	uint64_t                            start_;
+	uint64_t                            last_report_;
+	uint64_t                            last_sent_[NUM_REQUEST_KINDS];
+	uint64_t                            last_answered_[NUM_REQUEST_KINDS];
+
+	std::priority_queue<ScheduledRequest, std::vector<ScheduledRequest>, std::greater<ScheduledRequest> > queue_;
+};
+
+static bool ParseOptions(int argc, char **argv, LoadOptions *opts) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		size_t eq = arg.find('=');
+		if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+			std::cerr << "libmumble-loadgen: bad argument: " << arg << std::endl;
+			return false;
+		}
+
+		std::string key = arg.substr(2, eq - 2);
+		int n = std::atoi(arg.substr(eq + 1).c_str());
+
+		if (key == "clients") {
+			opts->clients = n;
+		} else if (key == "client-loops") {
+			opts->client_loops = n;
+		} else if (key == "server-loops") {
+			opts->server_loops = n;
+		} else if (key == "duration") {
+			opts->duration = n;
+		} else if (key == "connect-rate") {
+			opts->connect_rate = n;
+		} else if (key == "ping-interval") {
+			opts->interval[REQUEST_PING] = n;
+		} else if (key == "move-interval") {
+			opts->interval[REQUEST_MOVE] = n;
+		} else if (key == "text-interval") {
+			opts->interval[REQUEST_TEXT] = n;
+		} else if (key == "channels") {
+			opts->channels = n;
+		} else if (key == "text-size") {
+			opts->text_size = n;
+		} else if (key == "report-interval") {
+			opts->report_interval = n;
+		} else if (key == "seed") {
+			opts->seed = n;
+		} else {
+			std::cerr << "libmumble-loadgen: unknown option: " << key << std::endl;
+			return false;
+		}
+	}
+
+	if (opts->clients < 1 || opts->client_loops < 1 || opts->server_loops < 1 || opts->duration < 1 ||
+	    opts->connect_rate < 1 || opts->channels < 1 || opts->text_size < 0 || opts->report_interval < 1) {
+		std::cerr << "libmumble-loadgen: bad option value" << std::endl;
+		return false;
+	}
+	for (int i = 0; i < NUM_REQUEST_KINDS; i++) {
+		if (opts->interval[i] < 0) {
+			std::cerr << "libmumble-loadgen: intervals must not be negative" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+static double Percentile(const std::vector<uint64_t> &sorted, double p) {
+	if (sorted.empty()) {
+		return 0;
+	}
+	size_t idx = static_cast<size_t>(p * sorted.size());
+	if (idx >= sorted.size()) {
+		idx = sorted.size() - 1;
+	}
+	return sorted[idx] / 1000.0;
+}
+
+static std::string LatencyJSON(std::vector<uint64_t> &samples) {
+	std::sort(samples.begin(), samples.end());
+	std::ostringstream out;
+	out << "{"
+	    << "\"count\": " << samples.size() << ", "
+	    << "\"p50\": " << Percentile(samples, 0.50) << ", "
+	    << "\"p90\": " << Percentile(samples, 0.90) << ", "
+	    << "\"p99\": " << Percentile(samples, 0.99) << ", "
+	    << "\"p999\": " << Percentile(samples, 0.999) << ", "
+	    << "\"max\": " << Percentile(samples, 1.0)
+	    << "}";
+	return out.str();
+}
+
+int main(int argc, char **argv) {
+	LoadOptions opts;
+	if (!ParseOptions(argc, argv, &opts)) {
+		return 2;
+	}
+
+#ifndef LIBMUMBLE_OS_WINDOWS
+	// The stand-in server may still be answering a client
+	// when the client disconnects.
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	// Set up the stand-in server.
+	std::atomic<uint32_t> next_session(1);
+	mumble::X509Certificate cert = mumble::X509Certificate::GenerateSelfSignedCertificate("libmumble-loadgen");
+	mumble::TLSListener listener;
+	listener.SetAcceptHandler([&next_session](mumble::TLSConnection &conn) {
+		ServerSession *session = new ServerSession(conn, next_session++);
+		conn.SetErrorHandler([session](const mumble::Error &err) {
+			delete session;
+		}).SetDisconnectHandler([session](bool local) {
+			delete session;
+		});
+	});
+
+	mumble::TLSListenerOptions lopts;
+	lopts.num_event_loops = opts.server_loops;
+	lopts.backlog = std::max(511, opts.connect_rate);
+	lopts.connection_options.tcp_no_delay = true;
+
+	mumble::Error err = listener.Listen(std::string("127.0.0.1"), 0, cert, &lopts);
+	if (err.HasError()) {
+		std::cerr << "libmumble-loadgen: unable to listen: " << err.String() << std::endl;
+		return 1;
+	}
+
+	Counters counters;
+	std::vector<LoopStats> stats(opts.client_loops);
+	std::vector<LoadClient *> clients;
+	uv_sem_t done;
+	uv_sem_init(&done, 0);
+
+	Driver driver(opts, clients, counters, listener.Port());
+	for (int i = 0; i < opts.client_loops; i++) {
+		mumble::EventLoop *loop = new mumble::EventLoop;
+		err = loop->Start();
+		if (err.HasError()) {
+			std::cerr << "libmumble-loadgen: unable to start event loop: " << err.String() << std::endl;
+			return 1;
+		}
+		driver.loops_.push_back(loop);
+	}
+
+	for (int i = 0; i < opts.clients; i++) {
+		LoadClient *client = new LoadClient(i, &stats[i % opts.client_loops], &counters, &done);
+		clients.push_back(client);
+
+		client->conn_.SetChainVerifyHandler([](const std::vector<mumble::X509Certificate> &chain) {
+			return true;
+		}).SetEstablishedHandler([client] {
+			client->OnEstablished();
+		}).SetErrorHandler([client](const mumble::Error &err) {
+			client->OnClosed(true);
+		}).SetDisconnectHandler([client](bool local) {
+			client->OnClosed(!local);
+		});
+	}
+
+	driver.Start();
+	uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+
+	// Shut down all clients, and wait for their connections to close
+	// before looking at the latencies that their EventLoops recorded.
+	for (int i = 0; i < driver.connected_; i++) {
+		clients[i]->conn_.Disconnect();
+	}
+	for (int i = 0; i < driver.started_; i++) {
+		uv_sem_wait(&done);
+	}
+
+	std::vector<uint64_t> connect;
+	std::vector<uint64_t> latency[NUM_REQUEST_KINDS];
+	for (LoopStats &ls : stats) {
+		connect.insert(connect.end(), ls.connect.begin(), ls.connect.end());
+		for (int i = 0; i < NUM_REQUEST_KINDS; i++) {
+			latency[i].insert(latency[i].end(), ls.latency[i].begin(), ls.latency[i].end());
+		}
+	}
+
+	double secs = static_cast<double>(opts.duration);
+	uint64_t total_sent = 0;
+	std::ostringstream out;
+	out << "{"
+	    << "\"clients\": " << opts.clients << ", "
+	    << "\"client_loops\": " << opts.client_loops << ", "
+	    << "\"server_loops\": " << opts.server_loops << ", "
+	    << "\"duration_s\": " << opts.duration << ", "
+	    << "\"synced\": " << counters.synced << ", "
+	    << "\"errors\": " << counters.errors << ", "
+	    << "\"connect_us\": " << LatencyJSON(connect) << ", ";
+	for (int i = 0; i < NUM_REQUEST_KINDS; i++) {
+		uint64_t sent = counters.sent[i];
+		total_sent += sent;
+		out << "\"" << kRequestNames[i] << "\": {"
+		    <<   "\"interval_ms\": " << opts.interval[i] << ", "
+		    <<   "\"sent\": " << sent << ", "
+		    <<   "\"per_s\": " << sent / secs << ", "
+		    <<   "\"latency_us\": " << LatencyJSON(latency[i])
+		    << "}, ";
+	}
+	bool ok = counters.errors == 0 && counters.synced == opts.clients;
+	out << "\"msgs_per_s\": " << total_sent / secs << ", "
+	    << "\"ok\": " << (ok ? "true" : "false")
+	    << "}";
+	std::cout << out.str() << std::endl;
+
+	for (LoadClient *client : clients) {
+		delete client;
+	}
+	for (mumble::EventLoop *loop : driver.loops_) {
+		delete loop;
+	}
+	uv_sem_destroy(&done);
+
+	return ok ? 0 : 1;
+}